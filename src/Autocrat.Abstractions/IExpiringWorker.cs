@@ -0,0 +1,23 @@
+﻿// Copyright (c) Samuel Cragg.
+//
+// Licensed under the MIT license. See LICENSE file in the project root for
+// full license information.
+
+namespace Autocrat.Abstractions
+{
+    /// <summary>
+    /// Allows a worker to be notified when it is removed for being idle.
+    /// </summary>
+    public interface IExpiringWorker
+    {
+        /// <summary>
+        /// Called before the worker is removed.
+        /// </summary>
+        /// <remarks>
+        /// The worker has already been removed from the lookup, so requesting
+        /// it again from <see cref="IWorkerFactory"/> will create a new
+        /// instance and any changes made to this instance are discarded.
+        /// </remarks>
+        void OnExpired();
+    }
+}
@@ -39,5 +39,89 @@ namespace Autocrat.Abstractions
         /// <returns>A task that represents an instance of the specified type.</returns>
         public Task<T> GetWorkerAsync<T>(string id)
             where T : class;
+
+        /// <summary>
+        /// Gets a read-only copy of a worker of the specified type.
+        /// </summary>
+        /// <typeparam name="T">The type to return.</typeparam>
+        /// <param name="id">The identifier of the worker.</param>
+        /// <returns>A task that represents an instance of the specified type.</returns>
+        /// <remarks>
+        /// The returned instance is shared with other readers of the worker
+        /// and must not be modified. Changes made to the worker are seen the
+        /// next time it is requested.
+        /// </remarks>
+        public Task<T> GetWorkerReadOnlyAsync<T>(Guid id)
+            where T : class;
+
+        /// <summary>
+        /// Gets a read-only copy of a worker of the specified type.
+        /// </summary>
+        /// <typeparam name="T">The type to return.</typeparam>
+        /// <param name="id">The identifier of the worker.</param>
+        /// <returns>A task that represents an instance of the specified type.</returns>
+        /// <remarks>
+        /// The returned instance is shared with other readers of the worker
+        /// and must not be modified. Changes made to the worker are seen the
+        /// next time it is requested.
+        /// </remarks>
+        public Task<T> GetWorkerReadOnlyAsync<T>(long id)
+            where T : class;
+
+        /// <summary>
+        /// Gets a read-only copy of a worker of the specified type.
+        /// </summary>
+        /// <typeparam name="T">The type to return.</typeparam>
+        /// <param name="id">The identifier of the worker.</param>
+        /// <returns>A task that represents an instance of the specified type.</returns>
+        /// <remarks>
+        /// The returned instance is shared with other readers of the worker
+        /// and must not be modified. Changes made to the worker are seen the
+        /// next time it is requested.
+        /// </remarks>
+        public Task<T> GetWorkerReadOnlyAsync<T>(string id)
+            where T : class;
+
+        /// <summary>
+        /// Creates or loads the workers of the specified type ahead of them
+        /// being used.
+        /// </summary>
+        /// <typeparam name="T">The type of the workers.</typeparam>
+        /// <param name="ids">The identifiers of the workers.</param>
+        /// <returns>The number of workers that were created or loaded.</returns>
+        /// <remarks>
+        /// This is intended to be called during initialization and blocks
+        /// until all the workers have been preloaded.
+        /// </remarks>
+        public int PreloadWorkers<T>(Guid[] ids)
+            where T : class;
+
+        /// <summary>
+        /// Creates or loads the workers of the specified type ahead of them
+        /// being used.
+        /// </summary>
+        /// <typeparam name="T">The type of the workers.</typeparam>
+        /// <param name="ids">The identifiers of the workers.</param>
+        /// <returns>The number of workers that were created or loaded.</returns>
+        /// <remarks>
+        /// This is intended to be called during initialization and blocks
+        /// until all the workers have been preloaded.
+        /// </remarks>
+        public int PreloadWorkers<T>(long[] ids)
+            where T : class;
+
+        /// <summary>
+        /// Creates or loads the workers of the specified type ahead of them
+        /// being used.
+        /// </summary>
+        /// <typeparam name="T">The type of the workers.</typeparam>
+        /// <param name="ids">The identifiers of the workers.</param>
+        /// <returns>The number of workers that were created or loaded.</returns>
+        /// <remarks>
+        /// This is intended to be called during initialization and blocks
+        /// until all the workers have been preloaded.
+        /// </remarks>
+        public int PreloadWorkers<T>(string[] ids)
+            where T : class;
     }
 }
@@ -0,0 +1,38 @@
+﻿// Copyright (c) Samuel Cragg.
+//
+// Licensed under the MIT license. See LICENSE file in the project root for
+// full license information.
+
+namespace Autocrat.Abstractions
+{
+    using System;
+
+    /// <summary>
+    /// Specifies how long a worker is kept for when it is not being used.
+    /// </summary>
+    /// <remarks>
+    /// Once a worker has expired it is removed, so the next request for it
+    /// will create a new instance. Implement <see cref="IExpiringWorker"/>
+    /// to be notified before it is removed.
+    /// </remarks>
+    [AttributeUsage(AttributeTargets.Class, Inherited = false)]
+    public sealed class WorkerTimeToLiveAttribute : Attribute
+    {
+        /// <summary>
+        /// Initializes a new instance of the <see cref="WorkerTimeToLiveAttribute"/> class.
+        /// </summary>
+        /// <param name="seconds">
+        /// The number of seconds the worker can be idle for before it is
+        /// removed, or zero to never remove it.
+        /// </param>
+        public WorkerTimeToLiveAttribute(int seconds)
+        {
+            this.Seconds = seconds;
+        }
+
+        /// <summary>
+        /// Gets the number of seconds the worker can be idle for.
+        /// </summary>
+        public int Seconds { get; }
+    }
+}
@@ -6,7 +6,10 @@
 #include <CLI/Config.hpp>
 #include <CLI/Formatter.hpp>
 #include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <filesystem>
+#include <string>
 
 namespace autocrat
 {
@@ -48,14 +51,62 @@ public:
     void version(const char* value);
 
 private:
+    void compress_workers_if_due();
+    void dump_statistics_if_due();
+    void expire_workers_if_due();
+    void load_checkpoint();
+    void save_checkpoint();
+    void save_checkpoint_if_due();
     void initialize_managed_thread(gc_service* gc);
+    void initialize_memory();
     void initialize_threads();
+    void spill_workers_if_due();
+    void trim_memory();
+    void trim_memory_if_due();
 
     CLI::App _app;
     gc_heap _global_heap;
+    std::chrono::microseconds _next_checkpoint = {};
+    std::chrono::microseconds _next_compression = {};
+    std::chrono::microseconds _next_expiry = {};
+    std::chrono::microseconds _next_spill = {};
+    std::chrono::microseconds _next_statistics_dump = {};
+    std::chrono::microseconds _next_trim = {};
     std::atomic_bool _running;
+    bool _adaptive_node_size = false;
+    std::string _checkpoint_file;
+    bool _expire_workers = false;
+    int _checkpoint_interval = 0;
+    bool _evacuate_task_state = false;
+    std::size_t _buffer_node_high_watermark = 0;
+    std::size_t _buffer_node_low_watermark = 0;
+    std::size_t _buffer_node_size = 0;
+    std::size_t _heap_hard_limit_kb = 0;
+    std::size_t _heap_node_high_watermark = 0;
+    std::size_t _heap_node_low_watermark = 0;
+    std::size_t _heap_node_size_kb = 0;
+    std::size_t _heap_soft_limit_kb = 0;
+    bool _lock_memory = false;
+    std::size_t _prefault_stack_kb = 0;
+    bool _prefetch_workers = false;
+    std::size_t _reserve_buffer_nodes = 0;
+    std::size_t _reserve_byte_arrays = 0;
+    std::size_t _reserve_heap_nodes = 0;
+    bool _resident_workers = false;
+    std::string _spill_directory;
+    int _spill_idle_time = 60;
+    int _statistics_interval = 0;
     int _thread_affinity = -1;
     int _thread_count = -1;
+    bool _track_page_faults = false;
+    int _trim_interval = 0;
+    std::size_t _worker_batch_size = 0;
+    int _worker_compress_idle_time = 0;
+    int _worker_expiry_interval = 60;
+    std::size_t _worker_garbage_percentage = 100;
+    std::size_t _worker_memory_budget_mb = 0;
+    bool _worker_statistics = false;
+    int _worker_time_to_live = 0;
 };
 
 /**
@@ -3,25 +3,24 @@
 
 #include "smart_ptr.h"
 #include <array>
+#include <atomic>
 #include <cstdint>
-#include <deque>
-#include <stack>
 
 namespace autocrat
 {
 
 /**
  * Represents a byte array that can be used from managed code.
+ * @remarks The elements are stored directly after this instance (as they are
+ *          for managed arrays), therefore, instances must be allocated with
+ *          enough space for their elements, as done by `array_pool`.
  */
 class managed_byte_array
 {
 public:
-    static constexpr std::size_t buffer_size = 4096;
-
     using value_type = std::uint8_t;
-    using storage_type = std::array<value_type, buffer_size>;
-    using const_iterator = storage_type::const_iterator;
-    using iterator = storage_type::iterator;
+    using const_iterator = const value_type*;
+    using iterator = value_type*;
 
     managed_byte_array();
     ~managed_byte_array() noexcept = default;
@@ -29,8 +28,8 @@ public:
     managed_byte_array(const managed_byte_array&) = delete;
     managed_byte_array& operator=(const managed_byte_array&) = delete;
 
-    managed_byte_array(managed_byte_array&&) noexcept = default;
-    managed_byte_array& operator=(managed_byte_array&&) noexcept = default;
+    managed_byte_array(managed_byte_array&&) = delete;
+    managed_byte_array& operator=(managed_byte_array&&) = delete;
 
     /**
      * Returns an iterator to the first element of the container.
@@ -44,16 +43,6 @@ public:
      */
     [[nodiscard]] const_iterator begin() const noexcept;
 
-    /**
-     * Returns the number of elements that the container has allocated
-     * space for.
-     * @returns Capacity of the currently allocated storage.
-     */
-    [[nodiscard]] constexpr std::size_t capacity() const noexcept
-    {
-        return buffer_size;
-    }
-
     /**
      * Erases all elements from the container.
      */
@@ -86,6 +75,7 @@ public:
     /**
      * Resizes the container to contain count elements.
      * @param count The new size of the container.
+     * @remarks `count` must not exceed the space allocated for the elements.
      */
     void resize(std::size_t count);
 
@@ -98,7 +88,6 @@ public:
 private:
     const void* _ee_type;
     std::uint64_t _length = 0;
-    storage_type _data;
 };
 
 class array_pool;
@@ -108,9 +97,18 @@ namespace detail
 
 struct array_pool_block
 {
+    /**
+     * Returns the number of elements that the array has allocated space for.
+     * @returns Capacity of the allocated storage.
+     */
+    [[nodiscard]] std::size_t capacity() const noexcept;
+
     array_pool* owner = nullptr;
-    std::atomic_size_t usage;
-    managed_byte_array array;
+    array_pool_block* allocated_list = nullptr;
+    array_pool_block* next = nullptr;
+    std::atomic_size_t usage = 0;
+    std::uint32_t size_class = 0;
+    managed_byte_array array; // Must be last as the elements follow it
 };
 
 void intrusive_ptr_add_ref(array_pool_block* pointer) noexcept;
@@ -123,18 +121,43 @@ using managed_byte_array_ptr = intrusive_ptr<detail::array_pool_block>;
 
 /**
  * Represents a pool of byte array resources.
+ * @remarks Arrays are grouped into size classes, with each class having its
+ *          own lock-free list of available arrays. Arrays can be released
+ *          from any thread, however, they must only be acquired from a
+ *          single thread at a time.
  */
 class array_pool
 {
 public:
     using element_type = detail::array_pool_block;
-    using storage_type = std::deque<element_type>;
+
+    /**
+     * The number of bytes the arrays in each size class can hold.
+     */
+    static constexpr std::array<std::size_t, 4> size_classes = {
+        512u,
+        2u * 1024u,
+        9u * 1024u,
+        64u * 1024u};
+
+    array_pool() = default;
+
+    /**
+     * Destroys the `array_pool` instance.
+     */
+    ~array_pool() noexcept;
+
+    array_pool(const array_pool&) = delete;
+    array_pool& operator=(const array_pool&) = delete;
 
     /**
      * Gets a byte array from the pool.
-     * @returns A pointer to a `mnaged_byte_array`.
+     * @param size The number of bytes the array needs to be able to hold.
+     * @returns A pointer to a `managed_byte_array`.
+     * @remarks If `size` is larger than the biggest size class then an array
+     *          from the biggest size class is returned.
      */
-    managed_byte_array_ptr aquire();
+    managed_byte_array_ptr aquire(std::size_t size);
 
     /**
      * Gets the number of arrays that the pool has currently allocated
@@ -143,6 +166,20 @@ public:
      */
     [[nodiscard]] std::size_t capacity() const noexcept;
 
+    /**
+     * Logs the number of arrays that are allocated and in use for each of
+     * the size classes.
+     */
+    void dump_statistics() const;
+
+    /**
+     * Allocates the specified number of arrays, allowing them to be acquired
+     * later without allocating.
+     * @param size  The number of bytes the arrays need to be able to hold.
+     * @param count The number of arrays to allocate.
+     */
+    void reserve(std::size_t size, std::size_t count);
+
     /**
      * Gets the number of arrays that have been allocated.
      * @returns The number of arrays in use.
@@ -152,10 +189,18 @@ public:
 private:
     friend void detail::intrusive_ptr_release(element_type* pointer) noexcept;
 
+    struct size_class_list
+    {
+        std::atomic<element_type*> allocated_list = nullptr;
+        std::atomic<element_type*> free_list = nullptr;
+        std::atomic_size_t allocated_count = 0;
+        std::atomic_size_t free_count = 0;
+    };
+
+    element_type* allocate_new(std::size_t size_class);
     void release(element_type* value);
 
-    std::stack<element_type*> _available;
-    storage_type _pool;
+    std::array<size_class_list, size_classes.size()> _lists;
 };
 
 }
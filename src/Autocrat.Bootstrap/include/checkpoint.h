@@ -0,0 +1,155 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "managed_interop.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace autocrat
+{
+
+/**
+ * Represents the location of a workers data inside a checkpoint file.
+ */
+struct checkpoint_location
+{
+    std::uint64_t offset = 0;
+    std::uint32_t size = 0;
+};
+
+/**
+ * Represents a worker stored inside a checkpoint file.
+ */
+struct checkpoint_entry
+{
+    std::int64_t type = 0;
+    std::string id;
+    checkpoint_location location;
+};
+
+/**
+ * Reads the workers from a checkpoint file on demand.
+ * @remarks The entries are read when the file is opened, however, the data of
+ *          each worker is only read when requested. Types are stored relative
+ *          to an anchor type, which must be the same one used when writing
+ *          the file. This class is thread safe.
+ */
+class checkpoint_reader
+{
+public:
+    /**
+     * Constructs a new instance of the `checkpoint_reader` class.
+     * @param path        The path of the checkpoint file.
+     * @param anchor      The type the stored types are relative to.
+     * @param fingerprint Identifies the types known by the program, which
+     *                    must match the value used when writing the file.
+     * @remarks An exception is thrown if the file is not valid for the
+     *          running program.
+     */
+    checkpoint_reader(
+        const std::filesystem::path& path,
+        const void* anchor,
+        std::uint64_t fingerprint);
+
+    checkpoint_reader(const checkpoint_reader&) = delete;
+    checkpoint_reader& operator=(const checkpoint_reader&) = delete;
+
+    /**
+     * Gets the workers stored inside the checkpoint.
+     * @returns The stored workers.
+     */
+    [[nodiscard]] const std::vector<checkpoint_entry>& entries() const noexcept;
+
+    /**
+     * Reads the data of a worker into the specified serializer.
+     * @param location   The location of the workers data.
+     * @param serializer Receives the workers data.
+     */
+    void read(
+        const checkpoint_location& location,
+        object_serializer& serializer);
+
+private:
+    void read_entries(std::uint64_t offset, std::uint64_t count);
+    void read_types(
+        std::uint64_t offset,
+        std::uint64_t count,
+        const void* anchor);
+
+    std::vector<checkpoint_entry> _entries;
+    std::ifstream _file;
+    std::mutex _lock;
+    std::vector<const void*> _types;
+};
+
+/**
+ * Writes workers to a checkpoint file.
+ * @remarks The data is written to a temporary file that replaces the
+ *          checkpoint file when `commit` is called, so that an existing
+ *          checkpoint is not lost if writing fails.
+ */
+class checkpoint_writer
+{
+public:
+    /**
+     * Constructs a new instance of the `checkpoint_writer` class.
+     * @param path        The path of the checkpoint file.
+     * @param anchor      The type the stored types are relative to.
+     * @param fingerprint Identifies the types known by the program.
+     */
+    checkpoint_writer(
+        const std::filesystem::path& path,
+        const void* anchor,
+        std::uint64_t fingerprint);
+
+    /**
+     * Destroys the `checkpoint_writer` instance, deleting the temporary file
+     * if `commit` has not been called.
+     */
+    ~checkpoint_writer() noexcept;
+
+    checkpoint_writer(const checkpoint_writer&) = delete;
+    checkpoint_writer& operator=(const checkpoint_writer&) = delete;
+
+    /**
+     * Writes the data of a worker to the file.
+     * @param type       The type of the worker, relative to the anchor.
+     * @param id         The identifier of the worker.
+     * @param serializer Contains the saved worker data.
+     */
+    void add(
+        std::int64_t type,
+        std::string_view id,
+        const object_serializer& serializer);
+
+    /**
+     * Finishes writing the file and replaces the checkpoint file with it.
+     */
+    void commit();
+
+private:
+    std::uint64_t get_type_id(const void* type);
+    void write(const void* data, std::size_t size);
+
+    std::vector<checkpoint_entry> _entries;
+    std::ofstream _file;
+    std::filesystem::path _path;
+    std::filesystem::path _temp_path;
+    std::unordered_map<const void*, std::uint64_t> _type_ids;
+    std::vector<const void*> _types;
+    const std::byte* _anchor;
+    std::uint64_t _fingerprint;
+    std::uint64_t _position = 0;
+    bool _committed = false;
+};
+
+}
+
+#endif
@@ -49,6 +49,22 @@ public:
      */
     template <class... Args>
     void emplace(Args&&... args)
+    {
+        if (!try_emplace(std::forward<Args>(args)...))
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    /**
+     * Appends a new element to the end of the queue if there is room.
+     * @tparam Args The argument types.
+     * @param args The arguments to forward to the constructor of the element.
+     * @returns `true` if the element was added; otherwise, `false` if the
+     *          queue is full, in which case the arguments are not used.
+     */
+    template <class... Args>
+    bool try_emplace(Args&&... args)
     {
         cell_t* cell;
         std::size_t position =
@@ -72,7 +88,7 @@ public:
             }
             else if (delta < 0)
             {
-                throw std::bad_alloc();
+                return false;
             }
             else
             {
@@ -82,6 +98,7 @@ public:
 
         ::new (&cell->storage) T(std::forward<Args>(args)...);
         cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
     }
 
     /**
@@ -123,7 +140,7 @@ public:
         T* item = std::launder(reinterpret_cast<T*>(&cell->storage));
         *value = std::move(*item);
         item->~T();
-        cell->sequence.store(position + Sz + 1, std::memory_order_release);
+        cell->sequence.store(position + Sz, std::memory_order_release);
         return true;
     }
 
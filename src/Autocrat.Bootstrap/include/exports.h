@@ -22,6 +22,23 @@ using udp_data_received_method = void* (*)(std::int32_t, const void*);
 using method_types =
     std::variant<construct_worker, timer_method, udp_data_received_method>;
 
+// The memory the current thread can allocate small managed objects from
+// without calling into the library. The library empties it whenever the
+// managed heap of the thread changes. Objects larger than large_object_size
+// are stored separately by the library, so are never allocated from here
+struct allocation_context
+{
+    std::byte* pointer;
+    std::byte* limit;
+    std::size_t large_object_size;
+};
+
+// Supplied by the library
+extern thread_local allocation_context managed_allocation_context;
+
+// Supplied by the library
+extern "C" void* allocate_bytes(std::size_t bytes);
+
 // Supplied by the library
 extern int autocrat_main(int argc, char* argv[]);
 
@@ -34,4 +51,30 @@ extern void set_description(const char*);
 // Supplied by the library
 extern void set_version(const char*);
 
+// Allocates zero-filled memory from the allocation context of the current
+// thread, returning null if there isn't enough left or the object is large
+// (allocate_bytes must then be called instead, which will also refill the
+// context)
+inline void* try_allocate_bytes(std::size_t bytes) noexcept
+{
+    allocation_context& context = managed_allocation_context;
+    auto available = static_cast<std::size_t>(context.limit - context.pointer);
+    if ((bytes > available) || (bytes > context.large_object_size))
+    {
+        return nullptr;
+    }
+
+    // This must match the alignment used by the library for small objects
+    const std::size_t alignment = sizeof(std::max_align_t);
+    std::size_t size = (bytes + (alignment - 1u)) & ~(alignment - 1u);
+    if (size > available)
+    {
+        return nullptr;
+    }
+
+    std::byte* memory = context.pointer;
+    context.pointer += size;
+    return memory;
+}
+
 #endif
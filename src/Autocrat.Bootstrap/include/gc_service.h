@@ -4,7 +4,10 @@
 #include "defines.h"
 #include "memory_pool.h"
 #include "thread_pool.h"
+#include <atomic>
 #include <cstddef>
+#include <utility>
+#include <vector>
 
 namespace autocrat
 {
@@ -17,7 +20,12 @@ class gc_service;
 class gc_heap
 {
 public:
-    using pool_type = autocrat::node_pool<1024u * 1024u>;
+    using pool_type = autocrat::node_pool;
+
+    /**
+     * The default size, in bytes, of the nodes used to store small objects.
+     */
+    static constexpr std::size_t default_node_size = 1024u * 1024u;
 
     /**
      * Constructs a new instance of the `gc_heap` class.
@@ -35,6 +43,21 @@ public:
     gc_heap(gc_heap&& other) noexcept;
     gc_heap& operator=(gc_heap&& other) noexcept;
 
+    /**
+     * Takes ownership of the memory allocated by another heap.
+     * @param other The heap to take the memory from, which is left empty.
+     * @remarks New allocations are made after the memory taken from `other`.
+     */
+    void append(gc_heap&& other);
+
+    /**
+     * Gets the memory that objects have been allocated from.
+     * @returns The start and end address of each area of memory, sorted by
+     *          their start address.
+     */
+    [[nodiscard]] std::vector<std::pair<const std::byte*, const std::byte*>>
+    get_memory_ranges() const;
+
     /**
      * Exchanges the contents of this instance and `other`.
      * @param other The instance to exchange contents with.
@@ -47,16 +70,18 @@ private:
     struct large_allocation
     {
         alignas(std::max_align_t) large_allocation* previous;
+        std::size_t size;
     };
 
     void* allocate_large(std::size_t size);
-    std::byte* allocate_small(std::size_t size);
+    void* allocate_small(std::size_t size);
     void free_large();
     void free_small();
 
     pool_type::node_type* _head;
     pool_type::node_type* _tail;
     large_allocation* _large_objects = nullptr;
+    std::size_t _allocated_bytes = 0;
 };
 
 /**
@@ -74,6 +99,15 @@ public:
      */
     explicit gc_service(thread_pool* pool);
 
+    /**
+     * Changes the heap node size to fit the memory allocated by most of the
+     * work items.
+     * @remarks The number of bytes allocated by each work item is recorded
+     *          when it completes, once `enable_adaptive_node_size` has been
+     *          called, and are cleared after calling this method.
+     */
+    MOCKABLE_METHOD void adapt_node_size();
+
     /**
      * Allocates dynamic memory of the specified size.
      * @param size The number of bytes to allocate.
@@ -81,21 +115,90 @@ public:
      */
     MOCKABLE_METHOD void* allocate(std::size_t size);
 
+    /**
+     * Allocates dynamic memory of the specified size, then refills the
+     * allocation context of the current thread from what is left of the
+     * heap node.
+     * @param size The number of bytes to allocate.
+     * @returns The allocated memory.
+     * @remarks The allocation context allows small objects to be allocated
+     *          without calling this service (see `try_allocate_bytes`). It
+     *          is emptied whenever the heap of the thread changes.
+     */
+    MOCKABLE_METHOD void* allocate_and_refill(std::size_t size);
+
+    /**
+     * Logs the number of heap nodes that are allocated and in use, as well
+     * as the peak number of bytes allocated by a work item.
+     */
+    MOCKABLE_METHOD void dump_statistics();
+
+    /**
+     * Enables the recording of the work item sizes used by
+     * `adapt_node_size`.
+     * @remarks This must be called before the thread pool is started.
+     */
+    MOCKABLE_METHOD void enable_adaptive_node_size();
+
+    /**
+     * Allocates the specified number of heap nodes, allowing them to be used
+     * later without allocating.
+     * @param count The number of nodes to allocate.
+     */
+    MOCKABLE_METHOD void reserve(std::size_t count);
+
     /**
      * Resets the current threads heap to an empty instance.
      * @returns The previous memory allocations.
      */
     MOCKABLE_METHOD gc_heap reset_heap();
 
+    /**
+     * Sets the maximum number of bytes a work item may allocate.
+     * @param soft The number of bytes that, when exceeded, will be logged.
+     * @param hard The number of bytes that, when exceeded, will cause the
+     *             allocation to fail.
+     * @remarks A value of zero disables the respective limit.
+     */
+    MOCKABLE_METHOD void set_allocation_limits(
+        std::size_t soft,
+        std::size_t hard);
+
     /**
      * Sets the current threads head to the specified memory.
      * @param heap Contains the memory allocations.
      */
     MOCKABLE_METHOD void set_heap(gc_heap&& heap);
 
+    /**
+     * Changes the size of the nodes used to store small objects.
+     * @param size The size, in bytes, of the nodes.
+     */
+    MOCKABLE_METHOD void set_node_size(std::size_t size);
+
+    /**
+     * Frees unused heap nodes if the number of them exceeds the high
+     * watermark.
+     * @param low  The maximum number of unused nodes to keep after trimming.
+     * @param high The number of unused nodes that will trigger a trim.
+     * @returns The number of nodes that were freed.
+     */
+    MOCKABLE_METHOD std::size_t trim(std::size_t low, std::size_t high);
+
 protected:
     void on_begin_work(gc_heap* heap) override;
     void on_end_work(gc_heap* heap) override;
+
+private:
+    void check_allocation_limits(gc_heap* heap, std::size_t size);
+    void close_allocation_context(gc_heap* heap);
+    void open_allocation_context(gc_heap* heap);
+
+    std::size_t _hard_limit = 0;
+    std::size_t _soft_limit = 0;
+    std::atomic_size_t _peak_allocated_bytes = 0;
+    size_histogram _work_item_sizes;
+    bool _adaptive_node_size = false;
 };
 
 }
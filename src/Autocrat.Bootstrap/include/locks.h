@@ -26,6 +26,14 @@ public:
      */
     bool try_lock();
 
+    /**
+     * Determines whether the lock is held by any thread.
+     * @returns `true` if the lock is held; otherwise, `false`.
+     * @remarks The lock may be acquired or released as soon as this returns,
+     *          so this is only suitable as a hint.
+     */
+    [[nodiscard]] bool is_locked() const noexcept;
+
     /**
      * Releases the lock.
      */
@@ -10,6 +10,7 @@ extern "C" void* CDECL GetByteArrayType();
 extern "C" void CDECL InitializeManagedThread();
 extern "C" bool CDECL LoadConfiguration(void* source);
 extern "C" void CDECL OnConfigurationLoaded();
+extern "C" void CDECL OnWorkerExpired(void* worker);
 extern "C" void CDECL RegisterManagedTypes();
 
 }
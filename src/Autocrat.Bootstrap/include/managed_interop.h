@@ -2,9 +2,17 @@
 #define MANAGED_INEROP_H
 
 #include "memory_pool.h"
+#include "spill_store.h"
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <optional>
+#include <unordered_map>
+#include <vector>
+
+#if !__GNUC__
+#include <xmmintrin.h>
+#endif
 
 namespace autocrat
 {
@@ -14,41 +22,336 @@ namespace autocrat
 namespace detail
 {
 
-struct managed_object;
+class evacuator;
 struct managed_type;
 
+// Object
+struct managed_object
+{
+    managed_type* type;
+};
+
+// Array
+struct managed_array : managed_object
+{
+    std::uint32_t length;
+};
+
+// EEType
+struct managed_type
+{
+    std::uint16_t component_size;
+    std::uint16_t flags;
+    std::uint32_t base_size;
+    managed_type* base_type;
+};
+
+/**
+ * Describes the location of the references inside a managed type.
+ */
+struct type_layout
+{
+    /**
+     * Determines whether instances of the type contain any references.
+     * @returns `true` if there are references to scan; otherwise, `false`.
+     */
+    [[nodiscard]] bool has_references() const noexcept
+    {
+        return reference_array || !offsets.empty();
+    }
+
+    std::vector<std::uint32_t> offsets;
+    std::uint32_t base_size = 0;
+    std::uint16_t component_size = 0;
+    bool reference_array = false;
+};
+
+/**
+ * Gets the reference layout of the specified type.
+ * @param type The managed type information.
+ * @returns The layout of the references inside the type.
+ * @remarks The layout is decoded from the type information the first time
+ *          a type is seen by the calling thread and then cached.
+ */
+const type_layout& get_type_layout(const managed_type* type);
+
+/**
+ * Gets the size of the specified object.
+ * @param object The managed object.
+ * @param layout The layout of the objects type.
+ * @returns The size, in bytes, of the object.
+ */
+inline std::size_t get_object_size(
+    const managed_object* object,
+    const type_layout& layout) noexcept
+{
+    std::size_t bytes = layout.base_size;
+    if (layout.component_size > 0)
+    {
+        auto array = static_cast<const managed_array*>(object);
+        std::size_t component_size = layout.component_size;
+        bytes += component_size * array->length;
+    }
+
+    return bytes;
+}
+
+/**
+ * Invokes the specified function with the offset of each reference field.
+ * @param object   The managed object.
+ * @param layout   The layout of the objects type.
+ * @param function Called with the offset, in bytes, of each field.
+ */
+template <class Function>
+void for_each_reference(
+    const managed_object* object,
+    const type_layout& layout,
+    Function&& function)
+{
+    for (std::uint32_t offset : layout.offsets)
+    {
+        function(static_cast<std::size_t>(offset));
+    }
+
+    if (layout.reference_array)
+    {
+        auto array = static_cast<const managed_array*>(object);
+        std::size_t elements = array->length;
+        std::size_t offset = sizeof(managed_array);
+        for (std::size_t i = 0; i != elements; ++i)
+        {
+            function(offset);
+            offset += sizeof(void*);
+        }
+    }
+}
+
+/**
+ * Hints to the processor that the specified memory will be read soon.
+ * @param address The address of the memory.
+ */
+inline void prefetch(const void* address) noexcept
+{
+#if __GNUC__
+    __builtin_prefetch(address);
+#else
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#endif
+}
+
+/**
+ * Visits every object reachable from a root object.
+ * @remarks The hooks are provided by `Derived` (i.e. CRTP), which avoids
+ *          virtual calls inside the scanning loop. The objects are tracked
+ *          with an explicit stack so that deeply nested object graphs do
+ *          not overflow the native stack.
+ */
+template <class Derived>
 class reference_scanner
 {
 public:
-    void* move(void* root);
+    void* move(void* root)
+    {
+        void* moved = visit(root);
+        while (!_pending.empty())
+        {
+            pending_object pending = _pending.back();
+            _pending.pop_back();
+            scan(pending);
+        }
+
+        return moved;
+    }
 
 protected:
     ~reference_scanner() = default;
 
-    virtual std::optional<void*> get_moved_location(void* object) = 0;
-    virtual void* get_reference(void* object, std::size_t offset) = 0;
-    virtual void* move_object(void* object, std::size_t size) = 0;
-    virtual void set_moved_location(void* object, void* new_location) = 0;
-    virtual void set_reference(
-        void* object,
-        std::size_t offset,
-        void* reference) = 0;
-
 private:
-    void scan(managed_object* object, void* copy, const managed_type* type);
-    void scan_references(
-        void* object,
-        void* copy,
-        std::size_t offset,
-        std::size_t count);
+    struct pending_object
+    {
+        managed_object* object;
+        void* copy;
+        const type_layout* layout;
+    };
+
+    Derived& derived() noexcept
+    {
+        return static_cast<Derived&>(*this);
+    }
+
+    void scan(const pending_object& pending)
+    {
+        // Start loading the referenced objects before we need them
+        for_each_reference(
+            pending.object,
+            *pending.layout,
+            [&](std::size_t offset) {
+                auto field = reinterpret_cast<void* const*>(
+                    reinterpret_cast<const std::byte*>(pending.object) +
+                    offset);
+                prefetch(*field);
+            });
+
+        for_each_reference(
+            pending.object,
+            *pending.layout,
+            [&](std::size_t offset) {
+                void* instance =
+                    derived().get_reference(pending.object, offset);
+                void* new_reference = visit(instance);
+                derived().set_reference(pending.copy, offset, new_reference);
+            });
+    }
+
+    void* visit(void* instance)
+    {
+        if (instance == nullptr)
+        {
+            return nullptr;
+        }
+
+        std::optional<void*> moved_object =
+            derived().get_moved_location(instance);
+        if (moved_object)
+        {
+            return *moved_object;
+        }
+
+        auto object = static_cast<managed_object*>(instance);
+        const type_layout& layout = get_type_layout(object->type);
+        void* moved =
+            derived().move_object(object, get_object_size(object, layout));
+        derived().set_moved_location(object, moved);
+        if (layout.has_references())
+        {
+            _pending.push_back({object, moved, &layout});
+        }
+
+        return moved;
+    }
+
+    std::vector<pending_object> _pending;
 };
 
 }
 
+/**
+ * Stores a managed object graph in memory owned by this instance, allowing
+ * the objects to be used in place between work items.
+ * @remarks Only one thread may use an instance at a time.
+ */
+class object_arena
+{
+public:
+    object_arena() = default;
+
+    /**
+     * Destroys the `object_arena` instance.
+     */
+    ~object_arena() noexcept;
+
+    object_arena(const object_arena&) = delete;
+    object_arena& operator=(const object_arena&) = delete;
+
+    /**
+     * Gets the number of bytes allocated by this instance for objects.
+     * @returns The number of bytes used by live objects and garbage.
+     */
+    [[nodiscard]] std::size_t allocated_bytes() const noexcept;
+
+    /**
+     * Gets the number of bytes used by the objects reachable from the root
+     * at the time of the last save.
+     * @returns The number of bytes used by live objects.
+     */
+    [[nodiscard]] std::size_t live_bytes() const noexcept;
+
+    /**
+     * Moves the objects reachable from the specified object that are not
+     * stored in this instance into it.
+     * @param object             The root of the object graph.
+     * @param garbage_percentage The amount of unreachable memory, as a
+     *                           percentage of the reachable memory, that
+     *                           will cause the objects to be compacted.
+     * @returns The location of the root object inside this instance.
+     * @remarks Objects already stored in this instance are not copied,
+     *          unless the instance is compacted, in which case all the
+     *          objects are moved.
+     */
+    void* save(void* object, std::size_t garbage_percentage);
+
+private:
+    friend class detail::evacuator;
+
+    struct block
+    {
+        block* next;
+        std::size_t capacity;
+        std::size_t used;
+    };
+
+    void add_block(std::size_t capacity);
+    std::byte* allocate(std::size_t size);
+    void* compact(void* root);
+    [[nodiscard]] bool contains(const void* address) const noexcept;
+    void free_blocks() noexcept;
+
+    block* _blocks = nullptr;
+    std::size_t _allocated_bytes = 0;
+    std::size_t _live_bytes = 0;
+    std::uint32_t _epoch = 0;
+};
+
+/**
+ * Copies a managed object graph into the heap of the current thread.
+ * @remarks Only the objects that `should_copy` returns `true` for are copied
+ *          (and scanned), so references to other objects are kept as they
+ *          are. The objects of saved workers are never followed. The
+ *          original objects are left unchanged.
+ */
+class object_evacuator : private detail::reference_scanner<object_evacuator>
+{
+public:
+    /**
+     * Copies the objects reachable from the specified object.
+     * @param object The root of the object graph to copy.
+     * @returns The location of the root object, which is unchanged if it was
+     *          not copied.
+     * @remarks Objects copied by a previous call are not copied again.
+     */
+    void* evacuate(void* object);
+
+protected:
+    /**
+     * Called when a reference field inside a copied object has been set.
+     * @param field A pointer to the field, which points to an object.
+     */
+    virtual void on_field(void** field) = 0;
+
+    /**
+     * Determines whether the specified object should be copied.
+     * @param object The address of the object.
+     * @returns `true` to copy the object; otherwise, `false` to leave it
+     *          (and the objects it references) where it is.
+     */
+    virtual bool should_copy(void* object) = 0;
+
+private:
+    friend detail::reference_scanner<object_evacuator>;
+
+    std::optional<void*> get_moved_location(void* object);
+    void* get_reference(void* object, std::size_t offset);
+    void* move_object(void* object, std::size_t size);
+    void set_moved_location(void* object, void* new_location);
+    void set_reference(void* object, std::size_t offset, void* reference);
+
+    std::unordered_map<void*, void*> _moved_objects;
+};
+
 /**
  * Allows the scanning of a managed object graph.
  */
-class object_scanner : private detail::reference_scanner
+class object_scanner : private detail::reference_scanner<object_scanner>
 {
 public:
     /**
@@ -72,21 +375,88 @@ protected:
     virtual void on_object(void* object, std::size_t size) = 0;
 
 private:
-    std::optional<void*> get_moved_location(void* object) final;
-    void* get_reference(void* object, std::size_t offset) final;
-    void* move_object(void* object, std::size_t size) final;
-    void set_moved_location(void* object, void* new_location) final;
-    void set_reference(void* object, std::size_t offset, void* reference) final;
+    friend detail::reference_scanner<object_scanner>;
+
+    std::optional<void*> get_moved_location(void* object);
+    void* get_reference(void* object, std::size_t offset);
+    void* move_object(void* object, std::size_t size);
+    void set_moved_location(void* object, void* new_location);
+    void set_reference(void* object, std::size_t offset, void* reference);
 
     std::uint32_t _version = 0;
 };
 
 /**
  * Allows the saving and loading of an object.
+ * @remarks The object graph is saved in a single forward pass, with the
+ *          references stored as offsets into the saved data. Note that
+ *          saving an object modifies the original graph, so it must not be
+ *          used afterwards. The saved data is kept after restoring, which
+ *          allows saving to be skipped if the restored objects have not
+ *          been modified.
  */
 class object_serializer
 {
 public:
+    /**
+     * Compresses the saved data to reduce the memory it uses.
+     * @returns `true` if the data was compressed; otherwise, `false` if it
+     *          was already compressed or compressing it would not save any
+     *          memory.
+     * @remarks The data is decompressed each time it is restored and stays
+     *          compressed until a modified object is saved, so this is
+     *          intended for objects that are not expected to be used soon.
+     */
+    bool compress();
+
+    /**
+     * Gets a copy of the saved data that can be stored outside of the
+     * process.
+     * @param get_type_id Returns the value to store in place of a type.
+     * @returns The saved data, with the type of each object replaced by the
+     *          value returned from `get_type_id`.
+     */
+    std::vector<std::byte> export_data(
+        const std::function<std::uint64_t(const void*)>& get_type_id) const;
+
+    /**
+     * Replaces the saved data with data returned from `export_data`.
+     * @param data     The exported data, which is modified in place.
+     * @param size     The size, in bytes, of the data.
+     * @param get_type Returns the type for a value stored by `export_data`,
+     *                 or `nullptr` if the value is not known.
+     */
+    void import_data(
+        std::byte* data,
+        std::size_t size,
+        const std::function<const void*(std::uint64_t)>& get_type);
+
+    /**
+     * Determines whether the saved data is compressed.
+     * @returns `true` if `compress` has been called since the object was
+     *          last saved; otherwise, `false`.
+     */
+    [[nodiscard]] bool is_compressed() const noexcept;
+
+    /**
+     * Keeps the existing data if the specified object is the unmodified
+     * result of the last call to `restore`.
+     * @param object The address of the object that would be saved.
+     * @returns `true` if the existing data was kept, in which case the
+     *          object is left as it is; otherwise, `false` and the object
+     *          needs to be passed to `save`.
+     * @remarks This allows checking whether an object has changed before
+     *          doing any work needed only to save it. Either way the
+     *          restored objects are no longer tracked.
+     */
+    bool keep_if_unchanged(const void* object);
+
+    /**
+     * Gets the number of objects in the saved data.
+     * @returns The number of objects reachable from the saved object.
+     */
+    [[nodiscard]] std::size_t object_count() const noexcept;
+
     /**
      * Restores the previously saved object.
      * @returns A pointer to the object.
@@ -96,12 +466,51 @@ public:
     /**
      * Saves the specified object to this instance.
      * @param object The address of the object to save.
+     * @returns `true` if the object was saved; otherwise, `false` if the
+     *          object is the unmodified result of the last call to
+     *          `restore`, in which case the existing data is kept.
+     */
+    bool save(void* object);
+
+    /**
+     * Gets the number of bytes used to store the saved object.
+     * @returns The size of the saved data, which is the compressed size if
+     *          the data is compressed.
+     */
+    [[nodiscard]] std::size_t size() const noexcept;
+
+    /**
+     * Moves the saved data to the specified store, freeing the memory used
+     * to hold it.
+     * @param store The store to write the data to.
+     * @returns The location of the data inside the store.
+     */
+    spill_location spill(spill_store& store);
+
+    /**
+     * Reads the saved data back from the specified store.
+     * @param store    The store the data was written to.
+     * @param location The location returned from `spill`.
+     * @remarks The data is not released from the store. The data stays
+     *          compressed if it was compressed when it was spilled.
      */
-    void save(void* object);
+    void unspill(spill_store& store, const spill_location& location);
+
+    /**
+     * Gets the number of bytes the saved object uses once restored.
+     * @returns The size of the saved data before it was compressed.
+     */
+    [[nodiscard]] std::size_t uncompressed_size() const noexcept;
 
 private:
+    std::vector<std::byte> read_data() const;
+
     memory_pool_buffer _buffer;
-    std::size_t _references = 0;
+    std::byte* _restored = nullptr;
+    std::uint64_t _restored_hash = 0;
+    std::size_t _object_count = 0;
+    std::size_t _uncompressed_size = 0;
+    bool _compressed = false;
 };
 
 }
@@ -25,10 +25,19 @@ struct managed_string
     char16_t data[1];
 };
 
+struct managed_string_array
+{
+    void* ee_type;
+    std::uint32_t length;
+    managed_string* data[1];
+};
+
 // Check no padding has been added (in 64 bit builds - allow 32-bit builds for
 // clang-tidy analysis under VS)
 static_assert(sizeof(void*) == 4 || offsetof(managed_string, length) == 8u);
 static_assert(sizeof(void*) == 4 || offsetof(managed_string, data) == 12u);
+static_assert(
+    sizeof(void*) == 4 || offsetof(managed_string_array, data) == 16u);
 
 struct typed_reference
 {
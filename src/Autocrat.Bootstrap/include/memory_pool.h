@@ -1,6 +1,7 @@
 #ifndef MEMORY_POOL_H
 #define MEMORY_POOL_H
 
+#include "locks.h"
 #include <algorithm>
 #include <array>
 #include <atomic>
@@ -11,22 +12,84 @@ namespace autocrat
 {
 
 /**
- * Represents a small chunk of memory.
- * @tparam Size The number of bytes to store in the pool.
+ * Contains a snapshot of the number of nodes managed by a pool.
+ */
+struct node_pool_statistics
+{
+    std::size_t allocated;
+    std::size_t free;
+    std::size_t in_use;
+};
+
+/**
+ * Records the distribution of sizes using power of two buckets.
+ * @remarks This class is designed to be thread-safe.
  */
-template <std::size_t Size>
-struct pool_node
+class size_histogram
 {
-    using this_type = pool_node<Size>;
+public:
+    /**
+     * Gets the number of sizes that have been recorded.
+     * @returns The number of recorded sizes.
+     */
+    [[nodiscard]] std::size_t count() const noexcept;
+
+    /**
+     * Gets the size that the specified percentage of the recorded sizes are
+     * less than or equal to.
+     * @param percent The percentage of recorded sizes, from 1 to 100.
+     * @returns The upper bound of the bucket containing the percentile,
+     *          which will be a power of two.
+     */
+    [[nodiscard]] std::size_t percentile(unsigned percent) const noexcept;
 
-    constexpr static std::size_t capacity = Size;
+    /**
+     * Adds the specified size to the distribution.
+     * @param size The size to record.
+     */
+    void record(std::size_t size) noexcept;
+
+    /**
+     * Removes all the recorded sizes.
+     */
+    void reset() noexcept;
+
+private:
+    std::array<std::atomic_size_t, 64> _buckets{};
+};
 
+/**
+ * Represents a small chunk of memory.
+ * @remarks The buffer is stored directly after this instance, therefore,
+ *          instances can only be created by a `node_pool`.
+ */
+struct alignas(std::max_align_t) pool_node
+{
     /**
      * Initializes a new instance of the `pool_node` class.
+     * @param size The number of bytes allocated after the instance.
      */
-    pool_node()
+    explicit pool_node(std::size_t size) : capacity(size)
     {
-        data = buffer.data();
+        data = buffer();
+    }
+
+    /**
+     * Gets the start of the memory stored by this instance.
+     * @returns A pointer to the first byte of the buffer.
+     */
+    std::byte* buffer() noexcept
+    {
+        return reinterpret_cast<std::byte*>(this + 1);
+    }
+
+    /**
+     * Gets the start of the memory stored by this instance.
+     * @returns A pointer to the first byte of the buffer.
+     */
+    [[nodiscard]] const std::byte* buffer() const noexcept
+    {
+        return reinterpret_cast<const std::byte*>(this + 1);
     }
 
     /**
@@ -34,127 +97,121 @@ struct pool_node
      */
     void clear_data()
     {
-        std::fill(buffer.data(), data, std::byte{});
-        data = buffer.data();
+        std::fill(buffer(), data, std::byte{});
+        data = buffer();
     }
 
-    this_type* allocated_list;
-    this_type* next;
+    pool_node* allocated_list = nullptr;
+    pool_node* allocated_previous = nullptr;
+    pool_node* next = nullptr;
     std::byte* data;
-    std::array<std::byte, Size> buffer{};
+    std::size_t capacity;
 #ifndef NDEBUG
-    bool is_free;
+    bool is_free = false;
 #endif
 };
 
 /**
  * Represents a pool of memory nodes.
- * @tparam NodeSize The size, in bytes, of the nodes for the pool.
  * @remarks This class is designed to be thread-safe. All nodes returned
  *          will have their buffer zero-filled.
  */
-template <std::size_t NodeSize>
 class node_pool
 {
 public:
-    using node_type = pool_node<NodeSize>;
+    using node_type = pool_node;
 
     /**
      * Initializes a new instance of the `node_pool` class.
+     * @param node_size The size, in bytes, of the nodes for the pool.
      */
-    node_pool() : _free_list(nullptr), _root(nullptr)
-    {
-    }
+    explicit node_pool(std::size_t node_size);
 
     /**
      * Destroys the `node_pool` instance.
      */
-    ~node_pool() noexcept
-    {
-        node_type* node = _root.load();
-        while (node != nullptr)
-        {
-            node_type* next = node->allocated_list;
-            assert(next != node);
-            delete node;
-            node = next;
-        }
-    }
+    ~node_pool() noexcept;
+
+    node_pool(const node_pool&) = delete;
+    node_pool& operator=(const node_pool&) = delete;
 
     /**
      * Gets a node from this instance, allocating a new one is non are
      * available.
      * @returns A node from the pool if available; otherwise, a new node.
      */
-    node_type* acquire()
-    {
-        node_type* node = get_from_free_list();
-        if (node == nullptr)
-        {
-            node = allocate_new();
-        }
-
-#ifndef NDEBUG
-        node->is_free = false;
-#endif
+    node_type* acquire();
 
-        node->next = nullptr;
-        return node;
-    }
+    /**
+     * Gets the size, in bytes, of the nodes allocated by this instance.
+     * @returns The capacity of new nodes.
+     */
+    [[nodiscard]] std::size_t node_size() const noexcept;
 
     /**
      * Adds the specified node to this instance, allowing it to be reused.
      * @param node The node to return to the pool.
+     * @remarks If the node is not the current node size then it will be
+     *          freed instead.
      */
-    void release(node_type* node)
-    {
-#ifndef NDEBUG
-        assert(!node->is_free);
-        node->is_free = true;
-#endif
-        // We optimize for allocations by clearing the memory now, as this
-        // code is executed after the user code, so we're not time critical
-        node->clear_data();
-
-        node_type* free = _free_list.load();
-        do
-        {
-            node->next = free;
-        } while (!_free_list.compare_exchange_weak(free, node));
-    }
+    void release(node_type* node);
 
-private:
-    node_type* allocate_new()
-    {
-        auto* node = new node_type();
-        node_type* root = _root.load();
-        do
-        {
-            node->allocated_list = root;
-        } while (!_root.compare_exchange_weak(root, node));
-
-        return node;
-    }
+    /**
+     * Allocates the specified number of nodes and adds them to this
+     * instance, allowing them to be acquired without allocating.
+     * @param count The number of nodes to allocate.
+     * @remarks The memory of the nodes is written to when they are
+     *          allocated, therefore, they will be resident in memory.
+     */
+    void reserve(std::size_t count);
 
-    node_type* get_from_free_list()
-    {
-        node_type* free = _free_list.load();
-        node_type* next;
-        do
-        {
-            if (free == nullptr)
-            {
-                return nullptr;
-            }
-
-            next = free->next;
-        } while (!_free_list.compare_exchange_weak(free, next));
-
-        return free;
-    }
+    /**
+     * Changes the size of the nodes allocated by this instance.
+     * @param node_size The size, in bytes, of the nodes for the pool.
+     * @remarks Unused nodes of the previous size are freed and nodes
+     *          currently in use will be freed when they are released.
+     */
+    void set_node_size(std::size_t node_size);
+
+    /**
+     * Gets the current number of nodes managed by this instance.
+     * @returns The node counts at the time of the call.
+     * @remarks The counts are updated independently, therefore, may be
+     *          slightly inconsistent if the pool is being used concurrently.
+     */
+    [[nodiscard]] node_pool_statistics statistics() const noexcept;
+
+    /**
+     * Frees unused nodes if the number of them exceeds the high watermark.
+     * @param low  The maximum number of unused nodes to keep after trimming.
+     * @param high The number of unused nodes that will trigger a trim.
+     * @returns The number of nodes that were freed.
+     * @remarks Acquiring nodes will be blocked whilst the free nodes are
+     *          being removed from the pool.
+     */
+    std::size_t trim(std::size_t low, std::size_t high);
+
+private:
+    static void delete_nodes(node_type* node);
+    static void push_node(
+        std::atomic<node_type*>* list,
+        std::atomic_size_t* count,
+        node_type* node);
+
+    node_type* allocate_new();
+    node_type* get_from_free_list();
+    node_type* pop_free();
+    node_type* remove_unused_nodes(std::size_t low, std::size_t* count);
+    void unlink_allocated(node_type* node);
 
     std::atomic<node_type*> _free_list;
+    std::atomic<node_type*> _retired_list = nullptr;
     std::atomic<node_type*> _root;
+    std::atomic_size_t _allocated_count = 0;
+    std::atomic_size_t _free_count = 0;
+    std::atomic_size_t _retired_count = 0;
+    std::atomic_size_t _node_size;
+    shared_spin_lock _lock;
 };
 
 /**
@@ -164,9 +221,14 @@ private:
 class memory_pool_buffer
 {
 public:
-    using pool_type = node_pool<1024u>;
+    using pool_type = node_pool;
     using value_type = std::byte;
 
+    /**
+     * The default size, in bytes, of the nodes used to store the data.
+     */
+    static constexpr std::size_t default_node_size = 1024u;
+
     /**
      * Destroys the `memory_pool_buffer` instance.
      */
@@ -179,6 +241,18 @@ public:
      */
     void append(const value_type* data, std::size_t length);
 
+    /**
+     * Removes all the data written to this instance.
+     */
+    void clear() noexcept;
+
+    /**
+     * Copies the stored data within this instance to the specified buffer.
+     * @param destination The destination buffer to receive the data.
+     * @param size        The size, in bytes, of the destination buffer.
+     */
+    void copy_to(value_type* destination, std::size_t size) const;
+
     /**
      * Moves the stored data within this instance to the specified buffer.
      * @param destination The destination buffer to receive the data.
@@ -201,6 +275,47 @@ public:
      */
     [[nodiscard]] std::size_t size() const noexcept;
 
+    /**
+     * Changes the node size to fit most of the recorded buffer sizes.
+     * @remarks The sizes are recorded when the data is moved out of a
+     *          buffer, once `enable_adaptive_node_size` has been called, and
+     *          are cleared after calling this method.
+     */
+    static void adapt_node_size();
+
+    /**
+     * Enables the recording of the buffer sizes used by `adapt_node_size`.
+     * @remarks This must be called before any buffers are used by other
+     *          threads.
+     */
+    static void enable_adaptive_node_size();
+
+    /**
+     * Allocates the specified number of nodes for use by all the buffers.
+     * @param count The number of nodes to allocate.
+     */
+    static void reserve(std::size_t count);
+
+    /**
+     * Changes the size of the nodes used by all the buffers.
+     * @param size The size, in bytes, of the nodes.
+     */
+    static void set_node_size(std::size_t size);
+
+    /**
+     * Gets the current number of nodes used by all the buffers.
+     * @returns The node counts at the time of the call.
+     */
+    static node_pool_statistics statistics() noexcept;
+
+    /**
+     * Frees unused nodes if the number of them exceeds the high watermark.
+     * @param low  The maximum number of unused nodes to keep after trimming.
+     * @param high The number of unused nodes that will trigger a trim.
+     * @returns The number of nodes that were freed.
+     */
+    static std::size_t trim(std::size_t low, std::size_t high);
+
 private:
     using node_type = pool_type::node_type;
 
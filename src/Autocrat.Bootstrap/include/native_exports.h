@@ -25,10 +25,50 @@ extern "C"
         managed_string* id,
         typed_reference* result);
 
+    // Autocrat.NativeAdapters.WorkerFactory.LoadReadOnlyObjectGuid
+    extern void CDECL load_read_only_object_guid(
+        const void* type,
+        managed_guid* id,
+        typed_reference* result);
+
+    // Autocrat.NativeAdapters.WorkerFactory.LoadReadOnlyObjectInt64
+    extern void CDECL load_read_only_object_int64(
+        const void* type,
+        std::int64_t id,
+        typed_reference* result);
+
+    // Autocrat.NativeAdapters.WorkerFactory.LoadReadOnlyObjectString
+    extern void CDECL load_read_only_object_string(
+        const void* type,
+        managed_string* id,
+        typed_reference* result);
+
+    // Autocrat.NativeAdapters.WorkerFactory.PreloadWorkersGuid
+    extern std::int32_t CDECL preload_workers_guid(
+        const void* type,
+        const managed_guid* ids,
+        std::int32_t count);
+
+    // Autocrat.NativeAdapters.WorkerFactory.PreloadWorkersInt64
+    extern std::int32_t CDECL preload_workers_int64(
+        const void* type,
+        const std::int64_t* ids,
+        std::int32_t count);
+
+    // Autocrat.NativeAdapters.WorkerFactory.PreloadWorkersString
+    extern std::int32_t CDECL
+    preload_workers_string(const void* type, managed_string_array* ids);
+
     // Autocrat.NativeAdapters.WorkerFactory.RegisterConstructor
     extern void CDECL
     register_constructor(const void* type, std::int32_t handle);
 
+    // Autocrat.NativeAdapters.WorkerFactory.RegisterExpiry
+    extern void CDECL register_expiry(
+        const void* type,
+        std::int32_t time_to_live_s,
+        std::int32_t notify);
+
     // Autocrat.NativeAdapters.TimerService::OnTimerTick
     extern std::int32_t CDECL register_timer(
         std::int64_t delay_us,
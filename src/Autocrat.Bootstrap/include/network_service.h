@@ -48,6 +48,18 @@ public:
      */
     MOCKABLE_METHOD void check_and_dispatch();
 
+    /**
+     * Logs the number of network buffers that are allocated and in use.
+     */
+    MOCKABLE_METHOD void dump_statistics();
+
+    /**
+     * Allocates the specified number of receive buffers, allowing them to be
+     * used later without allocating.
+     * @param count The number of buffers to allocate for each size class.
+     */
+    MOCKABLE_METHOD void reserve_buffers(std::size_t count);
+
 private:
     void handle_poll(
         const pal::socket_handle& handle,
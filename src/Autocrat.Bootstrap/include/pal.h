@@ -3,6 +3,7 @@
 
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <thread>
 
@@ -35,6 +36,46 @@ enum class poll_event
     write,
 };
 
+/**
+ * Represents the number of page faults incurred by a thread.
+ */
+struct page_faults
+{
+    /**
+     * The number of faults that required loading data from disk.
+     */
+    std::uint64_t major;
+
+    /**
+     * The number of faults that were serviced without any I/O.
+     */
+    std::uint64_t minor;
+};
+
+/**
+ * Represents a native file handle.
+ */
+class file_handle
+{
+public:
+    file_handle() noexcept = default;
+    explicit file_handle(std::intptr_t handle) noexcept;
+    ~file_handle() noexcept;
+
+    file_handle(const file_handle&) = delete;
+    file_handle& operator=(const file_handle&) = delete;
+
+    file_handle(file_handle&& other) noexcept;
+    file_handle& operator=(file_handle&& other) noexcept;
+
+    [[nodiscard]] std::intptr_t handle() const noexcept;
+
+private:
+    void close() noexcept;
+
+    std::intptr_t _handle = -1;
+};
+
 class socket_address;
 class socket_handle;
 class socket_list;
@@ -48,6 +89,13 @@ using close_signal_method = void (*)();
  */
 void bind(const socket_handle& socket, const socket_address& address);
 
+/**
+ * Creates a file for reading and writing, truncating any existing file.
+ * @param path The path of the file to create.
+ * @returns A wrapper over a native handle.
+ */
+file_handle create_file(const std::filesystem::path& path);
+
 /**
  * Creates a UDP socket.
  * @returns A wrapper over a native handle.
@@ -72,6 +120,50 @@ std::size_t get_current_processor();
  */
 std::chrono::microseconds get_current_time();
 
+/**
+ * Gets the number of page faults incurred by the current thread.
+ * @returns The page fault counters for the current thread.
+ */
+page_faults get_thread_page_faults();
+
+/**
+ * Locks all the current and future pages of the process into memory.
+ * @returns `true` if the memory was locked; otherwise, `false`.
+ */
+bool lock_memory();
+
+/**
+ * Gets the size of the next datagram waiting to be received.
+ * @param socket The socket to check.
+ * @returns The number of bytes in the next datagram, or zero if there is no
+ *          datagram or the size could not be determined.
+ * @remarks On some platforms this may return the total number of bytes
+ *          waiting to be read, so should be treated as an upper bound.
+ */
+std::size_t peek_datagram_size(const socket_handle& socket);
+
+/**
+ * Touches the pages of the current thread's stack so they are resident
+ * before they are first used.
+ * @param size The number of bytes of the stack to touch.
+ */
+void prefault_stack(std::size_t size);
+
+/**
+ * Reads from the specified position in a file without moving the file
+ * pointer, so multiple threads can read from the same file at once.
+ * @param file   The file to read from.
+ * @param offset The position in the file to start reading at.
+ * @param buffer The buffer to receive the data.
+ * @param length The number of bytes to read.
+ * @remarks An exception is thrown if fewer than `length` bytes are read.
+ */
+void read_file(
+    const file_handle& file,
+    std::uint64_t offset,
+    std::byte* buffer,
+    std::size_t length);
+
 /**
  * Receives a datagram and stores the source address.
  * @param socket The socket to receive on.
@@ -86,6 +178,14 @@ int recv_from(
     std::size_t length,
     socket_address* from);
 
+/**
+ * Returns the memory that has been freed by the process back to the
+ * operating system.
+ * @remarks This is a hint to the native heap and may not have an effect on
+ *          all platforms.
+ */
+void release_free_memory();
+
 /**
  * Sets the index of the CPU the specified thread should run on.
  * @param thread The thread to set the affinity of. Can be null to set the
@@ -114,6 +214,20 @@ void wait_on(std::uint32_t* address);
  */
 void wake_all(std::uint32_t* address);
 
+/**
+ * Writes to the specified position in a file without moving the file
+ * pointer, so multiple threads can write to the same file at once.
+ * @param file   The file to write to.
+ * @param offset The position in the file to start writing at.
+ * @param data   The data to write.
+ * @param length The number of bytes to write.
+ */
+void write_file(
+    const file_handle& file,
+    std::uint64_t offset,
+    const std::byte* data,
+    std::size_t length);
+
 }
 
 #if defined(UNIT_TESTS)
@@ -22,6 +22,7 @@ namespace autocrat
  * @remarks The `Service` class must have the following:
  * + A constructor accepting a pointer to a ThreadPool
  * + (optional) A method called `check_and_dispatch`
+ * + (optional) A method called `dump_statistics`
  */
 template <class ThreadPool, class... Services>
 class services
@@ -37,6 +38,18 @@ public:
             [](auto& service) { service.check_and_dispatch(); });
     }
 
+    /**
+     * Writes the statistics gathered by the thread pool and services to the
+     * log.
+     */
+    MOCKABLE_METHOD void dump_statistics()
+    {
+        invoke<has_dump_statistics<ThreadPool>>(
+            _thread_pool, [](auto& pool) { pool.dump_statistics(); });
+        invoke_all<has_dump_statistics>(
+            [](auto& service) { service.dump_statistics(); });
+    }
+
     /**
      * Gets the specified service instance.
      * @returns A pointer to the service.
@@ -88,6 +101,24 @@ private:
     {
     };
 
+    template <class Service, class Fallback = void>
+    struct has_dump_statistics_value : std::false_type
+    {
+    };
+
+    template <class Service>
+    struct has_dump_statistics_value<
+        Service,
+        typename std::enable_if<std::is_member_function_pointer_v<decltype(
+            &Service::dump_statistics)>>::type> : std::true_type
+    {
+    };
+
+    template <class Service>
+    struct has_dump_statistics : has_dump_statistics_value<Service>
+    {
+    };
+
     template <class Service>
     struct is_base_of_lifetime_service
         : std::is_base_of<lifetime_service, Service>
@@ -120,13 +151,16 @@ private:
     std::unique_ptr<ThreadPool> _thread_pool;
 };
 
+// The thread pool ends the work of the services in the reverse order, so the
+// task service must come last, as it dispatches the deferred continuations
+// using the per-thread state of the other services
 using global_services_type = services<
     thread_pool,
     gc_service,
     network_service,
-    task_service,
     timer_service,
-    worker_service>;
+    worker_service,
+    task_service>;
 
 extern MOCKABLE_GLOBAL(global_services_type) global_services;
 
@@ -0,0 +1,111 @@
+#ifndef SPILL_STORE_H
+#define SPILL_STORE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace autocrat
+{
+
+/**
+ * Represents the location of data written to a `spill_store`.
+ */
+struct spill_location
+{
+    std::uint64_t offset = 0;
+    std::uint32_t segment = 0;
+    std::uint32_t size = 0;
+
+    // The data is written as it is given, so the writer records whether it
+    // was compressed (and its original size) to be able to read it back
+    std::uint32_t uncompressed_size = 0;
+    bool compressed = false;
+};
+
+/**
+ * Stores data in files on disk so that it doesn't need to be kept in memory.
+ * @remarks Data is appended to a segment file until it reaches the segment
+ *          size, after which a new segment is started. Once all the data
+ *          inside a segment has been released the file is deleted. This
+ *          class is thread safe; the lock only covers the segment
+ *          bookkeeping and the file I/O is positional, so reads and writes
+ *          from different threads run concurrently.
+ */
+class spill_store
+{
+public:
+    /**
+     * The default size, in bytes, of the segment files.
+     */
+    static constexpr std::size_t default_segment_size = 64u * 1024u * 1024u;
+
+    /**
+     * Constructs a new instance of the `spill_store` class.
+     * @param directory    The directory to create the segment files in.
+     * @param segment_size The number of bytes to write to a segment file
+     *                     before starting a new one.
+     */
+    explicit spill_store(
+        std::filesystem::path directory,
+        std::size_t segment_size = default_segment_size);
+
+    /**
+     * Destroys the `spill_store` instance, deleting the segment files.
+     */
+    ~spill_store() noexcept;
+
+    spill_store(const spill_store&) = delete;
+    spill_store& operator=(const spill_store&) = delete;
+
+    /**
+     * Reads previously written data.
+     * @param location    The location returned from `write`.
+     * @param destination The buffer to receive the data, which must be at
+     *                    least `location.size` bytes.
+     * @remarks The location must not be released whilst it is being read.
+     */
+    void read(const spill_location& location, std::byte* destination);
+
+    /**
+     * Marks previously written data as no longer required.
+     * @param location The location returned from `write`.
+     */
+    void release(const spill_location& location);
+
+    /**
+     * Gets the number of bytes that have been written and not released.
+     * @returns The number of bytes stored on disk.
+     */
+    [[nodiscard]] std::size_t size() const noexcept;
+
+    /**
+     * Writes the specified data to disk.
+     * @param data   The data to write.
+     * @param length The number of bytes to write.
+     * @returns The location of the written data.
+     */
+    spill_location write(const std::byte* data, std::size_t length);
+
+private:
+    struct segment;
+
+    segment& get_segment(std::uint32_t index);
+    std::filesystem::path get_segment_path(std::uint32_t index) const;
+    segment& open_segment(std::uint32_t index);
+
+    std::filesystem::path _directory;
+    std::unordered_map<std::uint32_t, std::unique_ptr<segment>> _segments;
+    std::mutex _lock;
+    std::atomic_size_t _live_bytes = 0;
+    std::size_t _segment_size;
+    std::uint32_t _current = 0;
+};
+
+}
+
+#endif
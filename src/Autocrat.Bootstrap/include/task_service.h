@@ -3,16 +3,28 @@
 
 #include "defines.h"
 #include "managed_types.h"
+#include "thread_pool.h"
+#include <any>
+#include <vector>
 
 namespace autocrat
 {
 
-class thread_pool;
+namespace detail
+{
+
+struct deferred_tasks
+{
+    std::vector<std::any> contexts;
+};
+
+}
 
 /**
  * Allows the enqueue of managed work onto the thread pool.
  */
-class task_service
+class task_service FINAL
+    : public thread_specific_storage<detail::deferred_tasks>
 {
 public:
     MOCKABLE_CONSTRUCTOR_AND_DESTRUCTOR(task_service)
@@ -23,6 +35,14 @@ public:
      */
     explicit task_service(thread_pool* pool);
 
+    /**
+     * Enables copying the objects reachable from the state of a continuation
+     * into a new heap, rather than keeping everything the work allocated.
+     * @remarks The continuations are not queued until the work posting them
+     *          has finished, as until then it may still use the objects.
+     */
+    MOCKABLE_METHOD void enable_evacuation();
+
     /**
      * Queues the specified work on the thread pool.
      * @param callback The delegate to invoke.
@@ -36,8 +56,15 @@ public:
      */
     MOCKABLE_METHOD void start_new(managed_delegate* action);
 
+protected:
+    void on_begin_work(detail::deferred_tasks* storage) override;
+    void on_end_work(detail::deferred_tasks* storage) override;
+
 private:
+    void dispatch(std::any context);
+
     thread_pool* _thread_pool;
+    bool _evacuate_state = false;
 };
 
 }
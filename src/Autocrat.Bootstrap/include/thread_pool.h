@@ -76,6 +76,17 @@ public:
      */
     MOCKABLE_METHOD void add_observer(lifetime_service* service);
 
+    /**
+     * Writes the statistics gathered about the threads to the log.
+     */
+    MOCKABLE_METHOD void dump_statistics();
+
+    /**
+     * Enables the recording of the page faults incurred by each thread.
+     * @remarks This must be called before the pool is started.
+     */
+    MOCKABLE_METHOD void enable_page_fault_tracking();
+
     /**
      * Enqueues the specified work to be performed in a background thread.
      * @param function The function to invoke.
@@ -83,6 +94,20 @@ public:
      */
     MOCKABLE_METHOD void enqueue(callback_function function, std::any&& arg);
 
+    /**
+     * Enqueues the specified work to be performed by a background thread
+     * once there is no other work waiting.
+     * @param function The function to invoke.
+     * @param arg      The data to pass to the function.
+     * @returns `true` if the work was queued; otherwise, `false` if too much
+     *          idle work is already waiting.
+     * @remarks This does not wake any sleeping threads, as the work is only
+     *          worth doing if a thread is otherwise idle.
+     */
+    MOCKABLE_METHOD bool enqueue_idle(
+        callback_function function,
+        std::any&& arg);
+
     /**
      * Starts the background threads and, therefore, processing of work.
      * @param cpu_id     The index of the first core to bind to.
@@ -98,6 +123,14 @@ public:
         initialize_function initialize);
 
 private:
+    struct thread_statistics
+    {
+        std::atomic_uint64_t major_faults = 0;
+        std::atomic_uint64_t minor_faults = 0;
+        std::uint64_t reported_major_faults = 0;
+        std::uint64_t reported_minor_faults = 0;
+    };
+
     struct work_item
     {
         callback_function callback;
@@ -106,11 +139,16 @@ private:
 
     void invoke_work_item(std::size_t index, work_item& item) const;
     void perform_work(std::size_t index, initialize_function initialize);
+    void update_page_faults(std::size_t index);
     void wait_for_work();
 
     bounded_queue<work_item, 1024> _work;
+    bounded_queue<work_item, 256> _idle_work;
     small_vector<lifetime_service*> _observers;
+    dynamic_array<thread_statistics> _statistics;
     dynamic_array<std::thread> _threads;
+    thread_statistics _dispatcher_statistics;
+    bool _track_page_faults = false;
     std::atomic_uint32_t _initialized = 0;
     std::atomic_uint32_t _sleeping = 0;
     std::uint32_t _wait_handle = 0;
@@ -166,6 +204,31 @@ protected:
     virtual void on_begin_work(T* storage) = 0;
     virtual void on_end_work(T* storage) = 0;
 
+    /**
+     * Invokes the specified function with the storage of every thread,
+     * including the global thread.
+     * @tparam Func The type of the function.
+     * @param func The function to invoke.
+     */
+    template <class Func>
+    void for_each_thread_storage(Func&& func)
+    {
+        for (T& storage : _storage)
+        {
+            func(storage);
+        }
+    }
+
+    /**
+     * Determines whether the calling thread is running a work item.
+     * @returns `true` if the storage for the calling thread has been set;
+     *          otherwise, `false`.
+     */
+    [[nodiscard]] static bool has_thread_storage() noexcept
+    {
+        return thread_storage != nullptr;
+    }
+
     [[nodiscard]] T* get_thread_storage() const
     {
         assert(thread_storage != nullptr); // Missing call to on_begin_work
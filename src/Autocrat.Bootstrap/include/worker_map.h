@@ -0,0 +1,605 @@
+#ifndef WORKER_MAP_H
+#define WORKER_MAP_H
+
+#include "locks.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+// structure was padded due to alignment specifier
+#pragma warning(push)
+#pragma warning(disable : 4324)
+#endif
+
+namespace autocrat
+{
+
+namespace detail
+{
+
+/**
+ * Stores the identifier of a worker.
+ * @remarks Identifiers of up to `inline_size` bytes, which includes the
+ *          integer and GUID identifiers, are stored without allocating.
+ */
+class worker_id
+{
+public:
+    /**
+     * The maximum number of bytes that are stored inside the instance.
+     */
+    static constexpr std::size_t inline_size = 16u;
+
+    /**
+     * Constructs a new instance of the `worker_id` class.
+     * @param id The bytes of the identifier.
+     */
+    explicit worker_id(std::string_view id) : _size(id.size())
+    {
+        char* data = _inline.data();
+        if (id.size() > inline_size)
+        {
+            _external = std::make_unique<char[]>(id.size());
+            data = _external.get();
+        }
+
+        if (!id.empty())
+        {
+            std::memcpy(data, id.data(), id.size());
+        }
+    }
+
+    /**
+     * Gets the bytes of the identifier.
+     * @returns A view over the identifier.
+     */
+    operator std::string_view() const noexcept
+    {
+        const char* data =
+            (_external == nullptr) ? _inline.data() : _external.get();
+        return std::string_view(data, _size);
+    }
+
+private:
+    std::array<char, inline_size> _inline{};
+    std::unique_ptr<char[]> _external;
+    std::size_t _size;
+};
+
+struct worker_key
+{
+    using type_handle = std::uintptr_t;
+    type_handle type;
+    worker_id id;
+};
+
+}
+
+/**
+ * Represents a concurrent lookup of values by a worker type and identifier.
+ * @remarks The entries are split between a fixed number of shards, each with
+ *          its own open addressing table and a lock that is only taken when
+ *          changing that shard. Finding an entry does not lock or allocate.
+ *          Entries are never moved, however, removed entries (and the tables
+ *          replaced when a shard grows) may still be in use by other
+ *          threads, so they are kept until `reclaim` is called with an epoch
+ *          newer than when they were removed.
+ */
+template <class T>
+class worker_map
+{
+public:
+    using type_handle = detail::worker_key::type_handle;
+
+    /**
+     * The number of independently locked parts of the map.
+     */
+    static constexpr std::size_t shard_count = 64u;
+
+    worker_map()
+    {
+        for (shard& shard : _shards)
+        {
+            shard.storage = std::make_unique<table>(initial_capacity);
+            shard.current.store(
+                shard.storage.get(), std::memory_order_relaxed);
+        }
+    }
+
+    ~worker_map() noexcept
+    {
+        for (shard& shard : _shards)
+        {
+            const table& table = *shard.storage;
+            for (std::size_t i = 0; i != table.capacity; ++i)
+            {
+                node* entry = table.slots[i].load(std::memory_order_relaxed);
+                if (entry != tombstone())
+                {
+                    delete entry;
+                }
+            }
+        }
+    }
+
+    worker_map(const worker_map&) = delete;
+    worker_map& operator=(const worker_map&) = delete;
+
+    /**
+     * Gets the current epoch of the map.
+     * @returns A value that is incremented each time an entry or table is
+     *          removed from the map.
+     * @remarks A thread that reads the epoch before it starts using the map
+     *          can keep using the pointers it finds until it has finished,
+     *          provided `reclaim` is not passed a newer epoch.
+     */
+    [[nodiscard]] std::uint64_t epoch() const noexcept
+    {
+        return _epoch.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Removes the value associated with the specified key.
+     * @param type The type of the worker.
+     * @param id   The identifier of the worker.
+     * @returns `true` if the value was removed; otherwise, `false`.
+     * @remarks The value is not destroyed until `reclaim` is called.
+     */
+    bool erase(type_handle type, std::string_view id)
+    {
+        std::size_t hash = get_hash(type, id);
+        shard& shard = get_shard(hash);
+        std::unique_lock<shared_spin_lock> lock(shard.lock);
+
+        table& table = *shard.storage;
+        std::size_t mask = table.capacity - 1;
+        for (std::size_t i = (hash >> shard_bits) & mask;; i = (i + 1) & mask)
+        {
+            node* entry = table.slots[i].load(std::memory_order_relaxed);
+            if (entry == nullptr)
+            {
+                return false;
+            }
+
+            if ((entry != tombstone()) && is_match(*entry, hash, type, id))
+            {
+                // The slot can't be emptied, as that would break the probe
+                // sequence of the entries after it
+                table.slots[i].store(tombstone(), std::memory_order_release);
+                --shard.count;
+                lock.unlock();
+
+                retire(std::unique_ptr<node>(entry), nullptr);
+                return true;
+            }
+        }
+    }
+
+    /**
+     * Finds the value associated with the specified key.
+     * @param type The type of the worker.
+     * @param id   The identifier of the worker.
+     * @returns The value, or `nullptr` if the key was not found.
+     */
+    [[nodiscard]] T* find(type_handle type, std::string_view id) const noexcept
+    {
+        std::size_t hash = get_hash(type, id);
+        return find(get_shard(hash), hash, type, id);
+    }
+
+    /**
+     * Gets the index of the shard that the specified key is stored in.
+     * @param type The type of the worker.
+     * @param id   The identifier of the worker.
+     * @returns A value less than `shard_count`.
+     * @remarks Keys in different shards can be added at the same time
+     *          without contending on a lock.
+     */
+    [[nodiscard]] static std::size_t get_shard_index(
+        type_handle type,
+        std::string_view id) noexcept
+    {
+        return get_hash(type, id) & (shard_count - 1);
+    }
+
+    /**
+     * Invokes the specified function for each entry in the map.
+     * @tparam Func The type of the function.
+     * @param func The function, which accepts the key and the value.
+     * @remarks Entries added whilst this method is running may not be seen.
+     *          This must not run at the same time as `reclaim`.
+     */
+    template <class Func>
+    void for_each(Func&& func)
+    {
+        for (std::size_t i = 0; i != shard_count; ++i)
+        {
+            for_each_in_shard(i, func);
+        }
+    }
+
+    /**
+     * Invokes the specified function for each entry in a shard of the map.
+     * @tparam Func The type of the function.
+     * @param index The index of the shard, which is less than `shard_count`.
+     * @param func  The function, which accepts the key and the value.
+     * @remarks Entries added whilst this method is running may not be seen.
+     *          This must not run at the same time as `reclaim`, unless
+     *          `reclaim` is passed an epoch no newer than the value returned
+     *          by `epoch` before this method was called.
+     */
+    template <class Func>
+    void for_each_in_shard(std::size_t index, Func&& func)
+    {
+        const table& table =
+            *_shards[index].current.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i != table.capacity; ++i)
+        {
+            node* entry = table.slots[i].load(std::memory_order_acquire);
+            if ((entry != nullptr) && (entry != tombstone()))
+            {
+                func(std::as_const(entry->key), entry->value);
+            }
+        }
+    }
+
+    /**
+     * Adds a value for the specified key if there isn't one already.
+     * @tparam Prepare The type of the preparation function.
+     * @param type    The type of the worker.
+     * @param id      The identifier of the worker.
+     * @param prepare Invoked with the new value before other threads can
+     *                find it.
+     * @returns The value associated with the key and whether it was added.
+     */
+    template <class Prepare>
+    std::pair<T*, bool> try_emplace(
+        type_handle type,
+        std::string_view id,
+        Prepare&& prepare)
+    {
+        std::size_t hash = get_hash(type, id);
+        shard& shard = get_shard(hash);
+        if (T* existing = find(shard, hash, type, id); existing != nullptr)
+        {
+            return {existing, false};
+        }
+
+        // Create the entry before taking the lock, so that other threads
+        // adding to the shard aren't held up by the allocation
+        auto entry = std::make_unique<node>(hash, type, id);
+        prepare(entry->value);
+
+        std::lock_guard<shared_spin_lock> lock(shard.lock);
+        if (T* existing = find(shard, hash, type, id); existing != nullptr)
+        {
+            return {existing, false};
+        }
+
+        T* value = &entry->value;
+        insert(shard, entry.release());
+        return {value, true};
+    }
+
+    /**
+     * Adds values for the specified keys that aren't already in the map.
+     * @tparam Prepare The type of the preparation function.
+     * @param type    The type of the workers.
+     * @param ids     The identifiers of the workers.
+     * @param prepare Invoked with each new value before other threads can
+     *                find it.
+     * @returns The number of values that were added.
+     * @remarks The values are created without holding any locks, then the
+     *          lock of each shard is taken once to add all of its values.
+     *          If a key is added by another thread first (or appears more
+     *          than once) then the extra values are destroyed.
+     */
+    template <class Prepare>
+    std::size_t try_emplace_all(
+        type_handle type,
+        const std::vector<std::string_view>& ids,
+        Prepare&& prepare)
+    {
+        return try_emplace_all(
+            type, ids, std::forward<Prepare>(prepare), [](T&) {});
+    }
+
+    /**
+     * Adds values for the specified keys that aren't already in the map.
+     * @tparam Prepare The type of the preparation function.
+     * @tparam Added   The type of the function called for the added values.
+     * @param type        The type of the workers.
+     * @param ids         The identifiers of the workers.
+     * @param prepare     Invoked with each new value before other threads
+     *                    can find it.
+     * @param added_value Invoked with each value that was added to the
+     *                    map, whilst the lock of its shard is held.
+     * @returns The number of values that were added.
+     * @remarks `added_value` is not called for the values that are destroyed
+     *          because their key was already in the map.
+     */
+    template <class Prepare, class Added>
+    std::size_t try_emplace_all(
+        type_handle type,
+        const std::vector<std::string_view>& ids,
+        Prepare&& prepare,
+        Added&& added_value)
+    {
+        std::vector<std::unique_ptr<node>> entries;
+        entries.reserve(ids.size());
+        for (std::string_view id : ids)
+        {
+            std::size_t hash = get_hash(type, id);
+            if (find(get_shard(hash), hash, type, id) == nullptr)
+            {
+                auto& entry = entries.emplace_back(
+                    std::make_unique<node>(hash, type, id));
+                prepare(entry->value);
+            }
+        }
+
+        auto get_index = [](const std::unique_ptr<node>& entry) {
+            return entry->hash & (shard_count - 1);
+        };
+        std::stable_sort(
+            entries.begin(),
+            entries.end(),
+            [&](const auto& a, const auto& b) {
+                return get_index(a) < get_index(b);
+            });
+
+        std::size_t added = 0;
+        auto first = entries.begin();
+        while (first != entries.end())
+        {
+            std::size_t index = get_index(*first);
+            auto last = std::find_if(
+                first, entries.end(), [&](const std::unique_ptr<node>& entry) {
+                    return get_index(entry) != index;
+                });
+
+            shard& shard = _shards[index];
+            std::lock_guard<shared_spin_lock> lock(shard.lock);
+            make_room(shard, static_cast<std::size_t>(last - first));
+            for (; first != last; ++first)
+            {
+                const node& entry = **first;
+                if (find(shard, entry.hash, type, entry.key.id) == nullptr)
+                {
+                    added_value((*first)->value);
+                    store(*shard.storage, first->release());
+                    ++shard.count;
+                    ++shard.used;
+                    ++added;
+                }
+            }
+        }
+
+        return added;
+    }
+
+    /**
+     * Destroys the removed entries and tables that are no longer in use.
+     * @param oldest_epoch The oldest epoch that a thread using the map
+     *                     started in.
+     * @returns The number of entries that were destroyed.
+     */
+    std::size_t reclaim(std::uint64_t oldest_epoch)
+    {
+        std::vector<retired_item> expired;
+        {
+            std::lock_guard<shared_spin_lock> lock(_retired_lock);
+            auto it = std::stable_partition(
+                _retired.begin(),
+                _retired.end(),
+                [oldest_epoch](const retired_item& item) {
+                    return item.epoch >= oldest_epoch;
+                });
+            expired.assign(
+                std::make_move_iterator(it),
+                std::make_move_iterator(_retired.end()));
+            _retired.erase(it, _retired.end());
+        }
+
+        std::size_t count = 0;
+        for (const retired_item& item : expired)
+        {
+            if (item.entry != nullptr)
+            {
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+private:
+    static constexpr std::size_t hardware_destructive_interference_size = 64;
+    static constexpr std::size_t initial_capacity = 16u;
+    static constexpr std::size_t shard_bits = 6u;
+    static_assert((std::size_t{1} << shard_bits) == shard_count);
+
+    struct node
+    {
+        node(std::size_t hash, type_handle type, std::string_view id) :
+            hash(hash),
+            key{type, detail::worker_id(id)}
+        {
+        }
+
+        std::size_t hash;
+        detail::worker_key key;
+        T value;
+    };
+
+    struct table
+    {
+        explicit table(std::size_t capacity) :
+            capacity(capacity),
+            slots(std::make_unique<std::atomic<node*>[]>(capacity))
+        {
+        }
+
+        std::size_t capacity;
+        std::unique_ptr<std::atomic<node*>[]> slots;
+    };
+
+    struct alignas(hardware_destructive_interference_size) shard
+    {
+        std::atomic<table*> current = nullptr;
+        std::unique_ptr<table> storage;
+        std::size_t count = 0;
+        std::size_t used = 0;
+        shared_spin_lock lock;
+    };
+
+    struct retired_item
+    {
+        std::uint64_t epoch;
+        std::unique_ptr<node> entry;
+        std::unique_ptr<table> storage;
+    };
+
+    static std::size_t get_hash(type_handle type, std::string_view id)
+    {
+        std::size_t hash = std::hash<std::string_view>{}(id);
+        return hash ^ (type + 0x9E3779B97F4A7C15u + (hash << 6) + (hash >> 2));
+    }
+
+    static T* find(
+        const shard& shard,
+        std::size_t hash,
+        type_handle type,
+        std::string_view id) noexcept
+    {
+        const table& table = *shard.current.load(std::memory_order_acquire);
+        std::size_t mask = table.capacity - 1;
+        for (std::size_t i = (hash >> shard_bits) & mask;; i = (i + 1) & mask)
+        {
+            node* entry = table.slots[i].load(std::memory_order_acquire);
+            if (entry == nullptr)
+            {
+                return nullptr;
+            }
+
+            if ((entry != tombstone()) && is_match(*entry, hash, type, id))
+            {
+                return &entry->value;
+            }
+        }
+    }
+
+    static bool is_match(
+        const node& entry,
+        std::size_t hash,
+        type_handle type,
+        std::string_view id) noexcept
+    {
+        return (entry.hash == hash) && (entry.key.type == type) &&
+               (static_cast<std::string_view>(entry.key.id) == id);
+    }
+
+    static node* tombstone() noexcept
+    {
+        // Marks a removed entry; it's never dereferenced
+        static char marker;
+        return reinterpret_cast<node*>(&marker);
+    }
+
+    void insert(shard& shard, node* entry)
+    {
+        make_room(shard, 1u);
+        store(*shard.storage, entry);
+        ++shard.count;
+        ++shard.used;
+    }
+
+    void make_room(shard& shard, std::size_t additional)
+    {
+        table* current = shard.storage.get();
+        if (((shard.used + additional) * 4) > (current->capacity * 3))
+        {
+            // Removed entries still take up a slot, so if there are enough
+            // of them then rebuilding at the same size makes enough room
+            std::size_t capacity = current->capacity;
+            while (((shard.count + additional) * 2) > capacity)
+            {
+                capacity *= 2;
+            }
+
+            auto rebuilt = std::make_unique<table>(capacity);
+            for (std::size_t i = 0; i != current->capacity; ++i)
+            {
+                node* existing =
+                    current->slots[i].load(std::memory_order_relaxed);
+                if ((existing != nullptr) && (existing != tombstone()))
+                {
+                    store(*rebuilt, existing);
+                }
+            }
+
+            // Readers may still be using the old table, so it's kept alive
+            // until it's reclaimed
+            std::unique_ptr<table> previous = std::move(shard.storage);
+            shard.storage = std::move(rebuilt);
+            shard.current.store(shard.storage.get(), std::memory_order_release);
+            shard.used = shard.count;
+            retire(nullptr, std::move(previous));
+        }
+    }
+
+    void retire(std::unique_ptr<node> entry, std::unique_ptr<table> storage)
+    {
+        // The epoch is advanced after the item has been unlinked, so any
+        // thread that starts after this can't find it
+        std::uint64_t epoch = _epoch.fetch_add(1, std::memory_order_seq_cst);
+
+        std::lock_guard<shared_spin_lock> lock(_retired_lock);
+        _retired.push_back({epoch, std::move(entry), std::move(storage)});
+    }
+
+    static void store(table& table, node* entry)
+    {
+        std::size_t mask = table.capacity - 1;
+        std::size_t i = (entry->hash >> shard_bits) & mask;
+        while (table.slots[i].load(std::memory_order_relaxed) != nullptr)
+        {
+            i = (i + 1) & mask;
+        }
+
+        table.slots[i].store(entry, std::memory_order_release);
+    }
+
+    shard& get_shard(std::size_t hash) noexcept
+    {
+        return _shards[hash & (shard_count - 1)];
+    }
+
+    const shard& get_shard(std::size_t hash) const noexcept
+    {
+        return _shards[hash & (shard_count - 1)];
+    }
+
+    std::array<shard, shard_count> _shards;
+    std::atomic_uint64_t _epoch = 1;
+    std::vector<retired_item> _retired;
+    shared_spin_lock _retired_lock;
+};
+
+}
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif
@@ -1,45 +1,187 @@
 #ifndef WORKER_SERVICE_H
 #define WORKER_SERVICE_H
 
+#include "checkpoint.h"
 #include "collections.h"
 #include "defines.h"
 #include "exports.h"
+#include "gc_service.h"
 #include "locks.h"
 #include "managed_interop.h"
 #include "thread_pool.h"
+#include "worker_map.h"
+#include <any>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <tuple>
 #include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
 
 namespace autocrat
 {
 
+class worker_info;
+class worker_service;
+
 namespace detail
 {
 
-struct worker_key
+struct worker_snapshot
+{
+    object_arena arena;
+    void* object = nullptr;
+};
+
+using snapshot_handle = std::shared_ptr<const worker_snapshot>;
+
+// Each worker loaded from a checkpoint shares the reader, so that the file is
+// closed once every worker has been read from it
+struct checkpointed_worker
+{
+    std::shared_ptr<checkpoint_reader> reader;
+    checkpoint_location location;
+
+    void read(object_serializer& serializer) const
+    {
+        reader->read(location, serializer);
+    }
+};
+
+// The state of a checkpoint that is being written by the thread pool. The
+// workers that were locked when their shard was written are kept per shard,
+// so that a later pass can write them once they've been released
+struct checkpoint_pass
+{
+    using busy_workers =
+        std::vector<std::pair<const worker_key*, worker_info*>>;
+
+    checkpoint_pass(
+        const std::filesystem::path& path,
+        const void* anchor_type,
+        std::uint64_t fingerprint)
+        : writer(path, anchor_type, fingerprint), path(path)
+    {
+    }
+
+    checkpoint_writer writer;
+    std::mutex writer_lock;
+    std::vector<busy_workers> busy;
+    std::exception_ptr error;
+    std::filesystem::path path;
+    std::atomic_size_t count = 0;
+    std::atomic_size_t remaining = 0;
+    std::chrono::steady_clock::time_point retry_at;
+    std::uint64_t epoch = 0;
+    worker_key::type_handle anchor = 0;
+    bool committed = false;
+};
+
+template <class T>
+struct worker_counters
+{
+    T lock_failures{};
+    T locks{};
+    T lock_time_ns{};
+    T restores{};
+    T restore_time_ns{};
+    T saves{};
+    T save_time_ns{};
+    T saved_bytes{};
+    T saved_objects{};
+};
+
+// Only the owning thread updates the counters, so they don't need to be
+// atomically incremented, however, they are read when dumping statistics
+using thread_counters = worker_counters<std::atomic_uint64_t>;
+
+struct thread_workers
+{
+    small_vector<worker_info*> locked;
+    std::vector<snapshot_handle> snapshots;
+    std::vector<std::unique_ptr<thread_counters>> counters;
+    shared_spin_lock counters_lock;
+    worker_info* contended = nullptr;
+    std::atomic_uint64_t epoch = 0;
+    std::uint32_t contended_samples = 0;
+    std::uint32_t locked_samples = 0;
+};
+
+struct compression_statistics
+{
+    std::atomic_size_t compressed_count = 0;
+    std::atomic_size_t original_bytes = 0;
+    std::atomic_size_t compressed_bytes = 0;
+    std::atomic_int64_t compress_time_ns = 0;
+    std::atomic_size_t restored_count = 0;
+    std::atomic_int64_t restore_time_ns = 0;
+};
+
+struct worker_type
+{
+    compression_statistics compression;
+    worker_counters<std::uint64_t> reported;
+    std::atomic_size_t live_count = 0;
+    std::atomic_size_t stored_bytes = 0;
+    std::atomic_size_t in_use = 0;
+    construct_worker constructor = nullptr;
+    std::optional<std::chrono::seconds> time_to_live;
+    std::size_t index = 0;
+    bool notify_expired = false;
+};
+
+struct hot_worker
 {
-    using type_handle = std::uintptr_t;
-    type_handle type;
+    std::uint32_t count;
+    std::uintptr_t type;
     std::string id;
 };
 
-struct worker_key_equal
+enum class expiry_state : std::uint8_t
 {
-    bool operator()(const worker_key& a, const worker_key& b) const;
+    none,
+    pending,
+    expired
 };
 
-struct worker_key_hash
+struct worker_waiter
 {
-    std::size_t operator()(const worker_key& key) const;
+    thread_pool::callback_function callback;
+    std::any arg;
+    std::uint32_t age;
 };
 
-}
+// Where the data of a worker is when it isn't in its serializer, or the heap
+// that a prefetched worker was restored into. Only one of them applies to a
+// worker at a time
+using worker_data =
+    std::variant<std::monostate, checkpointed_worker, spill_location, gc_heap>;
 
-class worker_service;
+// The state that only the workers that are waited for, read by several
+// threads or have statistics recorded for need, which is allocated the first
+// time it's used to keep the other workers small
+struct worker_extras
+{
+    std::vector<worker_waiter> waiters;
+    shared_spin_lock waiters_lock;
+    snapshot_handle snapshot;
+    mutable shared_spin_lock snapshot_lock;
+    std::atomic<std::chrono::microseconds> last_read = {};
+    std::chrono::steady_clock::time_point locked_at;
+    std::atomic_uint32_t contended_count = 0;
+    std::atomic_uint32_t locked_count = 0;
+};
+
+}
 
 /**
  * Contains information about a managed worker.
@@ -47,23 +189,42 @@ class worker_service;
 class worker_info
 {
 public:
+    worker_info() = default;
+
+    ~worker_info() noexcept
+    {
+        delete extras.load(std::memory_order_relaxed);
+    }
+
+    worker_info(const worker_info&) = delete;
+    worker_info& operator=(const worker_info&) = delete;
+
 private:
     friend class worker_service;
 
+    object_arena arena;
     object_serializer serializer;
+    detail::worker_data data;
+    std::atomic<std::chrono::microseconds> last_used = {};
+    std::atomic_size_t stored_bytes = 0;
     void* object = nullptr;
+    detail::worker_type* type = nullptr;
+    std::atomic<detail::worker_extras*> extras = nullptr;
     exclusive_lock lock;
+    std::atomic_uint32_t pins = 0;
+    std::atomic<detail::expiry_state> expiry = detail::expiry_state::none;
 };
 
 /**
  * Exposes functionality for obtaining worker services.
  */
 class worker_service FINAL
-    : public thread_specific_storage<small_vector<worker_info*>>
+    : public thread_specific_storage<detail::thread_workers>
 {
 public:
-    using storage_type = small_vector<worker_info*>;
+    using storage_type = detail::thread_workers;
     using object_collection = dynamic_array<void*>;
+    using snapshot_collection = std::vector<detail::snapshot_handle>;
     using worker_collection = dynamic_array<worker_info*>;
 
     MOCKABLE_CONSTRUCTOR_AND_DESTRUCTOR(worker_service)
@@ -74,6 +235,161 @@ public:
      */
     explicit worker_service(thread_pool* pool);
 
+    /**
+     * Frees the workers, and the old storage of the map, that have been
+     * removed and are no longer being used by any thread, and moves on the
+     * checkpoint started by `queue_checkpoint`.
+     * @remarks The map replaces its storage as it grows, so this runs
+     *          whether or not workers expire. Nothing is freed if nothing
+     *          has been removed since the last time everything was freed.
+     */
+    MOCKABLE_METHOD void check_and_dispatch();
+
+    /**
+     * Compresses the saved data of the workers that have been idle for
+     * longer than the idle time passed to `enable_compression`.
+     * @remarks This does nothing unless `enable_compression` has been
+     *          called. Each shard of the workers is compressed by a separate
+     *          work item on the thread pool. Nothing is queued whilst the
+     *          work of the previous call is still running.
+     */
+    MOCKABLE_METHOD void compress_idle_workers();
+
+    /**
+     * Logs the number of storage nodes used by the serialized workers, the
+     * number of workers that were saved or, as they were unchanged, did not
+     * need saving, the number of workers (and the bytes they use) of each
+     * type and, if enabled, the compression of each type, how many of the
+     * prefetched workers were used, the usage of the spill store and the
+     * lock and serialization statistics of each type along with the
+     * workers that were locked, or failed to be locked, the most.
+     * @remarks The number of workers in use, and the workers locked the
+     *          most, are gathered by work items on the thread pool that are
+     *          queued by this method, so they are reported by the next call.
+     */
+    MOCKABLE_METHOD void dump_statistics();
+
+    /**
+     * Delivers the work waiting for a worker in batches, so that the worker
+     * is loaded and saved once per batch instead of once per work item.
+     * @param max_batch The maximum number of work items to run in one batch,
+     *                  which bounds how long the other waiting work is
+     *                  delayed by.
+     * @remarks This must be called before the thread pool is started.
+     */
+    MOCKABLE_METHOD void enable_batching(std::size_t max_batch);
+
+    /**
+     * Allows the saved data of workers that have not been used recently to
+     * be compressed, with the data being decompressed each time the worker
+     * is used until it is changed.
+     * @param idle_time The amount of time a worker is not used for before
+     *                  its data is compressed.
+     * @remarks This must be called before any workers are created.
+     */
+    MOCKABLE_METHOD void enable_compression(std::chrono::seconds idle_time);
+
+    /**
+     * Removes workers that have not been used for the specified time.
+     * @param time_to_live The amount of time a worker is not used for before
+     *                     it is removed, for types that have not specified
+     *                     their own time.
+     * @remarks This must be called before any workers are created.
+     */
+    MOCKABLE_METHOD void enable_expiry(std::chrono::seconds time_to_live);
+
+    /**
+     * Allows the workers needed by queued continuations to be restored by
+     * idle threads before the continuation runs.
+     * @remarks This must be called before any workers are created.
+     */
+    MOCKABLE_METHOD void enable_prefetch();
+
+    /**
+     * Keeps the workers in memory owned by each worker between work items,
+     * instead of saving them to a buffer each time they are released.
+     * @param garbage_percentage The amount of unreachable memory, as a
+     *                           percentage of the reachable memory, that
+     *                           will cause a workers memory to be compacted.
+     * @remarks This must be called before any workers are created.
+     */
+    MOCKABLE_METHOD void enable_resident_workers(
+        std::size_t garbage_percentage);
+
+    /**
+     * Allows the saved data of workers that have not been used recently to
+     * be written to disk, with the data being read back when the worker is
+     * next used.
+     * @param directory     The directory to write the data to.
+     * @param idle_time     The amount of time a worker is not used for
+     *                      before it is written to disk.
+     * @param memory_budget The number of bytes of saved data to keep in
+     *                      memory before writing the least recently used
+     *                      workers to disk regardless of how long they have
+     *                      been idle (zero disables the limit).
+     * @remarks This must be called before any workers are created.
+     */
+    MOCKABLE_METHOD void enable_spilling(
+        const std::filesystem::path& directory,
+        std::chrono::seconds idle_time,
+        std::size_t memory_budget);
+
+    /**
+     * Records how long the workers of each type are locked for, how often
+     * they can't be locked and how long they take to restore and save, as
+     * well as which workers are used and contended the most.
+     * @remarks This must be called before the thread pool is started.
+     */
+    MOCKABLE_METHOD void enable_statistics();
+
+    /**
+     * Queues the specified work to run once the worker that the current
+     * thread last failed to lock has been released.
+     * @param callback The function to invoke.
+     * @param arg      The data to pass to the function, which is moved from
+     *                 if the work is queued.
+     * @param age      The number of times the work has already failed to
+     *                 lock its workers.
+     * @returns `true` if the work has been queued; otherwise, `false` if
+     *          there is no worker to wait for, in which case the caller is
+     *          responsible for queuing the work.
+     * @remarks The waiting work is queued oldest first and then in the
+     *          order it was added.
+     */
+    MOCKABLE_METHOD bool enqueue_when_released(
+        thread_pool::callback_function callback,
+        std::any& arg,
+        std::uint32_t age);
+
+    /**
+     * Removes the workers that have not been used for longer than the time
+     * to live of their type.
+     * @remarks Workers that are in use, that have work waiting for them or
+     *          that are held by a continuation are not removed. The next
+     *          request for a removed worker will create a new one. Each
+     *          shard of the workers is checked by a separate work item on
+     *          the thread pool, with nothing queued whilst the work of the
+     *          previous call is still running. The memory of the removed
+     *          workers is freed by `check_and_dispatch`.
+     */
+    MOCKABLE_METHOD void expire_idle_workers();
+
+    /**
+     * Gets a read-only copy of a worker of the specified type.
+     * @param type The type of the worker to return.
+     * @param id   The identifier of the worker.
+     * @returns A managed object of the specified type, or `nullptr` if the
+     *          copy needs creating and the worker is in use.
+     * @remarks The copy is shared by all the threads reading the worker and
+     *          must not be modified. It is replaced when the worker is
+     *          changed, however, the current thread keeps using the version
+     *          it was given until its work (and any continuations of it)
+     *          have finished.
+     */
+    MOCKABLE_METHOD void* get_read_only_worker(
+        const void* type,
+        std::string_view id);
+
     /**
      * Gets a worker of the specified type.
      * @param type The type of the worker to return.
@@ -82,6 +398,78 @@ public:
     // TODO: C++ 20 span would be better than string_view
     MOCKABLE_METHOD void* get_worker(const void* type, std::string_view id);
 
+    /**
+     * Keeps the specified read-only workers alive until the work on the
+     * current thread has finished.
+     * @param snapshots The value returned from `release_snapshots`.
+     */
+    MOCKABLE_METHOD void hold_snapshots(snapshot_collection snapshots);
+
+    /**
+     * Determines whether any of the worker types have a time to live.
+     * @returns `true` if `expire_idle_workers` needs calling; otherwise,
+     *          `false`.
+     */
+    MOCKABLE_METHOD bool is_expiry_enabled() const;
+
+    /**
+     * Adds the workers stored in the specified checkpoint file.
+     * @param path The path of the file written by `save_checkpoint`.
+     * @returns The number of workers that were added.
+     * @remarks The data of each worker is read from the file the first time
+     *          the worker is used. This must be called after all the types
+     *          have been registered and before any workers are created. An
+     *          exception is thrown if the file was not written by the same
+     *          version of the program.
+     */
+    MOCKABLE_METHOD std::size_t load_checkpoint(
+        const std::filesystem::path& path);
+
+    /**
+     * Restores the specified workers, when a thread is idle, ahead of the
+     * work that will use them.
+     * @param workers The workers returned by `release_locked`, which must be
+     *                called before the continuation using them is queued.
+     * @remarks This does nothing unless `enable_prefetch` has been called.
+     *          The restored objects are kept in their own heap, which is
+     *          handed over to the work item that next locks the worker.
+     */
+    MOCKABLE_METHOD void prefetch_workers(const worker_collection& workers);
+
+    /**
+     * Creates the workers of the specified type that don't exist yet and
+     * reads the data of the ones in the checkpoint into memory.
+     * @param type The type of the workers.
+     * @param ids  The identifiers of the workers.
+     * @returns The number of workers that were created or read from the
+     *          checkpoint.
+     * @remarks The workers are split into batches by the part of the map
+     *          they belong to and the batches are run on the thread pool,
+     *          with this method blocking until they have all finished. It is
+     *          intended to be called during initialization (after the thread
+     *          pool has started) so that the first request for each worker
+     *          doesn't have to create it. If called from a work item, the
+     *          batches are run on the calling thread instead, as waiting for
+     *          the pool could wait forever.
+     */
+    MOCKABLE_METHOD std::size_t preload_workers(
+        const void* type,
+        const std::vector<std::string_view>& ids);
+
+    /**
+     * Starts writing the saved workers to the specified checkpoint file
+     * using the thread pool.
+     * @param path The path of the file to write.
+     * @remarks Each shard of the workers is written by a separate work item,
+     *          with a lock serializing the writes to the file. Workers that
+     *          are locked are skipped and written by a later pass, queued
+     *          from `check_and_dispatch`, once they've been released. The
+     *          file is replaced once every worker has been written and the
+     *          result is logged by `check_and_dispatch`. Nothing is queued
+     *          whilst the previous checkpoint is still being written.
+     */
+    MOCKABLE_METHOD void queue_checkpoint(const std::filesystem::path& path);
+
     /**
      * Registers the specified constructor.
      * @param type        The type of the worker returned by the constructor.
@@ -91,46 +479,174 @@ public:
         const void* type,
         construct_worker constructor);
 
+    /**
+     * Sets how long the workers of the specified type are kept whilst idle.
+     * @param type         The type of the worker.
+     * @param time_to_live The amount of time a worker is not used for before
+     *                     it is removed (zero keeps them forever and a
+     *                     negative value uses the time passed to
+     *                     `enable_expiry`).
+     * @param notify       Whether the managed object is told it has expired
+     *                     before it is removed.
+     * @remarks This must be called before any workers are created.
+     */
+    MOCKABLE_METHOD void set_time_to_live(
+        const void* type,
+        std::chrono::seconds time_to_live,
+        bool notify);
+
     /**
      * Releases the workers held by the current thread.
-     * @returns The workers that were locked by the current thread.
+     * @returns The workers that were locked by the current thread, ordered
+     *          by their address so that `try_lock` will always lock
+     *          overlapping workers in the same order.
      */
     MOCKABLE_METHOD std::tuple<object_collection, worker_collection>
     release_locked();
 
+    /**
+     * Releases the read-only workers used by the current thread.
+     * @returns The versions of the workers that were read, which must be
+     *          kept alive whilst the objects are still referenced.
+     */
+    MOCKABLE_METHOD snapshot_collection release_snapshots();
+
+    /**
+     * Writes the saved workers to the specified checkpoint file.
+     * @param path The path of the file to write.
+     * @returns The number of workers written to the file.
+     * @remarks Resident workers are not written to the file. Workers that
+     *          are locked are written once they have been released. This
+     *          writes the workers in the same way as `queue_checkpoint`,
+     *          but waits for the file to be replaced (after finishing any
+     *          checkpoint already being written), so is intended to be
+     *          called by the main loop when stopping.
+     */
+    MOCKABLE_METHOD std::size_t save_checkpoint(
+        const std::filesystem::path& path);
+
     /**
      * Attempts to lock all the specified workers and associates them with
      * the current thread.
      * @param workers The collection of workers to take ownership of.
      * @returns The managed objects of the loaded workers.
+     * @remarks The workers are locked in the order they are specified; if
+     *          any of them cannot be locked then none of them are locked.
      */
     MOCKABLE_METHOD std::optional<object_collection> try_lock(
         const worker_collection& workers);
 
+    /**
+     * Writes the workers that have been idle for longer than the idle time,
+     * or that exceed the memory budget, to disk.
+     * @remarks This does nothing unless `enable_spilling` has been called.
+     *          Each shard of the workers is spilled by a separate work item
+     *          on the thread pool, starting with its least recently used
+     *          workers. Nothing is queued whilst the work of the previous
+     *          call is still running.
+     */
+    MOCKABLE_METHOD void spill_idle_workers();
+
 protected:
     void on_begin_work(storage_type* storage) override;
     void on_end_work(storage_type* storage) override;
 
 private:
     using worker_key = detail::worker_key;
+    using sweep_function =
+        void (worker_service::*)(std::size_t, std::chrono::microseconds);
 
+    detail::worker_type& add_type(const void* type);
+    bool add_to_checkpoint(
+        detail::checkpoint_pass& pass,
+        const worker_key& key,
+        worker_info& info);
+    bool advance_checkpoint();
+    static void checkpoint_shard(std::any& arg);
+    static void expire_worker(std::any& arg);
+    static void prefetch_worker(std::any& arg);
+    static void preload_batch(std::any& arg);
+    static void sweep_shard(std::any& arg);
+
+    void compress_shard(
+        std::size_t shard,
+        std::chrono::microseconds idle_since);
+    void evict_worker(const worker_key& key, worker_info& info, bool notify);
+    void expire_shard(std::size_t shard, std::chrono::microseconds now);
     bool find_existing(
         worker_key::type_handle type,
         std::string_view id,
         void*& result) const;
+    detail::thread_counters* get_counters(
+        const detail::worker_type& type) const;
+    static detail::worker_extras& get_extras(worker_info& info);
+    std::optional<std::chrono::microseconds> get_idle_since(
+        worker_key::type_handle type,
+        std::chrono::microseconds now) const;
+    static std::chrono::microseconds get_last_used(const worker_info& info);
+    std::uint64_t get_type_fingerprint(worker_key::type_handle& anchor) const;
+    bool is_idle(worker_info& info, std::chrono::microseconds idle_since)
+        const;
     void* load_worker(worker_info& info) const;
-    void* make_worker(worker_key&& key);
+    void* make_worker(worker_key::type_handle type, std::string_view id);
+    void publish_snapshot(worker_info& info, detail::snapshot_handle snapshot);
+    void queue_sweep(
+        std::atomic_size_t& remaining,
+        sweep_function sweep,
+        std::chrono::microseconds time);
+    void reclaim_workers();
+    void record_contention(worker_info& info) const;
+    void record_locked(worker_info& info) const;
+    void restore_prefetched(worker_info& info);
+    void* restore_worker(worker_info& info) const;
     void save_worker(worker_info& info);
+    void spill_shard(std::size_t shard, std::chrono::microseconds idle_since);
+    void start_checkpoint(const std::filesystem::path& path);
+    void statistics_shard(std::size_t shard, std::chrono::microseconds);
+    void unlock_worker(worker_info& info);
+    void update_stored_bytes(worker_info& info);
+    void wait_for_checkpoint();
 
-    std::unordered_map<worker_key::type_handle, construct_worker> _constructors;
-    std::unordered_map<
-        worker_key,
-        worker_info,
-        detail::worker_key_hash,
-        detail::worker_key_equal>
-        _workers;
-
-    mutable shared_spin_lock _workers_lock;
+    std::unordered_map<worker_key::type_handle, detail::worker_type> _types;
+    worker_map<worker_info> _workers;
+    thread_pool* _thread_pool = nullptr;
+    std::unique_ptr<spill_store> _spill_store;
+    std::unique_ptr<detail::checkpoint_pass> _checkpoint;
+    std::vector<detail::hot_worker> _most_contended;
+    std::vector<detail::hot_worker> _most_locked;
+    std::mutex _hot_workers_lock;
+    std::atomic_size_t _batch_count = 0;
+    std::atomic_size_t _compress_sweeps = 0;
+    std::atomic_size_t _expire_sweeps = 0;
+    std::atomic_size_t _expired_count = 0;
+    std::atomic_size_t _lock_abandoned_count = 0;
+    std::atomic_size_t _lock_failed_count = 0;
+    std::atomic_size_t _parked_count = 0;
+    mutable std::atomic_size_t _prefetch_hits = 0;
+    std::atomic_size_t _prefetch_skipped = 0;
+    std::atomic_size_t _prefetched_count = 0;
+    std::atomic_size_t _saved_count = 0;
+    std::atomic_size_t _snapshot_count = 0;
+    std::atomic_size_t _snapshot_reads = 0;
+    mutable std::atomic_size_t _spill_hits = 0;
+    mutable std::atomic_size_t _spill_misses = 0;
+    std::atomic_size_t _spill_sweeps = 0;
+    std::atomic_size_t _spilled_count = 0;
+    std::atomic_size_t _statistics_sweeps = 0;
+    std::atomic_size_t _stored_bytes = 0;
+    std::atomic_size_t _unchanged_count = 0;
+    std::size_t _garbage_percentage = 0;
+    std::size_t _max_batch = 0;
+    std::size_t _memory_budget = 0;
+    std::uint64_t _reclaimed_epoch = 0;
+    std::chrono::microseconds _compress_idle_time = {};
+    std::chrono::microseconds _spill_idle_time = {};
+    std::chrono::seconds _time_to_live = {};
+    bool _collect_statistics = false;
+    bool _expiry_enabled = false;
+    bool _prefetch_enabled = false;
+    bool _resident_workers = false;
+    bool _track_last_used = false;
 };
 
 }
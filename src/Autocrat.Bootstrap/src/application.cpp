@@ -6,6 +6,7 @@
 #include <cerrno>
 #include <cstdlib>
 #include <fstream>
+#include <limits>
 #include <memory>
 #include <spdlog/spdlog.h>
 
@@ -92,6 +93,195 @@ void application::initialize(int argc, const char* const* argv)
             _thread_count,
             "Specifies the number of threads to use in the thread pool");
 
+        _app.add_flag(
+            "--adaptive_node_size",
+            _adaptive_node_size,
+            "Changes the size of the memory nodes to fit the observed usage "
+            "each time unused memory is trimmed (requires --trim_interval)");
+
+        _app.add_option(
+            "--buffer_node_high_watermark",
+            _buffer_node_high_watermark,
+            "Specifies the number of unused worker storage nodes that will "
+            "trigger a trim (zero disables trimming)");
+
+        _app.add_option(
+            "--buffer_node_low_watermark",
+            _buffer_node_low_watermark,
+            "Specifies the number of unused worker storage nodes to keep "
+            "after a trim");
+
+        _app.add_option(
+            "--buffer_node_size",
+            _buffer_node_size,
+            "Specifies the number of bytes in each worker storage node");
+
+        _app.add_option(
+            "--checkpoint_file",
+            _checkpoint_file,
+            "Specifies the file to save the workers to when stopping, which "
+            "are then loaded from it when starting");
+
+        _app.add_option(
+            "--checkpoint_interval",
+            _checkpoint_interval,
+            "Specifies the number of seconds between saving the workers to "
+            "the checkpoint file (zero only saves them when stopping)");
+
+        _app.add_flag(
+            "--evacuate_task_state",
+            _evacuate_task_state,
+            "Copies the objects reachable from the state of a continuation "
+            "into a new heap, freeing the rest of the memory the work "
+            "allocated before the continuation runs");
+
+        _app.add_option(
+            "--heap_hard_limit",
+            _heap_hard_limit_kb,
+            "Specifies the number of KiB a work item can allocate before "
+            "its allocations fail (zero disables the limit)");
+
+        _app.add_option(
+            "--heap_node_high_watermark",
+            _heap_node_high_watermark,
+            "Specifies the number of unused managed heap nodes that will "
+            "trigger a trim (zero disables trimming)");
+
+        _app.add_option(
+            "--heap_node_low_watermark",
+            _heap_node_low_watermark,
+            "Specifies the number of unused managed heap nodes to keep after "
+            "a trim");
+
+        _app.add_option(
+            "--heap_node_size",
+            _heap_node_size_kb,
+            "Specifies the number of KiB in each managed heap node");
+
+        _app.add_option(
+            "--heap_soft_limit",
+            _heap_soft_limit_kb,
+            "Specifies the number of KiB a work item can allocate before a "
+            "warning is logged (zero disables the warning)");
+
+        _app.add_flag(
+            "--lock_memory",
+            _lock_memory,
+            "Locks the process memory to prevent it from being paged out");
+
+        _app.add_option(
+            "--prefault_stack",
+            _prefault_stack_kb,
+            "Specifies the number of KiB of each thread's stack to touch "
+            "during startup");
+
+        _app.add_flag(
+            "--prefetch_workers",
+            _prefetch_workers,
+            "Restores the workers needed by queued continuations on idle "
+            "threads before the continuations run");
+
+        _app.add_option(
+            "--reserve_buffer_nodes",
+            _reserve_buffer_nodes,
+            "Specifies the number of worker storage nodes to allocate during "
+            "startup");
+
+        _app.add_option(
+            "--reserve_byte_arrays",
+            _reserve_byte_arrays,
+            "Specifies the number of network buffers of each size to allocate "
+            "during startup");
+
+        _app.add_option(
+            "--reserve_heap_nodes",
+            _reserve_heap_nodes,
+            "Specifies the number of managed heap nodes to allocate during "
+            "startup");
+
+        _app.add_flag(
+            "--resident_workers",
+            _resident_workers,
+            "Keeps each worker in its own memory between work items instead "
+            "of copying it in and out of the managed heap");
+
+        _app.add_option(
+            "--spill_directory",
+            _spill_directory,
+            "Specifies the directory to write idle workers to, allowing them "
+            "to be removed from memory (empty disables spilling)");
+
+        _app.add_option(
+            "--spill_idle_time",
+            _spill_idle_time,
+            "Specifies the number of seconds a worker is not used for before "
+            "it is written to the spill directory, which is also how often "
+            "the workers are checked");
+
+        _app.add_option(
+            "--statistics_interval",
+            _statistics_interval,
+            "Specifies the number of seconds between logging the runtime "
+            "statistics (zero disables logging)");
+
+        _app.add_flag(
+            "--track_page_faults",
+            _track_page_faults,
+            "Records the number of page faults incurred by each thread");
+
+        _app.add_option(
+            "--trim_interval",
+            _trim_interval,
+            "Specifies the number of seconds between returning unused memory "
+            "to the operating system (zero disables trimming)");
+
+        _app.add_option(
+            "--worker_batch_size",
+            _worker_batch_size,
+            "Specifies the maximum number of work items waiting for a worker "
+            "to run together once it is released (zero runs them "
+            "individually)");
+
+        _app.add_option(
+            "--worker_compress_idle_time",
+            _worker_compress_idle_time,
+            "Specifies the number of seconds a worker is not used for before "
+            "its saved data is compressed, which is also how often the "
+            "workers are checked (zero disables compression)");
+
+        _app.add_option(
+            "--worker_expiry_interval",
+            _worker_expiry_interval,
+            "Specifies the number of seconds between checking for workers "
+            "that have been idle for longer than their time to live");
+
+        _app.add_option(
+            "--worker_garbage_percentage",
+            _worker_garbage_percentage,
+            "Specifies the amount of unreachable memory, as a percentage of "
+            "the reachable memory, that causes a resident worker to be "
+            "compacted");
+
+        _app.add_option(
+            "--worker_memory_budget",
+            _worker_memory_budget_mb,
+            "Specifies the number of MiB of saved workers to keep in memory "
+            "before writing the least recently used ones to the spill "
+            "directory (zero disables the limit)");
+
+        _app.add_flag(
+            "--worker_statistics",
+            _worker_statistics,
+            "Includes the lock and serialization times of each worker type, "
+            "and the most used and contended workers, in the statistics");
+
+        _app.add_option(
+            "--worker_time_to_live",
+            _worker_time_to_live,
+            "Specifies the number of seconds a worker is not used for before "
+            "it is removed, for worker types that don't specify their own "
+            "time (zero keeps them forever)");
+
         _app.parse(argc, argv);
     }
     catch (const CLI::Error& error)
@@ -102,11 +292,15 @@ void application::initialize(int argc, const char* const* argv)
     spdlog::debug("Creating native services");
     autocrat::global_services.initialize();
 
+    spdlog::debug("Reserving memory");
+    initialize_memory();
+
     spdlog::debug("Setting up native/manage transition for threads");
     initialize_threads();
 
     spdlog::debug("Registering exported managed types");
     managed_exports::RegisterManagedTypes();
+    load_checkpoint();
 
     fs::path path = get_config_file();
     spdlog::info("Loading configuration from '{}'", path.string());
@@ -117,12 +311,64 @@ void application::initialize(int argc, const char* const* argv)
 void application::run()
 {
     _running = true;
+    if (_statistics_interval > 0)
+    {
+        _next_statistics_dump = pal::get_current_time() +
+                                std::chrono::seconds(_statistics_interval);
+    }
+
+    if (!_checkpoint_file.empty() && (_checkpoint_interval > 0))
+    {
+        _next_checkpoint = pal::get_current_time() +
+                           std::chrono::seconds(_checkpoint_interval);
+    }
+
+    if (!_spill_directory.empty())
+    {
+        _next_spill =
+            pal::get_current_time() + std::chrono::seconds(_spill_idle_time);
+    }
+
+    if (_worker_compress_idle_time > 0)
+    {
+        _next_compression = pal::get_current_time() +
+                            std::chrono::seconds(_worker_compress_idle_time);
+    }
+
+    // The types are registered by the managed code, so we don't know if any
+    // of them expire until now
+    _expire_workers =
+        (_worker_expiry_interval > 0) &&
+        global_services.get_service<worker_service>()->is_expiry_enabled();
+    if (_expire_workers)
+    {
+        _next_expiry = pal::get_current_time() +
+                       std::chrono::seconds(_worker_expiry_interval);
+    }
+
+    if (_trim_interval > 0)
+    {
+        _next_trim =
+            pal::get_current_time() + std::chrono::seconds(_trim_interval);
+    }
+
     do
     {
         global_services.check_and_dispatch();
+        compress_workers_if_due();
+        dump_statistics_if_due();
+        expire_workers_if_due();
+        save_checkpoint_if_due();
+        spill_workers_if_due();
+        trim_memory_if_due();
         pause();
     } while (_running);
 
+    if (!_checkpoint_file.empty())
+    {
+        save_checkpoint();
+    }
+
     auto* gc = autocrat::global_services.get_service<autocrat::gc_service>();
     gc->end_work(autocrat::lifetime_service::global_thread_id);
 }
@@ -143,6 +389,49 @@ void application::version(const char* value)
         "Show version information");
 }
 
+void application::compress_workers_if_due()
+{
+    if (_worker_compress_idle_time > 0)
+    {
+        std::chrono::microseconds now = pal::get_current_time();
+        if (now >= _next_compression)
+        {
+            global_services.get_service<worker_service>()
+                ->compress_idle_workers();
+            _next_compression =
+                now + std::chrono::seconds(_worker_compress_idle_time);
+        }
+    }
+}
+
+void application::dump_statistics_if_due()
+{
+    if (_statistics_interval > 0)
+    {
+        std::chrono::microseconds now = pal::get_current_time();
+        if (now >= _next_statistics_dump)
+        {
+            global_services.dump_statistics();
+            _next_statistics_dump =
+                now + std::chrono::seconds(_statistics_interval);
+        }
+    }
+}
+
+void application::expire_workers_if_due()
+{
+    if (_expire_workers)
+    {
+        std::chrono::microseconds now = pal::get_current_time();
+        if (now >= _next_expiry)
+        {
+            global_services.get_service<worker_service>()
+                ->expire_idle_workers();
+            _next_expiry = now + std::chrono::seconds(_worker_expiry_interval);
+        }
+    }
+}
+
 void application::initialize_managed_thread(autocrat::gc_service* gc)
 {
     gc->set_heap(std::move(_global_heap));
@@ -150,6 +439,127 @@ void application::initialize_managed_thread(autocrat::gc_service* gc)
     _global_heap = gc->reset_heap();
 }
 
+void application::initialize_memory()
+{
+    // Lock the memory first so that all the memory we're about to allocate
+    // is also locked
+    if (_lock_memory && pal::lock_memory())
+    {
+        spdlog::info("Process memory has been locked");
+    }
+
+    if (_track_page_faults)
+    {
+        global_services.get_thread_pool().enable_page_fault_tracking();
+    }
+
+    if (_buffer_node_size > 0)
+    {
+        memory_pool_buffer::set_node_size(_buffer_node_size);
+    }
+
+    if (_heap_node_size_kb > 0)
+    {
+        global_services.get_service<gc_service>()->set_node_size(
+            _heap_node_size_kb * 1024u);
+    }
+
+    if (_adaptive_node_size)
+    {
+        spdlog::info("Adapting the memory pool node sizes to the usage");
+        memory_pool_buffer::enable_adaptive_node_size();
+        global_services.get_service<gc_service>()->enable_adaptive_node_size();
+    }
+
+    if ((_heap_soft_limit_kb > 0) || (_heap_hard_limit_kb > 0))
+    {
+        global_services.get_service<gc_service>()->set_allocation_limits(
+            _heap_soft_limit_kb * 1024u, _heap_hard_limit_kb * 1024u);
+    }
+
+    if (_evacuate_task_state)
+    {
+        spdlog::info("Copying the reachable task state on continuations");
+        global_services.get_service<task_service>()->enable_evacuation();
+    }
+
+    if (_resident_workers)
+    {
+        spdlog::info("Keeping workers resident in memory");
+        global_services.get_service<worker_service>()->enable_resident_workers(
+            _worker_garbage_percentage);
+    }
+
+    if (_prefetch_workers)
+    {
+        spdlog::info("Prefetching workers on idle threads");
+        global_services.get_service<worker_service>()->enable_prefetch();
+    }
+
+    if (_worker_batch_size > 0)
+    {
+        spdlog::info(
+            "Delivering waiting work in batches of up to {}",
+            _worker_batch_size);
+        global_services.get_service<worker_service>()->enable_batching(
+            _worker_batch_size);
+    }
+
+    if (_worker_compress_idle_time > 0)
+    {
+        spdlog::info(
+            "Compressing workers that are idle for {} seconds",
+            _worker_compress_idle_time);
+        global_services.get_service<worker_service>()->enable_compression(
+            std::chrono::seconds(_worker_compress_idle_time));
+    }
+
+    if (_worker_time_to_live > 0)
+    {
+        spdlog::info(
+            "Removing workers that are idle for {} seconds",
+            _worker_time_to_live);
+        global_services.get_service<worker_service>()->enable_expiry(
+            std::chrono::seconds(_worker_time_to_live));
+    }
+
+    if (_worker_statistics)
+    {
+        global_services.get_service<worker_service>()->enable_statistics();
+    }
+
+    if (!_spill_directory.empty())
+    {
+        spdlog::info("Spilling idle workers to '{}'", _spill_directory);
+        global_services.get_service<worker_service>()->enable_spilling(
+            _spill_directory,
+            std::chrono::seconds(_spill_idle_time),
+            _worker_memory_budget_mb * 1024u * 1024u);
+    }
+
+    if (_reserve_buffer_nodes > 0)
+    {
+        spdlog::info(
+            "Reserving {} worker storage nodes", _reserve_buffer_nodes);
+        memory_pool_buffer::reserve(_reserve_buffer_nodes);
+    }
+
+    if (_reserve_byte_arrays > 0)
+    {
+        spdlog::info(
+            "Reserving {} network buffers of each size", _reserve_byte_arrays);
+        global_services.get_service<network_service>()->reserve_buffers(
+            _reserve_byte_arrays);
+    }
+
+    if (_reserve_heap_nodes > 0)
+    {
+        spdlog::info("Reserving {} managed heap nodes", _reserve_heap_nodes);
+        global_services.get_service<gc_service>()->reserve(
+            _reserve_heap_nodes);
+    }
+}
+
 void application::initialize_threads()
 {
     if (_thread_count < 0)
@@ -164,9 +574,22 @@ void application::initialize_threads()
         ++_thread_affinity;
     }
 
+    std::size_t prefault_stack = _prefault_stack_kb * 1024u;
+    if (prefault_stack > 0)
+    {
+        pal::prefault_stack(prefault_stack);
+    }
+
     auto* gc = autocrat::global_services.get_service<autocrat::gc_service>();
     autocrat::global_services.get_thread_pool().start(
-        _thread_affinity, _thread_count, [this, gc](std::size_t thread_id) {
+        _thread_affinity,
+        _thread_count,
+        [this, gc, prefault_stack](std::size_t thread_id) {
+            if (prefault_stack > 0)
+            {
+                pal::prefault_stack(prefault_stack);
+            }
+
             gc->begin_work(thread_id);
             initialize_managed_thread(gc);
             gc->end_work(thread_id);
@@ -181,6 +604,134 @@ void application::initialize_threads()
     managed_exports::InitializeManagedThread();
 }
 
+void application::load_checkpoint()
+{
+    if (_checkpoint_file.empty() || !fs::exists(_checkpoint_file))
+    {
+        return;
+    }
+
+    spdlog::info("Loading workers from '{}'", _checkpoint_file);
+    try
+    {
+        std::size_t count = global_services.get_service<worker_service>()
+                                ->load_checkpoint(_checkpoint_file);
+        spdlog::info("Loaded {} workers from the checkpoint", count);
+    }
+    catch (const std::exception& ex)
+    {
+        spdlog::warn("Unable to load the checkpoint: {}", ex.what());
+    }
+}
+
+void application::save_checkpoint()
+{
+    try
+    {
+        std::size_t count = global_services.get_service<worker_service>()
+                                ->save_checkpoint(_checkpoint_file);
+        spdlog::info("Saved {} workers to '{}'", count, _checkpoint_file);
+    }
+    catch (const std::exception& ex)
+    {
+        spdlog::warn("Unable to save the checkpoint: {}", ex.what());
+    }
+}
+
+void application::save_checkpoint_if_due()
+{
+    if (!_checkpoint_file.empty() && (_checkpoint_interval > 0))
+    {
+        std::chrono::microseconds now = pal::get_current_time();
+        if (now >= _next_checkpoint)
+        {
+            // The workers are written by the thread pool, with the result
+            // logged by the worker service once they've all been written
+            try
+            {
+                global_services.get_service<worker_service>()
+                    ->queue_checkpoint(_checkpoint_file);
+            }
+            catch (const std::exception& ex)
+            {
+                spdlog::warn("Unable to save the checkpoint: {}", ex.what());
+            }
+
+            _next_checkpoint =
+                now + std::chrono::seconds(_checkpoint_interval);
+        }
+    }
+}
+
+void application::spill_workers_if_due()
+{
+    if (!_spill_directory.empty())
+    {
+        std::chrono::microseconds now = pal::get_current_time();
+        if (now >= _next_spill)
+        {
+            global_services.get_service<worker_service>()
+                ->spill_idle_workers();
+            _next_spill = now + std::chrono::seconds(_spill_idle_time);
+        }
+    }
+}
+
+void application::trim_memory()
+{
+    // Adapt the sizes first so that the unused nodes of the old size are
+    // included in the memory returned to the OS
+    if (_adaptive_node_size)
+    {
+        memory_pool_buffer::adapt_node_size();
+        global_services.get_service<gc_service>()->adapt_node_size();
+    }
+
+    // The pools are trimmed even without a watermark, as that still frees
+    // the nodes left over from a previous node size
+    constexpr std::size_t no_limit = std::numeric_limits<std::size_t>::max();
+    std::size_t freed = 0;
+    if (_buffer_node_high_watermark > 0)
+    {
+        freed += memory_pool_buffer::trim(
+            _buffer_node_low_watermark, _buffer_node_high_watermark);
+    }
+    else
+    {
+        freed += memory_pool_buffer::trim(no_limit, no_limit);
+    }
+
+    auto* gc = global_services.get_service<gc_service>();
+    if (_heap_node_high_watermark > 0)
+    {
+        freed +=
+            gc->trim(_heap_node_low_watermark, _heap_node_high_watermark);
+    }
+    else
+    {
+        freed += gc->trim(no_limit, no_limit);
+    }
+
+    if ((freed > 0) || _adaptive_node_size)
+    {
+        spdlog::debug("Freed {} unused memory pool nodes", freed);
+        pal::release_free_memory();
+    }
+}
+
+void application::trim_memory_if_due()
+{
+    if (_trim_interval > 0)
+    {
+        std::chrono::microseconds now = pal::get_current_time();
+        if (now >= _next_trim)
+        {
+            trim_memory();
+            _next_trim = now + std::chrono::seconds(_trim_interval);
+        }
+    }
+}
+
 fs::path get_config_file()
 {
     fs::path exe = pal::get_current_executable();
@@ -1,10 +1,36 @@
 #include "array_pool.h"
 #include "managed_exports.h"
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <new>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+std::size_t get_size_class(std::size_t size)
+{
+    const auto& sizes = autocrat::array_pool::size_classes;
+    auto it = std::lower_bound(sizes.begin(), sizes.end(), size);
+    if (it == sizes.end())
+    {
+        return sizes.size() - 1u;
+    }
+
+    return static_cast<std::size_t>(it - sizes.begin());
+}
+
+}
 
 namespace autocrat::detail
 {
 
+std::size_t array_pool_block::capacity() const noexcept
+{
+    return array_pool::size_classes[size_class];
+}
+
 void intrusive_ptr_add_ref(array_pool_block* pointer) noexcept
 {
     pointer->usage++;
@@ -24,7 +50,7 @@ void intrusive_ptr_release(array_pool_block* pointer) noexcept
 namespace autocrat
 {
 
-managed_byte_array::managed_byte_array() : _data()
+managed_byte_array::managed_byte_array()
 {
     static const void* byte_array_type = managed_exports::GetByteArrayType();
     _ee_type = byte_array_type;
@@ -32,47 +58,45 @@ managed_byte_array::managed_byte_array() : _data()
 
 auto managed_byte_array::begin() const noexcept -> const_iterator
 {
-    return _data.begin();
+    return data();
 }
 
 auto managed_byte_array::begin() noexcept -> iterator
 {
-    return _data.begin();
+    return data();
 }
 
 void managed_byte_array::clear() noexcept
 {
-    std::fill_n(_data.begin(), _length, value_type{});
+    std::fill_n(data(), _length, value_type{});
     _length = 0;
 }
 
 auto managed_byte_array::data() const noexcept -> const value_type*
 {
-    return _data.data();
+    return reinterpret_cast<const value_type*>(this + 1);
 }
 
 auto managed_byte_array::data() noexcept -> value_type*
 {
-    return _data.data();
+    return reinterpret_cast<value_type*>(this + 1);
 }
 
 auto managed_byte_array::end() const noexcept -> const_iterator
 {
-    return _data.end();
+    return data() + _length;
 }
 
 auto managed_byte_array::end() noexcept -> iterator
 {
-    return _data.end();
+    return data() + _length;
 }
 
 void managed_byte_array::resize(std::size_t count)
 {
-    assert(count <= buffer_size);
-
     if (count < _length)
     {
-        std::fill_n(_data.begin() + count, _length - count, value_type{});
+        std::fill_n(data() + count, _length - count, value_type{});
     }
 
     _length = count;
@@ -83,32 +107,120 @@ std::size_t managed_byte_array::size() const noexcept
     return _length;
 }
 
-managed_byte_array_ptr array_pool::aquire()
+array_pool::~array_pool() noexcept
+{
+    for (size_class_list& list : _lists)
+    {
+        element_type* block = list.allocated_list.load();
+        while (block != nullptr)
+        {
+            element_type* next = block->allocated_list;
+            block->~element_type();
+            std::free(block);
+            block = next;
+        }
+    }
+}
+
+managed_byte_array_ptr array_pool::aquire(std::size_t size)
 {
-    // TODO: Thread safety?
-    element_type* block;
-    if (_available.empty())
+    std::size_t index = get_size_class(size);
+    size_class_list& list = _lists[index];
+
+    // Only a single thread is allowed to take from the list, so the next
+    // pointer can't be changed by someone else whilst we're reading it
+    element_type* block = list.free_list.load();
+    while ((block != nullptr) &&
+           !list.free_list.compare_exchange_weak(block, block->next))
+    {
+    }
+
+    if (block == nullptr)
     {
-        block = &_pool.emplace_back();
-        block->owner = this;
+        block = allocate_new(index);
     }
     else
     {
-        block = _available.top();
-        _available.pop();
+        list.free_count.fetch_sub(1, std::memory_order_relaxed);
     }
 
+    block->next = nullptr;
     return managed_byte_array_ptr(block);
 }
 
 std::size_t array_pool::capacity() const noexcept
 {
-    return _pool.size();
+    std::size_t count = 0;
+    for (const size_class_list& list : _lists)
+    {
+        count += list.allocated_count.load(std::memory_order_relaxed);
+    }
+
+    return count;
+}
+
+void array_pool::dump_statistics() const
+{
+    for (std::size_t i = 0; i != size_classes.size(); ++i)
+    {
+        std::size_t allocated =
+            _lists[i].allocated_count.load(std::memory_order_relaxed);
+        std::size_t free = _lists[i].free_count.load(std::memory_order_relaxed);
+        spdlog::info(
+            "Network buffers ({} bytes): {} allocated, {} in use",
+            size_classes[i],
+            allocated,
+            allocated - std::min(free, allocated));
+    }
+}
+
+void array_pool::reserve(std::size_t size, std::size_t count)
+{
+    std::size_t index = get_size_class(size);
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        release(allocate_new(index));
+    }
 }
 
 std::size_t array_pool::size() const noexcept
 {
-    return _pool.size() - _available.size();
+    std::size_t count = 0;
+    for (const size_class_list& list : _lists)
+    {
+        std::size_t allocated =
+            list.allocated_count.load(std::memory_order_relaxed);
+        std::size_t free = list.free_count.load(std::memory_order_relaxed);
+        count += allocated - std::min(free, allocated);
+    }
+
+    return count;
+}
+
+auto array_pool::allocate_new(std::size_t size_class) -> element_type*
+{
+    // The elements are stored after the block and must be zero-filled (as
+    // they would be for a managed array), hence calloc
+    std::size_t bytes = sizeof(element_type) + size_classes[size_class];
+    void* raw = std::calloc(bytes, sizeof(std::byte));
+    if (raw == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    auto* block = new (raw) element_type();
+    block->owner = this;
+    block->size_class = static_cast<std::uint32_t>(size_class);
+
+    size_class_list& list = _lists[size_class];
+    element_type* root = list.allocated_list.load();
+    do
+    {
+        block->allocated_list = root;
+    } while (!list.allocated_list.compare_exchange_weak(root, block));
+
+    list.allocated_count.fetch_add(1, std::memory_order_relaxed);
+    return block;
 }
 
 void array_pool::release(element_type* value)
@@ -116,8 +228,16 @@ void array_pool::release(element_type* value)
     assert(value != nullptr);
     assert(value->owner == this);
 
-    // TODO: Thread safety?
-    _available.push(value);
+    // Increment the count first so that it can't be decremented below zero
+    // by the block being acquired before we've counted it
+    size_class_list& list = _lists[value->size_class];
+    list.free_count.fetch_add(1, std::memory_order_relaxed);
+
+    element_type* free = list.free_list.load();
+    do
+    {
+        value->next = free;
+    } while (!list.free_list.compare_exchange_weak(free, value));
 }
 
 }
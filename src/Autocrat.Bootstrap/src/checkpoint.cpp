@@ -0,0 +1,276 @@
+#include "checkpoint.h"
+#include <stdexcept>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+// "ACRTCKPT" when viewed in a hex editor
+constexpr std::uint64_t file_magic = 0x54504B4354524341u;
+constexpr std::uint32_t file_version = 1u;
+
+struct file_header
+{
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t fingerprint;
+    std::uint64_t type_offset;
+    std::uint64_t type_count;
+    std::uint64_t entry_offset;
+    std::uint64_t entry_count;
+};
+
+struct stored_entry
+{
+    std::int64_t type;
+    std::uint64_t offset;
+    std::uint32_t size;
+    std::uint32_t id_length;
+};
+
+struct stored_type
+{
+    std::int64_t offset;
+    std::uint32_t base_size;
+    std::uint32_t component_size;
+};
+
+void read_data(std::istream& stream, void* data, std::size_t size)
+{
+    stream.read(static_cast<char*>(data), size);
+    if (!stream)
+    {
+        stream.clear();
+        throw std::runtime_error("Unable to read from the checkpoint file");
+    }
+}
+
+template <class T>
+T read_value(std::istream& stream)
+{
+    T value;
+    read_data(stream, &value, sizeof(value));
+    return value;
+}
+
+}
+
+namespace autocrat
+{
+
+checkpoint_reader::checkpoint_reader(
+    const fs::path& path,
+    const void* anchor,
+    std::uint64_t fingerprint) :
+    _file(path, std::ios_base::binary | std::ios_base::in)
+{
+    if (!_file.is_open())
+    {
+        throw std::runtime_error("Unable to open the checkpoint file");
+    }
+
+    auto header = read_value<file_header>(_file);
+    if ((header.magic != file_magic) || (header.version != file_version))
+    {
+        throw std::runtime_error("The file is not a valid checkpoint");
+    }
+
+    // The types are stored as offsets from the anchor, which are only valid
+    // if the program is the same as the one that wrote the file
+    if (header.fingerprint != fingerprint)
+    {
+        throw std::runtime_error(
+            "The checkpoint was written by a different version of the "
+            "program");
+    }
+
+    read_types(header.type_offset, header.type_count, anchor);
+    read_entries(header.entry_offset, header.entry_count);
+}
+
+auto checkpoint_reader::entries() const noexcept
+    -> const std::vector<checkpoint_entry>&
+{
+    return _entries;
+}
+
+void checkpoint_reader::read(
+    const checkpoint_location& location,
+    object_serializer& serializer)
+{
+    std::vector<std::byte> data(location.size);
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _file.seekg(location.offset);
+        read_data(_file, data.data(), data.size());
+    }
+
+    serializer.import_data(
+        data.data(), data.size(), [this](std::uint64_t id) -> const void* {
+            return (id < _types.size()) ? _types[id] : nullptr;
+        });
+}
+
+void checkpoint_reader::read_entries(std::uint64_t offset, std::uint64_t count)
+{
+    _file.seekg(offset);
+    _entries.reserve(count);
+    for (std::uint64_t i = 0; i != count; ++i)
+    {
+        auto stored = read_value<stored_entry>(_file);
+
+        checkpoint_entry& entry = _entries.emplace_back();
+        entry.type = stored.type;
+        entry.location.offset = stored.offset;
+        entry.location.size = stored.size;
+        entry.id.resize(stored.id_length);
+        read_data(_file, entry.id.data(), entry.id.size());
+    }
+}
+
+void checkpoint_reader::read_types(
+    std::uint64_t offset,
+    std::uint64_t count,
+    const void* anchor)
+{
+    _file.seekg(offset);
+    _types.reserve(count);
+    for (std::uint64_t i = 0; i != count; ++i)
+    {
+        auto stored = read_value<stored_type>(_file);
+        auto type = reinterpret_cast<const detail::managed_type*>(
+            static_cast<const std::byte*>(anchor) + stored.offset);
+
+        // Sanity check the type is the same as when it was written
+        if ((type->base_size != stored.base_size) ||
+            (type->component_size != stored.component_size))
+        {
+            throw std::runtime_error(
+                "The checkpoint types do not match the program");
+        }
+
+        _types.push_back(type);
+    }
+}
+
+checkpoint_writer::checkpoint_writer(
+    const fs::path& path,
+    const void* anchor,
+    std::uint64_t fingerprint) :
+    _path(path),
+    _temp_path(path),
+    _anchor(static_cast<const std::byte*>(anchor)),
+    _fingerprint(fingerprint)
+{
+    _temp_path += ".tmp";
+    _file.open(
+        _temp_path,
+        std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+    if (!_file.is_open())
+    {
+        throw std::runtime_error("Unable to create the checkpoint file");
+    }
+
+    // Reserve space for the header, which is written once we know where
+    // everything is
+    file_header header = {};
+    write(&header, sizeof(header));
+}
+
+checkpoint_writer::~checkpoint_writer() noexcept
+{
+    if (!_committed)
+    {
+        _file.close();
+
+        std::error_code error;
+        fs::remove(_temp_path, error);
+    }
+}
+
+void checkpoint_writer::add(
+    std::int64_t type,
+    std::string_view id,
+    const object_serializer& serializer)
+{
+    std::vector<std::byte> data = serializer.export_data(
+        [this](const void* object_type) { return get_type_id(object_type); });
+
+    checkpoint_entry& entry = _entries.emplace_back();
+    entry.type = type;
+    entry.id = id;
+    entry.location.offset = _position;
+    entry.location.size = static_cast<std::uint32_t>(data.size());
+    write(data.data(), data.size());
+}
+
+void checkpoint_writer::commit()
+{
+    file_header header = {};
+    header.magic = file_magic;
+    header.version = file_version;
+    header.fingerprint = _fingerprint;
+
+    header.type_offset = _position;
+    header.type_count = _types.size();
+    for (const void* type : _types)
+    {
+        auto managed_type = static_cast<const detail::managed_type*>(type);
+        stored_type stored = {};
+        stored.offset = static_cast<const std::byte*>(type) - _anchor;
+        stored.base_size = managed_type->base_size;
+        stored.component_size = managed_type->component_size;
+        write(&stored, sizeof(stored));
+    }
+
+    header.entry_offset = _position;
+    header.entry_count = _entries.size();
+    for (const checkpoint_entry& entry : _entries)
+    {
+        stored_entry stored = {};
+        stored.type = entry.type;
+        stored.offset = entry.location.offset;
+        stored.size = entry.location.size;
+        stored.id_length = static_cast<std::uint32_t>(entry.id.size());
+        write(&stored, sizeof(stored));
+        write(entry.id.data(), entry.id.size());
+    }
+
+    _file.seekp(0);
+    write(&header, sizeof(header));
+    _file.close();
+    if (_file.fail())
+    {
+        throw std::runtime_error("Unable to write to the checkpoint file");
+    }
+
+    fs::rename(_temp_path, _path);
+    _committed = true;
+}
+
+std::uint64_t checkpoint_writer::get_type_id(const void* type)
+{
+    auto [it, inserted] = _type_ids.try_emplace(type, _types.size());
+    if (inserted)
+    {
+        _types.push_back(type);
+    }
+
+    return it->second;
+}
+
+void checkpoint_writer::write(const void* data, std::size_t size)
+{
+    _file.write(static_cast<const char*>(data), size);
+    if (!_file)
+    {
+        throw std::runtime_error("Unable to write to the checkpoint file");
+    }
+
+    _position += size;
+}
+
+}
@@ -1,16 +1,23 @@
 #include "gc_service.h"
 #include "defines.h"
+#include "exports.h"
 #include "services.h"
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdlib>
 #include <new>
+#include <spdlog/spdlog.h>
 #include <type_traits>
+#include <utility>
 
 namespace
 {
 
+constexpr std::size_t large_object_size = 102'400u;
+constexpr std::size_t minimum_node_size = 16u * 1024u;
+
 // We need to ensure that the pool is available in our constructor and
 // destructor, but since gc_heap is a global that we can't control the lifetime
 // of, we'll manually keep track of the pool via the Nifty Counter idiom
@@ -20,6 +27,13 @@ std::atomic_size_t global_pool_count;
 std::aligned_storage<sizeof(pool_type), alignof(pool_type)>::type
     global_pool_storage;
 
+std::size_t get_large_object_threshold()
+{
+    // Make sure small objects always fit inside a node, even if the size of
+    // the nodes is reduced
+    return std::min(large_object_size, global_pool->node_size() / 4u);
+}
+
 std::size_t align_up(std::size_t value)
 {
     const std::size_t alignment = sizeof(std::max_align_t);
@@ -40,17 +54,42 @@ void initialize_global_pool()
 {
     if (global_pool_count++ == 0)
     {
-        global_pool = new (&global_pool_storage) pool_type();
+        global_pool = new (&global_pool_storage)
+            pool_type(autocrat::gc_heap::default_node_size);
     }
 }
 
+struct global_pool_reference
+{
+    global_pool_reference()
+    {
+        initialize_global_pool();
+    }
+
+    ~global_pool_reference()
+    {
+        destruct_global_pool();
+    }
+
+    global_pool_reference(const global_pool_reference&) = delete;
+    global_pool_reference& operator=(const global_pool_reference&) = delete;
+};
+
 }
 
+thread_local allocation_context managed_allocation_context = {};
+
 // The CoreRT native runtime will call this method to allocate memory
 extern "C" void* allocate_bytes(std::size_t bytes)
 {
-    return autocrat::global_services.get_service<autocrat::gc_service>()
-        ->allocate(bytes);
+    void* memory = try_allocate_bytes(bytes);
+    if (memory == nullptr)
+    {
+        memory = autocrat::global_services.get_service<autocrat::gc_service>()
+                     ->allocate_and_refill(bytes);
+    }
+
+    return memory;
 }
 
 namespace autocrat
@@ -91,12 +130,63 @@ gc_heap& gc_heap::operator=(gc_heap&& other) noexcept
     return *this;
 }
 
+void gc_heap::append(gc_heap&& other)
+{
+    assert(&other != this);
+
+    // Every heap owns at least one node, so give the other a new one
+    _tail->next = other._head;
+    _tail = other._tail;
+    other._head = global_pool->acquire();
+    other._tail = other._head;
+
+    if (other._large_objects != nullptr)
+    {
+        large_allocation* oldest = other._large_objects;
+        while (oldest->previous != nullptr)
+        {
+            oldest = oldest->previous;
+        }
+
+        oldest->previous = _large_objects;
+        _large_objects = std::exchange(other._large_objects, nullptr);
+    }
+
+    _allocated_bytes += std::exchange(other._allocated_bytes, 0);
+}
+
+auto gc_heap::get_memory_ranges() const
+    -> std::vector<std::pair<const std::byte*, const std::byte*>>
+{
+    std::vector<std::pair<const std::byte*, const std::byte*>> ranges;
+    for (const pool_type::node_type* node = _head; node != nullptr;
+         node = node->next)
+    {
+        if (node->data != node->buffer())
+        {
+            ranges.emplace_back(node->buffer(), node->data);
+        }
+    }
+
+    for (const large_allocation* allocation = _large_objects;
+         allocation != nullptr;
+         allocation = allocation->previous)
+    {
+        auto memory = reinterpret_cast<const std::byte*>(allocation + 1);
+        ranges.emplace_back(memory, memory + allocation->size);
+    }
+
+    std::sort(ranges.begin(), ranges.end());
+    return ranges;
+}
+
 void gc_heap::swap(gc_heap& other) noexcept
 {
     using std::swap;
     swap(_head, other._head);
     swap(_tail, other._tail);
     swap(_large_objects, other._large_objects);
+    swap(_allocated_bytes, other._allocated_bytes);
 }
 
 void* gc_heap::allocate_large(std::size_t size)
@@ -109,29 +199,33 @@ void* gc_heap::allocate_large(std::size_t size)
     }
 
     auto memory = static_cast<large_allocation*>(raw);
-    if (_large_objects != nullptr)
-    {
-        _large_objects->previous = memory;
-    }
-
+    memory->previous = _large_objects;
+    memory->size = size;
     _large_objects = memory;
 
     // The actual memory is after the large_allocation, hence +1
     return memory + 1;
 }
 
-std::byte* gc_heap::allocate_small(std::size_t size)
+void* gc_heap::allocate_small(std::size_t size)
 {
     size = align_up(size);
-    assert(size < pool_type::node_type::capacity);
 
-    std::size_t used = _tail->data - _tail->buffer.data();
+    std::size_t used = _tail->data - _tail->buffer();
     std::size_t available = _tail->capacity - used;
     if (available < size)
     {
         pool_type::node_type* previous = _tail;
         _tail = global_pool->acquire();
         previous->next = _tail;
+
+        // The size of the nodes can be reduced after the caller compared the
+        // object against it, so the new node may still be too small (it's
+        // kept for the allocations that follow)
+        if (size > _tail->capacity)
+        {
+            return allocate_large(size);
+        }
     }
 
     std::byte* memory = _tail->data;
@@ -174,7 +268,10 @@ gc_service::gc_service(thread_pool*)
 void* gc_service::allocate(std::size_t size)
 {
     gc_heap* storage = get_thread_storage();
-    if (size > 102'400u)
+    close_allocation_context(storage);
+    check_allocation_limits(storage, size);
+
+    if (size > get_large_object_threshold())
     {
         return storage->allocate_large(size);
     }
@@ -184,17 +281,96 @@ void* gc_service::allocate(std::size_t size)
     }
 }
 
+void* gc_service::allocate_and_refill(std::size_t size)
+{
+    void* memory = allocate(size);
+    open_allocation_context(get_thread_storage());
+    return memory;
+}
+
+void gc_service::adapt_node_size()
+{
+    const std::size_t minimum_samples = 64u;
+    if (_work_item_sizes.count() < minimum_samples)
+    {
+        return;
+    }
+
+    // Use a size that allows most work items to only use their first node
+    std::size_t size = std::clamp(
+        _work_item_sizes.percentile(90u),
+        minimum_node_size,
+        gc_heap::default_node_size);
+    _work_item_sizes.reset();
+
+    global_pool_reference reference;
+    if (size != global_pool->node_size())
+    {
+        spdlog::info("Changing managed heap node size to {} bytes", size);
+        global_pool->set_node_size(size);
+    }
+}
+
+void gc_service::dump_statistics()
+{
+    global_pool_reference reference;
+    node_pool_statistics statistics = global_pool->statistics();
+    spdlog::info(
+        "Managed heap nodes ({} bytes): {} allocated, {} free, {} in use",
+        global_pool->node_size(),
+        statistics.allocated,
+        statistics.free,
+        statistics.in_use);
+
+    spdlog::info(
+        "Managed heap peak work item allocation: {} bytes",
+        _peak_allocated_bytes.exchange(0));
+}
+
+void gc_service::enable_adaptive_node_size()
+{
+    _adaptive_node_size = true;
+}
+
+void gc_service::reserve(std::size_t count)
+{
+    // The pool is only kept alive whilst there are heaps using it
+    global_pool_reference reference;
+    global_pool->reserve(count);
+}
+
 gc_heap gc_service::reset_heap()
 {
     gc_heap* storage = get_thread_storage();
+    close_allocation_context(storage);
     gc_heap current(std::move(*storage));
     *storage = gc_heap();
     return current;
 }
 
+void gc_service::set_allocation_limits(std::size_t soft, std::size_t hard)
+{
+    _soft_limit = soft;
+    _hard_limit = hard;
+}
+
 void gc_service::set_heap(gc_heap&& heap)
 {
-    *get_thread_storage() = std::move(heap);
+    gc_heap* storage = get_thread_storage();
+    close_allocation_context(storage);
+    *storage = std::move(heap);
+}
+
+void gc_service::set_node_size(std::size_t size)
+{
+    global_pool_reference reference;
+    global_pool->set_node_size(std::max(size, minimum_node_size));
+}
+
+std::size_t gc_service::trim(std::size_t low, std::size_t high)
+{
+    global_pool_reference reference;
+    return global_pool->trim(low, high);
 }
 
 void gc_service::on_begin_work(gc_heap*)
@@ -203,8 +379,100 @@ void gc_service::on_begin_work(gc_heap*)
 
 void gc_service::on_end_work(gc_heap* heap)
 {
+    close_allocation_context(heap);
+    std::size_t allocated = heap->_allocated_bytes;
+    std::size_t peak = _peak_allocated_bytes.load(std::memory_order_relaxed);
+    while ((allocated > peak) &&
+           !_peak_allocated_bytes.compare_exchange_weak(peak, allocated))
+    {
+    }
+
+    if (_adaptive_node_size)
+    {
+        _work_item_sizes.record(allocated);
+    }
+
     heap->free_large();
     heap->free_small();
+    heap->_allocated_bytes = 0;
+
+    // Swap the first node if the node size has changed so that the next
+    // work item starts with a node of the new size
+    if (heap->_head->capacity != global_pool->node_size())
+    {
+        global_pool->release(heap->_head);
+        heap->_head = global_pool->acquire();
+        heap->_tail = heap->_head;
+    }
+}
+
+void gc_service::check_allocation_limits(gc_heap* heap, std::size_t size)
+{
+    std::size_t previous = heap->_allocated_bytes;
+    std::size_t current = previous + size;
+    if ((_hard_limit > 0) && (current > _hard_limit))
+    {
+        spdlog::critical(
+            "Work item allocating {} bytes exceeded the hard limit of {} "
+            "bytes ({} bytes already allocated)",
+            size,
+            _hard_limit,
+            previous);
+        throw std::bad_alloc();
+    }
+
+    // Only log the first time the limit is crossed by the work item
+    if ((_soft_limit > 0) && (previous <= _soft_limit) &&
+        (current > _soft_limit))
+    {
+        spdlog::warn(
+            "Work item has allocated {} bytes, exceeding the soft limit of "
+            "{} bytes",
+            current,
+            _soft_limit);
+    }
+
+    heap->_allocated_bytes = current;
+}
+
+void gc_service::close_allocation_context(gc_heap* heap)
+{
+    allocation_context& context = managed_allocation_context;
+    if (context.pointer == nullptr)
+    {
+        return;
+    }
+
+    // Give back the unused memory and count what was allocated from it
+    pool_type::node_type* tail = heap->_tail;
+    assert((context.pointer >= tail->data) &&
+           (context.pointer <= (tail->buffer() + tail->capacity)));
+    heap->_allocated_bytes += context.pointer - tail->data;
+    tail->data = context.pointer;
+    context = {};
+}
+
+void gc_service::open_allocation_context(gc_heap* heap)
+{
+    pool_type::node_type* tail = heap->_tail;
+    std::size_t used = tail->data - tail->buffer();
+    std::size_t available = tail->capacity - used;
+
+    // The limits are only checked when calling into the service, so don't
+    // allow the context to be used to go past them
+    std::size_t allocated = heap->_allocated_bytes;
+    if (_hard_limit > 0)
+    {
+        available = std::min(available, _hard_limit - allocated);
+    }
+
+    if ((_soft_limit > 0) && (allocated <= _soft_limit))
+    {
+        available = std::min(available, _soft_limit - allocated);
+    }
+
+    managed_allocation_context = {
+        tail->data, tail->data + available, get_large_object_threshold()};
 }
 
 }
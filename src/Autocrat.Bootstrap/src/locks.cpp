@@ -41,6 +41,11 @@ bool exclusive_lock::try_lock()
     }
 }
 
+bool exclusive_lock::is_locked() const noexcept
+{
+    return _owner_id.load(std::memory_order_relaxed) != unlocked;
+}
+
 void exclusive_lock::unlock()
 {
     assert(_lock_count > 0);
@@ -1,10 +1,15 @@
 #include "managed_interop.h"
-#include "collections.h"
 #include "services.h"
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdint>
-#include <spdlog/spdlog.h>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace
 {
@@ -16,36 +21,178 @@ struct gc_header
 };
 static_assert(sizeof(gc_header) == 8u);
 
+// Objects that have been saved by the serializer have the bottom bit of
+// their type set (it's never set for a real type, as they are aligned)
+constexpr std::uintptr_t saved_bit = 0x01;
+
 // Note that we don't need this to be thread safe - it's OK if two threads
 // use the same value, as they won't be scanning the same area of managed
 // memory and, therefore, can't mark another threads object as scanned.
 std::uint32_t scan_counter = 0u;
 
+std::uint64_t hash_words(const std::byte* data, std::size_t size)
+{
+    // The saved objects are padded to be pointer aligned, so we can process
+    // the data a word at a time (this is based on the MurmurHash3 mixing)
+    assert((size % sizeof(std::uint64_t)) == 0);
+    std::uint64_t hash = size;
+    for (std::size_t i = 0; i != size; i += sizeof(std::uint64_t))
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        word *= 0x87c37b91114253d5u;
+        word = (word << 31u) | (word >> 33u);
+        word *= 0x4cf5ad432745937fu;
+
+        hash ^= word;
+        hash = (hash << 27u) | (hash >> 37u);
+        hash = (hash * 5u) + 0x52dce729u;
+    }
+
+    return hash;
 }
 
-namespace autocrat::detail
+// The saved objects are mostly zero words (padding and unset fields), words
+// seen a short while ago (type pointers and common values) and small values
+// (lengths and the offsets that replaced the references), so each word is
+// given a two bit tag, with the tags for four words stored in the byte in
+// front of their data
+enum word_tag : unsigned
 {
+    zero_word = 0u,
+    recent_word = 1u,
+    small_word = 2u,
+    literal_word = 3u,
+};
+
+constexpr std::size_t words_per_tag_byte = 4u;
+using recent_words = std::array<std::uint64_t, 256u>;
 
-// Object
-struct managed_object
+std::size_t get_recent_index(std::uint64_t word)
 {
-    managed_type* type;
-};
+    return static_cast<std::size_t>((word * 0x9E3779B97F4A7C15u) >> 56u);
+}
 
-// Array
-struct managed_array : managed_object
+std::vector<std::byte> compress_words(const std::byte* data, std::size_t size)
 {
-    std::uint32_t length;
-};
+    assert((size % sizeof(std::uint64_t)) == 0);
+    recent_words recent = {};
+    std::vector<std::byte> output;
+    output.reserve(size / 2u);
+
+    std::size_t tag_position = 0;
+    std::size_t count = size / sizeof(std::uint64_t);
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        std::size_t slot = i % words_per_tag_byte;
+        if (slot == 0)
+        {
+            tag_position = output.size();
+            output.push_back(std::byte{});
+        }
+
+        std::uint64_t word;
+        std::memcpy(&word, data + (i * sizeof(word)), sizeof(word));
 
-// EEType
-struct managed_type
+        word_tag tag = zero_word;
+        if (word != 0)
+        {
+            std::size_t index = get_recent_index(word);
+            if (recent[index] == word)
+            {
+                tag = recent_word;
+                output.push_back(static_cast<std::byte>(index));
+            }
+            else if (word <= std::numeric_limits<std::uint32_t>::max())
+            {
+                tag = small_word;
+                recent[index] = word;
+                auto small = static_cast<std::uint32_t>(word);
+                auto bytes = reinterpret_cast<const std::byte*>(&small);
+                output.insert(output.end(), bytes, bytes + sizeof(small));
+            }
+            else
+            {
+                tag = literal_word;
+                recent[index] = word;
+                auto bytes = reinterpret_cast<const std::byte*>(&word);
+                output.insert(output.end(), bytes, bytes + sizeof(word));
+            }
+        }
+
+        output[tag_position] |= static_cast<std::byte>(tag << (slot * 2u));
+    }
+
+    return output;
+}
+
+void decompress_words(
+    const std::byte* input,
+    std::size_t input_size,
+    std::byte* output,
+    std::size_t output_size)
+{
+    recent_words recent = {};
+    const std::byte* end = input + input_size;
+    auto read = [&](void* destination, std::size_t size) {
+        if (static_cast<std::size_t>(end - input) < size)
+        {
+            throw std::runtime_error("The compressed data is incomplete");
+        }
+
+        std::memcpy(destination, input, size);
+        input += size;
+    };
+
+    unsigned tags = 0;
+    std::size_t count = output_size / sizeof(std::uint64_t);
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        std::size_t slot = i % words_per_tag_byte;
+        if (slot == 0)
+        {
+            std::uint8_t tag_byte;
+            read(&tag_byte, sizeof(tag_byte));
+            tags = tag_byte;
+        }
+
+        std::uint64_t word = 0;
+        switch ((tags >> (slot * 2u)) & 3u)
+        {
+        case recent_word:
+        {
+            std::uint8_t index;
+            read(&index, sizeof(index));
+            word = recent[index];
+            break;
+        }
+
+        case small_word:
+        {
+            std::uint32_t small;
+            read(&small, sizeof(small));
+            word = small;
+            recent[get_recent_index(word)] = word;
+            break;
+        }
+
+        case literal_word:
+            read(&word, sizeof(word));
+            recent[get_recent_index(word)] = word;
+            break;
+
+        default:
+            break;
+        }
+
+        std::memcpy(output + (i * sizeof(word)), &word, sizeof(word));
+    }
+}
+
+}
+
+namespace autocrat::detail
 {
-    std::uint16_t component_size;
-    std::uint16_t flags;
-    std::uint32_t base_size;
-    managed_type* base_type;
-};
 
 // CGCDescSeries
 struct block_layout
@@ -66,43 +213,16 @@ bool has_reference_fields(const managed_type* type)
     return (type->flags & has_pointers_flag) != 0;
 }
 
-void* reference_scanner::move(void* root)
+type_layout create_type_layout(const managed_type* type)
 {
-    if (root == nullptr)
-    {
-        return nullptr;
-    }
-
-    std::optional<void*> moved_object = get_moved_location(root);
-    if (moved_object)
-    {
-        return *moved_object;
-    }
-
-    auto object = static_cast<managed_object*>(root);
-    const managed_type* type = object->type;
-    std::size_t bytes = type->base_size;
-    if (type->component_size > 0)
+    type_layout layout;
+    layout.base_size = type->base_size;
+    layout.component_size = type->component_size;
+    if (!has_reference_fields(type))
     {
-        auto array = static_cast<const managed_array*>(object);
-        bytes += static_cast<std::size_t>(type->component_size) * array->length;
+        return layout;
     }
 
-    void* moved = move_object(object, bytes);
-    set_moved_location(object, moved);
-    if (has_reference_fields(type))
-    {
-        scan(object, moved, type);
-    }
-
-    return moved;
-}
-
-void reference_scanner::scan(
-    managed_object* object,
-    void* copy,
-    const managed_type* type)
-{
     // The layout of the references in a type goes backwards from the top
     // of the type information:
     //
@@ -120,7 +240,12 @@ void reference_scanner::scan(
     {
         std::size_t count =
             (type->base_size + block->series_size) / sizeof(void*);
-        scan_references(object, copy, block->start_offset, count);
+        for (std::size_t j = 0; j != count; ++j)
+        {
+            std::size_t offset = block->start_offset + (j * sizeof(void*));
+            layout.offsets.push_back(static_cast<std::uint32_t>(offset));
+        }
+
         --block;
     }
 
@@ -128,182 +253,331 @@ void reference_scanner::scan(
     if (type->component_size > 0)
     {
         assert(type->component_size == sizeof(void*));
-        std::size_t elements = static_cast<managed_array*>(object)->length;
-        scan_references(object, copy, sizeof(managed_array), elements);
+        layout.reference_array = true;
     }
+
+    return layout;
 }
 
-void reference_scanner::scan_references(
-    void* object,
-    void* copy,
-    std::size_t offset,
-    std::size_t count)
+class type_layout_cache
 {
-    while (count-- > 0)
+public:
+    const type_layout& get(const managed_type* type)
     {
-        void* instance = get_reference(object, offset);
-        void* new_reference = move(instance);
-        set_reference(copy, offset, new_reference);
+        // Objects in a graph tend to be of the same type as the previous
+        // one (e.g. linked lists), so avoid the lookup for those
+        if (type != _last_type)
+        {
+            auto [it, inserted] = _layouts.try_emplace(type);
+            if (inserted)
+            {
+                it->second = create_type_layout(type);
+            }
+
+            _last_type = type;
+            _last_layout = &it->second;
+        }
 
-        offset += sizeof(void*);
+        return *_last_layout;
     }
+
+private:
+    std::unordered_map<const managed_type*, type_layout> _layouts;
+    const managed_type* _last_type = nullptr;
+    const type_layout* _last_layout = nullptr;
+};
+
+// The types don't change once the program is running, so each thread can
+// build its own cache to avoid synchronization
+thread_local type_layout_cache layout_cache;
+
+const type_layout& get_type_layout(const managed_type* type)
+{
+    return layout_cache.get(type);
+}
+
+std::size_t get_stored_size(std::size_t object_size)
+{
+    // Objects are padded when saved so that every object inside the buffer
+    // starts pointer aligned
+    const std::size_t mask = sizeof(void*) - 1u;
+    return (object_size + mask) & ~mask;
+}
+
+void** get_field(void* object, std::size_t offset)
+{
+    void* address_of_field = static_cast<std::byte*>(object) + offset;
+    return static_cast<void**>(address_of_field);
 }
 
-template <class Storage>
-class deserializer : private reference_scanner
+/**
+ * Restores the objects written by the `serializer` class.
+ * @remarks The objects are stored one after another, with each reference
+ *          field holding the offset (plus one, so that zero is null) of the
+ *          object it points to. This allows the references to be fixed in a
+ *          single pass over the buffer, without tracking visited objects.
+ */
+class deserializer
 {
 public:
-    template <class... Args>
-    explicit deserializer(std::byte* data, Args&&... storage_args) :
+    deserializer(std::byte* data, std::size_t size) :
         _data(data),
-        _moved_objects(std::forward<Args>(storage_args)...)
+        _size(size)
     {
     }
 
     void* restore()
     {
-        return move(_data);
+        std::size_t position = 0;
+        while (position < _size)
+        {
+            auto object = reinterpret_cast<managed_object*>(_data + position);
+            const type_layout& layout = get_type_layout(object->type);
+            if (layout.has_references())
+            {
+                for_each_reference(object, layout, [&](std::size_t offset) {
+                    fix_reference(get_field(object, offset));
+                });
+            }
+
+            position += get_stored_size(get_object_size(object, layout));
+        }
+
+        return _data;
     }
 
-protected:
-    std::optional<void*> get_moved_location(void* object) override
+private:
+    void fix_reference(void** field)
     {
-        auto it = _moved_objects.find(object);
-        if (it == _moved_objects.end())
+        auto offset = reinterpret_cast<std::size_t>(*field);
+        if (offset != 0)
         {
-            return std::nullopt;
-        }
-        else
-        {
-            return it->second;
+            assert(offset <= _size);
+            *field = _data + (offset - 1u);
         }
     }
 
-    void* get_reference(void* object, std::size_t offset) override
+    std::byte* _data;
+    std::size_t _size;
+};
+
+/**
+ * Writes an object graph to a buffer.
+ * @remarks The objects are written in breadth-first order, with the offset
+ *          of an object being assigned when it is first found. Since that
+ *          is before any object referencing it is written, the references
+ *          can be written as offsets in a single forward pass, without
+ *          having to go back and patch the buffer.
+ */
+class serializer
+{
+public:
+    explicit serializer(memory_pool_buffer& buffer) :
+        _buffer(&buffer)
     {
-        std::ptrdiff_t reference_offset = *reinterpret_cast<std::ptrdiff_t*>(
-            static_cast<std::byte*>(object) + offset);
+    }
 
-        // See comments in serializer::set_reference
-        if (reference_offset < 0)
+    std::size_t save(void* object)
+    {
+        if (object != nullptr)
         {
-            return nullptr;
+            add_object(static_cast<managed_object*>(object));
         }
-        else
+
+        // Note that writing an object may add more pending objects, which
+        // can reallocate the storage, so we can't keep references into it
+        for (std::size_t i = 0; i != _pending.size(); ++i)
         {
-            return _data + reference_offset;
+            if ((i + prefetch_distance) < _pending.size())
+            {
+                prefetch(_pending[i + prefetch_distance].object);
+            }
+
+            pending_object pending = _pending[i];
+            write_object(pending);
         }
+
+        return _pending.size();
     }
 
-    void* move_object(void* object, std::size_t) override
+private:
+    static constexpr std::size_t prefetch_distance = 4u;
+
+    struct pending_object
     {
-        return object;
-    }
+        managed_object* object;
+        managed_type* type;
+        const type_layout* layout;
+        std::size_t size;
+    };
 
-    void set_moved_location(void* object, void* new_location) override
+    std::size_t add_object(managed_object* object)
     {
-        _moved_objects.emplace(object, new_location);
+        // We store the offset inside the object (every object contains a
+        // pointer to its type), using the last bit of the pointer to know
+        // if it's the offset or the normal type. The offset has one added
+        // to it so that zero can be used for null.
+        auto type = reinterpret_cast<std::uintptr_t>(object->type);
+        if ((type & saved_bit) != 0)
+        {
+            return type >> 1u;
+        }
+
+        const type_layout& layout = get_type_layout(object->type);
+        std::size_t size = get_object_size(object, layout);
+        std::size_t offset = _next_offset + 1u;
+        _pending.push_back({object, object->type, &layout, size});
+        _next_offset += get_stored_size(size);
+
+        object->type = reinterpret_cast<managed_type*>(
+            (offset << 1u) | saved_bit);
+        return offset;
     }
 
-    void set_reference(void* object, std::size_t offset, void* reference)
-        override
+    void write_object(const pending_object& pending)
     {
-        void* field_address = static_cast<std::byte*>(object) + offset;
-        *static_cast<void**>(field_address) = reference;
+        managed_object* object = pending.object;
+        if (pending.layout->has_references())
+        {
+            // The object is not used after it has been saved, so we can
+            // replace the references with their offsets in place and then
+            // copy the whole object in one go
+            const type_layout& layout = *pending.layout;
+            for_each_reference(object, layout, [&](std::size_t offset) {
+                void** field = get_field(object, offset);
+                if (*field != nullptr)
+                {
+                    std::size_t reference =
+                        add_object(static_cast<managed_object*>(*field));
+                    *field = reinterpret_cast<void*>(reference);
+                }
+            });
+        }
+
+        static constexpr std::byte padding[sizeof(void*)] = {};
+        auto bytes = reinterpret_cast<std::byte*>(object);
+        _buffer->append(
+            reinterpret_cast<const std::byte*>(&pending.type),
+            sizeof(managed_type*));
+        _buffer->append(
+            bytes + sizeof(managed_type*),
+            pending.size - sizeof(managed_type*));
+        _buffer->append(
+            padding,
+            get_stored_size(pending.size) - pending.size);
     }
 
-private:
-    std::byte* _data;
-    Storage _moved_objects;
+    memory_pool_buffer* _buffer;
+    std::size_t _next_offset = 0;
+    std::vector<pending_object> _pending;
 };
 
-class serializer : private reference_scanner
+/**
+ * Moves the objects reachable from a root into an `object_arena`.
+ * @remarks Objects already inside the arena are left in place (unless
+ *          everything is being copied), however, their references are still
+ *          scanned, as they may have been changed to point to new objects.
+ *          They are marked as visited by writing the epoch into their GC
+ *          header, so only the objects copied into the arena need to be
+ *          tracked in a table.
+ */
+class evacuator : public reference_scanner<evacuator>
 {
 public:
-    explicit serializer(memory_pool_buffer& buffer) :
-        _buffer(&buffer),
-        _objects(0)
+    evacuator(object_arena& arena, bool copy_all, std::uint32_t epoch) :
+        _arena(&arena),
+        _copy_all(copy_all),
+        _epoch(epoch)
     {
     }
 
-    [[nodiscard]] std::size_t moved_objects() const noexcept
+    [[nodiscard]] std::size_t live_bytes() const noexcept
     {
-        return _objects;
+        return _live_bytes;
     }
 
-    void save(void* object)
+private:
+    friend reference_scanner<evacuator>;
+
+    static gc_header& get_header(void* object) noexcept
     {
-        move(object);
+        // The arena leaves space before each object for its GC header
+        return static_cast<gc_header*>(object)[-1];
     }
 
-protected:
-    static constexpr std::uintptr_t moved_bit = 0x01;
-    static constexpr std::uintptr_t moved_mask = ~moved_bit;
-
-    std::optional<void*> get_moved_location(void* object) override
+    std::optional<void*> get_moved_location(void* object)
     {
-        // We store the moved location inside the object (every object
-        // contains a pointer to its type), using the last bit of the
-        // pointer to know if it's the location or the normal type.
-        auto type = reinterpret_cast<std::uintptr_t>(
-            static_cast<managed_object*>(object)->type);
-        if ((type & moved_bit) == 0)
+        if (!_copy_all && _arena->contains(object))
+        {
+            if (get_header(object).padding == _epoch)
+            {
+                return object;
+            }
+            else
+            {
+                return std::nullopt;
+            }
+        }
+
+        // We can't mark the objects outside of the arena, as they could
+        // belong to another worker that is still in use
+        auto it = _moved_objects.find(object);
+        if (it == _moved_objects.end())
         {
             return std::nullopt;
         }
         else
         {
-            return reinterpret_cast<void*>(type & moved_mask);
+            return it->second;
         }
     }
 
-    void* get_reference(void* object, std::size_t offset) override
+    void* get_reference(void* object, std::size_t offset)
     {
-        void* address_of_field = static_cast<std::byte*>(object) + offset;
-        return *static_cast<void**>(address_of_field);
+        return *get_field(object, offset);
     }
 
-    void* move_object(void* object, std::size_t size) override
+    void* move_object(void* object, std::size_t size)
     {
-        ++_objects;
+        std::size_t stored_size = get_stored_size(size);
+        _live_bytes += stored_size;
+        if (!_copy_all && _arena->contains(object))
+        {
+            return object;
+        }
 
-        // Add one to the offset so that we can tell the difference between
-        // null and a reference to this instance (which would have an
-        // offset of zero)
-        std::size_t offset = _buffer->size() + 1u;
-        _buffer->append(static_cast<std::byte*>(object), size);
-        return reinterpret_cast<void*>(offset);
+        // The header of the copy holds whatever was copied after the
+        // previous object, so it's marked to stop a later save finding a
+        // value that matches its epoch
+        std::byte* copy = _arena->allocate(stored_size);
+        std::copy_n(static_cast<std::byte*>(object), size, copy);
+        std::fill(copy + size, copy + stored_size, std::byte{});
+        get_header(copy).padding = _epoch;
+        return copy;
     }
 
-    void set_moved_location(void* object, void* new_location) override
+    void set_moved_location(void* object, void* new_location)
     {
-        auto pointer =
-            reinterpret_cast<std::uintptr_t>(new_location) | moved_bit;
-        static_cast<managed_object*>(object)->type =
-            reinterpret_cast<autocrat::detail::managed_type*>(pointer);
+        if (object == new_location)
+        {
+            get_header(object).padding = _epoch;
+        }
+        else
+        {
+            _moved_objects.emplace(object, new_location);
+        }
     }
 
     void set_reference(void* object, std::size_t offset, void* reference)
-        override
     {
-        // move_object adds one to the offset to distinguish between the
-        // root object and null. This has the side effect that nulls will
-        // be stored as a negative index, which help the deserializer
-        std::ptrdiff_t value = reinterpret_cast<std::ptrdiff_t>(reference) - 1;
-
-        // object is the value returned by move_object, which in our case
-        // is the index (+1) to where we started writing the object
-        auto index = reinterpret_cast<std::size_t>(object) - 1u;
-        _buffer->replace(
-            index + offset,
-            reinterpret_cast<std::byte*>(&value),
-            sizeof(std::ptrdiff_t));
+        *get_field(object, offset) = reference;
     }
 
-private:
-    static_assert(sizeof(std::ptrdiff_t) <= sizeof(void*));
-    memory_pool_buffer* _buffer;
-    std::size_t _objects;
+    object_arena* _arena;
+    bool _copy_all;
+    std::uint32_t _epoch;
+    std::size_t _live_bytes = 0;
+    std::unordered_map<void*, void*> _moved_objects;
 };
 
 }
@@ -311,6 +585,173 @@ private:
 namespace autocrat
 {
 
+object_arena::~object_arena() noexcept
+{
+    free_blocks();
+}
+
+std::size_t object_arena::allocated_bytes() const noexcept
+{
+    return _allocated_bytes;
+}
+
+std::size_t object_arena::live_bytes() const noexcept
+{
+    return _live_bytes;
+}
+
+void* object_arena::save(void* object, std::size_t garbage_percentage)
+{
+    if (object == nullptr)
+    {
+        return nullptr;
+    }
+
+    ++_epoch;
+    detail::evacuator evacuator(*this, false, _epoch);
+    void* root = evacuator.move(object);
+    _live_bytes = evacuator.live_bytes();
+
+    std::size_t garbage = _allocated_bytes - _live_bytes;
+    if ((garbage * 100u) > (_live_bytes * garbage_percentage))
+    {
+        root = compact(root);
+    }
+
+    return root;
+}
+
+void object_arena::add_block(std::size_t capacity)
+{
+    // The objects are stored after the block, with space before the first
+    // object for its GC header
+    void* raw = ::operator new(sizeof(block) + sizeof(gc_header) + capacity);
+    auto new_block = static_cast<block*>(raw);
+    new_block->next = _blocks;
+    new_block->capacity = capacity;
+    new_block->used = 0;
+    _blocks = new_block;
+}
+
+std::byte* object_arena::allocate(std::size_t size)
+{
+    if ((_blocks == nullptr) || ((_blocks->capacity - _blocks->used) < size))
+    {
+        const std::size_t minimum_block_size = 1024u;
+        add_block(std::max({size, minimum_block_size, _allocated_bytes / 2u}));
+    }
+
+    auto data = reinterpret_cast<std::byte*>(_blocks + 1) + sizeof(gc_header);
+    std::byte* memory = data + _blocks->used;
+    _blocks->used += size;
+    _allocated_bytes += size;
+    return memory;
+}
+
+void* object_arena::compact(void* root)
+{
+    // Store the live objects in a single block
+    object_arena compacted;
+    compacted.add_block(_live_bytes);
+    detail::evacuator evacuator(compacted, true, _epoch);
+    root = evacuator.move(root);
+
+    std::swap(_blocks, compacted._blocks);
+    std::swap(_allocated_bytes, compacted._allocated_bytes);
+    _live_bytes = evacuator.live_bytes();
+    return root;
+}
+
+bool object_arena::contains(const void* address) const noexcept
+{
+    auto bytes = static_cast<const std::byte*>(address);
+    for (const block* current = _blocks; current != nullptr;
+         current = current->next)
+    {
+        auto data = reinterpret_cast<const std::byte*>(current + 1) +
+                    sizeof(gc_header);
+        if ((bytes >= data) && (bytes < (data + current->used)))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void object_arena::free_blocks() noexcept
+{
+    block* current = _blocks;
+    while (current != nullptr)
+    {
+        block* next = current->next;
+        ::operator delete(current);
+        current = next;
+    }
+
+    _blocks = nullptr;
+}
+
+void* object_evacuator::evacuate(void* object)
+{
+    return move(object);
+}
+
+std::optional<void*> object_evacuator::get_moved_location(void* object)
+{
+    // The objects of saved workers have their type replaced, so can't be
+    // followed (the worker objects themselves are found by on_field)
+    auto type = reinterpret_cast<std::uintptr_t>(
+        static_cast<detail::managed_object*>(object)->type);
+    if (((type & saved_bit) != 0) || !should_copy(object))
+    {
+        return object;
+    }
+
+    auto it = _moved_objects.find(object);
+    if (it == _moved_objects.end())
+    {
+        return std::nullopt;
+    }
+    else
+    {
+        return it->second;
+    }
+}
+
+void* object_evacuator::get_reference(void* object, std::size_t offset)
+{
+    return *detail::get_field(object, offset);
+}
+
+void* object_evacuator::move_object(void* object, std::size_t size)
+{
+    std::size_t stored_size = detail::get_stored_size(size);
+    auto* gc = global_services.get_service<gc_service>();
+    auto copy = static_cast<std::byte*>(gc->allocate(stored_size));
+    std::copy_n(static_cast<std::byte*>(object), size, copy);
+    std::fill(copy + size, copy + stored_size, std::byte{});
+    return copy;
+}
+
+void object_evacuator::set_moved_location(void* object, void* new_location)
+{
+    _moved_objects.emplace(object, new_location);
+}
+
+void object_evacuator::set_reference(
+    void* object,
+    std::size_t offset,
+    void* reference)
+{
+    void** field = detail::get_field(object, offset);
+    *field = reference;
+    if (reference != nullptr)
+    {
+        on_field(field);
+    }
+}
+
 void object_scanner::scan(void* object)
 {
     // We increase the scan counter by 2 each time so that we can always
@@ -366,36 +807,204 @@ void object_scanner::set_reference(void*, std::size_t, void*)
 {
 }
 
-void* object_serializer::restore()
+bool object_serializer::compress()
 {
-    std::size_t size = _buffer.size();
-    auto* gc = global_services.get_service<gc_service>();
+    if (_compressed || (_buffer.size() == 0))
+    {
+        return false;
+    }
 
-    void* object = gc->allocate(size);
-    auto buffer = static_cast<std::byte*>(object);
-    _buffer.move_to(buffer, size);
+    std::vector<std::byte> data(_buffer.size());
+    _buffer.copy_to(data.data(), data.size());
+    std::vector<std::byte> compressed =
+        compress_words(data.data(), data.size());
+    if (compressed.size() >= data.size())
+    {
+        return false;
+    }
 
-    using fixed_hash = fixed_hashmap<void*, void*>;
-    if (_references <= fixed_hash::maximum_capacity)
+    _buffer.clear();
+    _buffer.append(compressed.data(), compressed.size());
+    _uncompressed_size = data.size();
+    _compressed = true;
+    return true;
+}
+
+std::vector<std::byte> object_serializer::export_data(
+    const std::function<std::uint64_t(const void*)>& get_type_id) const
+{
+    std::vector<std::byte> data = read_data();
+
+    std::size_t position = 0;
+    while (position < data.size())
     {
-        detail::deserializer<fixed_hash> d(buffer);
-        return d.restore();
+        auto object = reinterpret_cast<detail::managed_object*>(
+            data.data() + position);
+        const detail::type_layout& layout =
+            detail::get_type_layout(object->type);
+        position +=
+            detail::get_stored_size(detail::get_object_size(object, layout));
+
+        std::uint64_t id = get_type_id(object->type);
+        std::memcpy(&object->type, &id, sizeof(id));
+    }
+
+    return data;
+}
+
+void object_serializer::import_data(
+    std::byte* data,
+    std::size_t size,
+    const std::function<const void*(std::uint64_t)>& get_type)
+{
+    std::size_t count = 0;
+    std::size_t position = 0;
+    for (; position < size; ++count)
+    {
+        auto object = reinterpret_cast<detail::managed_object*>(
+            data + position);
+        std::uint64_t id;
+        std::memcpy(&id, &object->type, sizeof(id));
+
+        auto type = static_cast<const detail::managed_type*>(get_type(id));
+        if (type == nullptr)
+        {
+            throw std::runtime_error("Unknown type inside the worker data");
+        }
+
+        object->type = const_cast<detail::managed_type*>(type);
+        const detail::type_layout& layout = detail::get_type_layout(type);
+        position +=
+            detail::get_stored_size(detail::get_object_size(object, layout));
+    }
+
+    if (position != size)
+    {
+        throw std::runtime_error("The worker data is incomplete");
+    }
+
+    _restored = nullptr;
+    _compressed = false;
+    _object_count = count;
+    _buffer.clear();
+    _buffer.append(data, size);
+}
+
+bool object_serializer::is_compressed() const noexcept
+{
+    return _compressed;
+}
+
+bool object_serializer::keep_if_unchanged(const void* object)
+{
+    std::byte* restored = std::exchange(_restored, nullptr);
+    return (restored != nullptr) && (restored == object) &&
+           (hash_words(restored, uncompressed_size()) == _restored_hash);
+}
+
+std::size_t object_serializer::object_count() const noexcept
+{
+    return _object_count;
+}
+
+void* object_serializer::restore()
+{
+    std::size_t size = uncompressed_size();
+    if (size == 0)
+    {
+        return nullptr;
+    }
+
+    auto* gc = global_services.get_service<gc_service>();
+    auto buffer = static_cast<std::byte*>(gc->allocate(size));
+    if (_compressed)
+    {
+        std::vector<std::byte> compressed(_buffer.size());
+        _buffer.copy_to(compressed.data(), compressed.size());
+        decompress_words(compressed.data(), compressed.size(), buffer, size);
     }
     else
     {
-        spdlog::debug("Warning: Large object graph serialized, this could "
-                      "affect performance.");
-        detail::deserializer<std::unordered_map<void*, void*>> d(
-            buffer, _references);
-        return d.restore();
+        _buffer.copy_to(buffer, size);
     }
+
+    detail::deserializer d(buffer, size);
+    void* object = d.restore();
+
+    // Since the references are restored as pointers into the buffer, if
+    // none of the bytes have changed then the object graph hasn't changed
+    _restored = buffer;
+    _restored_hash = hash_words(buffer, size);
+    return object;
 }
 
-void object_serializer::save(void* object)
+bool object_serializer::save(void* object)
 {
+    if (keep_if_unchanged(object))
+    {
+        return false;
+    }
+
+    _compressed = false;
+    _buffer.clear();
     detail::serializer s(_buffer);
-    s.save(object);
-    _references = s.moved_objects();
+    _object_count = s.save(object);
+    return true;
+}
+
+std::size_t object_serializer::size() const noexcept
+{
+    return _buffer.size();
+}
+
+spill_location object_serializer::spill(spill_store& store)
+{
+    assert(_restored == nullptr);
+    std::vector<std::byte> data(_buffer.size());
+    _buffer.copy_to(data.data(), data.size());
+
+    // Only free the memory once it's safely written
+    spill_location location = store.write(data.data(), data.size());
+    location.compressed = _compressed;
+    location.uncompressed_size = static_cast<std::uint32_t>(_uncompressed_size);
+    _buffer.clear();
+    return location;
+}
+
+void object_serializer::unspill(
+    spill_store& store,
+    const spill_location& location)
+{
+    std::vector<std::byte> data(location.size);
+    store.read(location, data.data());
+
+    _buffer.clear();
+    _buffer.append(data.data(), data.size());
+    _compressed = location.compressed;
+    _uncompressed_size = location.uncompressed_size;
+}
+
+std::size_t object_serializer::uncompressed_size() const noexcept
+{
+    return _compressed ? _uncompressed_size : _buffer.size();
+}
+
+std::vector<std::byte> object_serializer::read_data() const
+{
+    std::vector<std::byte> data(uncompressed_size());
+    if (_compressed)
+    {
+        std::vector<std::byte> compressed(_buffer.size());
+        _buffer.copy_to(compressed.data(), compressed.size());
+        decompress_words(
+            compressed.data(), compressed.size(), data.data(), data.size());
+    }
+    else
+    {
+        _buffer.copy_to(data.data(), data.size());
+    }
+
+    return data;
 }
 
 }
@@ -2,24 +2,346 @@
 #include "defines.h"
 #include <algorithm>
 #include <cassert>
+#include <limits>
+#include <new>
+#include <spdlog/spdlog.h>
 
 namespace
 {
 
-autocrat::memory_pool_buffer::pool_type global_pool;
+constexpr std::size_t minimum_node_size = 64u;
+constexpr std::size_t maximum_node_size = 64u * 1024u;
+
+autocrat::memory_pool_buffer::pool_type global_pool(
+    autocrat::memory_pool_buffer::default_node_size);
+autocrat::size_histogram buffer_sizes;
+bool record_buffer_sizes = false;
+
+std::size_t get_bucket(std::size_t size)
+{
+    std::size_t bucket = 0;
+    std::size_t upper = 1;
+    while (upper < size)
+    {
+        upper <<= 1u;
+        ++bucket;
+    }
+
+    return bucket;
+}
 
 }
 
 namespace autocrat
 {
 
-memory_pool_buffer::~memory_pool_buffer() noexcept
+std::size_t size_histogram::count() const noexcept
 {
-    node_type* node = _head;
+    std::size_t total = 0;
+    for (const auto& bucket : _buckets)
+    {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+std::size_t size_histogram::percentile(unsigned percent) const noexcept
+{
+    assert((percent > 0) && (percent <= 100));
+
+    // Round up so that we never return a bucket below the percentile
+    std::size_t required = ((count() * percent) + 99u) / 100u;
+    std::size_t total = 0;
+    for (std::size_t i = 0; i != _buckets.size(); ++i)
+    {
+        total += _buckets[i].load(std::memory_order_relaxed);
+        if ((total > 0) && (total >= required))
+        {
+            return std::size_t{1} << i;
+        }
+    }
+
+    return 0;
+}
+
+void size_histogram::record(std::size_t size) noexcept
+{
+    std::size_t bucket = std::min(get_bucket(size), _buckets.size() - 1u);
+    _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void size_histogram::reset() noexcept
+{
+    for (auto& bucket : _buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+node_pool::node_pool(std::size_t node_size) :
+    _free_list(nullptr),
+    _root(nullptr),
+    _node_size(node_size)
+{
+}
+
+node_pool::~node_pool() noexcept
+{
+    node_type* node = _root.load();
     while (node != nullptr)
     {
-        node = release_node(node);
+        node_type* next = node->allocated_list;
+        assert(next != node);
+        node->~node_type();
+        ::operator delete(node);
+        node = next;
+    }
+}
+
+auto node_pool::acquire() -> node_type*
+{
+    node_type* node = get_from_free_list();
+    if (node == nullptr)
+    {
+        node = allocate_new();
+    }
+
+#ifndef NDEBUG
+    node->is_free = false;
+#endif
+
+    node->next = nullptr;
+    return node;
+}
+
+std::size_t node_pool::node_size() const noexcept
+{
+    return _node_size.load(std::memory_order_relaxed);
+}
+
+void node_pool::release(node_type* node)
+{
+#ifndef NDEBUG
+    assert(!node->is_free);
+    node->is_free = true;
+#endif
+    // We optimize for allocations by clearing the memory now, as this
+    // code is executed after the user code, so we're not time critical
+    node->clear_data();
+
+    // The size is checked whilst holding the lock so that set_node_size
+    // can't remove the unused nodes until we've added ours. Nodes of a
+    // previous size are kept separate so they're never acquired again
+    _lock.lock_shared();
+    if (node->capacity == _node_size.load())
+    {
+        push_node(&_free_list, &_free_count, node);
+    }
+    else
+    {
+        push_node(&_retired_list, &_retired_count, node);
+    }
+
+    _lock.unlock_shared();
+}
+
+void node_pool::reserve(std::size_t count)
+{
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        node_type* node = allocate_new();
+#ifndef NDEBUG
+        node->is_free = false;
+#endif
+        release(node);
+    }
+}
+
+void node_pool::set_node_size(std::size_t node_size)
+{
+    std::size_t count = 0;
+    node_type* removed = nullptr;
+
+    _lock.lock();
+    if (_node_size.exchange(node_size) != node_size)
+    {
+        removed = remove_unused_nodes(0, &count);
     }
+
+    _lock.unlock();
+
+    delete_nodes(removed);
+}
+
+node_pool_statistics node_pool::statistics() const noexcept
+{
+    std::size_t allocated = _allocated_count.load(std::memory_order_relaxed);
+    std::size_t free = _free_count.load(std::memory_order_relaxed) +
+                       _retired_count.load(std::memory_order_relaxed);
+    free = std::min(free, allocated);
+    return {allocated, free, allocated - free};
+}
+
+std::size_t node_pool::trim(std::size_t low, std::size_t high)
+{
+    // Nodes of a previous size are always removed, as they can't be reused
+    bool above_high = _free_count.load(std::memory_order_relaxed) > high;
+    if (!above_high && (_retired_count.load(std::memory_order_relaxed) == 0))
+    {
+        return 0;
+    }
+
+    std::size_t count = 0;
+    _lock.lock();
+    node_type* removed = remove_unused_nodes(
+        above_high ? low : std::numeric_limits<std::size_t>::max(), &count);
+    _lock.unlock();
+
+    delete_nodes(removed);
+    return count;
+}
+
+auto node_pool::allocate_new() -> node_type*
+{
+    // The buffer is stored after the node and must be zero-filled
+    std::size_t size = _node_size.load(std::memory_order_relaxed);
+    void* raw = ::operator new(sizeof(node_type) + size);
+    auto* node = new (raw) node_type(size);
+    std::fill_n(node->buffer(), size, std::byte{});
+    _lock.lock_shared();
+    node_type* root = _root.load();
+    do
+    {
+        node->allocated_list = root;
+    } while (!_root.compare_exchange_weak(root, node));
+
+    // Only the thread that pushed the node in front of the old root writes
+    // its back link, and trimming waits for the exclusive lock, so every
+    // link is complete by the time it's read
+    if (root != nullptr)
+    {
+        root->allocated_previous = node;
+    }
+
+    _lock.unlock_shared();
+    _allocated_count.fetch_add(1, std::memory_order_relaxed);
+    return node;
+}
+
+void node_pool::delete_nodes(node_type* node)
+{
+    while (node != nullptr)
+    {
+        node_type* next = node->next;
+        node->~node_type();
+        ::operator delete(node);
+        node = next;
+    }
+}
+
+auto node_pool::get_from_free_list() -> node_type*
+{
+    _lock.lock_shared();
+    node_type* node = pop_free();
+    _lock.unlock_shared();
+    return node;
+}
+
+auto node_pool::pop_free() -> node_type*
+{
+    node_type* free = _free_list.load();
+    node_type* next;
+    do
+    {
+        if (free == nullptr)
+        {
+            return nullptr;
+        }
+
+        next = free->next;
+    } while (!_free_list.compare_exchange_weak(free, next));
+
+    _free_count.fetch_sub(1, std::memory_order_relaxed);
+    return free;
+}
+
+void node_pool::push_node(
+    std::atomic<node_type*>* list,
+    std::atomic_size_t* count,
+    node_type* node)
+{
+    // Increment the count first so that it can't be decremented below
+    // zero by another thread acquiring the node before we've counted it
+    count->fetch_add(1, std::memory_order_relaxed);
+
+    node_type* head = list->load();
+    do
+    {
+        node->next = head;
+    } while (!list->compare_exchange_weak(head, node));
+}
+
+auto node_pool::remove_unused_nodes(std::size_t low, std::size_t* count)
+    -> node_type*
+{
+    // Must be called whilst holding the lock exclusively, which guarantees
+    // nobody else is reading the free list (releasing only writes to it),
+    // so we can safely remove nodes without them being referenced by
+    // another thread
+    std::size_t removed_count = _retired_count.exchange(0);
+    node_type* removed = _retired_list.exchange(nullptr);
+    for (node_type* node = removed; node != nullptr; node = node->next)
+    {
+        unlink_allocated(node);
+    }
+
+    while (_free_count.load(std::memory_order_relaxed) > low)
+    {
+        node_type* node = pop_free();
+        if (node == nullptr)
+        {
+            break;
+        }
+
+        unlink_allocated(node);
+        node->next = removed;
+        removed = node;
+        ++removed_count;
+    }
+
+    if (removed_count > 0)
+    {
+        _allocated_count.fetch_sub(removed_count, std::memory_order_relaxed);
+    }
+
+    *count = removed_count;
+    return removed;
+}
+
+void node_pool::unlink_allocated(node_type* node)
+{
+    // Must be called whilst holding the lock exclusively
+    node_type* next = node->allocated_list;
+    node_type* previous = node->allocated_previous;
+    if (previous == nullptr)
+    {
+        _root.store(next);
+    }
+    else
+    {
+        previous->allocated_list = next;
+    }
+
+    if (next != nullptr)
+    {
+        next->allocated_previous = previous;
+    }
+}
+
+memory_pool_buffer::~memory_pool_buffer() noexcept
+{
+    clear();
 }
 
 void memory_pool_buffer::append(const value_type* data, std::size_t length)
@@ -29,8 +351,8 @@ void memory_pool_buffer::append(const value_type* data, std::size_t length)
     while (remaining > 0)
     {
         ensure_space_to_write();
-        std::size_t used = _tail->data - _tail->buffer.data();
-        std::size_t count = std::min(remaining, node_type::capacity - used);
+        std::size_t used = _tail->data - _tail->buffer();
+        std::size_t count = std::min(remaining, _tail->capacity - used);
         _tail->data = std::copy_n(src, count, _tail->data);
 
         src += count;
@@ -39,20 +361,62 @@ void memory_pool_buffer::append(const value_type* data, std::size_t length)
     }
 }
 
+void memory_pool_buffer::clear() noexcept
+{
+    node_type* node = _head;
+    while (node != nullptr)
+    {
+        node = release_node(node);
+    }
+
+    _head = nullptr;
+    _tail = nullptr;
+    _count = 0;
+}
+
+void memory_pool_buffer::copy_to(value_type* destination, std::size_t size)
+    const
+{
+    assert(size >= _count);
+    UNUSED(size);
+
+    if (record_buffer_sizes)
+    {
+        buffer_sizes.record(_count);
+    }
+
+    const node_type* node = _head;
+    std::size_t remaining = _count;
+    std::byte* dst = destination;
+    while (remaining > 0)
+    {
+        std::size_t count = std::min(remaining, node->capacity);
+        remaining -= count;
+
+        dst = std::copy_n(node->buffer(), count, dst);
+        node = node->next;
+    }
+}
+
 void memory_pool_buffer::move_to(value_type* destination, std::size_t size)
 {
     assert(size >= _count);
     UNUSED(size);
 
+    if (record_buffer_sizes)
+    {
+        buffer_sizes.record(_count);
+    }
+
     node_type* node = _head;
     std::size_t remaining = _count;
     std::byte* dst = destination;
     while (node != nullptr)
     {
-        std::size_t count = std::min(remaining, node_type::capacity);
+        std::size_t count = std::min(remaining, node->capacity);
         remaining -= count;
 
-        dst = std::copy_n(node->buffer.data(), count, dst);
+        dst = std::copy_n(node->buffer(), count, dst);
         node = release_node(node);
     }
 
@@ -68,12 +432,13 @@ void memory_pool_buffer::replace(
 {
     assert((index + length) <= _count);
 
-    std::size_t node_index = index / node_type::capacity;
-    std::size_t offset = index % node_type::capacity;
-
+    // The node size can be changed whilst we're writing, so we can't assume
+    // all the nodes are the same size
     node_type* node = _head;
-    while (node_index-- > 0)
+    std::size_t offset = index;
+    while (offset >= node->capacity)
     {
+        offset -= node->capacity;
         node = node->next;
     }
 
@@ -81,8 +446,8 @@ void memory_pool_buffer::replace(
     std::size_t remaining = length;
     while (remaining > 0)
     {
-        std::size_t count = std::min(remaining, node_type::capacity - offset);
-        std::copy_n(src, count, node->buffer.data() + offset);
+        std::size_t count = std::min(remaining, node->capacity - offset);
+        std::copy_n(src, count, node->buffer() + offset);
         offset = 0;
 
         node = node->next;
@@ -96,6 +461,52 @@ std::size_t memory_pool_buffer::size() const noexcept
     return _count;
 }
 
+void memory_pool_buffer::adapt_node_size()
+{
+    const std::size_t minimum_samples = 64u;
+    if (buffer_sizes.count() < minimum_samples)
+    {
+        return;
+    }
+
+    // Use a size that will store most of the buffers in a single node
+    std::size_t size = std::clamp(
+        buffer_sizes.percentile(90u), minimum_node_size, maximum_node_size);
+    buffer_sizes.reset();
+
+    if (size != global_pool.node_size())
+    {
+        spdlog::info("Changing worker storage node size to {} bytes", size);
+        set_node_size(size);
+    }
+}
+
+void memory_pool_buffer::enable_adaptive_node_size()
+{
+    record_buffer_sizes = true;
+}
+
+void memory_pool_buffer::reserve(std::size_t count)
+{
+    global_pool.reserve(count);
+}
+
+void memory_pool_buffer::set_node_size(std::size_t size)
+{
+    global_pool.set_node_size(
+        std::clamp(size, minimum_node_size, maximum_node_size));
+}
+
+node_pool_statistics memory_pool_buffer::statistics() noexcept
+{
+    return global_pool.statistics();
+}
+
+std::size_t memory_pool_buffer::trim(std::size_t low, std::size_t high)
+{
+    return global_pool.trim(low, high);
+}
+
 void memory_pool_buffer::ensure_space_to_write()
 {
     if (_head == nullptr)
@@ -103,7 +514,7 @@ void memory_pool_buffer::ensure_space_to_write()
         _head = global_pool.acquire();
         _tail = _head;
     }
-    else if (_tail->data == (_tail->buffer.data() + node_type::capacity))
+    else if (_tail->data == (_tail->buffer() + _tail->capacity))
     {
         node_type* node = global_pool.acquire();
         _tail->next = node;
@@ -2,21 +2,36 @@
 #include "exports.h"
 #include "services.h"
 #include <string_view>
+#include <vector>
 
 namespace
 {
 
-void load_object(const void* type, typed_reference* result, std::string_view id)
+void load_object(
+    const void* type,
+    typed_reference* result,
+    std::string_view id,
+    bool read_only = false)
 {
     auto* service =
         autocrat::global_services.get_service<autocrat::worker_service>();
-    void* worker = service->get_worker(type, id);
+    void* worker = read_only ? service->get_read_only_worker(type, id)
+                             : service->get_worker(type, id);
 
     // result holds a reference to a local managed variable, which is an
     // object reference. So it's a pointer to a pointer, hence the cast
     *static_cast<void**>(result->value) = worker;
 }
 
+std::int32_t preload_workers(
+    const void* type,
+    const std::vector<std::string_view>& ids)
+{
+    auto* service =
+        autocrat::global_services.get_service<autocrat::worker_service>();
+    return static_cast<std::int32_t>(service->preload_workers(type, ids));
+}
+
 }
 
 extern "C"
@@ -57,6 +72,94 @@ extern "C"
                 id->length * sizeof(char16_t)));
     }
 
+    void CDECL load_read_only_object_guid(
+        const void* type,
+        managed_guid* id,
+        typed_reference* result)
+    {
+        load_object(
+            type,
+            result,
+            std::string_view(
+                reinterpret_cast<char*>(&id->data), sizeof(id->data)),
+            true);
+    }
+
+    void CDECL load_read_only_object_int64(
+        const void* type,
+        std::int64_t id,
+        typed_reference* result)
+    {
+        load_object(
+            type,
+            result,
+            std::string_view(reinterpret_cast<char*>(&id), sizeof(id)),
+            true);
+    }
+
+    void CDECL load_read_only_object_string(
+        const void* type,
+        managed_string* id,
+        typed_reference* result)
+    {
+        load_object(
+            type,
+            result,
+            std::string_view(
+                reinterpret_cast<char*>(id->data),
+                id->length * sizeof(char16_t)),
+            true);
+    }
+
+    std::int32_t CDECL preload_workers_guid(
+        const void* type,
+        const managed_guid* ids,
+        std::int32_t count)
+    {
+        std::vector<std::string_view> views;
+        views.reserve(count);
+        for (std::int32_t i = 0; i != count; ++i)
+        {
+            views.emplace_back(
+                reinterpret_cast<const char*>(&ids[i].data),
+                sizeof(ids[i].data));
+        }
+
+        return preload_workers(type, views);
+    }
+
+    std::int32_t CDECL preload_workers_int64(
+        const void* type,
+        const std::int64_t* ids,
+        std::int32_t count)
+    {
+        std::vector<std::string_view> views;
+        views.reserve(count);
+        for (std::int32_t i = 0; i != count; ++i)
+        {
+            views.emplace_back(
+                reinterpret_cast<const char*>(&ids[i]), sizeof(ids[i]));
+        }
+
+        return preload_workers(type, views);
+    }
+
+    std::int32_t CDECL
+    preload_workers_string(const void* type, managed_string_array* ids)
+    {
+        std::vector<std::string_view> views;
+        views.reserve(ids->length);
+        for (std::uint32_t i = 0; i != ids->length; ++i)
+        {
+            const managed_string* id = ids->data[i];
+            views.emplace_back(
+                reinterpret_cast<const char*>(id->data),
+                id->length * sizeof(char16_t));
+        }
+
+        return preload_workers(type, views);
+    }
+
     void CDECL register_constructor(const void* type, std::int32_t handle)
     {
         auto constructor = std::get<construct_worker>(get_known_method(handle));
@@ -65,6 +168,17 @@ extern "C"
         service->register_type(type, constructor);
     }
 
+    void CDECL register_expiry(
+        const void* type,
+        std::int32_t time_to_live_s,
+        std::int32_t notify)
+    {
+        auto* service =
+            autocrat::global_services.get_service<autocrat::worker_service>();
+        service->set_time_to_live(
+            type, std::chrono::seconds(time_to_live_s), notify != 0);
+    }
+
     std::int32_t CDECL register_timer(
         std::int64_t delay_us,
         std::int64_t interval_us,
@@ -60,6 +60,19 @@ void network_service::check_and_dispatch()
     });
 }
 
+void network_service::dump_statistics()
+{
+    _array_pool.dump_statistics();
+}
+
+void network_service::reserve_buffers(std::size_t count)
+{
+    for (std::size_t size : array_pool::size_classes)
+    {
+        _array_pool.reserve(size, count);
+    }
+}
+
 void network_service::handle_poll(
     const pal::socket_handle& handle,
     const socket_data& data,
@@ -72,12 +85,13 @@ void network_service::handle_poll(
         return;
     }
 
-    managed_byte_array_ptr block = _array_pool.aquire();
+    std::size_t pending = pal::peek_datagram_size(handle);
+    managed_byte_array_ptr block = _array_pool.aquire(pending);
     pal::socket_address address;
     int size = pal::recv_from(
         handle,
         reinterpret_cast<char*>(block->array.data()),
-        block->array.capacity(),
+        block->capacity(),
         &address);
     block->array.resize(size);
 
@@ -1,3 +1,4 @@
+#include <alloca.h>
 #include <arpa/inet.h>
 #include <cerrno>
 #include <chrono>
@@ -6,9 +7,13 @@
 #include <ctime>
 #include <fcntl.h>
 #include <linux/futex.h>
+#include <malloc.h>
 #include <pthread.h>
 #include <sched.h>
 #include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/syscall.h>
 #include <system_error>
 #include <unistd.h>
@@ -177,6 +182,43 @@ std::string socket_address::to_string() const
     return result;
 }
 
+file_handle::file_handle(std::intptr_t handle) noexcept : _handle(handle)
+{
+}
+
+file_handle::~file_handle() noexcept
+{
+    close();
+}
+
+file_handle::file_handle(file_handle&& other) noexcept
+{
+    _handle = other._handle;
+    other._handle = -1;
+}
+
+file_handle& file_handle::operator=(file_handle&& other) noexcept
+{
+    close();
+    _handle = other._handle;
+    other._handle = -1;
+    return *this;
+}
+
+std::intptr_t file_handle::handle() const noexcept
+{
+    return _handle;
+}
+
+void file_handle::close() noexcept
+{
+    if (_handle != -1)
+    {
+        ::close(static_cast<int>(_handle));
+        _handle = -1;
+    }
+}
+
 socket_handle::socket_handle(int type, int protocol)
 {
     _handle = socket(AF_INET, type, protocol);
@@ -229,6 +271,18 @@ void bind(const socket_handle& socket, const socket_address& address)
     }
 }
 
+file_handle create_file(const std::filesystem::path& path)
+{
+    int handle = ::open(
+        path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (handle == -1)
+    {
+        throw std::system_error(errno, std::system_category());
+    }
+
+    return file_handle(handle);
+}
+
 socket_handle create_udp_socket()
 {
     return socket_handle(SOCK_DGRAM, IPPROTO_UDP);
@@ -252,6 +306,81 @@ std::chrono::microseconds get_current_time()
     return std::chrono::microseconds((time.tv_sec * 1'000'000) + microseconds);
 }
 
+page_faults get_thread_page_faults()
+{
+    rusage usage = {};
+    getrusage(RUSAGE_THREAD, &usage);
+    return page_faults{
+        static_cast<std::uint64_t>(usage.ru_majflt),
+        static_cast<std::uint64_t>(usage.ru_minflt)};
+}
+
+bool lock_memory()
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        spdlog::error("Unable to lock the process memory (code: {})", errno);
+        return false;
+    }
+
+    return true;
+}
+
+std::size_t peek_datagram_size(const socket_handle& socket)
+{
+    // MSG_TRUNC returns the real length of the datagram, rather than the
+    // number of bytes copied into the (empty) buffer
+    ssize_t result =
+        ::recv(socket.handle(), nullptr, 0, MSG_PEEK | MSG_TRUNC);
+    return result < 0 ? 0u : static_cast<std::size_t>(result);
+}
+
+void prefault_stack(std::size_t size)
+{
+    static const auto page_size =
+        static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+
+    // Writing to the memory (rather than just reading it) ensures the page
+    // is backed by physical memory rather than the shared zero page
+    auto stack = static_cast<volatile char*>(alloca(size));
+    for (std::size_t i = 0; i < size; i += page_size)
+    {
+        stack[i] = 0;
+    }
+}
+
+void read_file(
+    const file_handle& file,
+    std::uint64_t offset,
+    std::byte* buffer,
+    std::size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t result = ::pread(
+            static_cast<int>(file.handle()),
+            buffer,
+            length,
+            static_cast<off_t>(offset));
+        if (result > 0)
+        {
+            buffer += result;
+            length -= static_cast<std::size_t>(result);
+            offset += static_cast<std::uint64_t>(result);
+        }
+        else if (result == 0)
+        {
+            throw std::system_error(
+                std::make_error_code(std::errc::io_error),
+                "Unexpected end of file");
+        }
+        else if (errno != EINTR)
+        {
+            throw std::system_error(errno, std::system_category());
+        }
+    }
+}
+
 int recv_from(
     const socket_handle& socket,
     char* buffer,
@@ -286,6 +415,15 @@ int recv_from(
     return result;
 }
 
+void release_free_memory()
+{
+#ifdef __GLIBC__
+    // Freed chunks can remain part of the heap, so ask glibc to give back
+    // the unused pages
+    malloc_trim(0);
+#endif
+}
+
 void set_affinity(std::thread* thread, int index)
 {
     pthread_t handle =
@@ -333,4 +471,36 @@ void wake_all(std::uint32_t* address)
         0);
 }
 
+void write_file(
+    const file_handle& file,
+    std::uint64_t offset,
+    const std::byte* data,
+    std::size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t result = ::pwrite(
+            static_cast<int>(file.handle()),
+            data,
+            length,
+            static_cast<off_t>(offset));
+        if (result > 0)
+        {
+            data += result;
+            length -= static_cast<std::size_t>(result);
+            offset += static_cast<std::uint64_t>(result);
+        }
+        else if (result == 0)
+        {
+            throw std::system_error(
+                std::make_error_code(std::errc::io_error),
+                "Unable to write to the file");
+        }
+        else if (errno != EINTR)
+        {
+            throw std::system_error(errno, std::system_category());
+        }
+    }
+}
+
 }
@@ -1,11 +1,16 @@
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <limits>
+#include <malloc.h>
 #include <spdlog/spdlog.h>
 #include <system_error>
 
 #undef UNIT_TESTS
 #include "pal.h"
+#include <psapi.h>
 
+#pragma comment(lib, "Psapi.lib")
 #pragma comment(lib, "Synchronization.lib")
 #pragma comment(lib, "Ws2_32.lib")
 
@@ -57,6 +62,21 @@ BOOL WINAPI CtrlHandlerRoutine(DWORD)
     return TRUE;
 }
 
+HANDLE get_native_handle(const pal::file_handle& file)
+{
+    return reinterpret_cast<HANDLE>(file.handle());
+}
+
+OVERLAPPED get_overlapped(std::uint64_t offset)
+{
+    // Passing the offset in the OVERLAPPED structure to a synchronous handle
+    // performs the I/O at that position instead of the file pointer
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    return overlapped;
+}
+
 std::int64_t get_clock_frequency()
 {
     LARGE_INTEGER frequency = {};
@@ -202,6 +222,44 @@ std::string socket_address::to_string() const
     return result;
 }
 
+file_handle::file_handle(std::intptr_t handle) noexcept : _handle(handle)
+{
+}
+
+file_handle::~file_handle() noexcept
+{
+    close();
+}
+
+file_handle::file_handle(file_handle&& other) noexcept
+{
+    _handle = other._handle;
+    other._handle = -1;
+}
+
+file_handle& file_handle::operator=(file_handle&& other) noexcept
+{
+    close();
+    _handle = other._handle;
+    other._handle = -1;
+    return *this;
+}
+
+std::intptr_t file_handle::handle() const noexcept
+{
+    return _handle;
+}
+
+void file_handle::close() noexcept
+{
+    // INVALID_HANDLE_VALUE is also -1
+    if (_handle != -1)
+    {
+        CloseHandle(reinterpret_cast<HANDLE>(_handle));
+        _handle = -1;
+    }
+}
+
 socket_handle::socket_handle(int type, int protocol)
 {
     _handle = socket(AF_INET, type, protocol);
@@ -254,6 +312,24 @@ void bind(const socket_handle& socket, const socket_address& address)
     }
 }
 
+file_handle create_file(const std::filesystem::path& path)
+{
+    HANDLE handle = CreateFileW(
+        path.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        0,
+        nullptr,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        throw_last_error();
+    }
+
+    return file_handle(reinterpret_cast<std::intptr_t>(handle));
+}
+
 socket_handle create_udp_socket()
 {
     return socket_handle(SOCK_DGRAM, IPPROTO_UDP);
@@ -287,6 +363,79 @@ std::chrono::microseconds get_current_time()
         (time.QuadPart + ticks_per_microsecond - 1) / ticks_per_microsecond);
 }
 
+page_faults get_thread_page_faults()
+{
+    // Windows only tracks the faults for the whole process and does not
+    // distinguish between soft and hard faults
+    PROCESS_MEMORY_COUNTERS counters = {};
+    counters.cb = sizeof(counters);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return page_faults{};
+    }
+
+    return page_faults{0u, counters.PageFaultCount};
+}
+
+bool lock_memory()
+{
+    spdlog::warn("Locking the process memory is not supported");
+    return false;
+}
+
+std::size_t peek_datagram_size(const socket_handle& socket)
+{
+    // For datagram sockets this is the total amount of data waiting to be
+    // read, which is at least the size of the next datagram
+    u_long pending = 0;
+    if (::ioctlsocket(socket.handle(), FIONREAD, &pending) == SOCKET_ERROR)
+    {
+        return 0;
+    }
+
+    return pending;
+}
+
+void prefault_stack(std::size_t size)
+{
+    // _alloca probes each page of the requested size (via __chkstk), which
+    // commits the stack pages as it goes
+    auto stack = static_cast<volatile char*>(_alloca(size));
+    if (size > 0)
+    {
+        stack[0] = 0;
+    }
+}
+
+void read_file(
+    const file_handle& file,
+    std::uint64_t offset,
+    std::byte* buffer,
+    std::size_t length)
+{
+    while (length > 0)
+    {
+        OVERLAPPED overlapped = get_overlapped(offset);
+        DWORD read = 0;
+        DWORD size = static_cast<DWORD>(
+            std::min<std::size_t>(length, std::numeric_limits<DWORD>::max()));
+        if (!ReadFile(get_native_handle(file), buffer, size, &read, &overlapped))
+        {
+            throw_last_error();
+        }
+        else if (read == 0)
+        {
+            throw std::system_error(
+                std::make_error_code(std::errc::io_error),
+                "Unexpected end of file");
+        }
+
+        buffer += read;
+        length -= read;
+        offset += read;
+    }
+}
+
 int recv_from(
     const socket_handle& socket,
     char* buffer,
@@ -326,6 +475,11 @@ int recv_from(
     return result;
 }
 
+void release_free_memory()
+{
+    _heapmin();
+}
+
 void set_affinity(std::thread* thread, int index)
 {
     HANDLE handle =
@@ -367,4 +521,28 @@ void wake_all(std::uint32_t* address)
     WakeByAddressAll(address);
 }
 
+void write_file(
+    const file_handle& file,
+    std::uint64_t offset,
+    const std::byte* data,
+    std::size_t length)
+{
+    while (length > 0)
+    {
+        OVERLAPPED overlapped = get_overlapped(offset);
+        DWORD written = 0;
+        DWORD size = static_cast<DWORD>(
+            std::min<std::size_t>(length, std::numeric_limits<DWORD>::max()));
+        if (!WriteFile(
+                get_native_handle(file), data, size, &written, &overlapped))
+        {
+            throw_last_error();
+        }
+
+        data += written;
+        length -= written;
+        offset += written;
+    }
+}
+
 }
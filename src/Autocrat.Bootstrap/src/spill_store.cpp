@@ -0,0 +1,150 @@
+#include "spill_store.h"
+#include <cassert>
+#include <string>
+#include <system_error>
+#include "pal.h"
+
+namespace fs = std::filesystem;
+
+namespace autocrat
+{
+
+struct spill_store::segment
+{
+    pal::file_handle file;
+    std::uint64_t live_bytes = 0;
+    std::uint64_t size = 0;
+};
+
+spill_store::spill_store(fs::path directory, std::size_t segment_size) :
+    _directory(std::move(directory)),
+    _segment_size(segment_size)
+{
+    fs::create_directories(_directory);
+}
+
+spill_store::~spill_store() noexcept
+{
+    for (auto& [index, segment] : _segments)
+    {
+        segment->file = pal::file_handle();
+
+        std::error_code error;
+        fs::remove(get_segment_path(index), error);
+    }
+}
+
+void spill_store::read(const spill_location& location, std::byte* destination)
+{
+    // The segment can't be removed whilst the location is live, so only the
+    // lookup needs the lock
+    segment* segment;
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        segment = _segments.at(location.segment).get();
+        assert((location.offset + location.size) <= segment->size);
+    }
+
+    pal::read_file(segment->file, location.offset, destination, location.size);
+}
+
+void spill_store::release(const spill_location& location)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    auto it = _segments.find(location.segment);
+    assert(it != _segments.end());
+
+    segment& segment = *it->second;
+    assert(segment.live_bytes >= location.size);
+    segment.live_bytes -= location.size;
+    _live_bytes.fetch_sub(location.size, std::memory_order_relaxed);
+
+    if (segment.live_bytes == 0)
+    {
+        if (location.segment == _current)
+        {
+            // Nothing is using the file, so start writing at the beginning
+            // again instead of growing it
+            segment.size = 0;
+        }
+        else
+        {
+            _segments.erase(it);
+
+            std::error_code error;
+            fs::remove(get_segment_path(location.segment), error);
+        }
+    }
+}
+
+std::size_t spill_store::size() const noexcept
+{
+    return _live_bytes.load(std::memory_order_relaxed);
+}
+
+spill_location spill_store::write(const std::byte* data, std::size_t length)
+{
+    // Reserve the range under the lock, counting it as live so the segment
+    // isn't removed or rewound, then write it without holding the lock
+    spill_location location;
+    segment* current;
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        current = &get_segment(_current);
+        if ((current->size > 0) && ((current->size + length) > _segment_size))
+        {
+            ++_current;
+            current = &open_segment(_current);
+        }
+
+        location.offset = current->size;
+        location.segment = _current;
+        location.size = static_cast<std::uint32_t>(length);
+
+        current->live_bytes += length;
+        current->size += length;
+        _live_bytes.fetch_add(length, std::memory_order_relaxed);
+    }
+
+    try
+    {
+        pal::write_file(current->file, location.offset, data, length);
+    }
+    catch (...)
+    {
+        release(location);
+        throw;
+    }
+
+    return location;
+}
+
+auto spill_store::get_segment(std::uint32_t index) -> segment&
+{
+    auto it = _segments.find(index);
+    if (it == _segments.end())
+    {
+        return open_segment(index);
+    }
+    else
+    {
+        return *it->second;
+    }
+}
+
+fs::path spill_store::get_segment_path(std::uint32_t index) const
+{
+    return _directory / ("workers_" + std::to_string(index) + ".spill");
+}
+
+auto spill_store::open_segment(std::uint32_t index) -> segment&
+{
+    auto segment = std::make_unique<spill_store::segment>();
+    segment->file = pal::create_file(get_segment_path(index));
+
+    auto& result = *segment;
+    _segments[index] = std::move(segment);
+    return result;
+}
+
+}
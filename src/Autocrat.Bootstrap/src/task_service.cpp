@@ -4,8 +4,13 @@
 #include "services.h"
 #include "thread_pool.h"
 #include "worker_service.h"
+#include "smart_ptr.h"
+#include <algorithm>
 #include <any>
-#include <unordered_map>
+#include <atomic>
+#include <optional>
+#include <utility>
+#include <vector>
 
 namespace
 {
@@ -16,27 +21,191 @@ struct delegate_info
     void* target;
 };
 
+/**
+ * Finds which of the workers captured by a continuation an object is.
+ */
+class worker_lookup
+{
+public:
+    void assign(const autocrat::worker_service::object_collection& objects)
+    {
+        _workers.clear();
+        for (std::size_t i = 0; i != objects.size(); ++i)
+        {
+            _workers.emplace_back(objects[i], i);
+        }
+
+        std::sort(_workers.begin(), _workers.end());
+    }
+
+    void clear() noexcept
+    {
+        _workers.clear();
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return _workers.empty();
+    }
+
+    [[nodiscard]] std::optional<std::size_t> find(const void* object) const
+    {
+        auto it = std::lower_bound(
+            _workers.begin(),
+            _workers.end(),
+            object,
+            [](const auto& worker, const void* value) {
+                return worker.first < value;
+            });
+        if ((it != _workers.end()) && (it->first == object))
+        {
+            return it->second;
+        }
+        else
+        {
+            return std::nullopt;
+        }
+    }
+
+private:
+    std::vector<std::pair<const void*, std::size_t>> _workers;
+};
+
+struct worker_field
+{
+    std::size_t index;
+    void** field;
+};
+
 struct task_context
 {
-    using workers_field_map = std::unordered_multimap<std::size_t, void**>;
+    void reset() noexcept
+    {
+        // Moving the heap out frees its memory without giving the context a
+        // new node to hold on to whilst it's waiting in the pool
+        autocrat::gc_heap released(std::move(heap));
+        thread_pool = nullptr;
+        workers = {};
+        snapshots.clear();
+        worker_objects.clear();
+        worker_fields.clear();
+        delegate = {};
+        state = nullptr;
+        attempts = 0;
+    }
 
     autocrat::gc_heap heap;
     autocrat::thread_pool* thread_pool = nullptr;
     autocrat::worker_service::worker_collection workers;
-    workers_field_map worker_fields;
+    autocrat::worker_service::snapshot_collection snapshots;
+    worker_lookup worker_objects;
+    std::vector<worker_field> worker_fields;
     delegate_info delegate = {};
     void* state = nullptr;
+    task_context* next = nullptr;
+    std::atomic_uint32_t references = 0;
+    std::uint32_t attempts = 0;
+};
+
+void intrusive_ptr_add_ref(task_context* context) noexcept;
+void intrusive_ptr_release(task_context* context) noexcept;
+
+using task_context_ptr = autocrat::intrusive_ptr<task_context>;
+
+/**
+ * Keeps the contexts of finished continuations so that they, and the memory
+ * their collections have grown to, can be used again.
+ * @remarks Each thread has its own pool, with contexts being returned to the
+ *          pool of the thread that finishes with them.
+ */
+class task_context_pool
+{
+public:
+    task_context_pool() = default;
+    ~task_context_pool() noexcept;
+
+    task_context_pool(const task_context_pool&) = delete;
+    task_context_pool& operator=(const task_context_pool&) = delete;
+
+    task_context_ptr acquire()
+    {
+        task_context* context = _free_list;
+        if (context == nullptr)
+        {
+            context = new task_context();
+        }
+        else
+        {
+            _free_list = std::exchange(context->next, nullptr);
+            --_free_count;
+        }
+
+        return task_context_ptr(context);
+    }
+
+    void release(task_context* context) noexcept
+    {
+        context->reset();
+        if (_free_count == max_free_count)
+        {
+            delete context;
+        }
+        else
+        {
+            context->next = std::exchange(_free_list, context);
+            ++_free_count;
+        }
+    }
+
+private:
+    // Limits the contexts kept by threads that finish more continuations
+    // than they create
+    static constexpr std::size_t max_free_count = 64u;
+
+    task_context* _free_list = nullptr;
+    std::size_t _free_count = 0;
 };
 
+thread_local task_context_pool context_pool;
+
+// Contexts can still be released after the pool of the thread has been
+// destroyed (e.g. work left in a queue during shutdown)
+thread_local bool context_pool_destroyed = false;
+
+task_context_pool::~task_context_pool() noexcept
+{
+    context_pool_destroyed = true;
+    while (_free_list != nullptr)
+    {
+        delete std::exchange(_free_list, _free_list->next);
+    }
+}
+
+void intrusive_ptr_add_ref(task_context* context) noexcept
+{
+    context->references++;
+}
+
+void intrusive_ptr_release(task_context* context) noexcept
+{
+    std::uint32_t count = --context->references;
+    if (count == 0)
+    {
+        if (context_pool_destroyed)
+        {
+            delete context;
+        }
+        else
+        {
+            context_pool.release(context);
+        }
+    }
+}
+
 class worker_field_scanner : private autocrat::object_scanner
 {
 public:
-    worker_field_scanner(
-        task_context::workers_field_map& map,
-        const autocrat::worker_service::object_collection& worker_objects) :
-        _map(&map),
-        _objects_begin(worker_objects.begin()),
-        _objects_end(worker_objects.end())
+    explicit worker_field_scanner(task_context& context) : _context(&context)
     {
     }
 
@@ -45,14 +214,11 @@ public:
 protected:
     void on_field(void** field) final
     {
-        void* object = *field;
-        if (object != nullptr)
+        std::optional<std::size_t> index =
+            _context->worker_objects.find(*field);
+        if (index)
         {
-            auto it = std::find(_objects_begin, _objects_end, object);
-            if (it != _objects_end)
-            {
-                _map->emplace(std::distance(_objects_begin, it), field);
-            }
+            _context->worker_fields.push_back({*index, field});
         }
     }
 
@@ -61,9 +227,65 @@ protected:
     }
 
 private:
-    task_context::workers_field_map* _map;
-    void* const* _objects_begin;
-    void* const* _objects_end;
+    task_context* _context;
+};
+
+using memory_ranges =
+    std::vector<std::pair<const std::byte*, const std::byte*>>;
+
+bool is_in_ranges(const memory_ranges& ranges, const void* object)
+{
+    auto address = static_cast<const std::byte*>(object);
+    auto it = std::upper_bound(
+        ranges.begin(),
+        ranges.end(),
+        address,
+        [](const std::byte* value, const auto& range) {
+            return value < range.first;
+        });
+    return (it != ranges.begin()) && (address < std::prev(it)->second);
+}
+
+class state_evacuator : private autocrat::object_evacuator
+{
+public:
+    state_evacuator(const memory_ranges& ranges, task_context& context) :
+        _ranges(&ranges),
+        _context(&context)
+    {
+    }
+
+    using autocrat::object_evacuator::evacuate;
+
+protected:
+    void on_field(void** field) final
+    {
+        std::optional<std::size_t> index =
+            _context->worker_objects.find(*field);
+        if (index)
+        {
+            _context->worker_fields.push_back({*index, field});
+        }
+    }
+
+    bool should_copy(void* object) final
+    {
+        // The workers have been saved, so their objects are left for
+        // update_workers to replace
+        if (_context->worker_objects.find(object))
+        {
+            return false;
+        }
+
+        // Only copy the objects from the heap being discarded - anything
+        // else (e.g. the snapshots of read-only workers) is kept alive
+        // elsewhere
+        return is_in_ranges(*_ranges, object);
+    }
+
+private:
+    const memory_ranges* _ranges;
+    task_context* _context;
 };
 
 delegate_info create_delegate_info(managed_delegate* delegate)
@@ -84,16 +306,9 @@ void update_workers(
 {
     // Update the workers to their new locations (the list returned by
     // try_lock is in the same order as the workers we passed in)
-    std::size_t count = objects.size();
-    for (std::size_t i = 0; i != count; ++i)
+    for (const worker_field& field : context.worker_fields)
     {
-        void* worker = objects[i];
-        auto range = context.worker_fields.equal_range(i);
-        for (auto it = range.first; it != range.second; ++it)
-        {
-            void** field = it->second;
-            *field = worker;
-        }
+        *field.field = objects[field.index];
     }
 }
 
@@ -118,7 +333,7 @@ void invoke_action(std::any& data)
 
 void invoke_send_or_post_callback(std::any& data)
 {
-    auto context = std::any_cast<std::shared_ptr<task_context>>(data);
+    auto context = std::any_cast<task_context_ptr>(data);
     auto gc = autocrat::global_services.get_service<autocrat::gc_service>();
     auto workers =
         autocrat::global_services.get_service<autocrat::worker_service>();
@@ -127,13 +342,20 @@ void invoke_send_or_post_callback(std::any& data)
     auto objects = workers->try_lock(context->workers);
     if (!objects)
     {
-        // We couldn't lock everything, so queue the work again
+        // We couldn't lock everything, so wait for the worker that is in use
+        // to be released before trying again
         context->heap = gc->reset_heap();
-        context->thread_pool->enqueue(
-            invoke_send_or_post_callback, std::move(data));
+        ++context->attempts;
+        if (!workers->enqueue_when_released(
+                invoke_send_or_post_callback, data, context->attempts))
+        {
+            context->thread_pool->enqueue(
+                invoke_send_or_post_callback, std::move(data));
+        }
     }
     else
     {
+        workers->hold_snapshots(std::move(context->snapshots));
         update_workers(*context, *objects);
         invoke_delegate(
             context->delegate.method, context->delegate.target, context->state);
@@ -149,24 +371,47 @@ task_service::task_service(thread_pool* pool) : _thread_pool(pool)
 {
 }
 
+void task_service::enable_evacuation()
+{
+    _evacuate_state = true;
+}
+
 void task_service::enqueue(managed_delegate* callback, void* state)
 {
-    auto context = std::make_shared<task_context>();
+    task_context_ptr context = context_pool.acquire();
     context->delegate = create_delegate_info(callback);
     context->state = state;
     context->thread_pool = _thread_pool;
 
+    auto workers = global_services.get_service<worker_service>();
     worker_service::object_collection objects;
-    std::tie(objects, context->workers) =
-        global_services.get_service<worker_service>()->release_locked();
+    std::tie(objects, context->workers) = workers->release_locked();
+    context->worker_objects.assign(objects);
+
+    // The read-only workers aren't locked, but the versions that were read
+    // must stay alive as the state may still reference them
+    context->snapshots = workers->release_snapshots();
+
+    if (_evacuate_state)
+    {
+        // The caller may still use the state (e.g. the method that awaited
+        // it), so it can only be copied once the work has finished
+        get_thread_storage()->contexts.emplace_back(std::move(context));
+        return;
+    }
 
     // The state will be the only thing the new task will have access to,
-    // therefore, it acts as the root object
-    worker_field_scanner scanner(context->worker_fields, objects);
-    scanner.scan(state);
+    // therefore, it acts as the root object. There's nothing to find if the
+    // work didn't lock any workers
+    if (!context->worker_objects.empty())
+    {
+        worker_field_scanner scanner(*context);
+        scanner.scan(state);
+    }
 
-    context->heap = global_services.get_service<gc_service>()->reset_heap();
-    _thread_pool->enqueue(invoke_send_or_post_callback, std::move(context));
+    auto gc = global_services.get_service<gc_service>();
+    context->heap = gc->reset_heap();
+    dispatch(std::move(context));
 }
 
 void task_service::start_new(managed_delegate* action)
@@ -175,4 +420,82 @@ void task_service::start_new(managed_delegate* action)
     _thread_pool->enqueue(invoke_action, create_delegate_info(action));
 }
 
+void task_service::dispatch(std::any context)
+{
+    // We know which workers the continuation needs, so let an idle thread
+    // restore them whilst it's waiting to run
+    auto workers = global_services.get_service<worker_service>();
+    workers->prefetch_workers(
+        std::any_cast<task_context_ptr&>(context)->workers);
+
+    // If the current work failed to get a worker (e.g. this is a continuation
+    // of GetWorkerAsync) then there's no point running it until that worker
+    // has been released
+    if (!workers->enqueue_when_released(
+            invoke_send_or_post_callback, context, 0))
+    {
+        _thread_pool->enqueue(invoke_send_or_post_callback, std::move(context));
+    }
+}
+
+void task_service::on_begin_work(detail::deferred_tasks*)
+{
+}
+
+void task_service::on_end_work(detail::deferred_tasks* storage)
+{
+    if (storage->contexts.empty())
+    {
+        return;
+    }
+
+    // Copy what is reachable from each continuation into a new heap so that
+    // the garbage the work created is freed now, rather than being kept
+    // alive until the continuation has finished
+    auto gc = global_services.get_service<gc_service>();
+    gc_heap heap = gc->reset_heap();
+    auto ranges = heap.get_memory_ranges();
+    auto kept = std::stable_partition(
+        storage->contexts.begin(),
+        storage->contexts.end(),
+        [&ranges](std::any& data) {
+            // If the state wasn't allocated by the work then it may reference
+            // anything inside the heap
+            auto& context = *std::any_cast<task_context_ptr&>(data);
+            void* target = context.delegate.target;
+            return ((context.state == nullptr) ||
+                    is_in_ranges(ranges, context.state)) &&
+                ((target == nullptr) || is_in_ranges(ranges, target));
+        });
+    for (auto it = storage->contexts.begin(); it != kept; ++it)
+    {
+        task_context& context = *std::any_cast<task_context_ptr&>(*it);
+        state_evacuator evacuator(ranges, context);
+        context.state = evacuator.evacuate(context.state);
+        context.delegate.target = evacuator.evacuate(context.delegate.target);
+        context.heap = gc->reset_heap();
+        dispatch(std::move(*it));
+    }
+
+    // The continuations that couldn't be copied keep the whole heap (only
+    // one can own it, which matches what happens without evacuation). This
+    // is done last so that nothing is copied from a heap that is in use
+    for (auto it = kept; it != storage->contexts.end(); ++it)
+    {
+        task_context& context = *std::any_cast<task_context_ptr&>(*it);
+        if (!context.worker_objects.empty())
+        {
+            worker_field_scanner scanner(context);
+            scanner.scan(context.state);
+        }
+
+        context.heap = std::exchange(heap, gc_heap());
+        dispatch(std::move(*it));
+    }
+
+    // Let the gc service free the original objects when it ends the work
+    storage->contexts.clear();
+    gc->set_heap(std::move(heap));
+}
+
 }
@@ -42,6 +42,46 @@ void thread_pool::add_observer(lifetime_service* service)
     _observers.emplace_back(service);
 }
 
+void thread_pool::dump_statistics()
+{
+    if (!_track_page_faults)
+    {
+        return;
+    }
+
+    auto report = [](const char* name, std::size_t id, auto& statistics) {
+        std::uint64_t major = statistics.major_faults.load();
+        std::uint64_t minor = statistics.minor_faults.load();
+        spdlog::info(
+            "{} {} page faults: {} minor, {} major",
+            name,
+            id,
+            minor - statistics.reported_minor_faults,
+            major - statistics.reported_major_faults);
+
+        statistics.reported_major_faults = major;
+        statistics.reported_minor_faults = minor;
+    };
+
+    // This is called from the dispatching thread, so we can get its counters
+    // directly
+    pal::page_faults faults = pal::get_thread_page_faults();
+    _dispatcher_statistics.major_faults = faults.major;
+    _dispatcher_statistics.minor_faults = faults.minor;
+    report("Dispatcher thread", 0u, _dispatcher_statistics);
+
+    for (std::size_t i = 0; i != _statistics.size(); ++i)
+    {
+        report("Pool thread", i, _statistics[i]);
+    }
+}
+
+void thread_pool::enable_page_fault_tracking()
+{
+    assert(_threads.size() == 0); // Must be called before starting
+    _track_page_faults = true;
+}
+
 void thread_pool::enqueue(callback_function function, std::any&& arg)
 {
     if (_sleeping != 0)
@@ -52,6 +92,11 @@ void thread_pool::enqueue(callback_function function, std::any&& arg)
     _work.emplace<work_item>({function, std::move(arg)});
 }
 
+bool thread_pool::enqueue_idle(callback_function function, std::any&& arg)
+{
+    return _idle_work.try_emplace<work_item>({function, std::move(arg)});
+}
+
 void thread_pool::start(int cpu_id, int threads, initialize_function initialize)
 {
     spdlog::info(
@@ -59,6 +104,7 @@ void thread_pool::start(int cpu_id, int threads, initialize_function initialize)
 
     // Allocate the threads first, letting the observers know too
     _threads = decltype(_threads)(threads);
+    _statistics = decltype(_statistics)(threads);
     for (auto observer : _observers)
     {
         observer->pool_created(_threads.size());
@@ -81,6 +127,13 @@ void thread_pool::start(int cpu_id, int threads, initialize_function initialize)
         std::this_thread::yield();
     }
 
+    if (_track_page_faults)
+    {
+        pal::page_faults faults = pal::get_thread_page_faults();
+        _dispatcher_statistics.reported_major_faults = faults.major;
+        _dispatcher_statistics.reported_minor_faults = faults.minor;
+    }
+
     spdlog::debug("Thread pool initialized");
 }
 
@@ -113,6 +166,16 @@ void thread_pool::perform_work(
         std::scoped_lock lock(thread_initializing);
         spdlog::debug("Initializing thread {}", index);
         initialize(index);
+
+        // Ignore the faults caused by starting up the thread
+        if (_track_page_faults)
+        {
+            update_page_faults(index);
+            thread_statistics& statistics = _statistics[index];
+            statistics.reported_major_faults = statistics.major_faults;
+            statistics.reported_minor_faults = statistics.minor_faults;
+        }
+
         ++_initialized;
     }
 
@@ -124,10 +187,14 @@ void thread_pool::perform_work(
     while (_is_running)
     {
         work_item work = {};
-        if (_work.pop(&work))
+        if (_work.pop(&work) || _idle_work.pop(&work))
         {
             spin_count = 0;
             invoke_work_item(index, work);
+            if (_track_page_faults)
+            {
+                update_page_faults(index);
+            }
         }
         else if (spin_count < maximum_spins)
         {
@@ -142,6 +209,14 @@ void thread_pool::perform_work(
     }
 }
 
+void thread_pool::update_page_faults(std::size_t index)
+{
+    pal::page_faults faults = pal::get_thread_page_faults();
+    thread_statistics& statistics = _statistics[index];
+    statistics.major_faults.store(faults.major, std::memory_order_relaxed);
+    statistics.minor_faults.store(faults.minor, std::memory_order_relaxed);
+}
+
 void thread_pool::wait_for_work()
 {
     std::uint32_t count = ++_sleeping;
@@ -1,215 +1,2326 @@
 #include "worker_service.h"
+#include "gc_service.h"
+#include "managed_exports.h"
+#include "pal.h"
+#include "pause.h"
+#include "services.h"
 #include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <functional>
 #include <mutex>
 #include <shared_mutex>
+#include <spdlog/spdlog.h>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
 
 namespace
 {
 
+using waiter_batch = std::vector<autocrat::detail::worker_waiter>;
+
+struct expiry_request
+{
+    autocrat::worker_service* service;
+    const autocrat::detail::worker_key* key;
+    autocrat::worker_info* info;
+};
+
+struct sweep_request
+{
+    autocrat::worker_service* service;
+    void (autocrat::worker_service::*sweep)(
+        std::size_t,
+        std::chrono::microseconds);
+    std::atomic_size_t* remaining;
+    std::size_t shard;
+    std::chrono::microseconds time;
+};
+
+struct checkpoint_request
+{
+    autocrat::worker_service* service;
+    autocrat::detail::checkpoint_pass* pass;
+    std::size_t shard;
+    bool retry;
+};
+
+struct prefetch_request
+{
+    autocrat::worker_service* service;
+    autocrat::worker_info* info;
+};
+
+struct preload_progress
+{
+    std::atomic_size_t created = 0;
+    std::atomic_size_t loaded = 0;
+    std::atomic_size_t processed = 0;
+    std::size_t remaining = 0;
+    std::exception_ptr error;
+    std::condition_variable finished;
+    std::mutex lock;
+};
+
+struct preload_request
+{
+    autocrat::worker_service* service;
+    autocrat::detail::worker_type* worker_type;
+    autocrat::detail::worker_key::type_handle type;
+    const std::vector<std::string_view>* ids;
+    preload_progress* progress;
+    std::chrono::microseconds now;
+};
+
+void commit_checkpoint(std::any& arg)
+{
+    autocrat::detail::checkpoint_pass& pass =
+        *std::any_cast<autocrat::detail::checkpoint_pass*>(arg);
+    {
+        std::lock_guard<std::mutex> lock(pass.writer_lock);
+        try
+        {
+            pass.writer.commit();
+            pass.committed = true;
+        }
+        catch (...)
+        {
+            pass.error = std::current_exception();
+        }
+    }
+
+    pass.remaining.fetch_sub(1, std::memory_order_release);
+}
+
+void deliver_batch(std::any& arg)
+{
+    auto gc = autocrat::global_services.get_service<autocrat::gc_service>();
+
+    // Each work item swaps in its own heap, however, a worker loaded by one
+    // of them stays loaded for the rest of the batch so we need to keep the
+    // heaps alive until the batch has finished (the worker is then saved
+    // and the memory freed at the end of the work as normal)
+    autocrat::gc_heap batch_heap = gc->reset_heap();
+    for (autocrat::detail::worker_waiter& waiter :
+         std::any_cast<waiter_batch&>(arg))
+    {
+        waiter.callback(waiter.arg);
+        waiter.arg.reset();
+        batch_heap.append(gc->reset_heap());
+    }
+
+    gc->set_heap(std::move(batch_heap));
+}
+
+autocrat::detail::snapshot_handle make_snapshot(void* object)
+{
+    auto snapshot = std::make_shared<autocrat::detail::worker_snapshot>();
+    snapshot->object = snapshot->arena.save(object, 0);
+    return snapshot;
+}
+
 std::uintptr_t get_type(const void* type)
 {
-    // We don't use these bits on x64
-    return reinterpret_cast<std::uintptr_t>(type) >> 3;
+    // We don't use these bits on x64
+    return reinterpret_cast<std::uintptr_t>(type) >> 3;
+}
+
+const void* get_type_pointer(std::uintptr_t type)
+{
+    return reinterpret_cast<const void*>(type << 3);
+}
+
+std::int64_t get_elapsed_ns(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+using counter_values = autocrat::detail::worker_counters<std::uint64_t>;
+
+constexpr std::size_t hot_worker_count = 5u;
+
+// Each thread only adds one in this many of its locks (and failed locks) to
+// the counts of the workers, which are used to find the most used workers,
+// so that the threads sharing a worker don't keep writing to its counters
+constexpr std::uint32_t statistics_sample_rate = 8u;
+
+// How often the workers that were in use when a checkpoint was written are
+// tried again
+constexpr std::chrono::milliseconds checkpoint_retry_interval(10);
+
+using autocrat::detail::hot_worker;
+
+// Keeps the workers with the highest counts in a heap that has the lowest of
+// them at the front, so only the workers that make it in have their id copied
+class hot_workers
+{
+public:
+    explicit hot_workers(std::vector<hot_worker>& workers) : _workers(workers)
+    {
+    }
+
+    void add(std::uint32_t count, const autocrat::detail::worker_key& key)
+    {
+        if ((count != 0) && make_room(count))
+        {
+            push({count, key.type, std::string(key.id)});
+        }
+    }
+
+    void add(hot_worker&& worker)
+    {
+        if (make_room(worker.count))
+        {
+            push(std::move(worker));
+        }
+    }
+
+    std::vector<hot_worker> take()
+    {
+        // Sorting with the same comparison puts the highest count first
+        std::sort_heap(_workers.begin(), _workers.end(), is_higher);
+        return std::exchange(_workers, {});
+    }
+
+private:
+    static bool is_higher(const hot_worker& a, const hot_worker& b)
+    {
+        return a.count > b.count;
+    }
+
+    bool make_room(std::uint32_t count)
+    {
+        if (_workers.size() == hot_worker_count)
+        {
+            if (count <= _workers.front().count)
+            {
+                return false;
+            }
+
+            std::pop_heap(_workers.begin(), _workers.end(), is_higher);
+            _workers.pop_back();
+        }
+
+        return true;
+    }
+
+    void push(hot_worker&& worker)
+    {
+        _workers.push_back(std::move(worker));
+        std::push_heap(_workers.begin(), _workers.end(), is_higher);
+    }
+
+    std::vector<hot_worker>& _workers;
+};
+
+void add_counter(std::atomic_uint64_t& counter, std::uint64_t value)
+{
+    // Only the owning thread changes the counter, so it doesn't need the
+    // cost of an atomic increment
+    counter.store(
+        counter.load(std::memory_order_relaxed) + value,
+        std::memory_order_relaxed);
+}
+
+bool is_sampled(std::uint32_t& countdown)
+{
+    if (countdown == 0)
+    {
+        countdown = statistics_sample_rate - 1u;
+        return true;
+    }
+
+    --countdown;
+    return false;
+}
+
+std::uint64_t average(std::uint64_t total, std::uint64_t count)
+{
+    return (count > 0) ? total / count : 0;
+}
+
+template <class T, class U, class Func>
+void for_each_counter(T& a, U& b, Func func)
+{
+    func(a.lock_failures, b.lock_failures);
+    func(a.locks, b.locks);
+    func(a.lock_time_ns, b.lock_time_ns);
+    func(a.restores, b.restores);
+    func(a.restore_time_ns, b.restore_time_ns);
+    func(a.saves, b.saves);
+    func(a.save_time_ns, b.save_time_ns);
+    func(a.saved_bytes, b.saved_bytes);
+    func(a.saved_objects, b.saved_objects);
+}
+
+std::string format_id(std::string_view id)
+{
+    // String identifiers are logged as they are, however, the integer and
+    // GUID identifiers are stored as their bytes
+    auto is_printable = [](char c) {
+        return std::isprint(static_cast<unsigned char>(c)) != 0;
+    };
+    if (!id.empty() && std::all_of(id.begin(), id.end(), is_printable))
+    {
+        return std::string(id);
+    }
+
+    if (id.size() == sizeof(std::int64_t))
+    {
+        std::int64_t value;
+        std::memcpy(&value, id.data(), sizeof(value));
+        return std::to_string(value);
+    }
+
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(id.size() * 2u);
+    for (char c : id)
+    {
+        auto byte = static_cast<unsigned char>(c);
+        hex.push_back(digits[byte >> 4u]);
+        hex.push_back(digits[byte & 0x0fu]);
+    }
+
+    return hex;
+}
+
+}
+
+namespace autocrat
+{
+
+worker_service::worker_service(thread_pool* pool) : _thread_pool(pool)
+{
+}
+
+void worker_service::check_and_dispatch()
+{
+    if (_workers.epoch() != _reclaimed_epoch)
+    {
+        reclaim_workers();
+    }
+
+    if ((_checkpoint != nullptr) && advance_checkpoint())
+    {
+        std::unique_ptr<detail::checkpoint_pass> pass = std::move(_checkpoint);
+        if (pass->error == nullptr)
+        {
+            spdlog::info(
+                "Saved {} workers to '{}'",
+                pass->count.load(std::memory_order_relaxed),
+                pass->path.string());
+        }
+        else
+        {
+            try
+            {
+                std::rethrow_exception(pass->error);
+            }
+            catch (const std::exception& ex)
+            {
+                spdlog::warn("Unable to save the checkpoint: {}", ex.what());
+            }
+        }
+    }
+}
+
+void worker_service::compress_idle_workers()
+{
+    if (_compress_idle_time.count() > 0)
+    {
+        queue_sweep(
+            _compress_sweeps,
+            &worker_service::compress_shard,
+            pal::get_current_time() - _compress_idle_time);
+    }
+}
+
+void worker_service::compress_shard(
+    std::size_t shard,
+    std::chrono::microseconds idle_since)
+{
+    _workers.for_each_in_shard(
+        shard, [&](const worker_key&, worker_info& info) {
+            // Only lock the workers that look idle, so that work using the
+            // others doesn't fail to lock them
+            if ((info.last_used.load(std::memory_order_relaxed) > idle_since) ||
+                (info.stored_bytes.load(std::memory_order_relaxed) == 0) ||
+                info.lock.is_locked() || !info.lock.try_lock())
+            {
+                return;
+            }
+
+            // Spilled workers are already out of memory and checkpointed ones
+            // haven't been read into memory yet
+            if ((info.object == nullptr) &&
+                std::holds_alternative<std::monostate>(info.data) &&
+                !info.serializer.is_compressed() &&
+                (info.last_used.load(std::memory_order_relaxed) <= idle_since))
+            {
+                std::size_t original_size = info.serializer.size();
+                auto start = std::chrono::steady_clock::now();
+                bool is_compressed = info.serializer.compress();
+
+                detail::compression_statistics& statistics =
+                    info.type->compression;
+                statistics.compress_time_ns.fetch_add(
+                    get_elapsed_ns(start), std::memory_order_relaxed);
+                if (is_compressed)
+                {
+                    statistics.compressed_count.fetch_add(
+                        1, std::memory_order_relaxed);
+                    statistics.original_bytes.fetch_add(
+                        original_size, std::memory_order_relaxed);
+                    statistics.compressed_bytes.fetch_add(
+                        info.serializer.size(), std::memory_order_relaxed);
+                }
+            }
+
+            unlock_worker(info);
+        });
+}
+
+void worker_service::dump_statistics()
+{
+    node_pool_statistics statistics = memory_pool_buffer::statistics();
+    spdlog::info(
+        "Worker storage nodes: {} allocated, {} free, {} in use",
+        statistics.allocated,
+        statistics.free,
+        statistics.in_use);
+
+    spdlog::info(
+        "Workers saved: {}, unchanged (not saved): {}",
+        _saved_count.exchange(0),
+        _unchanged_count.exchange(0));
+
+    spdlog::info(
+        "Worker contention: {} work items waited, {} failed to lock all "
+        "their workers ({} after locking some of them)",
+        _parked_count.exchange(0),
+        _lock_failed_count.exchange(0),
+        _lock_abandoned_count.exchange(0));
+
+    if (_max_batch > 0)
+    {
+        spdlog::info(
+            "Waiting work delivered in {} batches", _batch_count.exchange(0));
+    }
+
+    spdlog::info(
+        "Read-only workers: {} reads, {} versions published",
+        _snapshot_reads.exchange(0),
+        _snapshot_count.exchange(0));
+
+    if (_expiry_enabled)
+    {
+        spdlog::info("Workers expired: {}", _expired_count.exchange(0));
+    }
+
+    // The live workers, and their bytes, are kept up to date as they change
+    // (the bytes of workers that are in use are from when they were last
+    // released). The rest is gathered by the work queued by the last call,
+    // so is only taken if that has finished
+    bool gathered = _statistics_sweeps.load(std::memory_order_acquire) == 0;
+    for (auto& [type, worker_type] : _types)
+    {
+        std::size_t in_use =
+            gathered ? worker_type.in_use.exchange(0, std::memory_order_relaxed)
+                     : 0;
+        std::size_t live =
+            worker_type.live_count.load(std::memory_order_relaxed);
+        if (live == 0)
+        {
+            continue;
+        }
+
+        spdlog::info(
+            "Workers of type {}: {} live ({} in use), {} bytes",
+            get_type_pointer(type),
+            live,
+            in_use,
+            worker_type.stored_bytes.load(std::memory_order_relaxed));
+    }
+
+    std::vector<hot_worker> most_locked;
+    std::vector<hot_worker> most_contended;
+    if (gathered)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_hot_workers_lock);
+            most_locked = hot_workers(_most_locked).take();
+            most_contended = hot_workers(_most_contended).take();
+        }
+
+        queue_sweep(
+            _statistics_sweeps,
+            &worker_service::statistics_shard,
+            std::chrono::microseconds());
+    }
+
+    if (_compress_idle_time.count() > 0)
+    {
+        for (auto& [type, worker_type] : _types)
+        {
+            detail::compression_statistics& statistics =
+                worker_type.compression;
+            std::size_t count = statistics.compressed_count.exchange(0);
+            std::size_t original = statistics.original_bytes.exchange(0);
+            std::size_t compressed = statistics.compressed_bytes.exchange(0);
+            std::int64_t compress_ns = statistics.compress_time_ns.exchange(0);
+            std::size_t restored = statistics.restored_count.exchange(0);
+            std::int64_t restore_ns = statistics.restore_time_ns.exchange(0);
+            if ((count == 0) && (restored == 0))
+            {
+                continue;
+            }
+
+            spdlog::info(
+                "Worker compression of type {}: {} compressed from {} to {} "
+                "bytes ({:.1f}x) taking {} us, {} restored taking {} us",
+                get_type_pointer(type),
+                count,
+                original,
+                compressed,
+                (compressed > 0) ? static_cast<double>(original) / compressed
+                                 : 0.0,
+                compress_ns / 1'000,
+                restored,
+                restore_ns / 1'000);
+        }
+    }
+
+    if (_prefetch_enabled)
+    {
+        std::size_t prefetched = _prefetched_count.exchange(0);
+        std::size_t hits = _prefetch_hits.exchange(0);
+        spdlog::info(
+            "Worker prefetch: {} restored ahead of time, {} used ({:.1f}% "
+            "hit rate), {} skipped",
+            prefetched,
+            hits,
+            (prefetched > 0) ? (100.0 * hits) / prefetched : 0.0,
+            _prefetch_skipped.exchange(0));
+    }
+
+    if (_spill_store != nullptr)
+    {
+        spdlog::info(
+            "Worker spill store: {} bytes on disk, {} spilled, {} hits, {} "
+            "misses",
+            _spill_store->size(),
+            _spilled_count.exchange(0),
+            _spill_hits.exchange(0),
+            _spill_misses.exchange(0));
+    }
+
+    if (!_collect_statistics)
+    {
+        return;
+    }
+
+    for (auto& [type, worker_type] : _types)
+    {
+        // The counters only ever increase, so report the change since they
+        // were last reported
+        counter_values totals;
+        std::size_t index = worker_type.index;
+        for_each_thread_storage([&](storage_type& storage) {
+            std::shared_lock<decltype(storage.counters_lock)> lock(
+                storage.counters_lock);
+            if ((index < storage.counters.size()) &&
+                (storage.counters[index] != nullptr))
+            {
+                for_each_counter(
+                    totals,
+                    *storage.counters[index],
+                    [](std::uint64_t& total, const std::atomic_uint64_t& v) {
+                        total += v.load(std::memory_order_relaxed);
+                    });
+            }
+        });
+
+        for_each_counter(
+            totals,
+            worker_type.reported,
+            [](std::uint64_t& total, std::uint64_t& reported) {
+                reported = std::exchange(total, total - reported);
+            });
+        if ((totals.locks == 0) && (totals.lock_failures == 0) &&
+            (totals.restores == 0) && (totals.saves == 0))
+        {
+            continue;
+        }
+
+        spdlog::info(
+            "Worker locking of type {}: {} locked for {} us on average, {} "
+            "failed to lock",
+            get_type_pointer(type),
+            totals.locks,
+            average(totals.lock_time_ns, totals.saves) / 1'000,
+            totals.lock_failures);
+        spdlog::info(
+            "Worker serialization of type {}: {} restored taking {} us on "
+            "average, {} saved taking {} us on average ({} bytes and {} "
+            "objects on average)",
+            get_type_pointer(type),
+            totals.restores,
+            average(totals.restore_time_ns, totals.restores) / 1'000,
+            totals.saves,
+            average(totals.save_time_ns, totals.saves) / 1'000,
+            average(totals.saved_bytes, totals.saves),
+            average(totals.saved_objects, totals.saves));
+    }
+
+    for (const hot_worker& worker : most_locked)
+    {
+        spdlog::info(
+            "Most locked worker of type {}: {} (about {} times)",
+            get_type_pointer(worker.type),
+            format_id(worker.id),
+            worker.count);
+    }
+
+    for (const hot_worker& worker : most_contended)
+    {
+        spdlog::info(
+            "Most contended worker of type {}: {} (about {} failed locks)",
+            get_type_pointer(worker.type),
+            format_id(worker.id),
+            worker.count);
+    }
+}
+
+void worker_service::enable_batching(std::size_t max_batch)
+{
+    _max_batch = max_batch;
+}
+
+void worker_service::enable_compression(std::chrono::seconds idle_time)
+{
+    _compress_idle_time = idle_time;
+    _track_last_used = true;
+}
+
+void worker_service::enable_expiry(std::chrono::seconds time_to_live)
+{
+    _time_to_live = time_to_live;
+    _expiry_enabled = _expiry_enabled || (time_to_live.count() > 0);
+    _track_last_used = _track_last_used || _expiry_enabled;
+}
+
+void worker_service::enable_prefetch()
+{
+    _prefetch_enabled = true;
+}
+
+void worker_service::enable_resident_workers(std::size_t garbage_percentage)
+{
+    _garbage_percentage = garbage_percentage;
+    _resident_workers = true;
+}
+
+void worker_service::enable_spilling(
+    const std::filesystem::path& directory,
+    std::chrono::seconds idle_time,
+    std::size_t memory_budget)
+{
+    _spill_store = std::make_unique<spill_store>(directory);
+    _spill_idle_time = idle_time;
+    _memory_budget = memory_budget;
+    _track_last_used = true;
+}
+
+void worker_service::enable_statistics()
+{
+    _collect_statistics = true;
+}
+
+bool worker_service::enqueue_when_released(
+    thread_pool::callback_function callback,
+    std::any& arg,
+    std::uint32_t age)
+{
+    worker_info* info = std::exchange(get_thread_storage()->contended, nullptr);
+    if (info == nullptr)
+    {
+        return false;
+    }
+
+    // The fence pairs with the one in unlock_worker, so either it sees the
+    // waiters we're about to add or we see that the worker was released
+    detail::worker_extras& extras = get_extras(*info);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::unique_lock<decltype(extras.waiters_lock)> lock(extras.waiters_lock);
+
+    // The worker may have been released since we failed to lock it, in which
+    // case there's nothing to wait for (we hold the waiters lock, so if it's
+    // released after this check then it will see our work when it wakes the
+    // waiters)
+    if (info->lock.try_lock())
+    {
+        info->lock.unlock();
+        return false;
+    }
+
+    // Work that has waited before goes in front of newer work, so that work
+    // needing several workers isn't starved by work needing only one of them
+    auto position = std::find_if(
+        extras.waiters.begin(),
+        extras.waiters.end(),
+        [age](const detail::worker_waiter& waiter) {
+            return waiter.age < age;
+        });
+    extras.waiters.insert(position, {callback, std::move(arg), age});
+    _parked_count.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void worker_service::expire_idle_workers()
+{
+    if (_expiry_enabled)
+    {
+        queue_sweep(
+            _expire_sweeps,
+            &worker_service::expire_shard,
+            pal::get_current_time());
+    }
+}
+
+void worker_service::expire_shard(
+    std::size_t shard,
+    std::chrono::microseconds now)
+{
+    // This runs inside a work item, which has published its epoch, so the
+    // entries we remove can't be freed until after we've finished with them
+    _workers.for_each_in_shard(
+        shard, [&](const worker_key& key, worker_info& info) {
+            std::optional<std::chrono::microseconds> idle_since =
+                get_idle_since(key.type, now);
+            if (!idle_since.has_value() ||
+                (info.expiry.load(std::memory_order_relaxed) !=
+                 detail::expiry_state::none))
+            {
+                return;
+            }
+
+            // Only lock the workers that look idle, so that work using the
+            // others doesn't fail to lock them
+            if ((get_last_used(info) > *idle_since) || info.lock.is_locked() ||
+                !info.lock.try_lock())
+            {
+                return;
+            }
+
+            if (!is_idle(info, *idle_since))
+            {
+                unlock_worker(info);
+                return;
+            }
+
+            if (_types.at(key.type).notify_expired)
+            {
+                // The managed code needs to run on a thread from the pool,
+                // which will check the worker is still idle before removing it
+                info.expiry.store(
+                    detail::expiry_state::pending, std::memory_order_relaxed);
+                unlock_worker(info);
+                _thread_pool->enqueue(
+                    expire_worker, expiry_request{this, &key, &info});
+            }
+            else
+            {
+                evict_worker(key, info, false);
+            }
+        });
+}
+
+void* worker_service::get_read_only_worker(
+    const void* type_ptr,
+    std::string_view id)
+{
+    std::uintptr_t type = get_type(type_ptr);
+    worker_info* info = _workers.find(type, id);
+    if (info == nullptr)
+    {
+        // There's nothing to share yet, so create it as a normal worker
+        return make_worker(type, id);
+    }
+
+    // If we're changing the worker then read our version of it
+    storage_type* storage = get_thread_storage();
+    auto& locked_workers = storage->locked;
+    if (std::find(locked_workers.begin(), locked_workers.end(), info) !=
+        locked_workers.end())
+    {
+        return info->object;
+    }
+
+    detail::worker_extras& extras = get_extras(*info);
+    detail::snapshot_handle snapshot;
+    {
+        std::shared_lock<decltype(extras.snapshot_lock)> lock(
+            extras.snapshot_lock);
+        snapshot = extras.snapshot;
+    }
+
+    if (snapshot == nullptr)
+    {
+        // The first reader creates the version, which needs the worker to
+        // be locked so that its saved data can be restored
+        if (!info->lock.try_lock())
+        {
+            storage->contended = info;
+            record_contention(*info);
+            return nullptr;
+        }
+
+        if (info->expiry.load(std::memory_order_relaxed) ==
+            detail::expiry_state::expired)
+        {
+            info->lock.unlock();
+            return nullptr;
+        }
+
+        try
+        {
+            // Another reader may have beaten us to it
+            snapshot = extras.snapshot;
+            if (snapshot == nullptr)
+            {
+                if (info->object != nullptr)
+                {
+                    snapshot = make_snapshot(info->object);
+                }
+                else
+                {
+                    // Saving the unchanged object keeps the existing data,
+                    // but lets the serializer know the restored copy isn't
+                    // in use anymore
+                    void* object = restore_worker(*info);
+                    snapshot = make_snapshot(object);
+                    info->serializer.save(object);
+                }
+
+                publish_snapshot(*info, snapshot);
+            }
+        }
+        catch (...)
+        {
+            unlock_worker(*info);
+            throw;
+        }
+
+        unlock_worker(*info);
+    }
+
+    auto& snapshots = storage->snapshots;
+    if (std::find(snapshots.begin(), snapshots.end(), snapshot) ==
+        snapshots.end())
+    {
+        snapshots.push_back(snapshot);
+    }
+
+    if (_expiry_enabled)
+    {
+        // Reading the worker counts as using it, but we don't hold its lock
+        extras.last_read.store(
+            pal::get_current_time(), std::memory_order_relaxed);
+    }
+
+    _snapshot_reads.fetch_add(1, std::memory_order_relaxed);
+    return snapshot->object;
+}
+
+void* worker_service::get_worker(const void* type_ptr, std::string_view id)
+{
+    std::uintptr_t type = get_type(type_ptr);
+    void* worker = nullptr;
+    if (find_existing(type, id, worker))
+    {
+        return worker;
+    }
+    else
+    {
+        return make_worker(type, id);
+    }
+}
+
+void worker_service::hold_snapshots(snapshot_collection snapshots)
+{
+    auto& held = get_thread_storage()->snapshots;
+    held.insert(
+        held.end(),
+        std::make_move_iterator(snapshots.begin()),
+        std::make_move_iterator(snapshots.end()));
+}
+
+bool worker_service::is_expiry_enabled() const
+{
+    return _expiry_enabled;
+}
+
+std::size_t worker_service::load_checkpoint(const std::filesystem::path& path)
+{
+    worker_key::type_handle anchor = 0;
+    std::uint64_t fingerprint = get_type_fingerprint(anchor);
+    auto reader = std::make_shared<checkpoint_reader>(
+        path, get_type_pointer(anchor), fingerprint);
+
+    // The workers haven't been used by this run of the program, so they are
+    // treated as last used now for working out when they expire
+    std::chrono::microseconds now = {};
+    if (_track_last_used)
+    {
+        now = pal::get_current_time();
+    }
+
+    std::size_t count = 0;
+    for (const checkpoint_entry& entry : reader->entries())
+    {
+        auto type = static_cast<worker_key::type_handle>(anchor + entry.type);
+        bool inserted =
+            _workers
+                .try_emplace(
+                    type,
+                    entry.id,
+                    [&](worker_info& info) {
+                        info.data =
+                            detail::checkpointed_worker{reader, entry.location};
+                        info.last_used.store(now, std::memory_order_relaxed);
+                        info.type = &_types.at(type);
+                    })
+                .second;
+        if (inserted)
+        {
+            _types.at(type).live_count.fetch_add(1, std::memory_order_relaxed);
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+void worker_service::prefetch_workers(const worker_collection& workers)
+{
+    // Resident workers are never saved, so there's nothing to restore
+    if (!_prefetch_enabled || _resident_workers)
+    {
+        return;
+    }
+
+    for (worker_info* info : workers)
+    {
+        // The continuation has pinned the worker, so it can't be removed
+        // before now, and the extra pin keeps it until the prefetch has run
+        info->pins.fetch_add(1, std::memory_order_relaxed);
+        if (!_thread_pool->enqueue_idle(
+                prefetch_worker, prefetch_request{this, info}))
+        {
+            info->pins.fetch_sub(1, std::memory_order_relaxed);
+            _prefetch_skipped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::size_t worker_service::preload_workers(
+    const void* type_ptr,
+    const std::vector<std::string_view>& ids)
+{
+    std::uintptr_t type = get_type(type_ptr);
+    auto worker_type = _types.find(type);
+    if ((worker_type == _types.end()) ||
+        (worker_type->second.constructor == nullptr))
+    {
+        throw std::invalid_argument("Type has not been registered");
+    }
+
+    // Each batch only adds to one part of the map, so the batches don't
+    // contend with each other when adding their workers
+    using map_type = worker_map<worker_info>;
+    std::vector<std::vector<std::string_view>> batches(map_type::shard_count);
+    for (std::string_view id : ids)
+    {
+        batches[map_type::get_shard_index(type, id)].push_back(id);
+    }
+
+    preload_progress progress;
+    std::chrono::microseconds now = {};
+    if (_track_last_used)
+    {
+        now = pal::get_current_time();
+    }
+
+    // Waiting on a thread from the pool could wait forever, as the batches
+    // may be queued behind the work item that is waiting, so they are run
+    // on the calling thread instead
+    bool run_inline = has_thread_storage();
+    progress.remaining = static_cast<std::size_t>(std::count_if(
+        batches.begin(), batches.end(), [](const auto& batch) {
+            return !batch.empty();
+        }));
+
+    auto start = std::chrono::steady_clock::now();
+    for (const std::vector<std::string_view>& batch : batches)
+    {
+        if (!batch.empty())
+        {
+            std::any request = preload_request{
+                this, &worker_type->second, type, &batch, &progress, now};
+            if (run_inline)
+            {
+                preload_batch(request);
+            }
+            else
+            {
+                _thread_pool->enqueue(preload_batch, std::move(request));
+            }
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(progress.lock);
+    while (!progress.finished.wait_for(
+        lock, std::chrono::seconds(1), [&progress]() {
+            return progress.remaining == 0;
+        }))
+    {
+        spdlog::info(
+            "Preloading workers: {} of {} done",
+            progress.processed.load(std::memory_order_relaxed),
+            ids.size());
+    }
+
+    if (progress.error != nullptr)
+    {
+        std::rethrow_exception(progress.error);
+    }
+
+    std::size_t created = progress.created.load(std::memory_order_relaxed);
+    std::size_t loaded = progress.loaded.load(std::memory_order_relaxed);
+    spdlog::info(
+        "Preloaded {} workers in {} ms ({} created, {} read from the "
+        "checkpoint)",
+        ids.size(),
+        get_elapsed_ns(start) / 1'000'000,
+        created,
+        loaded);
+    return created + loaded;
+}
+
+void worker_service::queue_checkpoint(const std::filesystem::path& path)
+{
+    // Only this thread starts a checkpoint, so if the previous one is still
+    // being written (e.g. it's waiting for a busy worker) then skip this one
+    if (_checkpoint == nullptr)
+    {
+        start_checkpoint(path);
+    }
+}
+
+void worker_service::register_type(
+    const void* type,
+    construct_worker constructor)
+{
+    add_type(type).constructor = constructor;
+}
+
+auto worker_service::release_locked()
+    -> std::tuple<object_collection, worker_collection>
+{
+    // Sort the workers so that work needing overlapping workers will lock
+    // them in the same order and, therefore, will contend on the first
+    // shared worker rather than each holding some the other needs
+    auto& locked_workers = get_thread_storage()->locked;
+    std::sort(locked_workers.begin(), locked_workers.end(), std::less<>());
+
+    object_collection objects(locked_workers.size());
+    worker_collection workers(locked_workers.size());
+
+    void** object_it = objects.data();
+    worker_info** worker_it = workers.data();
+    for (worker_info* worker : locked_workers)
+    {
+        // The continuation will need the worker again, so stop it from
+        // expiring until then
+        ++worker->pins;
+        *object_it++ = worker->object;
+        *worker_it++ = worker;
+        save_worker(*worker);
+    }
+
+    locked_workers.clear();
+    return std::make_tuple(std::move(objects), std::move(workers));
+}
+
+auto worker_service::release_snapshots() -> snapshot_collection
+{
+    return std::exchange(get_thread_storage()->snapshots, {});
+}
+
+std::size_t worker_service::save_checkpoint(const std::filesystem::path& path)
+{
+    // A checkpoint that is already being written may be to the same file, so
+    // it's finished (and its result logged) first
+    if (_checkpoint != nullptr)
+    {
+        wait_for_checkpoint();
+        check_and_dispatch();
+    }
+
+    start_checkpoint(path);
+    wait_for_checkpoint();
+
+    std::unique_ptr<detail::checkpoint_pass> pass = std::move(_checkpoint);
+    if (pass->error != nullptr)
+    {
+        std::rethrow_exception(pass->error);
+    }
+
+    return pass->count.load(std::memory_order_relaxed);
+}
+
+void worker_service::set_time_to_live(
+    const void* type,
+    std::chrono::seconds time_to_live,
+    bool notify)
+{
+    detail::worker_type& worker_type = add_type(type);
+    if (time_to_live.count() >= 0)
+    {
+        worker_type.time_to_live = time_to_live;
+    }
+
+    worker_type.notify_expired = notify;
+    _expiry_enabled = _expiry_enabled || (time_to_live.count() > 0);
+    _track_last_used = _track_last_used || _expiry_enabled;
+}
+
+void worker_service::spill_idle_workers()
+{
+    if (_spill_store != nullptr)
+    {
+        queue_sweep(
+            _spill_sweeps,
+            &worker_service::spill_shard,
+            pal::get_current_time() - _spill_idle_time);
+    }
+}
+
+void worker_service::spill_shard(
+    std::size_t shard,
+    std::chrono::microseconds idle_since)
+{
+    struct spill_candidate
+    {
+        std::chrono::microseconds last_used;
+        worker_info* info;
+    };
+
+    // Find the saved workers from what was recorded when they were last
+    // released, so that the ones in use aren't locked. Note removed workers
+    // aren't freed whilst this work item is running, so it's safe to use
+    // their address after we've looked at them
+    bool over_budget = (_memory_budget > 0) &&
+        (_stored_bytes.load(std::memory_order_relaxed) > _memory_budget);
+    std::vector<spill_candidate> candidates;
+    _workers.for_each_in_shard(
+        shard, [&](const worker_key&, worker_info& info) {
+            std::chrono::microseconds last_used =
+                info.last_used.load(std::memory_order_relaxed);
+            if ((info.stored_bytes.load(std::memory_order_relaxed) > 0) &&
+                !info.lock.is_locked() &&
+                (over_budget || (last_used <= idle_since)))
+            {
+                candidates.push_back({last_used, &info});
+            }
+        });
+
+    // Spill the least recently used first so that, when over budget, the
+    // workers most likely to be used again stay in memory
+    std::sort(
+        candidates.begin(),
+        candidates.end(),
+        [](const spill_candidate& a, const spill_candidate& b) {
+            return a.last_used < b.last_used;
+        });
+
+    std::size_t spilled = 0;
+    for (const spill_candidate& candidate : candidates)
+    {
+        bool is_idle = candidate.last_used <= idle_since;
+        over_budget = (_memory_budget > 0) &&
+            (_stored_bytes.load(std::memory_order_relaxed) > _memory_budget);
+        if (!is_idle && !over_budget)
+        {
+            break;
+        }
+
+        worker_info& info = *candidate.info;
+        if (!info.lock.try_lock())
+        {
+            continue;
+        }
+
+        // The worker may have been used since we last looked at it
+        if ((info.object == nullptr) &&
+            !std::holds_alternative<spill_location>(info.data) &&
+            (info.last_used.load(std::memory_order_relaxed) ==
+             candidate.last_used) &&
+            (info.serializer.size() > 0) &&
+            (info.expiry.load(std::memory_order_relaxed) !=
+             detail::expiry_state::expired))
+        {
+            try
+            {
+                info.data = info.serializer.spill(*_spill_store);
+            }
+            catch (const std::exception& ex)
+            {
+                unlock_worker(info);
+                spdlog::warn("Unable to spill worker to disk: {}", ex.what());
+                break;
+            }
+
+            ++spilled;
+        }
+
+        // This updates the bytes stored, which we check against the budget
+        unlock_worker(info);
+    }
+
+    _spilled_count.fetch_add(spilled, std::memory_order_relaxed);
+}
+
+void worker_service::sweep_shard(std::any& arg)
+{
+    auto& request = std::any_cast<sweep_request&>(arg);
+    try
+    {
+        (request.service->*request.sweep)(request.shard, request.time);
+    }
+    catch (const std::exception& ex)
+    {
+        spdlog::warn("Unable to process the idle workers: {}", ex.what());
+    }
+
+    request.remaining->fetch_sub(1, std::memory_order_release);
+}
+
+auto worker_service::try_lock(const worker_collection& workers)
+    -> std::optional<object_collection>
+{
+    // Since the workers locks are recursive, we can go through and try to
+    // lock them all. If that works we can then call load_worker, which
+    // will lock it again. This means it's locked twice so we need to
+    // unlock it once inside this method, which also allows us to handle
+    // the case that we only locked some of them and, therefore, need to
+    // unlock them again.
+    std::size_t locked_count = 0;
+    for (; locked_count != workers.size(); ++locked_count)
+    {
+        if (!workers[locked_count]->lock.try_lock())
+        {
+            get_thread_storage()->contended = workers[locked_count];
+            record_contention(*workers[locked_count]);
+            _lock_failed_count.fetch_add(1, std::memory_order_relaxed);
+            if (locked_count > 0)
+            {
+                _lock_abandoned_count.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            break;
+        }
+    }
+
+    std::optional<object_collection> result = std::nullopt;
+    if (locked_count == workers.size())
+    {
+        // We locked them all so now we can do the expensive loading
+        object_collection objects(workers.size());
+        for (std::size_t i = 0; i != workers.size(); ++i)
+        {
+            assert(workers[i]->pins > 0);
+            --workers[i]->pins;
+            objects[i] = load_worker(*workers[i]);
+            assert(objects[i] != nullptr);
+        }
+
+        result = std::move(objects);
+    }
+
+    for (std::size_t i = 0; i != locked_count; ++i)
+    {
+        // If we've loaded the workers then they're still locked, so only
+        // wake anything that waited on them if we failed
+        if (result.has_value())
+        {
+            workers[i]->lock.unlock();
+        }
+        else
+        {
+            unlock_worker(*workers[i]);
+        }
+    }
+
+    return result;
+}
+
+void worker_service::on_begin_work(storage_type* storage)
+{
+    storage->contended = nullptr;
+
+    // Publish the epoch before finding any workers, so that the entries we
+    // can see won't be freed until we've finished (the fence pairs with the
+    // one in reclaim_workers)
+    storage->epoch.store(_workers.epoch(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void worker_service::on_end_work(storage_type* storage)
+{
+    for (worker_info* info : storage->locked)
+    {
+        save_worker(*info);
+    }
+
+    storage->locked.clear();
+    storage->snapshots.clear();
+    storage->epoch.store(0, std::memory_order_release);
+}
+
+detail::worker_type& worker_service::add_type(const void* type)
+{
+    auto [it, inserted] = _types.try_emplace(get_type(type));
+    if (inserted)
+    {
+        it->second.index = _types.size() - 1u;
+    }
+
+    return it->second;
+}
+
+bool worker_service::add_to_checkpoint(
+    detail::checkpoint_pass& pass,
+    const worker_key& key,
+    worker_info& info)
+{
+    // Resident workers don't have any saved data, however, prefetched ones
+    // still do as restoring the object doesn't change it
+    if ((info.object != nullptr) &&
+        !std::holds_alternative<gc_heap>(info.data))
+    {
+        return false;
+    }
+
+    // Take the data out of the previous checkpoint, as it's about to be
+    // replaced and we can't read from it afterwards
+    if (auto* checkpointed =
+            std::get_if<detail::checkpointed_worker>(&info.data))
+    {
+        checkpointed->read(info.serializer);
+        info.data = std::monostate();
+    }
+
+    // The data is read before taking the lock, so that only the writes to
+    // the file are serialized between the work items
+    auto type = static_cast<std::int64_t>(key.type - pass.anchor);
+    auto write = [&](const object_serializer& serializer) {
+        std::lock_guard<std::mutex> lock(pass.writer_lock);
+        if (pass.error == nullptr)
+        {
+            pass.writer.add(type, key.id, serializer);
+        }
+    };
+
+    if (auto* location = std::get_if<spill_location>(&info.data))
+    {
+        object_serializer spilled;
+        spilled.unspill(*_spill_store, *location);
+        write(spilled);
+    }
+    else
+    {
+        write(info.serializer);
+    }
+
+    return true;
+}
+
+bool worker_service::advance_checkpoint()
+{
+    // This is only called by the thread that started the checkpoint, which
+    // is the only thread that queues its work
+    detail::checkpoint_pass& pass = *_checkpoint;
+    if (pass.remaining.load(std::memory_order_acquire) != 0)
+    {
+        return false;
+    }
+
+    if (pass.committed || (pass.error != nullptr))
+    {
+        return true;
+    }
+
+    auto busy_shards = static_cast<std::size_t>(std::count_if(
+        pass.busy.begin(), pass.busy.end(), [](const auto& busy) {
+            return !busy.empty();
+        }));
+    if (busy_shards == 0)
+    {
+        // Every worker has been written, so the file can be finished
+        pass.remaining.store(1, std::memory_order_relaxed);
+        _thread_pool->enqueue(commit_checkpoint, &pass);
+        return false;
+    }
+
+    // The workers that were in use are tried again after a while, rather
+    // than continuously until they've been released
+    auto now = std::chrono::steady_clock::now();
+    if (now < pass.retry_at)
+    {
+        return false;
+    }
+
+    pass.retry_at = now + checkpoint_retry_interval;
+    pass.remaining.store(busy_shards, std::memory_order_relaxed);
+    for (std::size_t shard = 0; shard != pass.busy.size(); ++shard)
+    {
+        if (!pass.busy[shard].empty())
+        {
+            _thread_pool->enqueue(
+                checkpoint_shard, checkpoint_request{this, &pass, shard, true});
+        }
+    }
+
+    return false;
+}
+
+void worker_service::checkpoint_shard(std::any& arg)
+{
+    auto& request = std::any_cast<checkpoint_request&>(arg);
+    worker_service* service = request.service;
+    detail::checkpoint_pass& pass = *request.pass;
+    auto add_worker = [&](const worker_key& key, worker_info& info) {
+        try
+        {
+            // Workers that expired whilst we were waiting have been removed
+            if ((info.expiry.load(std::memory_order_relaxed) !=
+                 detail::expiry_state::expired) &&
+                service->add_to_checkpoint(pass, key, info))
+            {
+                pass.count.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        catch (...)
+        {
+            service->unlock_worker(info);
+            throw;
+        }
+
+        service->unlock_worker(info);
+    };
+
+    detail::checkpoint_pass::busy_workers& busy = pass.busy[request.shard];
+    try
+    {
+        if (request.retry)
+        {
+            auto it = std::remove_if(
+                busy.begin(), busy.end(), [&](const auto& worker) {
+                    if (!worker.second->lock.try_lock())
+                    {
+                        return false;
+                    }
+
+                    add_worker(*worker.first, *worker.second);
+                    return true;
+                });
+            busy.erase(it, busy.end());
+        }
+        else
+        {
+            // Workers that are in use are written by a later pass once
+            // they're released, so that they are not lost from the
+            // checkpoint. The removed entries aren't freed until the
+            // checkpoint has finished (see reclaim_workers)
+            service->_workers.for_each_in_shard(
+                request.shard, [&](const worker_key& key, worker_info& info) {
+                    if (info.lock.try_lock())
+                    {
+                        add_worker(key, info);
+                    }
+                    else
+                    {
+                        busy.emplace_back(&key, &info);
+                    }
+                });
+        }
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(pass.writer_lock);
+        if (pass.error == nullptr)
+        {
+            pass.error = std::current_exception();
+        }
+    }
+
+    pass.remaining.fetch_sub(1, std::memory_order_release);
+}
+
+void worker_service::evict_worker(
+    const worker_key& key,
+    worker_info& info,
+    bool notify)
+{
+    // Remove the worker from the map first, so any requests for it made by
+    // the managed code create a new worker, and mark it so that threads that
+    // found it before it was removed don't use it
+    _workers.erase(key.type, key.id);
+    info.expiry.store(detail::expiry_state::expired, std::memory_order_relaxed);
+
+    try
+    {
+        if (notify)
+        {
+            void* object =
+                (info.object != nullptr) ? info.object : restore_worker(info);
+            managed_exports::OnWorkerExpired(object);
+        }
+
+        if (auto* location = std::get_if<spill_location>(&info.data))
+        {
+            _spill_store->release(*location);
+            info.data = std::monostate();
+        }
+    }
+    catch (...)
+    {
+        unlock_worker(info);
+        throw;
+    }
+
+    // The rest of the memory is freed when the entry is reclaimed. Anything
+    // that waited for the worker will find it's been removed and retry
+    unlock_worker(info);
+    std::size_t bytes =
+        info.stored_bytes.exchange(0, std::memory_order_relaxed);
+    _stored_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    info.type->stored_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    info.type->live_count.fetch_sub(1, std::memory_order_relaxed);
+    _expired_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void worker_service::expire_worker(std::any& arg)
+{
+    auto& request = std::any_cast<expiry_request&>(arg);
+    worker_service* service = request.service;
+    worker_info& info = *request.info;
+
+    // The worker may have been used since it was queued
+    if (!info.lock.try_lock())
+    {
+        info.expiry.store(
+            detail::expiry_state::none, std::memory_order_relaxed);
+        return;
+    }
+
+    std::optional<std::chrono::microseconds> idle_since =
+        service->get_idle_since(request.key->type, pal::get_current_time());
+    if (!service->is_idle(info, *idle_since))
+    {
+        info.expiry.store(
+            detail::expiry_state::none, std::memory_order_relaxed);
+        service->unlock_worker(info);
+        return;
+    }
+
+    service->evict_worker(*request.key, info, true);
+}
+
+void worker_service::prefetch_worker(std::any& arg)
+{
+    auto& request = std::any_cast<prefetch_request&>(arg);
+    worker_service* service = request.service;
+    worker_info& info = *request.info;
+
+    // If we hold the only pin then the continuation has already locked the
+    // worker, so there's nothing waiting for it
+    bool restored = false;
+    if ((info.pins.load(std::memory_order_relaxed) > 1) &&
+        info.lock.try_lock())
+    {
+        if ((info.object == nullptr) &&
+            (info.expiry.load(std::memory_order_relaxed) !=
+             detail::expiry_state::expired))
+        {
+            try
+            {
+                service->restore_prefetched(info);
+            }
+            catch (...)
+            {
+                service->unlock_worker(info);
+                info.pins.fetch_sub(1, std::memory_order_relaxed);
+                throw;
+            }
+
+            restored = true;
+        }
+
+        service->unlock_worker(info);
+    }
+
+    if (!restored)
+    {
+        service->_prefetch_skipped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // This must be the last use of the worker, as it can be removed as soon
+    // as it's no longer pinned
+    info.pins.fetch_sub(1, std::memory_order_relaxed);
 }
 
+void worker_service::preload_batch(std::any& arg)
+{
+    auto& request = std::any_cast<preload_request&>(arg);
+    worker_service* service = request.service;
+    preload_progress& progress = *request.progress;
+    try
+    {
+        // Workers in the checkpoint already exist, so read their data now
+        // rather than when they're first used
+        std::vector<std::string_view> missing;
+        for (std::string_view id : *request.ids)
+        {
+            worker_info* info = service->_workers.find(request.type, id);
+            if (info == nullptr)
+            {
+                missing.push_back(id);
+            }
+            else if (
+                std::holds_alternative<detail::checkpointed_worker>(
+                    info->data) &&
+                info->lock.try_lock())
+            {
+                try
+                {
+                    if (auto* checkpointed =
+                            std::get_if<detail::checkpointed_worker>(
+                                &info->data))
+                    {
+                        checkpointed->read(info->serializer);
+                        info->data = std::monostate();
+                        progress.loaded.fetch_add(
+                            1, std::memory_order_relaxed);
+                    }
+                }
+                catch (...)
+                {
+                    service->unlock_worker(*info);
+                    throw;
+                }
+
+                service->unlock_worker(*info);
+            }
+        }
+
+        // The new workers are saved before they're added, so they are in
+        // the same state as a worker that has been used and released. When
+        // run inline all the batches share one work item, so the memory used
+        // to construct each worker is freed once it has been saved, rather
+        // than when the work finishes (the caller's heap is kept to one side,
+        // as the identifiers may have been allocated from it)
+        auto gc = global_services.get_service<gc_service>();
+        gc_heap caller_heap = gc->reset_heap();
+        detail::worker_type& worker_type = *request.worker_type;
+        std::size_t created = 0;
+        try
+        {
+            created = service->_workers.try_emplace_all(
+                request.type,
+                missing,
+                [&](worker_info& info) {
+                    info.type = &worker_type;
+                    info.last_used.store(
+                        request.now, std::memory_order_relaxed);
+                    void* object = worker_type.constructor();
+                    if (service->_resident_workers)
+                    {
+                        info.object = info.arena.save(
+                            object, service->_garbage_percentage);
+                    }
+                    else
+                    {
+                        info.serializer.save(object);
+                    }
+
+                    gc->reset_heap();
+                    info.stored_bytes.store(
+                        info.serializer.size() + info.arena.allocated_bytes(),
+                        std::memory_order_relaxed);
+                },
+                [&](worker_info& info) {
+                    // Only count the workers that were added, as the others
+                    // are destroyed straight away
+                    std::size_t bytes =
+                        info.stored_bytes.load(std::memory_order_relaxed);
+                    service->_stored_bytes.fetch_add(
+                        bytes, std::memory_order_relaxed);
+                    worker_type.stored_bytes.fetch_add(
+                        bytes, std::memory_order_relaxed);
+                    worker_type.live_count.fetch_add(
+                        1, std::memory_order_relaxed);
+                });
+        }
+        catch (...)
+        {
+            gc->set_heap(std::move(caller_heap));
+            throw;
+        }
+
+        gc->set_heap(std::move(caller_heap));
+        progress.created.fetch_add(created, std::memory_order_relaxed);
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(progress.lock);
+        if (progress.error == nullptr)
+        {
+            progress.error = std::current_exception();
+        }
+    }
+
+    // The progress is owned by the waiting thread, so it's notified while
+    // the lock is held, stopping it from returning before we're done
+    std::lock_guard<std::mutex> lock(progress.lock);
+    progress.processed.fetch_add(
+        request.ids->size(), std::memory_order_relaxed);
+    if (--progress.remaining == 0)
+    {
+        progress.finished.notify_one();
+    }
 }
 
-namespace autocrat::detail
+bool worker_service::find_existing(
+    worker_key::type_handle type,
+    std::string_view id,
+    void*& result) const
 {
+    worker_info* info = _workers.find(type, id);
+    if (info != nullptr)
+    {
+        result = load_worker(*info);
+        return true;
+    }
+
+    return false;
+}
 
-bool worker_key_equal::operator()(const worker_key& a, const worker_key& b)
-    const
+detail::thread_counters* worker_service::get_counters(
+    const detail::worker_type& type) const
 {
-    return (a.type == b.type) && (a.id == b.id);
+    if (!_collect_statistics)
+    {
+        return nullptr;
+    }
+
+    // Types can be registered after the threads have started, so each thread
+    // adds the counters for a type the first time it uses it
+    storage_type* storage = get_thread_storage();
+    auto& counters = storage->counters;
+    if ((type.index >= counters.size()) || (counters[type.index] == nullptr))
+    {
+        std::lock_guard<decltype(storage->counters_lock)> lock(
+            storage->counters_lock);
+        if (type.index >= counters.size())
+        {
+            counters.resize(type.index + 1u);
+        }
+
+        counters[type.index] = std::make_unique<detail::thread_counters>();
+    }
+
+    return counters[type.index].get();
 }
 
-std::size_t worker_key_hash::operator()(const worker_key& key) const
+detail::worker_extras& worker_service::get_extras(worker_info& info)
 {
-    std::hash<std::string> id_hasher;
-    return (key.type * 31u) + id_hasher(key.id);
+    detail::worker_extras* extras = info.extras.load(std::memory_order_acquire);
+    if (extras == nullptr)
+    {
+        // Another thread may be adding them at the same time, in which case
+        // theirs are used and ours are freed
+        auto created = std::make_unique<detail::worker_extras>();
+        if (info.extras.compare_exchange_strong(
+                extras, created.get(), std::memory_order_acq_rel))
+        {
+            extras = created.release();
+        }
+    }
+
+    return *extras;
 }
 
+std::optional<std::chrono::microseconds> worker_service::get_idle_since(
+    worker_key::type_handle type,
+    std::chrono::microseconds now) const
+{
+    const detail::worker_type& worker_type = _types.at(type);
+    std::chrono::seconds time_to_live =
+        worker_type.time_to_live.value_or(_time_to_live);
+    if (time_to_live.count() <= 0)
+    {
+        return std::nullopt;
+    }
+
+    return now - time_to_live;
 }
 
-namespace autocrat
+std::uint64_t worker_service::get_type_fingerprint(
+    worker_key::type_handle& anchor) const
 {
+    // The type handles change each time the program is run, however, their
+    // positions relative to each other only change if the program changes
+    std::vector<worker_key::type_handle> types;
+    types.reserve(_types.size());
+    for (const auto& pair : _types)
+    {
+        types.push_back(pair.first);
+    }
+
+    std::sort(types.begin(), types.end());
+    anchor = types.empty() ? 0 : types.front();
+
+    // FNV-1a
+    std::uint64_t hash = 14695981039346656037u;
+    for (worker_key::type_handle type : types)
+    {
+        hash ^= type - anchor;
+        hash *= 1099511628211u;
+    }
+
+    return hash;
+}
 
-worker_service::worker_service(thread_pool*)
+std::chrono::microseconds worker_service::get_last_used(
+    const worker_info& info)
 {
+    // Reading a worker counts as using it, but doesn't change last_used as
+    // that's only changed whilst the worker is locked
+    std::chrono::microseconds last_used =
+        info.last_used.load(std::memory_order_relaxed);
+    const detail::worker_extras* extras =
+        info.extras.load(std::memory_order_acquire);
+    if (extras != nullptr)
+    {
+        last_used = std::max(
+            last_used, extras->last_read.load(std::memory_order_relaxed));
+    }
+
+    return last_used;
 }
 
-void* worker_service::get_worker(const void* type_ptr, std::string_view id)
+bool worker_service::is_idle(
+    worker_info& info,
+    std::chrono::microseconds idle_since) const
 {
-    std::uintptr_t type = get_type(type_ptr);
-    void* worker = nullptr;
-    if (find_existing(type, id, worker))
+    // The worker must be locked by the caller
+    if ((info.pins > 0) || (get_last_used(info) > idle_since))
     {
-        return worker;
+        return false;
     }
-    else
+
+    detail::worker_extras* extras = info.extras.load(std::memory_order_acquire);
+    if (extras == nullptr)
     {
-        return make_worker({type, std::string(id.begin(), id.end())});
+        return true;
     }
+
+    std::shared_lock<decltype(extras->waiters_lock)> lock(extras->waiters_lock);
+    return extras->waiters.empty();
 }
 
-void worker_service::register_type(
-    const void* type,
-    construct_worker constructor)
+void* worker_service::load_worker(worker_info& info) const
 {
-    _constructors.try_emplace(get_type(type), constructor);
+    storage_type* storage = get_thread_storage();
+    if (!info.lock.try_lock())
+    {
+        storage->contended = &info;
+        record_contention(info);
+        return nullptr;
+    }
+
+    if (info.expiry.load(std::memory_order_relaxed) ==
+        detail::expiry_state::expired)
+    {
+        // The worker was removed after we found it, so report it as in use;
+        // when the work is retried it will create a new worker
+        info.lock.unlock();
+        return nullptr;
+    }
+
+    // The lock is recursive, so check if we've already loaded it (resident
+    // workers keep their object whilst unlocked, so we can't use that)
+    auto& locked_workers = storage->locked;
+    auto it = std::find(locked_workers.begin(), locked_workers.end(), &info);
+    if (it != locked_workers.end())
+    {
+        info.lock.unlock();
+        return info.object;
+    }
+
+    if (info.object == nullptr)
+    {
+        info.object = restore_worker(info);
+    }
+    else if (auto* prefetched = std::get_if<gc_heap>(&info.data))
+    {
+        // The object was restored by another thread, so its memory now
+        // belongs to this work item and is freed when the work finishes
+        auto gc = global_services.get_service<gc_service>();
+        gc_heap heap = gc->reset_heap();
+        heap.append(std::move(*prefetched));
+        info.data = std::monostate();
+        gc->set_heap(std::move(heap));
+        _prefetch_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    record_locked(info);
+    locked_workers.emplace_back(&info);
+    return info.object;
 }
 
-auto worker_service::release_locked()
-    -> std::tuple<object_collection, worker_collection>
+void* worker_service::make_worker(
+    worker_key::type_handle type,
+    std::string_view id)
 {
-    storage_type* locked_workers = get_thread_storage();
-    object_collection objects(locked_workers->size());
-    worker_collection workers(locked_workers->size());
+    auto worker_type = _types.find(type);
+    if ((worker_type == _types.end()) ||
+        (worker_type->second.constructor == nullptr))
+    {
+        throw std::invalid_argument("Type has not been registered");
+    }
 
-    void** object_it = objects.data();
-    worker_info** worker_it = workers.data();
-    for (worker_info* worker : *locked_workers)
+    // Lock the worker before it can be found by other threads, so they can't
+    // use it until it's been constructed (which is done without holding any
+    // of the map locks, so other threads aren't held up)
+    auto [worker, inserted] =
+        _workers.try_emplace(type, id, [&](worker_info& info) {
+            info.lock.try_lock();
+            info.type = &worker_type->second;
+        });
+    if (!inserted)
     {
-        *object_it++ = worker->object;
-        *worker_it++ = worker;
-        save_worker(*worker);
+        return load_worker(*worker);
     }
 
-    locked_workers->clear();
-    return std::make_tuple(std::move(objects), std::move(workers));
+    worker_type->second.live_count.fetch_add(1, std::memory_order_relaxed);
+    record_locked(*worker);
+    worker->object = worker_type->second.constructor();
+    get_thread_storage()->locked.emplace_back(worker);
+    return worker->object;
 }
 
-auto worker_service::try_lock(const worker_collection& workers)
-    -> std::optional<object_collection>
+void worker_service::publish_snapshot(
+    worker_info& info,
+    detail::snapshot_handle snapshot)
 {
-    // Since the workers locks are recursive, we can go through and try to
-    // lock them all. If that works we can then call load_worker, which
-    // will lock it again. This means it's locked twice so we need to
-    // unlock it once inside this method, which also allows us to handle
-    // the case that we only locked some of them and, therefore, need to
-    // unlock them again.
-    std::size_t locked_count = 0;
-    for (; locked_count != workers.size(); ++locked_count)
+    // The worker is locked by us, so no other thread can publish a version
+    // and we only need the lock to stop readers seeing a partial update
+    detail::worker_extras& extras = get_extras(info);
+    std::unique_lock<decltype(extras.snapshot_lock)> lock(extras.snapshot_lock);
+    extras.snapshot = std::move(snapshot);
+    lock.unlock();
+
+    _snapshot_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void worker_service::queue_sweep(
+    std::atomic_size_t& remaining,
+    sweep_function sweep,
+    std::chrono::microseconds time)
+{
+    // Only this thread queues the work, so if the previous pass is still
+    // running (e.g. it's spilling a lot of workers) then skip this one
+    if (remaining.load(std::memory_order_acquire) != 0)
     {
-        if (!workers[locked_count]->lock.try_lock())
-        {
-            break;
-        }
+        return;
     }
 
-    std::optional<object_collection> result = std::nullopt;
-    if (locked_count == workers.size())
+    constexpr std::size_t shard_count = worker_map<worker_info>::shard_count;
+    remaining.store(shard_count, std::memory_order_relaxed);
+    for (std::size_t shard = 0; shard != shard_count; ++shard)
     {
-        // We locked them all so now we can do the expensive loading
-        object_collection objects(workers.size());
-        for (std::size_t i = 0; i != workers.size(); ++i)
+        _thread_pool->enqueue(
+            sweep_shard, sweep_request{this, sweep, &remaining, shard, time});
+    }
+}
+
+void worker_service::reclaim_workers()
+{
+    // Any thread that published its epoch after this fence will not be able
+    // to find the entries removed before it, and any thread that published
+    // before it will be seen here (see on_begin_work)
+    std::uint64_t oldest = _workers.epoch();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for_each_thread_storage([&oldest](storage_type& storage) {
+        std::uint64_t epoch = storage.epoch.load(std::memory_order_acquire);
+        if (epoch != 0)
         {
-            objects[i] = load_worker(*workers[i]);
-            assert(objects[i] != nullptr);
+            oldest = std::min(oldest, epoch);
         }
+    });
 
-        result = std::move(objects);
+    // The workers that a checkpoint is waiting for are kept between its work
+    // items, so they can't be freed until it has finished
+    if (_checkpoint != nullptr)
+    {
+        oldest = std::min(oldest, _checkpoint->epoch);
     }
 
-    for (std::size_t i = 0; i != locked_count; ++i)
+    _workers.reclaim(oldest);
+    _reclaimed_epoch = oldest;
+}
+
+void worker_service::record_contention(worker_info& info) const
+{
+    if (detail::thread_counters* counters = get_counters(*info.type))
     {
-        workers[i]->lock.unlock();
+        add_counter(counters->lock_failures, 1u);
+        if (is_sampled(get_thread_storage()->contended_samples))
+        {
+            get_extras(info).contended_count.fetch_add(
+                statistics_sample_rate, std::memory_order_relaxed);
+        }
     }
+}
 
-    return result;
+void worker_service::record_locked(worker_info& info) const
+{
+    if (detail::thread_counters* counters = get_counters(*info.type))
+    {
+        detail::worker_extras& extras = get_extras(info);
+        extras.locked_at = std::chrono::steady_clock::now();
+        add_counter(counters->locks, 1u);
+        if (is_sampled(get_thread_storage()->locked_samples))
+        {
+            extras.locked_count.fetch_add(
+                statistics_sample_rate, std::memory_order_relaxed);
+        }
+    }
 }
 
-void worker_service::on_begin_work(storage_type*)
+void worker_service::restore_prefetched(worker_info& info)
 {
+    // The object is restored into its own heap, as the current work item's
+    // heap will be freed when it finishes
+    auto gc = global_services.get_service<gc_service>();
+    gc_heap previous = gc->reset_heap();
+    try
+    {
+        info.object = restore_worker(info);
+    }
+    catch (...)
+    {
+        gc->set_heap(std::move(previous));
+        throw;
+    }
+
+    info.data = gc->reset_heap();
+    gc->set_heap(std::move(previous));
+    _prefetched_count.fetch_add(1, std::memory_order_relaxed);
 }
 
-void worker_service::on_end_work(storage_type* storage)
+void* worker_service::restore_worker(worker_info& info) const
 {
-    for (worker_info* info : *storage)
+    detail::thread_counters* counters = get_counters(*info.type);
+    std::chrono::steady_clock::time_point start;
+    if (counters != nullptr)
     {
-        save_worker(*info);
+        start = std::chrono::steady_clock::now();
+    }
+
+    if (auto* checkpointed =
+            std::get_if<detail::checkpointed_worker>(&info.data))
+    {
+        checkpointed->read(info.serializer);
+        info.data = std::monostate();
+    }
+    else if (auto* location = std::get_if<spill_location>(&info.data))
+    {
+        _spill_misses.fetch_add(1, std::memory_order_relaxed);
+        info.serializer.unspill(*_spill_store, *location);
+        _spill_store->release(*location);
+        info.data = std::monostate();
+    }
+    else if (_spill_store != nullptr)
+    {
+        _spill_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void* object = nullptr;
+    if (!info.serializer.is_compressed())
+    {
+        object = info.serializer.restore();
+    }
+    else
+    {
+        auto decompress_start = std::chrono::steady_clock::now();
+        object = info.serializer.restore();
+
+        detail::compression_statistics& statistics = info.type->compression;
+        statistics.restored_count.fetch_add(1, std::memory_order_relaxed);
+        statistics.restore_time_ns.fetch_add(
+            get_elapsed_ns(decompress_start), std::memory_order_relaxed);
+    }
+
+    if (counters != nullptr)
+    {
+        add_counter(counters->restores, 1u);
+        add_counter(counters->restore_time_ns, get_elapsed_ns(start));
     }
 
-    storage->clear();
+    return object;
 }
 
-bool worker_service::find_existing(
-    worker_key::type_handle type,
-    std::string_view id,
-    void*& result) const
+void worker_service::save_worker(worker_info& info)
 {
-    std::shared_lock<decltype(_workers_lock)> lock(_workers_lock);
+    // The worker is locked until it has been saved
+    detail::thread_counters* counters = get_counters(*info.type);
+    std::chrono::steady_clock::time_point start;
+    if (counters != nullptr)
+    {
+        start = std::chrono::steady_clock::now();
+        add_counter(
+            counters->lock_time_ns,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                start - get_extras(info).locked_at)
+                .count());
+    }
 
-    // TODO: C++ 20 would allow the use of a different key type here, one using
-    // string_view
-    auto it = _workers.find({type, std::string(id.begin(), id.end())});
-    if (it != _workers.end())
+    // The changes are published to readers only if there are any (i.e. a
+    // version has been published before). The copy is made before saving,
+    // as the serializer overwrites the objects it has saved, but only once
+    // we know there's something new to publish
+    detail::worker_extras* extras = info.extras.load(std::memory_order_acquire);
+    bool publish = (extras != nullptr) && (extras->snapshot != nullptr);
+    detail::snapshot_handle snapshot;
+    if (_resident_workers)
     {
-        lock.unlock();
-        result = load_worker(const_cast<worker_info&>(it->second));
-        return true;
+        if (publish)
+        {
+            snapshot = make_snapshot(info.object);
+        }
+
+        info.object = info.arena.save(info.object, _garbage_percentage);
+    }
+    else if (info.serializer.keep_if_unchanged(info.object))
+    {
+        _unchanged_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        if (publish)
+        {
+            snapshot = make_snapshot(info.object);
+        }
+
+        info.serializer.save(info.object);
+        _saved_count.fetch_add(1, std::memory_order_relaxed);
     }
 
-    return false;
+    if (snapshot != nullptr)
+    {
+        publish_snapshot(info, std::move(snapshot));
+    }
+
+    if (!_resident_workers)
+    {
+        info.object = nullptr;
+    }
+
+    if (_track_last_used)
+    {
+        info.last_used.store(
+            pal::get_current_time(), std::memory_order_relaxed);
+    }
+
+    if (counters != nullptr)
+    {
+        add_counter(counters->saves, 1u);
+        add_counter(counters->save_time_ns, get_elapsed_ns(start));
+        if (!_resident_workers)
+        {
+            add_counter(counters->saved_bytes, info.serializer.size());
+            add_counter(
+                counters->saved_objects, info.serializer.object_count());
+        }
+    }
+
+    unlock_worker(info);
 }
 
-void* worker_service::load_worker(worker_info& info) const
+void worker_service::update_stored_bytes(worker_info& info)
 {
-    if (!info.lock.try_lock())
+    // The worker must be locked by the caller. The sizes are recorded so the
+    // passes over the idle workers (and the statistics) can find out how
+    // much memory each worker uses without locking it
+    std::size_t bytes = info.serializer.size() + info.arena.allocated_bytes();
+    std::size_t previous =
+        info.stored_bytes.exchange(bytes, std::memory_order_relaxed);
+    if (bytes > previous)
     {
-        return nullptr;
+        _stored_bytes.fetch_add(bytes - previous, std::memory_order_relaxed);
+        info.type->stored_bytes.fetch_add(
+            bytes - previous, std::memory_order_relaxed);
+    }
+    else if (bytes < previous)
+    {
+        _stored_bytes.fetch_sub(previous - bytes, std::memory_order_relaxed);
+        info.type->stored_bytes.fetch_sub(
+            previous - bytes, std::memory_order_relaxed);
     }
+}
 
-    if (info.object == nullptr)
+void worker_service::start_checkpoint(const std::filesystem::path& path)
+{
+    worker_key::type_handle anchor = 0;
+    std::uint64_t fingerprint = get_type_fingerprint(anchor);
+    _checkpoint = std::make_unique<detail::checkpoint_pass>(
+        path, get_type_pointer(anchor), fingerprint);
+
+    constexpr std::size_t shard_count = worker_map<worker_info>::shard_count;
+    detail::checkpoint_pass& pass = *_checkpoint;
+    pass.anchor = anchor;
+    pass.busy.resize(shard_count);
+    pass.epoch = _workers.epoch();
+    pass.retry_at =
+        std::chrono::steady_clock::now() + checkpoint_retry_interval;
+    pass.remaining.store(shard_count, std::memory_order_relaxed);
+    for (std::size_t shard = 0; shard != shard_count; ++shard)
     {
-        info.object = info.serializer.restore();
-        get_thread_storage()->emplace_back(&info);
+        _thread_pool->enqueue(
+            checkpoint_shard, checkpoint_request{this, &pass, shard, false});
     }
+}
 
-    return info.object;
+void worker_service::statistics_shard(
+    std::size_t shard,
+    std::chrono::microseconds)
+{
+    std::vector<hot_worker> locked;
+    std::vector<hot_worker> contended;
+    hot_workers most_locked(locked);
+    hot_workers most_contended(contended);
+    _workers.for_each_in_shard(
+        shard, [&](const worker_key& key, worker_info& info) {
+            if (info.lock.is_locked())
+            {
+                info.type->in_use.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Only the workers with statistics recorded have the counters
+            detail::worker_extras* extras =
+                info.extras.load(std::memory_order_acquire);
+            if (extras != nullptr)
+            {
+                most_locked.add(
+                    extras->locked_count.exchange(
+                        0, std::memory_order_relaxed),
+                    key);
+                most_contended.add(
+                    extras->contended_count.exchange(
+                        0, std::memory_order_relaxed),
+                    key);
+            }
+        });
+
+    // Each shard only adds its own most used workers, so the lock is taken
+    // once per shard
+    if (!locked.empty() || !contended.empty())
+    {
+        std::lock_guard<std::mutex> lock(_hot_workers_lock);
+        hot_workers all_locked(_most_locked);
+        for (hot_worker& worker : locked)
+        {
+            all_locked.add(std::move(worker));
+        }
+
+        hot_workers all_contended(_most_contended);
+        for (hot_worker& worker : contended)
+        {
+            all_contended.add(std::move(worker));
+        }
+    }
 }
 
-void* worker_service::make_worker(worker_key&& key)
+void worker_service::unlock_worker(worker_info& info)
 {
-    worker_key::type_handle constructor_type = key.type;
+    update_stored_bytes(info);
+    info.lock.unlock();
 
-    std::unique_lock<decltype(_workers_lock)> lock(_workers_lock);
-    auto [it, inserted] = _workers.try_emplace(std::move(key));
-    if (!inserted)
+    // Only the workers that have been waited for have somewhere to store the
+    // waiting work (see enqueue_when_released for the fence)
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    detail::worker_extras* extras = info.extras.load(std::memory_order_relaxed);
+    if (extras == nullptr)
     {
-        lock.unlock();
-        return load_worker(it->second);
+        return;
     }
-    else
+
+    std::vector<detail::worker_waiter> waiters;
     {
-        // We need to release the _worker_lock ASAP, so lock the worker to
-        // prevent anyone else playing with it so we can unlock the workers
-        // and then we can run the construction without holding any other
-        // thread up. Note we can't use the iterator after we've called
-        // unlock, as another thread could then insert something that
-        // causes a rehash to invalidate it.
-        auto& worker = it->second;
-        worker.lock.try_lock();
-        lock.unlock();
+        std::unique_lock<decltype(extras->waiters_lock)> lock(
+            extras->waiters_lock);
+        waiters.swap(extras->waiters);
+    }
 
-        auto constructor = _constructors.find(constructor_type);
-        if (constructor == _constructors.end())
+    if ((_max_batch > 1) && (waiters.size() > 1))
+    {
+        // Run the waiting work back to back on the same thread, so the
+        // first one loads the worker and the rest use it in place
+        auto first = waiters.begin();
+        while (first != waiters.end())
         {
-            throw std::invalid_argument("Type has not been registered");
+            auto remaining = static_cast<std::size_t>(waiters.end() - first);
+            auto last = first + std::min(remaining, _max_batch);
+            _thread_pool->enqueue(
+                deliver_batch,
+                waiter_batch(
+                    std::make_move_iterator(first),
+                    std::make_move_iterator(last)));
+            _batch_count.fetch_add(1, std::memory_order_relaxed);
+            first = last;
         }
 
-        worker.object = constructor->second();
-        get_thread_storage()->emplace_back(&worker);
-        return worker.object;
+        return;
+    }
+
+    // Queue everything that was waiting in the order it arrived; whichever
+    // runs first will lock the worker and, if any fail to lock it, they will
+    // wait again for that one to release it
+    for (detail::worker_waiter& waiter : waiters)
+    {
+        _thread_pool->enqueue(waiter.callback, std::move(waiter.arg));
     }
 }
 
-void worker_service::save_worker(worker_info& info)
+void worker_service::wait_for_checkpoint()
 {
-    info.serializer.save(info.object);
-    info.object = nullptr;
-    info.lock.unlock();
+    while (!advance_checkpoint())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
 }
 
 }
@@ -8,6 +8,7 @@ namespace Autocrat.NativeAdapters
     using System;
     using System.Runtime.InteropServices;
     using System.Threading;
+    using Autocrat.Abstractions;
 
     /// <summary>
     /// Contains helper method for native code to access managed information.
@@ -47,5 +48,18 @@ namespace Autocrat.NativeAdapters
         {
             return ConfigService.Load(NativeHelpers.FromPointer<byte[]>(source));
         }
+
+        /// <summary>
+        /// Notifies a worker that it is about to be removed.
+        /// </summary>
+        /// <param name="worker">The worker that has expired.</param>
+        [UnmanagedCallersOnly(EntryPoint = nameof(OnWorkerExpired), CallingConvention = CallingConvention.Cdecl)]
+        public static unsafe void OnWorkerExpired(void* worker)
+        {
+            if (NativeHelpers.FromPointer<object>(worker) is IExpiringWorker expiring)
+            {
+                expiring.OnExpired();
+            }
+        }
     }
 }
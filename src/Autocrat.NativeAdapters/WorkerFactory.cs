@@ -65,6 +65,80 @@ namespace Autocrat.NativeAdapters
             return (T)worker;
         }
 
+        /// <inheritdoc cref="IWorkerFactory.GetWorkerReadOnlyAsync{T}(Guid)"/>
+        public static async Task<T> GetWorkerReadOnlyAsync<T>(Guid id)
+            where T : class
+        {
+            IntPtr handle = NativeHelpers.GetHandle<T>();
+            object? worker = LoadReadOnlyObjectGuid(handle, id);
+            while (worker is null)
+            {
+                await Task.Yield();
+                worker = LoadReadOnlyObjectGuid(handle, id);
+            }
+
+            return (T)worker;
+        }
+
+        /// <inheritdoc cref="IWorkerFactory.GetWorkerReadOnlyAsync{T}(long)"/>
+        public static async Task<T> GetWorkerReadOnlyAsync<T>(long id)
+            where T : class
+        {
+            IntPtr handle = NativeHelpers.GetHandle<T>();
+            object? worker = LoadReadOnlyObjectInt64(handle, id);
+            while (worker is null)
+            {
+                await Task.Yield();
+                worker = LoadReadOnlyObjectInt64(handle, id);
+            }
+
+            return (T)worker;
+        }
+
+        /// <inheritdoc cref="IWorkerFactory.GetWorkerReadOnlyAsync{T}(string)"/>
+        public static async Task<T> GetWorkerReadOnlyAsync<T>(string id)
+            where T : class
+        {
+            IntPtr handle = NativeHelpers.GetHandle<T>();
+            object? worker = LoadReadOnlyObjectString(handle, id);
+            while (worker is null)
+            {
+                await Task.Yield();
+                worker = LoadReadOnlyObjectString(handle, id);
+            }
+
+            return (T)worker;
+        }
+
+        /// <inheritdoc cref="IWorkerFactory.PreloadWorkers{T}(Guid[])"/>
+        public static unsafe int PreloadWorkers<T>(Guid[] ids)
+            where T : class
+        {
+            fixed (Guid* data = ids)
+            {
+                return NativeMethods.PreloadWorkersGuid(NativeHelpers.GetHandle<T>(), data, ids.Length);
+            }
+        }
+
+        /// <inheritdoc cref="IWorkerFactory.PreloadWorkers{T}(long[])"/>
+        public static unsafe int PreloadWorkers<T>(long[] ids)
+            where T : class
+        {
+            fixed (long* data = ids)
+            {
+                return NativeMethods.PreloadWorkersInt64(NativeHelpers.GetHandle<T>(), data, ids.Length);
+            }
+        }
+
+        /// <inheritdoc cref="IWorkerFactory.PreloadWorkers{T}(string[])"/>
+        public static unsafe int PreloadWorkers<T>(string[] ids)
+            where T : class
+        {
+            return NativeMethods.PreloadWorkersString(
+                NativeHelpers.GetHandle<T>(),
+                NativeHelpers.ToPointer(__makeref(ids)));
+        }
+
         /// <summary>
         /// Registers a method as being able to construct the specified type.
         /// </summary>
@@ -77,6 +151,25 @@ namespace Autocrat.NativeAdapters
                 methodHandle);
         }
 
+        /// <summary>
+        /// Registers how long the workers of the specified type are kept for
+        /// when they are not being used.
+        /// </summary>
+        /// <typeparam name="T">The type of the worker.</typeparam>
+        /// <param name="seconds">
+        /// The number of seconds a worker can be idle for before it is removed.
+        /// </param>
+        /// <param name="notify">
+        /// Whether the worker is notified before it is removed.
+        /// </param>
+        public static void RegisterExpiry<T>(int seconds, bool notify)
+        {
+            NativeMethods.RegisterExpiry(
+                NativeHelpers.GetHandle<T>(),
+                seconds,
+                notify ? 1 : 0);
+        }
+
         private static unsafe object? LoadObjectGuid(IntPtr type, Guid id)
         {
             object? result = null;
@@ -101,6 +194,30 @@ namespace Autocrat.NativeAdapters
             return result;
         }
 
+        private static unsafe object? LoadReadOnlyObjectGuid(IntPtr type, Guid id)
+        {
+            object? result = null;
+            TypedReference tr = __makeref(result);
+            NativeMethods.LoadReadOnlyObjectGuid(type, &id, &tr);
+            return result;
+        }
+
+        private static unsafe object? LoadReadOnlyObjectInt64(IntPtr type, long id)
+        {
+            object? result = null;
+            TypedReference tr = __makeref(result);
+            NativeMethods.LoadReadOnlyObjectInt64(type, id, &tr);
+            return result;
+        }
+
+        private static unsafe object? LoadReadOnlyObjectString(IntPtr type, string id)
+        {
+            object? result = null;
+            TypedReference tr = __makeref(result);
+            NativeMethods.LoadReadOnlyObjectString(type, NativeHelpers.ToPointer(__makeref(id)), &tr);
+            return result;
+        }
+
 #pragma warning disable S3218 // Inner class members should not shadow outer class "static" or type members
 
         private static unsafe class NativeMethods
@@ -114,8 +231,29 @@ namespace Autocrat.NativeAdapters
             [DllImport("*", CallingConvention = CallingConvention.Cdecl, EntryPoint = "load_object_string")]
             public static extern void LoadObjectString(IntPtr type, void* id, void* result);
 
+            [DllImport("*", CallingConvention = CallingConvention.Cdecl, EntryPoint = "load_read_only_object_guid")]
+            public static extern void LoadReadOnlyObjectGuid(IntPtr type, void* id, void* result);
+
+            [DllImport("*", CallingConvention = CallingConvention.Cdecl, EntryPoint = "load_read_only_object_int64")]
+            public static extern void LoadReadOnlyObjectInt64(IntPtr type, long id, void* result);
+
+            [DllImport("*", CallingConvention = CallingConvention.Cdecl, EntryPoint = "load_read_only_object_string")]
+            public static extern void LoadReadOnlyObjectString(IntPtr type, void* id, void* result);
+
+            [DllImport("*", CallingConvention = CallingConvention.Cdecl, EntryPoint = "preload_workers_guid")]
+            public static extern int PreloadWorkersGuid(IntPtr type, void* ids, int count);
+
+            [DllImport("*", CallingConvention = CallingConvention.Cdecl, EntryPoint = "preload_workers_int64")]
+            public static extern int PreloadWorkersInt64(IntPtr type, void* ids, int count);
+
+            [DllImport("*", CallingConvention = CallingConvention.Cdecl, EntryPoint = "preload_workers_string")]
+            public static extern int PreloadWorkersString(IntPtr type, void* ids);
+
             [DllImport("*", CallingConvention = CallingConvention.Cdecl, EntryPoint = "register_constructor")]
             public static extern void RegisterConstructor(IntPtr type, int methodHandle);
+
+            [DllImport("*", CallingConvention = CallingConvention.Cdecl, EntryPoint = "register_expiry")]
+            public static extern void RegisterExpiry(IntPtr type, int seconds, int notify);
         }
 
 #pragma warning restore S3218 // Inner class members should not shadow outer class "static" or type members
@@ -6,6 +6,8 @@
 namespace Autocrat.Transform.Managed.CodeGeneration
 {
     using System.Collections.Generic;
+    using System.Linq;
+    using Autocrat.Abstractions;
     using Autocrat.NativeAdapters;
     using Mono.Cecil;
     using Mono.Cecil.Cil;
@@ -47,11 +49,18 @@ namespace Autocrat.Transform.Managed.CodeGeneration
         ////     return new MyClass(dependency);
         //// }
         //
-        // where 123 is the method handle for the CreateMyClass method.
+        // where 123 is the method handle for the CreateMyClass method. Types
+        // marked with WorkerTimeToLive, or that implement IExpiringWorker,
+        // also have their expiry registered:
+        //
+        ////     WorkerFactory.RegisterExpiry<MyClass>(60, true);
+        //
+        // where -1 is passed for the time if the type doesn't specify one.
         private readonly ExportedMethods exportedMethods;
         private readonly IReadOnlyCollection<TypeReference> factoryTypes;
         private readonly InstanceBuilder instanceBuilder;
         private MethodDefinition? workerFactoryRegister;
+        private MethodDefinition? workerFactoryRegisterExpiry;
 
         /// <summary>
         /// Initializes a new instance of the <see cref="WorkerRegisterGenerator"/> class.
@@ -105,6 +114,7 @@ namespace Autocrat.Transform.Managed.CodeGeneration
             {
                 int handle = this.EmitCreateMethod(workers, type);
                 this.EmitCallRegisterConstructor(il, type, handle);
+                this.EmitCallRegisterExpiry(il, type);
             }
 
             il.Emit(OpCodes.Ret);
@@ -112,6 +122,21 @@ namespace Autocrat.Transform.Managed.CodeGeneration
             return workers;
         }
 
+        private static bool ImplementsExpiringWorker(TypeDefinition? type)
+        {
+            while (type != null)
+            {
+                if (type.Interfaces.Any(i => i.InterfaceType.FullName == typeof(IExpiringWorker).FullName))
+                {
+                    return true;
+                }
+
+                type = type.BaseType?.Resolve();
+            }
+
+            return false;
+        }
+
         private void EmitCallRegisterConstructor(ILProcessor il, TypeReference type, int handle)
         {
             ModuleDefinition module = il.Body.Method.Module;
@@ -130,6 +155,34 @@ namespace Autocrat.Transform.Managed.CodeGeneration
             il.Emit(OpCodes.Call, registerConstructor);
         }
 
+        private void EmitCallRegisterExpiry(ILProcessor il, TypeReference type)
+        {
+            TypeDefinition definition = type.Resolve();
+            CustomAttribute? timeToLive = CecilHelper.FindAttribute<WorkerTimeToLiveAttribute>(definition);
+            bool notify = ImplementsExpiringWorker(definition);
+            if ((timeToLive is null) && !notify)
+            {
+                return;
+            }
+
+            ModuleDefinition module = il.Body.Method.Module;
+            if (this.workerFactoryRegisterExpiry is null)
+            {
+                this.workerFactoryRegisterExpiry = module
+                    .ImportReference(typeof(WorkerFactory).GetMethod(nameof(WorkerFactory.RegisterExpiry)))
+                    .Resolve();
+            }
+
+            var registerExpiry = new GenericInstanceMethod(this.workerFactoryRegisterExpiry);
+            registerExpiry.GenericArguments.Add(type);
+
+            //// WorkerFactory.RegisterExpiry<Type>(60, true)
+            int seconds = (timeToLive is null) ? -1 : (int)timeToLive.ConstructorArguments[0].Value;
+            il.Emit(OpCodes.Ldc_I4, seconds);
+            il.Emit(notify ? OpCodes.Ldc_I4_1 : OpCodes.Ldc_I4_0);
+            il.Emit(OpCodes.Call, registerExpiry);
+        }
+
         private int EmitCreateMethod(TypeDefinition workers, TypeReference type)
         {
             //// [UnmanagedCallersOnly(...)]
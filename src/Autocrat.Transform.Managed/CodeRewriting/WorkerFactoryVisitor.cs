@@ -30,7 +30,9 @@ namespace Autocrat.Transform.Managed.CodeRewriting
         /// <inheritdoc />
         protected override void OnMethodCall(Instruction instruction, MethodReference method)
         {
-            if (string.Equals(method.Name, nameof(IWorkerFactory.GetWorkerAsync), StringComparison.Ordinal) &&
+            if ((string.Equals(method.Name, nameof(IWorkerFactory.GetWorkerAsync), StringComparison.Ordinal) ||
+                 string.Equals(method.Name, nameof(IWorkerFactory.GetWorkerReadOnlyAsync), StringComparison.Ordinal) ||
+                 string.Equals(method.Name, nameof(IWorkerFactory.PreloadWorkers), StringComparison.Ordinal)) &&
                 string.Equals(method.DeclaringType.FullName, "Autocrat.Abstractions.IWorkerFactory", StringComparison.Ordinal))
             {
                 TypeReference type = ((GenericInstanceMethod)method).GenericArguments[0];
@@ -1,5 +1,6 @@
 #include <atomic>
 #include <cassert>
+#include <cstddef>
 #include <cstdlib>
 #include <new>
 #include "defines.h"
@@ -9,13 +10,16 @@ namespace
 {
     std::atomic_size_t allocated;
 
+    // Keep the returned memory aligned as the standard requires
+    constexpr std::size_t header_size = alignof(std::max_align_t);
+
     std::size_t release(void* ptr)
     {
         std::size_t count = 0u;
         if (ptr != nullptr)
         {
-            std::size_t* original = static_cast<std::size_t*>(ptr);
-            --original;
+            auto original = reinterpret_cast<std::size_t*>(
+                static_cast<char*>(ptr) - header_size);
             count = *original;
             allocated -= count;
             std::free(original);
@@ -27,7 +31,7 @@ namespace
 
 void* operator new(std::size_t bytes)
 {
-    void* raw = std::malloc(bytes + sizeof(std::size_t));
+    void* raw = std::malloc(bytes + header_size);
     if (raw == nullptr)
     {
         throw std::bad_alloc();
@@ -36,7 +40,7 @@ void* operator new(std::size_t bytes)
     std::size_t* ptr = static_cast<std::size_t*>(raw);
     allocated += bytes;
     *ptr = bytes;
-    return &ptr[1];
+    return static_cast<char*>(raw) + header_size;
 }
 
 void operator delete(void* ptr) noexcept
@@ -2,6 +2,8 @@
 #define TEST_MOCKS_H
 
 #include "thread_pool.h"
+#include <utility>
+#include <vector>
 
 class FakeThreadPool : public autocrat::thread_pool
 {
@@ -12,7 +14,22 @@ public:
         callback(data);
     }
 
+    bool enqueue_idle(callback_function callback, std::any&& data) override
+    {
+        idle_work.emplace_back(callback, std::move(data));
+        return true;
+    }
+
+    void run_idle_work()
+    {
+        for (auto& [callback, data] : std::exchange(idle_work, {}))
+        {
+            callback(data);
+        }
+    }
+
     std::size_t enqueue_count = 0u;
+    std::vector<std::pair<callback_function, std::any>> idle_work;
 };
 
 #endif
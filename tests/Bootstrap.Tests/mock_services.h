@@ -2,23 +2,37 @@
 #define MOCK_SERVICES_H
 
 #include "services.h"
+#include <optional>
 #include <cpp_mock.h>
 
 class mock_gc_service : public autocrat::gc_service
 {
 public:
+    MockMethod(void, adapt_node_size, ())
     MockMethod(void*, allocate, (std::size_t))
+    MockMethod(void*, allocate_and_refill, (std::size_t))
     MockMethod(void, begin_work, (std::size_t))
+    MockMethod(void, dump_statistics, ())
+    MockMethod(void, enable_adaptive_node_size, ())
     MockMethod(void, end_work, (std::size_t))
+    MockMethod(void, reserve, (std::size_t))
+    MockMethod(void, set_allocation_limits, (std::size_t, std::size_t))
+    MockMethod(void, set_node_size, (std::size_t))
+    MockMethod(std::size_t, trim, (std::size_t, std::size_t))
 
     autocrat::gc_heap reset_heap() override
     {
-        return autocrat::gc_heap();
+        // Don't keep hold of a heap between tests, as it owns memory
+        autocrat::gc_heap heap = next_heap ? std::move(*next_heap) : autocrat::gc_heap();
+        next_heap.reset();
+        return heap;
     }
 
     void set_heap(autocrat::gc_heap&&) override
     {
     }
+
+    std::optional<autocrat::gc_heap> next_heap;
 };
 
 class mock_network_service : public autocrat::network_service
@@ -26,11 +40,14 @@ class mock_network_service : public autocrat::network_service
 public:
     MockMethod(void, add_udp_callback, (std::uint16_t, udp_data_received_method))
     MockMethod(void, check_and_dispatch, ())
+    MockMethod(void, dump_statistics, ())
+    MockMethod(void, reserve_buffers, (std::size_t))
 };
 
 class mock_task_service : public autocrat::task_service
 {
 public:
+    MockMethod(void, enable_evacuation, ())
     MockMethod(void, enqueue, (managed_delegate*, void*))
     MockMethod(void, start_new, (managed_delegate*))
 };
@@ -53,9 +70,30 @@ public:
 class mock_worker_service : public autocrat::worker_service
 {
 public:
+    MockMethod(void, check_and_dispatch, ())
+    MockMethod(void, compress_idle_workers, ())
+    MockMethod(void, dump_statistics, ())
+    MockMethod(void, enable_batching, (std::size_t))
+    MockMethod(void, enable_compression, (std::chrono::seconds))
+    MockMethod(void, enable_expiry, (std::chrono::seconds))
+    MockMethod(void, enable_prefetch, ())
+    MockMethod(void, enable_resident_workers, (std::size_t))
+    MockMethod(void, enable_spilling, (const std::filesystem::path&, std::chrono::seconds, std::size_t))
+    MockMethod(void, enable_statistics, ())
+    MockMethod(void, expire_idle_workers, ())
+    MockMethod(void*, get_read_only_worker, (const void*, std::string_view))
     MockMethod(void*, get_worker, (const void*, std::string_view))
+    MockMethod(void, hold_snapshots, (snapshot_collection))
+    MockConstMethod(bool, is_expiry_enabled, ())
+    MockMethod(std::size_t, load_checkpoint, (const std::filesystem::path&))
+    MockMethod(std::size_t, preload_workers, (const void*, const std::vector<std::string_view>&))
+    MockMethod(void, queue_checkpoint, (const std::filesystem::path&))
     MockMethod(void, register_type, (const void*, construct_worker))
-    
+    MockMethod(snapshot_collection, release_snapshots, ())
+    MockMethod(std::size_t, save_checkpoint, (const std::filesystem::path&))
+    MockMethod(void, set_time_to_live, (const void*, std::chrono::seconds, bool))
+    MockMethod(void, spill_idle_workers, ())
+
     std::tuple<object_collection, worker_collection> release_locked() override
     {
         object_collection objects(1u);
@@ -63,6 +101,16 @@ public:
         return std::make_tuple(std::move(objects), worker_collection(1u));
     }
 
+    bool enqueue_when_released(autocrat::thread_pool::callback_function, std::any&, std::uint32_t) override
+    {
+        return std::exchange(wait_for_release, false);
+    }
+
+    void prefetch_workers(const worker_collection& workers) override
+    {
+        prefetched_count += workers.size();
+    }
+
     std::optional<object_collection> try_lock(const worker_collection&) override
     {
         if (is_locked)
@@ -79,6 +127,8 @@ public:
     }
 
     bool is_locked = false;
+    bool wait_for_release = false;
+    std::size_t prefetched_count = 0;
     void* locked_worker = nullptr;
     void* original_worker = nullptr;
 };
@@ -87,6 +137,7 @@ class mock_services : public autocrat::global_services_type
 {
 public:
     MockMethod(void, check_and_dispatch, ())
+    MockMethod(void, dump_statistics, ())
     MockMethod(void, initialize, ())
 
     void create_services()
@@ -95,9 +146,9 @@ public:
         _services = std::make_tuple(
             std::make_unique<mock_gc_service>(),
             std::make_unique<mock_network_service>(),
-            std::make_unique<mock_task_service>(),
             std::make_unique<mock_timer_service>(),
-            std::make_unique<mock_worker_service>()
+            std::make_unique<mock_worker_service>(),
+            std::make_unique<mock_task_service>()
         );
     }
 
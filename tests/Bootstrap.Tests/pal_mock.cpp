@@ -73,6 +73,11 @@ namespace pal
         return active_service_mock->current_time();
     }
 
+    std::size_t peek_datagram_size(const test_socket_handle& socket)
+    {
+        return active_socket_mock->peek_datagram_size(socket);
+    }
+
     int recv_from(const test_socket_handle& socket, char* buffer, std::size_t length, test_socket_address* from)
     {
         return active_socket_mock->recv_from(socket, buffer, length, from);
@@ -100,6 +100,7 @@ namespace pal
     void bind(const test_socket_handle& socket, const test_socket_address& address);
     test_socket_handle test_create_udp_socket();
     std::chrono::microseconds test_get_current_time();
+    std::size_t peek_datagram_size(const test_socket_handle& socket);
     int recv_from(const test_socket_handle& socket, char* buffer, std::size_t length, test_socket_address* from);
 
 }
@@ -120,6 +121,7 @@ public:
     virtual void bind(const pal::socket_handle& socket, const pal::socket_address& address) = 0;
     virtual pal::socket_handle create_udp_socket() = 0;
     virtual std::optional<pal::poll_event> get_poll_event(const pal::socket_handle& handle) = 0;
+    virtual std::size_t peek_datagram_size(const pal::socket_handle& socket) = 0;
     virtual int recv_from(const pal::socket_handle& socket, char* buffer, std::size_t length, pal::socket_address* from) = 0;
 };
 
@@ -8,11 +8,18 @@
 #include <iostream>
 #include <gtest/gtest.h>
 #include <cpp_mock.h>
+#include "pal_mock.h"
 
 using namespace std::chrono_literals;
 
 namespace
 {
+    class MockPalService : public pal_service
+    {
+    public:
+        MockMethod(std::chrono::microseconds, current_time, ())
+    };
+
     std::size_t initialize_managed_thread_call_count;
     std::size_t load_configuration_call_count;
     std::size_t on_configuration_loaded_call_count;
@@ -103,6 +110,50 @@ TEST_F(ApplicationDeathTests, VersionShouldAddTheVersionCommandLineOption)
     ExpectExitWithMessage("--version", "1.2.3");
 }
 
+TEST_F(ApplicationTests, InitializeShouldEnableAdaptiveNodeSizes)
+{
+    const char* args[2] = { "unit_test", "--adaptive_node_size" };
+
+    _application.initialize(2, args);
+
+    Verify(mock_global_services.gc_service().enable_adaptive_node_size);
+}
+
+TEST_F(ApplicationTests, InitializeShouldEnableBatching)
+{
+    const char* args[3] = { "unit_test", "--worker_batch_size", "8" };
+
+    _application.initialize(3, args);
+
+    Verify(mock_global_services.worker_service().enable_batching)
+        .With(8u);
+}
+
+TEST_F(ApplicationTests, InitializeShouldEnableResidentWorkers)
+{
+    const char* args[4] = {
+        "unit_test", "--resident_workers", "--worker_garbage_percentage", "50"};
+
+    _application.initialize(4, args);
+
+    Verify(mock_global_services.worker_service().enable_resident_workers)
+        .With(50u);
+}
+
+TEST_F(ApplicationTests, InitializeShouldEnableSpilling)
+{
+    const char* args[7] = {
+        "unit_test",
+        "--spill_directory", "spill",
+        "--spill_idle_time", "30",
+        "--worker_memory_budget", "2" };
+
+    _application.initialize(7, args);
+
+    Verify(mock_global_services.worker_service().enable_spilling)
+        .With(std::filesystem::path("spill"), 30s, 2u * 1024u * 1024u);
+}
+
 TEST_F(ApplicationTests, InitializeShouldInitializeTheGlobalServices)
 {
     _application.initialize(1, _args);
@@ -126,6 +177,38 @@ TEST_F(ApplicationTests, InitializeShouldInitializeTheManagedThreads)
     EXPECT_EQ(2u, initialize_managed_thread_call_count);
 }
 
+TEST_F(ApplicationTests, InitializeShouldReserveMemory)
+{
+    const char* args[5] = {
+        "unit_test", "--reserve_heap_nodes", "2", "--reserve_byte_arrays", "3"};
+
+    _application.initialize(5, args);
+
+    Verify(mock_global_services.gc_service().reserve).With(2u);
+    Verify(mock_global_services.network_service().reserve_buffers)
+        .With(3u);
+}
+
+TEST_F(ApplicationTests, InitializeShouldSetTheHeapNodeSize)
+{
+    const char* args[3] = { "unit_test", "--heap_node_size", "64" };
+
+    _application.initialize(3, args);
+
+    Verify(mock_global_services.gc_service().set_node_size).With(65536u);
+}
+
+TEST_F(ApplicationTests, InitializeShouldSetTheAllocationLimits)
+{
+    const char* args[5] = {
+        "unit_test", "--heap_soft_limit", "2", "--heap_hard_limit", "3"};
+
+    _application.initialize(5, args);
+
+    Verify(mock_global_services.gc_service().set_allocation_limits)
+        .With(2048u, 3072u);
+}
+
 TEST_F(ApplicationTests, InitializeShouldLoadTheConfigFile)
 {
     auto config = ConfigFile("123456");
@@ -177,3 +260,102 @@ TEST_F(ApplicationTests, RunShouldDispatchWorkUntilStopIsCalled)
 
     stop_after_10ms.join();
 }
+
+TEST_F(ApplicationTests, RunShouldTrimMemoryWhenDue)
+{
+    MockPalService pal;
+    std::chrono::seconds time = 0s;
+    When(pal.current_time).Do([&]() -> std::chrono::microseconds
+        {
+            return time++;
+        });
+    active_service_mock = &pal;
+
+    const char* args[7] = {
+        "unit_test",
+        "--heap_node_high_watermark", "4",
+        "--heap_node_low_watermark", "2",
+        "--trim_interval", "1" };
+    _application.initialize(7, args);
+
+    std::thread stop_after_10ms([this]()
+        {
+            std::this_thread::sleep_for(10ms);
+            _application.stop();
+        });
+    _application.run();
+    stop_after_10ms.join();
+    active_service_mock = nullptr;
+
+    Verify(mock_global_services.gc_service().trim).With(2u, 4u);
+}
+
+TEST_F(ApplicationTests, RunShouldQueueTheCheckpointWhenDue)
+{
+    MockPalService pal;
+    std::chrono::seconds time = 0s;
+    When(pal.current_time).Do([&]() -> std::chrono::microseconds
+        {
+            return time++;
+        });
+    active_service_mock = &pal;
+
+    const char* args[5] = {
+        "unit_test", "--checkpoint_file", "workers.bin", "--checkpoint_interval", "1" };
+    _application.initialize(5, args);
+
+    std::thread stop_after_10ms([this]()
+        {
+            std::this_thread::sleep_for(10ms);
+            _application.stop();
+        });
+    _application.run();
+    stop_after_10ms.join();
+    active_service_mock = nullptr;
+
+    Verify(mock_global_services.worker_service().queue_checkpoint)
+        .With(std::filesystem::path("workers.bin"));
+}
+
+TEST_F(ApplicationTests, RunShouldSaveTheCheckpointWhenStopped)
+{
+    const char* args[3] = { "unit_test", "--checkpoint_file", "workers.bin" };
+    _application.initialize(3, args);
+
+    std::thread stop_after_10ms([this]()
+        {
+            std::this_thread::sleep_for(10ms);
+            _application.stop();
+        });
+    _application.run();
+    stop_after_10ms.join();
+
+    Verify(mock_global_services.worker_service().save_checkpoint)
+        .With(std::filesystem::path("workers.bin"));
+}
+
+TEST_F(ApplicationTests, RunShouldSpillIdleWorkersWhenDue)
+{
+    MockPalService pal;
+    std::chrono::seconds time = 0s;
+    When(pal.current_time).Do([&]() -> std::chrono::microseconds
+        {
+            return time++;
+        });
+    active_service_mock = &pal;
+
+    const char* args[5] = {
+        "unit_test", "--spill_directory", "spill", "--spill_idle_time", "1" };
+    _application.initialize(5, args);
+
+    std::thread stop_after_10ms([this]()
+        {
+            std::this_thread::sleep_for(10ms);
+            _application.stop();
+        });
+    _application.run();
+    stop_after_10ms.join();
+    active_service_mock = nullptr;
+
+    Verify(mock_global_services.worker_service().spill_idle_workers);
+}
@@ -1,4 +1,7 @@
 #include "array_pool.h"
+#include <thread>
+#include <unordered_set>
+#include <vector>
 #include <gtest/gtest.h>
 
 class ArrayPoolTests : public testing::Test
@@ -12,15 +15,88 @@ TEST_F(ArrayPoolTests, ShouldReuseReleasedItems)
 {
     autocrat::detail::array_pool_block* first;
     {
-        autocrat::managed_byte_array_ptr ptr = _pool.aquire();
+        autocrat::managed_byte_array_ptr ptr = _pool.aquire(100u);
         first = ptr.get();
     }
 
     autocrat::detail::array_pool_block* second;
     {
-        autocrat::managed_byte_array_ptr ptr = _pool.aquire();
+        autocrat::managed_byte_array_ptr ptr = _pool.aquire(100u);
         second = ptr.get();
     }
     
     EXPECT_EQ(first, second);
 }
+
+TEST_F(ArrayPoolTests, ReserveShouldAllocateArraysUpFront)
+{
+    _pool.reserve(100u, 3u);
+
+    EXPECT_EQ(3u, _pool.capacity());
+    EXPECT_EQ(0u, _pool.size());
+
+    autocrat::managed_byte_array_ptr ptr = _pool.aquire(100u);
+    EXPECT_EQ(3u, _pool.capacity());
+    EXPECT_EQ(1u, _pool.size());
+}
+
+TEST_F(ArrayPoolTests, AquireShouldReturnArraysLargeEnoughForTheSize)
+{
+    for (std::size_t size : { 1u, 512u, 513u, 9000u, 65'000u })
+    {
+        autocrat::managed_byte_array_ptr ptr = _pool.aquire(size);
+
+        EXPECT_GE(ptr->capacity(), size);
+        EXPECT_EQ(0u, ptr->array.size());
+    }
+}
+
+TEST_F(ArrayPoolTests, AquireShouldLimitTheSizeToTheLargestClass)
+{
+    autocrat::managed_byte_array_ptr ptr = _pool.aquire(1'000'000u);
+
+    EXPECT_EQ(autocrat::array_pool::size_classes.back(), ptr->capacity());
+}
+
+TEST_F(ArrayPoolTests, ShouldReuseItemsFromTheSameSizeClass)
+{
+    autocrat::detail::array_pool_block* small;
+    {
+        autocrat::managed_byte_array_ptr ptr = _pool.aquire(100u);
+        small = ptr.get();
+    }
+
+    autocrat::managed_byte_array_ptr large = _pool.aquire(5000u);
+
+    EXPECT_NE(small, large.get());
+    EXPECT_EQ(2u, _pool.capacity());
+}
+
+TEST_F(ArrayPoolTests, ShouldAllowItemsToBeReleasedFromMultipleThreads)
+{
+    constexpr std::size_t count = 100u;
+    std::vector<autocrat::managed_byte_array_ptr> first;
+    std::vector<autocrat::managed_byte_array_ptr> second;
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        first.push_back(_pool.aquire(100u));
+        second.push_back(_pool.aquire(100u));
+    }
+
+    std::thread thread([&]() { first.clear(); });
+    second.clear();
+    thread.join();
+
+    EXPECT_EQ(count * 2u, _pool.capacity());
+    EXPECT_EQ(0u, _pool.size());
+
+    std::unordered_set<void*> reused;
+    for (std::size_t i = 0; i != count * 2u; ++i)
+    {
+        first.push_back(_pool.aquire(100u));
+        reused.insert(first.back().get());
+    }
+
+    EXPECT_EQ(count * 2u, reused.size());
+    EXPECT_EQ(count * 2u, _pool.capacity());
+}
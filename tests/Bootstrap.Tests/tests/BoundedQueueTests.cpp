@@ -73,3 +73,17 @@ TEST_F(BoundedQueueTests, ShouldThrowWhenFull)
 
     EXPECT_THROW(_queue.emplace(), std::bad_alloc);
 }
+
+TEST_F(BoundedQueueTests, TryEmplaceShouldReturnFalseWhenFull)
+{
+    for (unsigned i = 0; i != ArraySize; ++i)
+    {
+        EXPECT_TRUE(_queue.try_emplace(QueueItem(1)));
+    }
+
+    EXPECT_FALSE(_queue.try_emplace(QueueItem(2)));
+
+    QueueItem item;
+    _queue.pop(&item);
+    EXPECT_TRUE(_queue.try_emplace(QueueItem(3)));
+}
@@ -18,6 +18,17 @@ protected:
     }
 };
 
+TEST_F(ExclusiveLockTests, IsLockedShouldReturnWhetherTheLockIsHeld)
+{
+    EXPECT_FALSE(_lock.is_locked());
+
+    _lock.try_lock();
+    EXPECT_TRUE(_lock.is_locked());
+
+    _lock.unlock();
+    EXPECT_FALSE(_lock.is_locked());
+}
+
 TEST_F(ExclusiveLockTests, TryLockShouldReturnFalseForDifferentThreads)
 {
     EXPECT_TRUE(_lock.try_lock());
@@ -1,4 +1,5 @@
 #include "gc_service.h"
+#include "exports.h"
 
 #include <algorithm>
 #include <unordered_set>
@@ -57,6 +58,68 @@ TEST_F(GcServiceTests, AllocateShouldAllocateMultipleSmallBuffers)
     EXPECT_EQ(allocation_count, allocations.size());
 }
 
+TEST_F(GcServiceTests, AllocateAndRefillShouldAllowObjectsToBeAllocatedInline)
+{
+    _gc.begin_work(0u);
+    auto first = static_cast<std::byte*>(_gc.allocate_and_refill(small_allocation));
+    auto second = static_cast<std::byte*>(try_allocate_bytes(small_allocation));
+
+    // Calling the service gives back what is left of the context
+    auto third = static_cast<std::byte*>(_gc.allocate(small_allocation));
+    void* fourth = try_allocate_bytes(small_allocation);
+    _gc.end_work(0u);
+
+    EXPECT_EQ(first + small_allocation, second);
+    EXPECT_EQ(second + small_allocation, third);
+    EXPECT_EQ(nullptr, fourth);
+}
+
+TEST_F(GcServiceTests, AllocateAndRefillShouldNotAllowInlineAllocationsToExceedTheLimit)
+{
+    _gc.set_allocation_limits(0u, small_allocation * 2u);
+    _gc.begin_work(0u);
+
+    EXPECT_NE(nullptr, _gc.allocate_and_refill(small_allocation));
+    EXPECT_NE(nullptr, try_allocate_bytes(small_allocation));
+    EXPECT_EQ(nullptr, try_allocate_bytes(small_allocation));
+    EXPECT_THROW(_gc.allocate(small_allocation), std::bad_alloc);
+    _gc.end_work(0u);
+}
+
+TEST_F(GcServiceTests, AllocateAndRefillShouldNotAllowLargeObjectsToBeAllocatedInline)
+{
+    // Large objects are stored separately, even if they fit in the node
+    constexpr std::size_t large_inline = (autocrat::gc_heap::default_node_size / 4u) + 16u;
+    _gc.begin_work(0u);
+
+    EXPECT_NE(nullptr, _gc.allocate_and_refill(small_allocation));
+    EXPECT_EQ(nullptr, try_allocate_bytes(large_inline));
+    EXPECT_NE(nullptr, try_allocate_bytes(small_allocation));
+    _gc.end_work(0u);
+}
+
+TEST_F(GcServiceTests, AllocateShouldThrowWhenExceedingTheHardLimit)
+{
+    _gc.set_allocation_limits(0u, small_allocation * 2u);
+    _gc.begin_work(0u);
+
+    EXPECT_NE(nullptr, _gc.allocate(small_allocation));
+    EXPECT_NE(nullptr, _gc.allocate(small_allocation));
+    EXPECT_THROW(_gc.allocate(small_allocation), std::bad_alloc);
+}
+
+TEST_F(GcServiceTests, AllocateShouldResetTheLimitsForEachWorkItem)
+{
+    _gc.set_allocation_limits(small_allocation, small_allocation);
+
+    for (int i = 0; i != 2; ++i)
+    {
+        _gc.begin_work(0u);
+        EXPECT_NE(nullptr, _gc.allocate(small_allocation));
+        _gc.end_work(0u);
+    }
+}
+
 TEST_F(GcServiceTests, AllocateShouldZeroFillLargeBuffers)
 {
     CheckAllocation(_gc, large_allocation);
@@ -67,6 +130,44 @@ TEST_F(GcServiceTests, AllocateShouldZeroFillSmallBuffers)
     CheckAllocation(_gc, small_allocation);
 }
 
+TEST_F(GcServiceTests, AppendShouldAllocateAfterTheAppendedMemory)
+{
+    _gc.begin_work(0);
+    autocrat::gc_heap heap = _gc.reset_heap();
+    auto first = static_cast<std::byte*>(_gc.allocate(small_allocation));
+
+    heap.append(_gc.reset_heap());
+    _gc.set_heap(std::move(heap));
+    auto second = static_cast<std::byte*>(_gc.allocate(small_allocation));
+
+    EXPECT_EQ(first + small_allocation, second);
+}
+
+TEST_F(GcServiceTests, AppendShouldTakeOwnershipOfTheMemory)
+{
+    auto append_heaps = [this]()
+    {
+        _gc.begin_work(0);
+        EXPECT_NE(nullptr, _gc.allocate(small_allocation));
+        EXPECT_NE(nullptr, _gc.allocate(large_allocation));
+        autocrat::gc_heap heap = _gc.reset_heap();
+
+        EXPECT_NE(nullptr, _gc.allocate(large_allocation));
+        heap.append(_gc.reset_heap());
+        _gc.set_heap(std::move(heap));
+        _gc.end_work(0);
+    };
+
+    // The heap nodes are allocated from a global store - make sure it has
+    // enough nodes that can be re-used
+    append_heaps();
+
+    std::size_t before_bytes = allocated_bytes();
+    append_heaps();
+    std::size_t after_bytes = allocated_bytes();
+    EXPECT_EQ(before_bytes, after_bytes);
+}
+
 TEST_F(GcServiceTests, DestructorShouldReleaseAllTheMemory)
 {
     {
@@ -88,6 +189,29 @@ TEST_F(GcServiceTests, DestructorShouldReleaseAllTheMemory)
     EXPECT_EQ(before_bytes, after_bytes);
 }
 
+TEST_F(GcServiceTests, GetMemoryRangesShouldIncludeEachAllocation)
+{
+    _gc.begin_work(0);
+    auto small = static_cast<std::byte*>(_gc.allocate(small_allocation));
+    auto large = static_cast<std::byte*>(_gc.allocate(large_allocation));
+    autocrat::gc_heap heap = _gc.reset_heap();
+    _gc.end_work(0);
+
+    auto ranges = heap.get_memory_ranges();
+
+    ASSERT_EQ(2u, ranges.size());
+    EXPECT_TRUE(std::is_sorted(ranges.begin(), ranges.end()));
+    auto contains = [&](const std::byte* start, std::size_t size)
+    {
+        return std::any_of(ranges.begin(), ranges.end(), [&](const auto& range)
+            {
+                return (range.first <= start) && ((start + size) <= range.second);
+            });
+    };
+    EXPECT_TRUE(contains(small, small_allocation));
+    EXPECT_TRUE(contains(large, large_allocation));
+}
+
 TEST_F(GcServiceTests, OnEndWorkShouldReleaseAllTheMemory)
 {
     std::size_t before_bytes = allocated_bytes();
@@ -101,6 +225,51 @@ TEST_F(GcServiceTests, OnEndWorkShouldReleaseAllTheMemory)
     EXPECT_EQ(before_bytes, after_bytes);
 }
 
+TEST_F(GcServiceTests, OnEndWorkShouldZeroFillTheInlineAllocations)
+{
+    for (int i = 0; i != 2; ++i)
+    {
+        _gc.begin_work(0u);
+        EXPECT_NE(nullptr, _gc.allocate_and_refill(small_allocation));
+        auto memory = static_cast<std::byte*>(try_allocate_bytes(small_allocation));
+        ASSERT_NE(nullptr, memory);
+
+        EXPECT_TRUE(std::all_of(memory, memory + small_allocation, [](auto b) { return b == std::byte{}; }));
+        std::fill_n(memory, small_allocation, std::byte{ 255u });
+        _gc.end_work(0u);
+    }
+}
+
+TEST_F(GcServiceTests, OnEndWorkShouldReleaseEveryLargeAllocation)
+{
+    std::size_t before_bytes = allocated_bytes();
+
+    _gc.begin_work(0);
+    for (int i = 0; i != 3; ++i)
+    {
+        EXPECT_NE(nullptr, _gc.allocate(large_allocation));
+    }
+
+    _gc.end_work(0);
+    std::size_t after_bytes = allocated_bytes();
+    EXPECT_EQ(before_bytes, after_bytes);
+}
+
+TEST_F(GcServiceTests, SetNodeSizeShouldChangeTheNodesUsedByTheHeap)
+{
+    _gc.set_node_size(16u * 1024u);
+    _gc.begin_work(0);
+    auto first = static_cast<std::byte*>(_gc.allocate(small_allocation));
+    _gc.end_work(0);
+
+    _gc.set_node_size(autocrat::gc_heap::default_node_size);
+    _gc.begin_work(0);
+    auto second = static_cast<std::byte*>(_gc.allocate(small_allocation));
+    _gc.end_work(0);
+
+    EXPECT_NE(first, second);
+}
+
 TEST_F(GcServiceTests, ShouldBeAbleToUseDifferentHeaps)
 {
     _gc.begin_work(0);
@@ -18,9 +18,25 @@ class ManagedArrayTests : public testing::Test
 {
 public:
 protected:
-    autocrat::managed_byte_array _array;
+    ManagedArrayTests() :
+        _block(_pool.aquire(16u)),
+        _array(_block->array)
+    {
+    }
+
+    autocrat::array_pool _pool;
+    autocrat::managed_byte_array_ptr _block;
+    autocrat::managed_byte_array& _array;
 };
 
+TEST_F(ManagedArrayTests, DataShouldBeStoredAfterTheLength)
+{
+    // Managed arrays store their elements directly after the length
+    auto members = reinterpret_cast<std::uint8_t*>(&_array);
+
+    EXPECT_EQ(members + sizeof(void*) + sizeof(std::uint64_t), _array.data());
+}
+
 TEST_F(ManagedArrayTests, ConstructorShouldSetTheEEType)
 {
     // For the array to be used in the managed code, the first member *must* be
@@ -36,6 +36,29 @@ protected:
     }
 };
 
+TEST_F(MemoryPoolTests, ClearShouldRemoveAllTheData)
+{
+    auto array = CreateData<2000u>();
+    _buffer.append(array.data(), array.size());
+
+    _buffer.clear();
+
+    EXPECT_EQ(0u, _buffer.size());
+}
+
+TEST_F(MemoryPoolTests, CopyToShouldKeepTheData)
+{
+    auto array = CreateData<2000u>();
+    _buffer.append(array.data(), array.size());
+
+    std::array<std::byte, 2000u> copy;
+    _buffer.copy_to(copy.data(), copy.size());
+
+    EXPECT_TRUE(std::equal(array.begin(), array.end(), copy.begin()));
+    EXPECT_EQ(array.size(), _buffer.size());
+    AssertCopy(array);
+}
+
 TEST_F(MemoryPoolTests, ShouldOverwriteTheSpecifiedData)
 {
     // Force multiple nodes to be used via a large array
@@ -76,3 +99,18 @@ TEST_F(MemoryPoolTests, ShouldRoundTripMultipleData)
 
     AssertCopy(array);
 }
+
+TEST_F(MemoryPoolTests, ShouldHandleTheNodeSizeChangingWhilstWriting)
+{
+    auto array = CreateData<3000u>();
+    _buffer.append(array.data(), 1000u);
+
+    autocrat::memory_pool_buffer::set_node_size(512u);
+    _buffer.append(&array[1000], 2000u);
+    std::fill_n(&array[900], 200u, std::byte{ 1u });
+    _buffer.replace(900u, &array[900], 200u);
+    autocrat::memory_pool_buffer::set_node_size(
+        autocrat::memory_pool_buffer::default_node_size);
+
+    AssertCopy(array);
+}
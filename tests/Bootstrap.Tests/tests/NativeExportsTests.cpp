@@ -58,6 +58,42 @@ TEST_F(NativeExportsTests, LoadObjectStringShouldReturnTheValue)
         });
 }
 
+TEST_F(NativeExportsTests, LoadReadOnlyObjectInt64ShouldReturnTheValue)
+{
+    int type = 0;
+    int worker = 0;
+    When(mock_global_services.worker_service().get_read_only_worker)
+        .With(&type, _)
+        .Return(&worker);
+
+    void* result;
+    typed_reference tr = {};
+    tr.value = &result;
+
+    load_read_only_object_int64(&type, 0u, &tr);
+
+    EXPECT_EQ(&worker, result);
+}
+
+TEST_F(NativeExportsTests, PreloadWorkersInt64ShouldPassEachId)
+{
+    int type = 0;
+    std::int64_t ids[] = { 1, 2 };
+    When(mock_global_services.worker_service().preload_workers)
+        .Return(2u);
+
+    std::int32_t result = preload_workers_int64(&type, ids, 2);
+
+    EXPECT_EQ(2, result);
+    std::vector<std::string_view> expected =
+    {
+        std::string_view(reinterpret_cast<char*>(&ids[0]), sizeof(std::int64_t)),
+        std::string_view(reinterpret_cast<char*>(&ids[1]), sizeof(std::int64_t)),
+    };
+    Verify(mock_global_services.worker_service().preload_workers)
+        .With(&type, expected);
+}
+
 TEST_F(NativeExportsTests, RegisterConstructorShouldAddTheMethodHandle)
 {
     construct_worker method = []() -> void* { return nullptr; };
@@ -70,6 +106,16 @@ TEST_F(NativeExportsTests, RegisterConstructorShouldAddTheMethodHandle)
         .With(&type, method);
 }
 
+TEST_F(NativeExportsTests, RegisterExpiryShouldSetTheTimeToLive)
+{
+    int type = 0;
+
+    register_expiry(&type, 30, 1);
+
+    Verify(mock_global_services.worker_service().set_time_to_live)
+        .With(&type, std::chrono::seconds(30), true);
+}
+
 TEST_F(NativeExportsTests, RegisterTimerShouldAddTheMethodHandle)
 {
     timer_method method = [](std::int32_t) -> void* { return nullptr; };
@@ -16,6 +16,7 @@ public:
     MockMethod(void, bind, (const pal::socket_handle&, const pal::socket_address&))
     MockMethod(pal::socket_handle, create_udp_socket, ())
     MockMethod(std::optional<pal::poll_event>, get_poll_event, (const pal::socket_handle&))
+    MockMethod(std::size_t, peek_datagram_size, (const pal::socket_handle&))
     MockMethod(int, recv_from, (const pal::socket_handle&, char*, std::size_t, pal::socket_address*))
 };
 
@@ -75,6 +76,25 @@ TEST_F(NetworkServiceTests, ShouldInvokeTheHandlerWithTheReadData)
     EXPECT_STREQ("test", reinterpret_cast<const char*>(array_data->data()));
 }
 
+TEST_F(NetworkServiceTests, ShouldReceiveIntoABufferLargeEnoughForTheDatagram)
+{
+    When(_socket.get_poll_event).Return(pal::poll_event::read);
+    When(_socket.peek_datagram_size).Return(5000u);
+
+    std::size_t buffer_length = 0;
+    When(_socket.recv_from).Do([&](auto, auto, std::size_t length, auto)
+        {
+            buffer_length = length;
+            return 0;
+        });
+    on_udp_callback = [](auto, auto) {};
+
+    _service.add_udp_callback(123, &udp_callback);
+    _service.check_and_dispatch();
+
+    EXPECT_GE(buffer_length, 5000u);
+}
+
 TEST_F(NetworkServiceTests, ShouldListenOnASingleSocketForTheSamePort)
 {
     _service.add_udp_callback(123, &udp_callback);
@@ -6,8 +6,12 @@
 class NodePoolTests : public testing::Test
 {
 protected:
-    using node_pool = autocrat::node_pool<32u>;
-    node_pool _pool;
+    NodePoolTests() :
+        _pool(32u)
+    {
+    }
+
+    autocrat::node_pool _pool;
 };
 
 TEST_F(NodePoolTests, AcquireShouldReuseNodes)
@@ -25,10 +29,115 @@ TEST_F(NodePoolTests, DestructorShouldReleaseAllTheNodes)
 {
     std::size_t before_bytes = allocated_bytes();
     {
-        node_pool pool;
+        autocrat::node_pool pool(32u);
         EXPECT_NE(nullptr, pool.acquire());
         EXPECT_NE(nullptr, pool.acquire());
     }
     std::size_t after_bytes = allocated_bytes();
     EXPECT_EQ(before_bytes, after_bytes);
 }
+
+TEST_F(NodePoolTests, ReserveShouldAllocateNodesUpFront)
+{
+    _pool.reserve(2u);
+
+    std::size_t before_bytes = allocated_bytes();
+    auto first = _pool.acquire();
+    auto second = _pool.acquire();
+    std::size_t after_bytes = allocated_bytes();
+
+    EXPECT_NE(first, second);
+    EXPECT_EQ(before_bytes, after_bytes);
+}
+
+TEST_F(NodePoolTests, StatisticsShouldReturnTheNodeCounts)
+{
+    auto first = _pool.acquire();
+    _pool.acquire();
+    _pool.release(first);
+
+    autocrat::node_pool_statistics statistics = _pool.statistics();
+
+    EXPECT_EQ(2u, statistics.allocated);
+    EXPECT_EQ(1u, statistics.free);
+    EXPECT_EQ(1u, statistics.in_use);
+}
+
+TEST_F(NodePoolTests, TrimShouldFreeNodesAboveTheLowWatermark)
+{
+    _pool.reserve(4u);
+
+    std::size_t before_bytes = allocated_bytes();
+    std::size_t freed = _pool.trim(1u, 2u);
+    std::size_t after_bytes = allocated_bytes();
+
+    EXPECT_EQ(3u, freed);
+    EXPECT_LT(after_bytes, before_bytes);
+    EXPECT_EQ(1u, _pool.statistics().allocated);
+    EXPECT_NE(nullptr, _pool.acquire());
+}
+
+TEST_F(NodePoolTests, TrimShouldNotFreeNodesBelowTheHighWatermark)
+{
+    _pool.reserve(2u);
+
+    std::size_t freed = _pool.trim(0u, 2u);
+
+    EXPECT_EQ(0u, freed);
+    EXPECT_EQ(2u, _pool.statistics().free);
+}
+
+TEST_F(NodePoolTests, TrimShouldNotFreeNodesInUse)
+{
+    auto first = _pool.acquire();
+    _pool.reserve(2u);
+
+    _pool.trim(0u, 1u);
+
+    EXPECT_EQ(1u, _pool.statistics().allocated);
+    _pool.release(first);
+}
+
+TEST_F(NodePoolTests, TrimShouldLeaveTheNodesInUseForTheDestructor)
+{
+    std::size_t before_bytes = allocated_bytes();
+    {
+        autocrat::node_pool pool(32u);
+        auto first = pool.acquire();
+        auto second = pool.acquire();
+        auto third = pool.acquire();
+        auto fourth = pool.acquire();
+        pool.release(first);
+        pool.release(third);
+
+        EXPECT_EQ(2u, pool.trim(0u, 0u));
+        EXPECT_EQ(2u, pool.statistics().allocated);
+        EXPECT_NE(second, fourth);
+    }
+    std::size_t after_bytes = allocated_bytes();
+    EXPECT_EQ(before_bytes, after_bytes);
+}
+
+TEST_F(NodePoolTests, SetNodeSizeShouldFreeUnusedNodes)
+{
+    _pool.reserve(2u);
+
+    _pool.set_node_size(64u);
+
+    EXPECT_EQ(0u, _pool.statistics().allocated);
+    EXPECT_EQ(64u, _pool.acquire()->capacity);
+}
+
+TEST_F(NodePoolTests, ReleaseShouldNotReuseNodesOfAPreviousSize)
+{
+    auto first = _pool.acquire();
+    _pool.set_node_size(64u);
+
+    _pool.release(first);
+    auto second = _pool.acquire();
+
+    EXPECT_EQ(64u, second->capacity);
+    EXPECT_EQ(2u, _pool.statistics().allocated);
+    EXPECT_EQ(1u, _pool.trim(0u, 0u));
+    EXPECT_EQ(1u, _pool.statistics().allocated);
+}
@@ -0,0 +1,111 @@
+#include "managed_interop.h"
+
+#include <gtest/gtest.h>
+#include "ManagedObjects.h"
+
+class ObjectArenaTests : public testing::Test
+{
+protected:
+    autocrat::object_arena _arena;
+};
+
+TEST_F(ObjectArenaTests, SaveShouldCompactWhenTheGarbageExceedsTheThreshold)
+{
+    ManagedObject<BaseClass> first;
+    ManagedObject<BaseClass> second;
+    second->BaseInteger = 123;
+
+    ManagedObject<SingleReference> root;
+    root->Reference = first.get();
+    auto saved = static_cast<SingleReference*>(_arena.save(root.get(), 50u));
+
+    // Replacing the reference turns the copy of first into garbage
+    saved->Reference = second.get();
+    void* compacted = _arena.save(saved, 50u);
+
+    EXPECT_NE(saved, compacted);
+    EXPECT_EQ(_arena.live_bytes(), _arena.allocated_bytes());
+
+    auto copy = static_cast<SingleReference*>(compacted);
+    EXPECT_EQ(123, static_cast<BaseClass*>(copy->Reference)->BaseInteger);
+}
+
+TEST_F(ObjectArenaTests, SaveShouldCopyObjectsOutsideOfTheArena)
+{
+    ManagedObject<BaseClass> base_class;
+    base_class->BaseInteger = 123;
+
+    ManagedObject<SingleReference> root;
+    root->Reference = base_class.get();
+
+    void* result = _arena.save(root.get(), 100u);
+
+    // Clear the original to prove the copy is independent
+    base_class->BaseInteger = 0;
+
+    ASSERT_NE(root.get(), result);
+    auto copy = static_cast<SingleReference*>(result);
+    ASSERT_NE(base_class.get(), copy->Reference);
+    EXPECT_EQ(123, static_cast<BaseClass*>(copy->Reference)->BaseInteger);
+    EXPECT_EQ(24u + 32u, _arena.live_bytes());
+}
+
+TEST_F(ObjectArenaTests, SaveShouldCopyNewObjectsOnce)
+{
+    ManagedObject<ReferenceArray<2u>> root;
+    auto saved = static_cast<ReferenceArray<2u>*>(_arena.save(root.get(), 100u));
+
+    ManagedObject<BaseClass> base_class;
+    saved->references[0] = base_class.get();
+    saved->references[1] = base_class.get();
+    _arena.save(saved, 100u);
+
+    EXPECT_NE(base_class.get(), saved->references[0]);
+    EXPECT_EQ(saved->references[0], saved->references[1]);
+    EXPECT_EQ(40u + 32u, _arena.live_bytes());
+}
+
+TEST_F(ObjectArenaTests, SaveShouldCountTheObjectsInTheArenaOnce)
+{
+    ManagedObject<BaseClass> base_class;
+    ManagedObject<ReferenceArray<2u>> root;
+    root->references[0] = base_class.get();
+    root->references[1] = base_class.get();
+
+    void* first = _arena.save(root.get(), 100u);
+    std::size_t live_bytes = _arena.live_bytes();
+    void* second = _arena.save(first, 100u);
+
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(40u + 32u, live_bytes);
+    EXPECT_EQ(live_bytes, _arena.live_bytes());
+}
+
+TEST_F(ObjectArenaTests, SaveShouldMoveNewReferencesIntoTheArena)
+{
+    ManagedObject<SingleReference> root;
+    auto saved = static_cast<SingleReference*>(_arena.save(root.get(), 100u));
+
+    ManagedObject<BaseClass> base_class;
+    base_class->BaseInteger = 123;
+    saved->Reference = base_class.get();
+    void* result = _arena.save(saved, 100u);
+
+    EXPECT_EQ(saved, result);
+    ASSERT_NE(base_class.get(), saved->Reference);
+    EXPECT_EQ(123, static_cast<BaseClass*>(saved->Reference)->BaseInteger);
+}
+
+TEST_F(ObjectArenaTests, SaveShouldNotCopyObjectsAlreadyInTheArena)
+{
+    ManagedObject<SingleReference> root;
+    root->Reference = root.get();
+
+    void* first = _arena.save(root.get(), 100u);
+    std::size_t allocated = _arena.allocated_bytes();
+    void* second = _arena.save(first, 100u);
+
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(allocated, _arena.allocated_bytes());
+    EXPECT_EQ(first, static_cast<SingleReference*>(second)->Reference);
+}
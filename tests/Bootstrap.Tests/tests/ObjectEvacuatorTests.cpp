@@ -0,0 +1,140 @@
+#include "managed_interop.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+#include <gtest/gtest.h>
+#include "ManagedObjects.h"
+#include "mock_services.h"
+
+class FakeEvacuator : public autocrat::object_evacuator
+{
+public:
+    std::unordered_set<void**> fields;
+    std::unordered_set<void*> skipped;
+protected:
+    void on_field(void** field) override
+    {
+        bool inserted = fields.insert(field).second;
+        EXPECT_TRUE(inserted);
+    }
+
+    bool should_copy(void* object) override
+    {
+        return skipped.find(object) == skipped.end();
+    }
+};
+
+class ObjectEvacuatorTests : public testing::Test
+{
+protected:
+    ObjectEvacuatorTests() :
+        _buffer(1024u)
+    {
+        When(mock_global_services.gc_service().allocate)
+            .Do([&](std::size_t sz)
+                {
+                    EXPECT_LE(_used + sz, _buffer.size());
+                    void* memory = _buffer.data() + _used;
+                    _used += sz;
+                    return memory;
+                });
+    }
+
+    bool IsCopy(void* object)
+    {
+        auto address = static_cast<std::byte*>(object);
+        return (address >= _buffer.data()) &&
+            (address < (_buffer.data() + _buffer.size()));
+    }
+
+    FakeEvacuator _evacuator;
+private:
+    std::vector<std::byte> _buffer;
+    std::size_t _used = 0;
+};
+
+TEST_F(ObjectEvacuatorTests, EvacuateShouldCopyTheReachableObjects)
+{
+    ManagedObject<BaseClass> base_class;
+    base_class->BaseInteger = 123;
+    ManagedObject<SingleReference> root;
+    root->Reference = base_class.get();
+
+    auto copy = static_cast<SingleReference*>(_evacuator.evacuate(root.get()));
+
+    ASSERT_TRUE(IsCopy(copy));
+    ASSERT_TRUE(IsCopy(copy->Reference));
+    EXPECT_EQ(123, static_cast<BaseClass*>(copy->Reference)->BaseInteger);
+    EXPECT_EQ(1u, _evacuator.fields.size());
+    EXPECT_EQ(1u, _evacuator.fields.count(&copy->Reference));
+}
+
+TEST_F(ObjectEvacuatorTests, EvacuateShouldHandleCyclicGraphs)
+{
+    ManagedObject<SingleReference> object;
+    object->Reference = object.get();
+
+    auto copy = static_cast<SingleReference*>(_evacuator.evacuate(object.get()));
+
+    ASSERT_TRUE(IsCopy(copy));
+    EXPECT_EQ(copy, copy->Reference);
+}
+
+TEST_F(ObjectEvacuatorTests, EvacuateShouldKeepTheObjectsThatAreNotCopied)
+{
+    ManagedObject<BaseClass> base_class;
+    ManagedObject<SingleReference> root;
+    root->Reference = base_class.get();
+    _evacuator.skipped.insert(base_class.get());
+
+    auto copy = static_cast<SingleReference*>(_evacuator.evacuate(root.get()));
+
+    ASSERT_TRUE(IsCopy(copy));
+    EXPECT_EQ(base_class.get(), copy->Reference);
+    EXPECT_EQ(1u, _evacuator.fields.count(&copy->Reference));
+}
+
+TEST_F(ObjectEvacuatorTests, EvacuateShouldNotChangeTheOriginalObjects)
+{
+    ManagedObject<BaseClass> base_class;
+    ManagedObject<SingleReference> root;
+    root->Reference = base_class.get();
+    EEType* base_type = base_class->m_pEEType;
+    EEType* root_type = root->m_pEEType;
+
+    auto copy = static_cast<SingleReference*>(_evacuator.evacuate(root.get()));
+    base_class->BaseInteger = 123;
+
+    EXPECT_EQ(base_type, base_class->m_pEEType);
+    EXPECT_EQ(root_type, root->m_pEEType);
+    EXPECT_EQ(base_class.get(), root->Reference);
+    EXPECT_EQ(0, static_cast<BaseClass*>(copy->Reference)->BaseInteger);
+}
+
+TEST_F(ObjectEvacuatorTests, EvacuateShouldNotFollowSavedObjects)
+{
+    // The serializer replaces the type of the objects it saves with their
+    // offset, marked by the bottom bit
+    ManagedObject<SingleReference> saved;
+    saved->m_pEEType = reinterpret_cast<EEType*>(std::uintptr_t{0x11});
+    ManagedObject<SingleReference> root;
+    root->Reference = saved.get();
+
+    auto copy = static_cast<SingleReference*>(_evacuator.evacuate(root.get()));
+
+    ASSERT_TRUE(IsCopy(copy));
+    EXPECT_EQ(saved.get(), copy->Reference);
+}
+
+TEST_F(ObjectEvacuatorTests, EvacuateShouldReturnTheRootIfItIsNotCopied)
+{
+    ManagedObject<SingleReference> root;
+    _evacuator.skipped.insert(root.get());
+
+    void* result = _evacuator.evacuate(root.get());
+
+    EXPECT_EQ(root.get(), result);
+    EXPECT_TRUE(_evacuator.fields.empty());
+}
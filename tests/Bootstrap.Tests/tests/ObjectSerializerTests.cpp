@@ -1,15 +1,330 @@
 #include "managed_interop.h"
 
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
 #include <gtest/gtest.h>
 #include "ManagedObjects.h"
 #include "mock_services.h"
 
+namespace
+{
+    // The base size of managed types includes space for the GC header
+    struct PaddedInt32Array : Int32Array<3u>
+    {
+        char padding[8];
+    };
+}
+
 class ObjectSerializerTests : public testing::Test
 {
 protected:
+    void* Restore(std::vector<std::byte>& buffer)
+    {
+        When(mock_global_services.gc_service().allocate)
+            .Do([&](std::size_t sz)
+                {
+                    EXPECT_LE(sz, buffer.size());
+                    return buffer.data();
+                });
+
+        return _serializer.restore();
+    }
+
     autocrat::object_serializer _serializer;
 };
 
+TEST_F(ObjectSerializerTests, CompressShouldReduceTheSizeOfTheSavedData)
+{
+    constexpr std::size_t object_count = 100u;
+    std::vector<ManagedObject<SingleReference>> objects(object_count);
+    for (std::size_t i = 1; i != object_count; ++i)
+    {
+        objects[i - 1u]->Reference = objects[i].get();
+    }
+
+    _serializer.save(objects[0].get());
+    std::size_t original_size = _serializer.size();
+
+    bool compressed = _serializer.compress();
+
+    EXPECT_TRUE(compressed);
+    EXPECT_TRUE(_serializer.is_compressed());
+    EXPECT_LT(_serializer.size(), original_size);
+    EXPECT_EQ(original_size, _serializer.uncompressed_size());
+
+    std::vector<std::byte> buffer(original_size);
+    auto current = static_cast<SingleReference*>(Restore(buffer));
+    auto type = current->m_pEEType;
+    std::size_t count = 0;
+    while (current != nullptr)
+    {
+        ASSERT_EQ(type, current->m_pEEType);
+        ++count;
+        current = static_cast<SingleReference*>(current->Reference);
+    }
+
+    EXPECT_EQ(object_count, count);
+}
+
+TEST_F(ObjectSerializerTests, ExportDataShouldExportCompressedData)
+{
+    ManagedObject<BaseClass> base_class;
+    ManagedObject<SingleReference> root;
+    root->Reference = base_class.get();
+    _serializer.save(root.get());
+    _serializer.compress();
+
+    std::size_t type_count = 0;
+    std::vector<std::byte> data = _serializer.export_data(
+        [&](const void*) -> std::uint64_t
+        {
+            ++type_count;
+            return 0u;
+        });
+
+    EXPECT_EQ(2u, type_count);
+    EXPECT_EQ(_serializer.uncompressed_size(), data.size());
+}
+
+TEST_F(ObjectSerializerTests, ExportDataShouldReplaceTheTypes)
+{
+    ManagedObject<BaseClass> base_class;
+    ManagedObject<SingleReference> root;
+    root->Reference = base_class.get();
+    const void* root_type = root.get()->m_pEEType;
+    const void* base_class_type = base_class.get()->m_pEEType;
+    _serializer.save(root.get());
+
+    std::vector<const void*> types;
+    std::vector<std::byte> data = _serializer.export_data(
+        [&](const void* type) -> std::uint64_t
+        {
+            types.push_back(type);
+            return 42u;
+        });
+
+    ASSERT_EQ(2u, types.size());
+    EXPECT_EQ(root_type, types[0]);
+    EXPECT_EQ(base_class_type, types[1]);
+
+    std::uint64_t first_type;
+    std::memcpy(&first_type, data.data(), sizeof(first_type));
+    EXPECT_EQ(42u, first_type);
+}
+
+TEST_F(ObjectSerializerTests, ImportDataShouldRestoreTheTypes)
+{
+    ManagedObject<BaseClass> base_class;
+    base_class->BaseInteger = 123;
+    const void* type = base_class.get()->m_pEEType;
+    _serializer.save(base_class.get());
+    std::vector<std::byte> data = _serializer.export_data(
+        [](const void*) -> std::uint64_t { return 0u; });
+
+    autocrat::object_serializer imported;
+    imported.import_data(
+        data.data(),
+        data.size(),
+        [=](std::uint64_t id) { return (id == 0u) ? type : nullptr; });
+
+    std::vector<std::byte> buffer(1024u);
+    When(mock_global_services.gc_service().allocate)
+        .Do([&](std::size_t) { return buffer.data(); });
+    auto copy = static_cast<BaseClass*>(imported.restore());
+    EXPECT_EQ(123, copy->BaseInteger);
+}
+
+TEST_F(ObjectSerializerTests, ImportDataShouldThrowForUnknownTypes)
+{
+    ManagedObject<BaseClass> base_class;
+    _serializer.save(base_class.get());
+    std::vector<std::byte> data = _serializer.export_data(
+        [](const void*) -> std::uint64_t { return 1u; });
+
+    autocrat::object_serializer imported;
+    EXPECT_THROW(
+        imported.import_data(
+            data.data(),
+            data.size(),
+            [](std::uint64_t) -> const void* { return nullptr; }),
+        std::runtime_error);
+}
+
+TEST_F(ObjectSerializerTests, KeepIfUnchangedShouldNotKeepModifiedObjects)
+{
+    ManagedObject<BaseClass> base_class;
+    base_class->BaseInteger = 123;
+    _serializer.save(base_class.get());
+
+    std::vector<std::byte> buffer(1024u);
+    auto restored = static_cast<BaseClass*>(Restore(buffer));
+    restored->BaseInteger = 456;
+    bool kept = _serializer.keep_if_unchanged(restored);
+    bool saved = _serializer.save(restored);
+
+    EXPECT_FALSE(kept);
+    EXPECT_TRUE(saved);
+    std::vector<std::byte> second_buffer(1024u);
+    auto copy = static_cast<BaseClass*>(Restore(second_buffer));
+    EXPECT_EQ(456, copy->BaseInteger);
+}
+
+TEST_F(ObjectSerializerTests, KeepIfUnchangedShouldKeepTheDataOfUnmodifiedObjects)
+{
+    ManagedObject<BaseClass> base_class;
+    base_class->BaseInteger = 123;
+    _serializer.save(base_class.get());
+
+    std::vector<std::byte> buffer(1024u);
+    auto restored = static_cast<BaseClass*>(Restore(buffer));
+    bool kept = _serializer.keep_if_unchanged(restored);
+
+    EXPECT_TRUE(kept);
+    EXPECT_EQ(123, restored->BaseInteger);
+}
+
+TEST_F(ObjectSerializerTests, ObjectCountShouldReturnTheNumberOfSavedObjects)
+{
+    ManagedObject<SingleReference> first;
+    ManagedObject<SingleReference> second;
+    first->Reference = second.get();
+    second->Reference = first.get();
+
+    _serializer.save(first.get());
+
+    EXPECT_EQ(2u, _serializer.object_count());
+}
+
+TEST_F(ObjectSerializerTests, SaveShouldKeepTheDataOfUnmodifiedObjects)
+{
+    ManagedObject<BaseClass> base_class;
+    base_class->BaseInteger = 123;
+    _serializer.save(base_class.get());
+
+    std::vector<std::byte> buffer(1024u);
+    void* restored = Restore(buffer);
+    bool saved = _serializer.save(restored);
+
+    EXPECT_FALSE(saved);
+    std::vector<std::byte> second_buffer(1024u);
+    auto copy = static_cast<BaseClass*>(Restore(second_buffer));
+    EXPECT_EQ(123, copy->BaseInteger);
+}
+
+TEST_F(ObjectSerializerTests, SaveShouldKeepTheCompressedDataOfUnmodifiedObjects)
+{
+    ManagedObject<BaseClass> base_class;
+    base_class->BaseInteger = 123;
+    _serializer.save(base_class.get());
+    _serializer.compress();
+
+    std::vector<std::byte> buffer(1024u);
+    void* restored = Restore(buffer);
+    bool saved = _serializer.save(restored);
+
+    EXPECT_FALSE(saved);
+    EXPECT_TRUE(_serializer.is_compressed());
+    std::vector<std::byte> second_buffer(1024u);
+    auto copy = static_cast<BaseClass*>(Restore(second_buffer));
+    EXPECT_EQ(123, copy->BaseInteger);
+}
+
+TEST_F(ObjectSerializerTests, SaveShouldSaveModifiedObjects)
+{
+    ManagedObject<BaseClass> base_class;
+    base_class->BaseInteger = 123;
+    _serializer.save(base_class.get());
+
+    std::vector<std::byte> buffer(1024u);
+    auto restored = static_cast<BaseClass*>(Restore(buffer));
+    restored->BaseInteger = 456;
+    bool saved = _serializer.save(restored);
+
+    EXPECT_TRUE(saved);
+    std::vector<std::byte> second_buffer(1024u);
+    auto copy = static_cast<BaseClass*>(Restore(second_buffer));
+    EXPECT_EQ(456, copy->BaseInteger);
+}
+
+TEST_F(ObjectSerializerTests, ShouldAlignEachObject)
+{
+    ManagedObject<PaddedInt32Array> integers;
+    integers->elements[2] = 123;
+
+    ManagedObject<SingleReference> element;
+
+    ManagedObject<ReferenceArray<2u>> array;
+    array->references[0] = integers.get();
+    array->references[1] = element.get();
+
+    _serializer.save(array.get());
+
+    std::vector<std::byte> buffer(1024u);
+    auto copy_array = static_cast<ReferenceArray<2u>*>(Restore(buffer));
+
+    auto copy_integers = static_cast<Int32Array<3u>*>(copy_array->references[0]);
+    EXPECT_EQ(123, copy_integers->elements[2]);
+
+    auto address = reinterpret_cast<std::uintptr_t>(copy_array->references[1]);
+    EXPECT_EQ(0u, address % sizeof(void*));
+}
+
+TEST_F(ObjectSerializerTests, ShouldRestoreNullWhenNothingWasSaved)
+{
+    _serializer.save(nullptr);
+
+    EXPECT_EQ(nullptr, _serializer.restore());
+}
+
+TEST_F(ObjectSerializerTests, ShouldRestoreSharedReferencesToTheSameObject)
+{
+    ManagedObject<SingleReference> element;
+
+    ManagedObject<ReferenceArray<2u>> array;
+    array->references[0] = element.get();
+    array->references[1] = element.get();
+    element->Reference = array.get();
+
+    _serializer.save(array.get());
+
+    std::vector<std::byte> buffer(1024u);
+    void* result = Restore(buffer);
+
+    auto copy_array = static_cast<ReferenceArray<2u>*>(result);
+    ASSERT_NE(nullptr, copy_array->references[0]);
+    EXPECT_EQ(copy_array->references[0], copy_array->references[1]);
+
+    auto copy_element = static_cast<SingleReference*>(copy_array->references[0]);
+    EXPECT_EQ(result, copy_element->Reference);
+}
+
+TEST_F(ObjectSerializerTests, ShouldRoundtripLargeObjectGraphs)
+{
+    constexpr std::size_t object_count = 100'000u;
+    std::vector<ManagedObject<SingleReference>> objects(object_count);
+    for (std::size_t i = 1; i != object_count; ++i)
+    {
+        objects[i - 1u]->Reference = objects[i].get();
+    }
+
+    _serializer.save(objects[0].get());
+
+    std::vector<std::byte> buffer(object_count * sizeof(SingleReference));
+    auto current = static_cast<SingleReference*>(Restore(buffer));
+
+    std::size_t count = 0;
+    while (current != nullptr)
+    {
+        ASSERT_NE(nullptr, current->m_pEEType);
+        ++count;
+        current = static_cast<SingleReference*>(current->Reference);
+    }
+
+    EXPECT_EQ(object_count, count);
+}
+
 TEST_F(ObjectSerializerTests, ShouldRoundtripObjectState)
 {
     // Simulate the following object graph:
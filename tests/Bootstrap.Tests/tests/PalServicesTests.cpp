@@ -2,10 +2,12 @@
 #include "pal.h"
 #include "PalTests.h"
 
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <cstdlib>
 #include <filesystem>
+#include <system_error>
 #include <thread>
 #include <gtest/gtest.h>
 
@@ -103,6 +105,30 @@ int run_ctrl_c_test()
     return 123;
 }
 
+TEST_F(PalServicesTests, ShouldReadAndWriteFilesAtAnOffset)
+{
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() / "autocrat_pal_file_test";
+    std::array<std::byte, 4> data = {
+        std::byte{1}, std::byte{2}, std::byte{3}, std::byte{4}};
+    std::array<std::byte, 2> read = {};
+    {
+        pal::file_handle file = pal::create_file(path);
+        pal::write_file(file, 4u, data.data(), data.size());
+        pal::write_file(file, 0u, data.data(), 2u);
+
+        pal::read_file(file, 5u, read.data(), read.size());
+        std::array<std::byte, 2> past_end = {};
+        EXPECT_THROW(pal::read_file(file, 7u, past_end.data(), past_end.size()), std::system_error);
+    }
+    std::uintmax_t size = std::filesystem::file_size(path);
+    std::filesystem::remove(path);
+
+    EXPECT_EQ(std::byte{2}, read[0]);
+    EXPECT_EQ(std::byte{3}, read[1]);
+    EXPECT_EQ(8u, size);
+}
+
 TEST_F(PalServicesTests, ShouldGetTheCurrentExecutable)
 {
 #if defined(_WIN32)
@@ -154,6 +154,17 @@ TEST_F(PalSocketTests, PollShouldThrowForErrors)
 }
 #endif
 
+TEST_F(PalSocketTests, PeekDatagramSizeShouldReturnTheSizeOfTheNextDatagram)
+{
+    pal::socket_handle server = pal::create_udp_socket();
+    pal::bind(server, pal::socket_address::any_ipv4());
+    SendData(GetPort(server), "12345");
+
+    std::size_t result = pal::peek_datagram_size(server);
+
+    EXPECT_EQ(5u, result);
+}
+
 TEST_F(PalSocketTests, RecvFromShouldReturnZeroIfThereIsNoDataReady)
 {
     pal::socket_handle socket = pal::create_udp_socket();
@@ -3,12 +3,15 @@
 #include <algorithm>
 #include <array>
 #include <unordered_map>
+#include <vector>
 #include <gtest/gtest.h>
 #include "ManagedObjects.h"
 
-struct ObjectCounter : autocrat::detail::reference_scanner
+struct ObjectCounter : autocrat::detail::reference_scanner<ObjectCounter>
 {
-    std::optional<void*> get_moved_location(void* object) override
+    virtual ~ObjectCounter() = default;
+
+    virtual std::optional<void*> get_moved_location(void* object)
     {
         auto it = moved_objects.find(object);
         if (it == moved_objects.end())
@@ -21,25 +24,25 @@ struct ObjectCounter : autocrat::detail::reference_scanner
         }
     }
 
-    void* get_reference(void* object, std::size_t offset) override
+    virtual void* get_reference(void* object, std::size_t offset)
     {
         void* address_of_field = static_cast<std::byte*>(object) + offset;
         return *static_cast<void**>(address_of_field);
     }
 
-    void* move_object(void* object, std::size_t size) override
+    virtual void* move_object(void* object, std::size_t size)
     {
         allocated_bytes += size;
         references++;
         return object;
     }
 
-    void set_moved_location(void* object, void* new_location) override
+    virtual void set_moved_location(void* object, void* new_location)
     {
         moved_objects[object] = new_location;
     }
 
-    void set_reference(void*, std::size_t, void*) override
+    virtual void set_reference(void*, std::size_t, void*)
     {
     }
 
@@ -79,6 +82,29 @@ class ReferenceScannerTests : public testing::Test
 protected:
 };
 
+TEST_F(ReferenceScannerTests, GetTypeLayoutShouldCacheTheLayout)
+{
+    ManagedObject<DerivedClass> derived;
+    auto object = reinterpret_cast<autocrat::detail::managed_object*>(derived.get());
+
+    const auto& first = autocrat::detail::get_type_layout(object->type);
+    const auto& second = autocrat::detail::get_type_layout(object->type);
+
+    EXPECT_EQ(&first, &second);
+}
+
+TEST_F(ReferenceScannerTests, GetTypeLayoutShouldFlattenTheReferenceOffsets)
+{
+    ManagedObject<DerivedClass> derived;
+    auto object = reinterpret_cast<autocrat::detail::managed_object*>(derived.get());
+
+    const auto& layout = autocrat::detail::get_type_layout(object->type);
+
+    EXPECT_EQ((std::vector<std::uint32_t>{ 8u, 24u, 32u }), layout.offsets);
+    EXPECT_FALSE(layout.reference_array);
+    EXPECT_EQ(48u, layout.base_size);
+}
+
 TEST_F(ReferenceScannerTests, MoveShouldHandleNullObjects)
 {
     ObjectCounter counter;
@@ -120,6 +146,22 @@ TEST_F(ReferenceScannerTests, ShouldMoveTheReferencesAndData)
     EXPECT_EQ(nullptr, array_copy->references[1]);
 }
 
+TEST_F(ReferenceScannerTests, ShouldScanDeeplyNestedObjects)
+{
+    constexpr std::size_t object_count = 100'000u;
+    std::vector<ManagedObject<SingleReference>> objects(object_count);
+    for (std::size_t i = 1; i != object_count; ++i)
+    {
+        objects[i - 1u]->Reference = objects[i].get();
+    }
+
+    ObjectCounter counter;
+    counter.move(objects[0].get());
+
+    EXPECT_EQ(object_count * 24u, counter.allocated_bytes);
+    EXPECT_EQ(object_count, counter.references);
+}
+
 TEST_F(ReferenceScannerTests, ShouldScanEmptyObjects)
 {
     ManagedObject<Object> value;
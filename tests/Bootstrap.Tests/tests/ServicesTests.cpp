@@ -21,6 +21,7 @@ struct MockService
     }
 
     MockMethod(void, check_and_dispatch, (), )
+    MockMethod(void, dump_statistics, (), )
 
     MockThreadPool* thread_pool;
 };
@@ -54,6 +55,15 @@ TEST_F(ServicesTests, CheckAndDispatchShouldCallTheServiceMethod)
     Verify(_services.get_service<MockService>()->check_and_dispatch);
 }
 
+TEST_F(ServicesTests, DumpStatisticsShouldCallTheServiceMethod)
+{
+    _services.initialize();
+
+    _services.dump_statistics();
+
+    Verify(_services.get_service<MockService>()->dump_statistics);
+}
+
 TEST_F(ServicesTests, InitializeShouldCreateNewInstances)
 {
     _services.initialize();
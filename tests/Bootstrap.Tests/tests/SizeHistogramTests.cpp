@@ -0,0 +1,44 @@
+#include "memory_pool.h"
+
+#include <gtest/gtest.h>
+
+class SizeHistogramTests : public testing::Test
+{
+protected:
+    autocrat::size_histogram _histogram;
+};
+
+TEST_F(SizeHistogramTests, CountShouldReturnTheNumberOfRecordedSizes)
+{
+    _histogram.record(1u);
+    _histogram.record(1000u);
+
+    EXPECT_EQ(2u, _histogram.count());
+}
+
+TEST_F(SizeHistogramTests, PercentileShouldReturnThePowerOfTwoBucket)
+{
+    for (std::size_t i = 0; i != 9u; ++i)
+    {
+        _histogram.record(100u);
+    }
+
+    _histogram.record(5000u);
+
+    EXPECT_EQ(128u, _histogram.percentile(90u));
+    EXPECT_EQ(8192u, _histogram.percentile(100u));
+}
+
+TEST_F(SizeHistogramTests, PercentileShouldReturnZeroIfNothingIsRecorded)
+{
+    EXPECT_EQ(0u, _histogram.percentile(50u));
+}
+
+TEST_F(SizeHistogramTests, ResetShouldRemoveTheRecordedSizes)
+{
+    _histogram.record(100u);
+
+    _histogram.reset();
+
+    EXPECT_EQ(0u, _histogram.count());
+}
@@ -0,0 +1,127 @@
+#include "spill_store.h"
+
+#include <array>
+#include <filesystem>
+#include <optional>
+#include <gtest/gtest.h>
+
+namespace fs = std::filesystem;
+
+class SpillStoreTests : public testing::Test
+{
+protected:
+    static constexpr std::size_t segment_size = 8u;
+
+    SpillStoreTests() :
+        _directory(fs::temp_directory_path() / "autocrat_spill_tests")
+    {
+        _store.emplace(_directory, segment_size);
+    }
+
+    ~SpillStoreTests()
+    {
+        _store.reset();
+        fs::remove_all(_directory);
+    }
+
+    std::size_t CountFiles()
+    {
+        auto it = fs::directory_iterator(_directory);
+        return static_cast<std::size_t>(
+            std::distance(it, fs::directory_iterator()));
+    }
+
+    std::array<std::byte, segment_size> MakeData(std::uint8_t value)
+    {
+        std::array<std::byte, segment_size> data;
+        data.fill(std::byte{value});
+        return data;
+    }
+
+    fs::path _directory;
+    std::optional<autocrat::spill_store> _store;
+};
+
+TEST_F(SpillStoreTests, DestructorShouldDeleteTheFiles)
+{
+    auto data = MakeData(1u);
+    _store->write(data.data(), data.size());
+    EXPECT_EQ(1u, CountFiles());
+
+    _store.reset();
+
+    EXPECT_EQ(0u, CountFiles());
+}
+
+TEST_F(SpillStoreTests, ReadShouldReturnTheWrittenData)
+{
+    auto first = MakeData(1u);
+    auto second = MakeData(2u);
+    autocrat::spill_location first_location =
+        _store->write(first.data(), 4u);
+    autocrat::spill_location second_location =
+        _store->write(second.data(), 4u);
+
+    auto buffer = MakeData(0u);
+    _store->read(second_location, buffer.data());
+    EXPECT_EQ(std::byte{2u}, buffer[0]);
+    EXPECT_EQ(std::byte{2u}, buffer[3]);
+    EXPECT_EQ(std::byte{0u}, buffer[4]);
+
+    _store->read(first_location, buffer.data());
+    EXPECT_EQ(std::byte{1u}, buffer[0]);
+    EXPECT_EQ(std::byte{1u}, buffer[3]);
+}
+
+TEST_F(SpillStoreTests, ReleaseShouldDeleteSegmentsThatAreNotUsed)
+{
+    auto data = MakeData(1u);
+    autocrat::spill_location first =
+        _store->write(data.data(), data.size());
+    autocrat::spill_location second =
+        _store->write(data.data(), data.size());
+    EXPECT_EQ(2u, CountFiles());
+
+    _store->release(first);
+
+    EXPECT_EQ(1u, CountFiles());
+    EXPECT_EQ(second.size, _store->size());
+}
+
+TEST_F(SpillStoreTests, ReleaseShouldReuseTheCurrentSegment)
+{
+    auto first = MakeData(1u);
+    auto second = MakeData(2u);
+    _store->release(_store->write(first.data(), first.size()));
+
+    autocrat::spill_location location =
+        _store->write(second.data(), second.size());
+
+    EXPECT_EQ(0u, location.offset);
+    EXPECT_EQ(0u, location.segment);
+    EXPECT_EQ(1u, CountFiles());
+}
+
+TEST_F(SpillStoreTests, SizeShouldReturnTheNumberOfUnreleasedBytes)
+{
+    auto data = MakeData(1u);
+    _store->write(data.data(), 3u);
+    autocrat::spill_location location = _store->write(data.data(), 2u);
+
+    EXPECT_EQ(5u, _store->size());
+
+    _store->release(location);
+
+    EXPECT_EQ(3u, _store->size());
+}
+
+TEST_F(SpillStoreTests, WriteShouldStartANewSegmentWhenFull)
+{
+    auto data = MakeData(1u);
+    autocrat::spill_location first = _store->write(data.data(), 6u);
+    autocrat::spill_location second = _store->write(data.data(), 6u);
+
+    EXPECT_EQ(0u, first.segment);
+    EXPECT_EQ(1u, second.segment);
+    EXPECT_EQ(0u, second.offset);
+}
@@ -1,5 +1,8 @@
 #include "task_service.h"
 
+#include <cstddef>
+#include <new>
+#include <vector>
 #include <gtest/gtest.h>
 #include <cpp_mock.h>
 #include "managed_types.h"
@@ -40,12 +43,57 @@ protected:
     TaskServiceTests() :
         _task_service(&_thread_pool)
     {
+        _task_service.pool_created(1u);
+    }
+
+    ~TaskServiceTests()
+    {
+        // The mock is shared by all the tests, so don't leave it pointing at
+        // the objects of this test
+        auto& workers = mock_global_services.worker_service();
+        workers.locked_worker = nullptr;
+        workers.original_worker = nullptr;
+        workers.prefetched_count = 0;
     }
 
     FakeThreadPool _thread_pool;
     autocrat::task_service _task_service;
 };
 
+TEST_F(TaskServiceTests, EnqueueShouldNotUpdateTheFieldsOfPreviousTasks)
+{
+    ManagedObject<SingleReference> locked_worker;
+    ManagedObject<SingleReference> original_worker;
+    ManagedObject<SingleReference> first_state;
+    ManagedObject<SingleReference> second_state;
+    first_state->Reference = original_worker.get();
+    mock_global_services.worker_service().locked_worker = locked_worker.get();
+    mock_global_services.worker_service().original_worker = original_worker.get();
+
+    managed_delegate delegate = {};
+    delegate.method_ptr = reinterpret_cast<void*>(&save_state);
+    _task_service.enqueue(&delegate, first_state.get());
+    ASSERT_EQ(locked_worker.get(), first_state->Reference);
+
+    // The context used for the first task is used again, so make sure it
+    // doesn't remember the field it found last time
+    first_state->Reference = original_worker.get();
+    _task_service.enqueue(&delegate, second_state.get());
+
+    EXPECT_EQ(second_state.get(), action_state);
+    EXPECT_EQ(original_worker.get(), first_state->Reference);
+}
+
+TEST_F(TaskServiceTests, EnqueueShouldPrefetchTheWorkersOfTheContinuation)
+{
+    managed_delegate delegate = {};
+    delegate.method_ptr = reinterpret_cast<void*>(&save_state);
+
+    _task_service.enqueue(&delegate, nullptr);
+
+    EXPECT_EQ(1u, mock_global_services.worker_service().prefetched_count);
+}
+
 TEST_F(TaskServiceTests, EnqueueShouldRetryIfWorkersAreLocked)
 {
     mock_global_services.worker_service().is_locked = true;
@@ -77,6 +125,89 @@ TEST_F(TaskServiceTests, EnqueueShouldScanTheStateForWorkers)
     EXPECT_EQ(locked_worker.get(), state->Reference);
 }
 
+TEST_F(TaskServiceTests, EnqueueShouldNotCopyTheStateUntilTheWorkHasFinished)
+{
+    // Create the state inside a heap that the task service will discard
+    autocrat::gc_service gc(&_thread_pool);
+    gc.pool_created(1u);
+    gc.begin_work(0u);
+    auto state = new (gc.allocate(sizeof(ManagedObject<SingleReference>)))
+        ManagedObject<SingleReference>();
+    auto value = new (gc.allocate(sizeof(ManagedObject<BaseClass>)))
+        ManagedObject<BaseClass>();
+    mock_global_services.gc_service().next_heap = gc.reset_heap();
+    gc.end_work(0u);
+
+    std::vector<std::byte> buffer(1024u);
+    std::size_t used = 0;
+    When(mock_global_services.gc_service().allocate)
+        .Do([&](std::size_t sz)
+            {
+                EXPECT_LE(used + sz, buffer.size());
+                void* memory = buffer.data() + used;
+                used += sz;
+                return memory;
+            });
+    _task_service.enable_evacuation();
+
+    managed_delegate delegate = {};
+    delegate.method_ptr = reinterpret_cast<void*>(&save_state);
+
+    action_state = nullptr;
+    _task_service.begin_work(0u);
+    _task_service.enqueue(&delegate, state->get());
+    EXPECT_EQ(nullptr, action_state);
+
+    // The method that awaited the state can carry on using it
+    (*value)->BaseInteger = 123;
+    (*state)->Reference = value->get();
+    EXPECT_EQ(value->get(), (*state)->Reference);
+    _task_service.end_work(0u);
+
+    auto copy = static_cast<SingleReference*>(action_state);
+    ASSERT_NE(nullptr, copy);
+    EXPECT_NE(state->get(), copy);
+    ASSERT_NE(nullptr, copy->Reference);
+    EXPECT_NE(value->get(), copy->Reference);
+    EXPECT_EQ(123, static_cast<BaseClass*>(copy->Reference)->BaseInteger);
+}
+
+TEST_F(TaskServiceTests, EnqueueShouldScanTheStateIfItIsNotInTheHeap)
+{
+    ManagedObject<SingleReference> locked_worker;
+    ManagedObject<SingleReference> original_worker;
+    ManagedObject<SingleReference> state;
+    state->Reference = original_worker.get();
+    mock_global_services.worker_service().locked_worker = locked_worker.get();
+    mock_global_services.worker_service().original_worker = original_worker.get();
+    _task_service.enable_evacuation();
+
+    managed_delegate delegate = {};
+    delegate.method_ptr = reinterpret_cast<void*>(&save_state);
+
+    // The state is not inside the heap, so it must be left where it is
+    action_state = nullptr;
+    _task_service.begin_work(0u);
+    _task_service.enqueue(&delegate, state.get());
+    _task_service.end_work(0u);
+
+    EXPECT_EQ(state.get(), action_state);
+    EXPECT_EQ(locked_worker.get(), state->Reference);
+}
+
+TEST_F(TaskServiceTests, EnqueueShouldWaitForContendedWorkersToBeReleased)
+{
+    mock_global_services.worker_service().wait_for_release = true;
+
+    managed_delegate delegate = {};
+    delegate.method_ptr = reinterpret_cast<void*>(&save_state);
+
+    _task_service.enqueue(&delegate, nullptr);
+
+    // The work is queued by the worker service when the worker is released
+    EXPECT_EQ(0u, _thread_pool.enqueue_count);
+}
+
 TEST_F(TaskServiceTests, StartNewShouldRunInstanceTasksOnTheThreadPool)
 {
     simple_instance object = {};
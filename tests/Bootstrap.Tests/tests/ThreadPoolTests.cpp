@@ -6,6 +6,7 @@
 #include <mutex>
 #include <thread>
 #include <tuple>
+#include <vector>
 #include <gtest/gtest.h>
 #include <cpp_mock.h>
 
@@ -102,6 +103,30 @@ TEST_F(ThreadPoolTests, ShouldCallPoolCreatedWithThreadCount)
 
     Verify(service.pool_created).With(3u);
 }
+TEST_F(ThreadPoolTests, EnqueueIdleShouldPerformTheWorkAfterOtherWork)
+{
+    static std::vector<int> order;
+    static std::promise<void> finished;
+    order.clear();
+    finished = std::promise<void>();
+    auto finished_future = finished.get_future();
+
+    bool queued = _pool.enqueue_idle(
+        [](std::any& arg)
+        {
+            order.push_back(std::any_cast<int>(arg));
+            finished.set_value();
+        },
+        2);
+    _pool.enqueue([](std::any& arg) { order.push_back(std::any_cast<int>(arg)); }, 1);
+    _pool.start(-1, 1, [](std::size_t) {});
+    std::future_status wait_result = finished_future.wait_for(1s);
+
+    EXPECT_TRUE(queued);
+    ASSERT_EQ(std::future_status::ready, wait_result);
+    EXPECT_EQ((std::vector<int> { 1, 2 }), order);
+}
+
 TEST_F(ThreadPoolTests, ShouldPerformTheWorkOnASeparateThread)
 {
     auto worker_promise = std::make_shared<promise_thread_id>();
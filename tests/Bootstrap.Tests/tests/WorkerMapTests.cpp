@@ -0,0 +1,241 @@
+#include "worker_map.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+namespace
+{
+    std::string_view AsId(const std::int64_t& value)
+    {
+        return std::string_view(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void NoPreparation(int&)
+    {
+    }
+}
+
+class WorkerMapTests : public testing::Test
+{
+protected:
+    autocrat::worker_map<int> _map;
+};
+
+TEST_F(WorkerMapTests, EraseShouldKeepTheEntriesAfterTheRemovedOne)
+{
+    constexpr std::int64_t count = 1'000;
+    for (std::int64_t i = 0; i != count; ++i)
+    {
+        _map.try_emplace(1u, AsId(i), [i](int& v) { v = static_cast<int>(i); });
+    }
+
+    for (std::int64_t i = 0; i < count; i += 2)
+    {
+        EXPECT_TRUE(_map.erase(1u, AsId(i)));
+    }
+
+    for (std::int64_t i = 0; i != count; ++i)
+    {
+        int* value = _map.find(1u, AsId(i));
+        if ((i % 2) == 0)
+        {
+            EXPECT_EQ(nullptr, value);
+        }
+        else
+        {
+            ASSERT_NE(nullptr, value);
+            EXPECT_EQ(i, *value);
+        }
+    }
+}
+
+TEST_F(WorkerMapTests, EraseShouldReturnFalseForUnknownKeys)
+{
+    _map.try_emplace(1u, "id", NoPreparation);
+
+    EXPECT_FALSE(_map.erase(1u, "other"));
+    EXPECT_NE(nullptr, _map.find(1u, "id"));
+}
+
+TEST_F(WorkerMapTests, FindShouldReturnNullForUnknownKeys)
+{
+    _map.try_emplace(1u, "id", NoPreparation);
+
+    EXPECT_EQ(nullptr, _map.find(2u, "id"));
+    EXPECT_EQ(nullptr, _map.find(1u, "other"));
+}
+
+TEST_F(WorkerMapTests, FindShouldReturnTheSameValueAfterTheMapHasGrown)
+{
+    constexpr std::int64_t count = 10'000;
+    std::vector<int*> values;
+    for (std::int64_t i = 0; i != count; ++i)
+    {
+        values.push_back(_map.try_emplace(1u, AsId(i), NoPreparation).first);
+    }
+
+    for (std::int64_t i = 0; i != count; ++i)
+    {
+        EXPECT_EQ(values[i], _map.find(1u, AsId(i)));
+    }
+}
+
+TEST_F(WorkerMapTests, FindShouldSupportLongIdentifiers)
+{
+    std::string id(100u, 'x');
+    int* value = _map.try_emplace(1u, id, [](int& v) { v = 123; }).first;
+
+    int* result = _map.find(1u, std::string(100u, 'x'));
+
+    EXPECT_EQ(value, result);
+    EXPECT_EQ(123, *result);
+}
+
+TEST_F(WorkerMapTests, FindShouldWorkWhilstAddingFromOtherThreads)
+{
+    constexpr std::int64_t count = 20'000;
+    std::atomic_bool finished = false;
+    std::thread writer([&]()
+        {
+            for (std::int64_t i = 0; i != count; ++i)
+            {
+                _map.try_emplace(1u, AsId(i), [i](int& v) { v = static_cast<int>(i); });
+            }
+
+            finished = true;
+        });
+
+    bool values_match = true;
+    while (!finished)
+    {
+        for (std::int64_t i = 0; i < count; i += 97)
+        {
+            int* value = _map.find(1u, AsId(i));
+            if ((value != nullptr) && (*value != static_cast<int>(i)))
+            {
+                values_match = false;
+            }
+        }
+
+        std::this_thread::yield();
+    }
+
+    writer.join();
+    EXPECT_TRUE(values_match);
+    EXPECT_NE(nullptr, _map.find(1u, AsId(count - 1)));
+}
+
+TEST_F(WorkerMapTests, ForEachShouldVisitAllTheEntries)
+{
+    _map.try_emplace(1u, "a", [](int& v) { v = 1; });
+    _map.try_emplace(2u, "a", [](int& v) { v = 2; });
+    _map.try_emplace(1u, "b", [](int& v) { v = 4; });
+
+    int total = 0;
+    _map.for_each([&](const autocrat::detail::worker_key&, int& value) { total += value; });
+
+    EXPECT_EQ(7, total);
+}
+
+TEST_F(WorkerMapTests, ForEachInShardShouldOnlyVisitTheEntriesOfTheShard)
+{
+    _map.try_emplace(1u, "a", [](int& v) { v = 1; });
+    _map.try_emplace(2u, "a", [](int& v) { v = 2; });
+    std::size_t shard = _map.get_shard_index(1u, "a");
+
+    int total = 0;
+    _map.for_each_in_shard(shard, [&](const autocrat::detail::worker_key& key, int& value)
+        {
+            EXPECT_EQ(shard, _map.get_shard_index(key.type, key.id));
+            total += value;
+        });
+
+    EXPECT_NE(0, total);
+}
+
+TEST_F(WorkerMapTests, ReclaimShouldOnlyFreeEntriesRemovedBeforeTheEpoch)
+{
+    _map.try_emplace(1u, "first", NoPreparation);
+    _map.try_emplace(1u, "second", NoPreparation);
+
+    _map.erase(1u, "first");
+    std::uint64_t epoch = _map.epoch();
+    _map.erase(1u, "second");
+
+    EXPECT_EQ(1u, _map.reclaim(epoch));
+    EXPECT_EQ(1u, _map.reclaim(_map.epoch()));
+}
+
+TEST_F(WorkerMapTests, TryEmplaceAllShouldOnlyAddTheMissingKeys)
+{
+    constexpr std::int64_t count = 1'000;
+    std::vector<std::int64_t> values;
+    for (std::int64_t i = 0; i != count; ++i)
+    {
+        values.push_back(i);
+        values.push_back(i); // Duplicates should only be added once
+    }
+
+    std::vector<std::string_view> ids;
+    for (const std::int64_t& value : values)
+    {
+        ids.push_back(AsId(value));
+    }
+
+    _map.try_emplace(1u, ids.front(), [](int& v) { v = -1; });
+    std::size_t added = _map.try_emplace_all(1u, ids, [](int& v) { v = 1; });
+
+    EXPECT_EQ(static_cast<std::size_t>(count - 1), added);
+    EXPECT_EQ(-1, *_map.find(1u, ids.front()));
+    for (std::int64_t i = 1; i != count; ++i)
+    {
+        int* value = _map.find(1u, AsId(i));
+        ASSERT_NE(nullptr, value);
+        EXPECT_EQ(1, *value);
+    }
+}
+
+TEST_F(WorkerMapTests, TryEmplaceAllShouldOnlyReportTheAddedValues)
+{
+    _map.try_emplace(1u, "existing", [](int& v) { v = -1; });
+    std::vector<std::string_view> ids = { "existing", "new", "new" };
+
+    int counter = 0;
+    int reported = 0;
+    std::size_t added = _map.try_emplace_all(
+        1u,
+        ids,
+        [&](int& v) { v = ++counter; },
+        [&](int& v) { reported += v; });
+
+    EXPECT_EQ(1u, added);
+    EXPECT_EQ(*_map.find(1u, "new"), reported);
+}
+
+TEST_F(WorkerMapTests, TryEmplaceShouldAddAgainAfterErasing)
+{
+    int* first = _map.try_emplace(1u, "id", [](int& v) { v = 1; }).first;
+    _map.erase(1u, "id");
+
+    auto [second, inserted] = _map.try_emplace(1u, "id", [](int& v) { v = 2; });
+
+    EXPECT_TRUE(inserted);
+    EXPECT_NE(first, second);
+    EXPECT_EQ(second, _map.find(1u, "id"));
+}
+
+TEST_F(WorkerMapTests, TryEmplaceShouldReturnTheExistingValue)
+{
+    auto [first, first_inserted] = _map.try_emplace(1u, "id", [](int& v) { v = 1; });
+    auto [second, second_inserted] = _map.try_emplace(1u, "id", [](int& v) { v = 2; });
+
+    EXPECT_TRUE(first_inserted);
+    EXPECT_FALSE(second_inserted);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(1, *second);
+}
@@ -1,22 +1,45 @@
 #include "worker_service.h"
 
 #include <algorithm>
+#include <any>
 #include <atomic>
+#include <chrono>
+#include <filesystem>
 #include <memory>
 #include <mutex>
+#include <sstream>
 #include <thread>
 #include <vector>
 #include <gtest/gtest.h>
 #include <cpp_mock.h>
+#include <spdlog/sinks/ostream_sink.h>
+#include <spdlog/spdlog.h>
 #include "ManagedObjects.h"
 #include "mock_services.h"
 #include "TestMocks.h"
+#include "pal_mock.h"
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
 
 namespace
 {
+    class MockPalService : public pal_service
+    {
+    public:
+        MockMethod(std::chrono::microseconds, current_time, ())
+    };
+
+    std::vector<int> expired_values;
+    std::vector<int> woken_work;
     std::unique_ptr<ManagedObject<BaseClass>> worker_class;
     std::unique_ptr<ManagedObject<SingleReference>> worker_object;
 
+    extern "C" void CDECL OnWorkerExpired(void* worker)
+    {
+        expired_values.push_back(reinterpret_cast<BaseClass*>(worker)->BaseInteger);
+    }
+
     void* create_worker_class()
     {
         worker_class = std::make_unique<ManagedObject<BaseClass>>();
@@ -53,6 +76,9 @@ protected:
     ~WorkerServiceTests()
     {
         _service.end_work(0u);
+        active_service_mock = nullptr;
+        expired_values.clear();
+        woken_work.clear();
         worker_class.reset();
         worker_object.reset();
     }
@@ -74,13 +100,394 @@ protected:
         EXPECT_EQ(expected, is_locked);
     }
 
+    std::string DumpStatistics()
+    {
+        std::ostringstream output;
+        auto previous = spdlog::default_logger();
+        spdlog::set_default_logger(std::make_shared<spdlog::logger>(
+            "worker_statistics",
+            std::make_shared<spdlog::sinks::ostream_sink_st>(output)));
+        _service.dump_statistics();
+        spdlog::set_default_logger(previous);
+        return output.str();
+    }
+
+    void ExpireWorkerAfter(std::chrono::microseconds idle_time, bool notify)
+    {
+        When(_pal.current_time).Do([this]() { return _now; });
+        active_service_mock = &_pal;
+
+        _service.register_type(&_worker_type, &create_worker_class);
+        _service.set_time_to_live(&_worker_type, 60s, notify);
+        _service.get_worker(&_worker_type, _worker_id);
+        _service.end_work(0u);
+
+        _now += idle_time;
+        _service.expire_idle_workers();
+        _service.begin_work(0u);
+    }
+
+    void ExpectSpilledWorkerIsRestored(
+        std::chrono::seconds idle_time,
+        std::size_t memory_budget)
+    {
+        When(_pal.current_time).Do([]() -> std::chrono::microseconds
+            {
+                return 1h;
+            });
+        active_service_mock = &_pal;
+
+        fs::path directory =
+            fs::temp_directory_path() / "autocrat_worker_spill_tests";
+        _service.enable_spilling(directory, idle_time, memory_budget);
+        _service.register_type(&_worker_type, &create_worker_class);
+        _service.get_worker(&_worker_type, _worker_id);
+        _service.end_work(0u);
+
+        std::size_t nodes_before = autocrat::memory_pool_buffer::statistics().in_use;
+        _service.spill_idle_workers();
+        std::size_t nodes_after = autocrat::memory_pool_buffer::statistics().in_use;
+
+        _service.begin_work(0u);
+        void* object = _service.get_worker(&_worker_type, _worker_id);
+
+        EXPECT_LT(nodes_after, nodes_before);
+        EXPECT_EQ(_allocated_bytes.get(), object);
+        EXPECT_EQ(123, reinterpret_cast<BaseClass*>(object)->BaseInteger);
+    }
+
     std::unique_ptr<std::byte[]> _allocated_bytes;
+    std::chrono::microseconds _now = 1h;
+    MockPalService _pal;
     FakeThreadPool _thread_pool;
     autocrat::worker_service _service;
     std::string_view _worker_id;
     int _worker_type;
 };
 
+TEST_F(WorkerServiceTests, CheckAndDispatchShouldFreeTheRemovedWorkers)
+{
+    ExpireWorkerAfter(2min, false);
+
+    std::size_t nodes_before = autocrat::memory_pool_buffer::statistics().in_use;
+    _service.check_and_dispatch();
+    std::size_t nodes_after = autocrat::memory_pool_buffer::statistics().in_use;
+
+    EXPECT_LT(nodes_after, nodes_before);
+}
+
+TEST_F(WorkerServiceTests, CompressIdleWorkersShouldCompressIdleWorkers)
+{
+    When(_pal.current_time).Do([this]() { return _now; });
+    active_service_mock = &_pal;
+
+    _service.enable_compression(60s);
+    _service.enable_statistics();
+    _service.register_type(&_worker_type, &create_worker_class);
+    _service.get_worker(&_worker_type, _worker_id);
+    _service.end_work(0u);
+
+    _now += 30s;
+    _service.compress_idle_workers();
+    std::string recently_used = DumpStatistics();
+    _now += 1min;
+    _service.compress_idle_workers();
+    std::string idle = DumpStatistics();
+
+    _service.begin_work(0u);
+    void* object = _service.get_worker(&_worker_type, _worker_id);
+
+    EXPECT_EQ(std::string::npos, recently_used.find("1 compressed from"));
+    EXPECT_NE(std::string::npos, idle.find("1 compressed from"));
+    EXPECT_EQ(123, reinterpret_cast<BaseClass*>(object)->BaseInteger);
+}
+
+TEST_F(WorkerServiceTests, DumpStatisticsShouldIncludeTheMostUsedAndContendedWorkers)
+{
+    _service.enable_statistics();
+    _service.register_type(&_worker_type, &create_worker_class);
+
+    // Only one in eight of the locks made by a thread is counted against
+    // the worker, which then counts for all eight
+    for (int i = 0; i != 7; ++i)
+    {
+        _service.get_worker(&_worker_type, _worker_id);
+        _service.end_work(0u);
+        _service.begin_work(0u);
+    }
+
+    _service.get_worker(&_worker_type, _worker_id);
+    AssertWorkerLocked(&_worker_type, true);
+    _service.end_work(0u);
+
+    // The most used workers are gathered by the work queued by the first
+    // dump, so are reported by the next one
+    std::string log = DumpStatistics();
+    std::string gathered = DumpStatistics();
+    _service.begin_work(0u);
+
+    EXPECT_NE(std::string::npos, log.find("8 locked for"));
+    EXPECT_NE(std::string::npos, log.find("1 failed to lock"));
+    EXPECT_NE(std::string::npos, log.find("8 saved taking"));
+    EXPECT_NE(std::string::npos, gathered.find("Most locked worker"));
+    EXPECT_NE(std::string::npos, gathered.find(": id (about 8 times)"));
+    EXPECT_NE(std::string::npos, gathered.find(": id (about 8 failed locks)"));
+}
+
+TEST_F(WorkerServiceTests, DumpStatisticsShouldIncludeTheLiveWorkersOfEachType)
+{
+    _service.register_type(&_worker_type, &create_worker_class);
+    _service.get_worker(&_worker_type, "a");
+    _service.end_work(0u);
+    _service.begin_work(0u);
+    _service.get_worker(&_worker_type, "b");
+    _service.end_work(0u);
+
+    std::string log = DumpStatistics();
+    _service.begin_work(0u);
+
+    EXPECT_NE(std::string::npos, log.find(": 2 live (0 in use), "));
+    EXPECT_EQ(std::string::npos, log.find(": 2 live (0 in use), 0 bytes"));
+}
+
+TEST_F(WorkerServiceTests, EnqueueWhenReleasedShouldQueueTheWorkWhenTheWorkerIsReleased)
+{
+    _service.register_type(&_worker_type, &create_worker_object);
+
+    // Cause another thread to lock the worker
+    std::mutex mutex;
+    std::unique_lock<std::mutex> lock(mutex);
+    std::atomic_bool worker_locked = false;
+    std::thread lock_worker([&]()
+        {
+            _service.begin_work(1u);
+            _service.get_worker(&_worker_type, _worker_id);
+            worker_locked = true;
+
+            // Wait for the test to release the worker
+            std::unique_lock<std::mutex> wait_for_release(mutex);
+            _service.end_work(1u);
+        });
+
+    while (!worker_locked)
+    {
+        std::this_thread::yield();
+    }
+
+    EXPECT_EQ(nullptr, _service.get_worker(&_worker_type, _worker_id));
+    std::any data = 123;
+    bool queued = _service.enqueue_when_released([](std::any&) {}, data, 0);
+    std::size_t enqueued_before_release = _thread_pool.enqueue_count;
+
+    lock.unlock();
+    lock_worker.join();
+
+    EXPECT_TRUE(queued);
+    EXPECT_EQ(enqueued_before_release + 1u, _thread_pool.enqueue_count);
+}
+
+TEST_F(WorkerServiceTests, EnableBatchingShouldDeliverTheWaitingWorkInBatches)
+{
+    _service.enable_batching(2u);
+    _service.register_type(&_worker_type, &create_worker_object);
+
+    std::mutex mutex;
+    std::unique_lock<std::mutex> lock(mutex);
+    std::atomic_bool worker_locked = false;
+    std::thread lock_worker([&]()
+        {
+            _service.begin_work(1u);
+            _service.get_worker(&_worker_type, _worker_id);
+            worker_locked = true;
+
+            std::unique_lock<std::mutex> wait_for_release(mutex);
+            _service.end_work(1u);
+        });
+
+    while (!worker_locked)
+    {
+        std::this_thread::yield();
+    }
+
+    auto record = [](std::any& data) { woken_work.push_back(std::any_cast<int>(data)); };
+    for (int i = 1; i <= 3; ++i)
+    {
+        std::any work = i;
+        _service.get_worker(&_worker_type, _worker_id);
+        _service.enqueue_when_released(record, work, 0);
+    }
+
+    std::size_t enqueued_before_release = _thread_pool.enqueue_count;
+    lock.unlock();
+    lock_worker.join();
+
+    EXPECT_EQ(enqueued_before_release + 2u, _thread_pool.enqueue_count);
+    EXPECT_EQ((std::vector<int> { 1, 2, 3 }), woken_work);
+}
+
+TEST_F(WorkerServiceTests, EnqueueWhenReleasedShouldQueueOlderWorkFirst)
+{
+    _service.register_type(&_worker_type, &create_worker_object);
+
+    std::mutex mutex;
+    std::unique_lock<std::mutex> lock(mutex);
+    std::atomic_bool worker_locked = false;
+    std::thread lock_worker([&]()
+        {
+            _service.begin_work(1u);
+            _service.get_worker(&_worker_type, _worker_id);
+            worker_locked = true;
+
+            std::unique_lock<std::mutex> wait_for_release(mutex);
+            _service.end_work(1u);
+        });
+
+    while (!worker_locked)
+    {
+        std::this_thread::yield();
+    }
+
+    auto record = [](std::any& data) { woken_work.push_back(std::any_cast<int>(data)); };
+    std::any new_work = 1;
+    _service.get_worker(&_worker_type, _worker_id);
+    _service.enqueue_when_released(record, new_work, 0);
+    std::any old_work = 2;
+    _service.get_worker(&_worker_type, _worker_id);
+    _service.enqueue_when_released(record, old_work, 3);
+
+    lock.unlock();
+    lock_worker.join();
+
+    EXPECT_EQ((std::vector<int> { 2, 1 }), woken_work);
+}
+
+TEST_F(WorkerServiceTests, EnqueueWhenReleasedShouldReturnFalseIfNoWorkerWasLocked)
+{
+    _service.register_type(&_worker_type, &create_worker_object);
+    _service.get_worker(&_worker_type, _worker_id);
+
+    std::any data = 123;
+    bool queued = _service.enqueue_when_released([](std::any&) {}, data, 0);
+
+    EXPECT_FALSE(queued);
+    EXPECT_TRUE(data.has_value());
+}
+
+TEST_F(WorkerServiceTests, ExpireIdleWorkersShouldKeepRecentlyUsedWorkers)
+{
+    ExpireWorkerAfter(30s, false);
+    void* object = _service.get_worker(&_worker_type, _worker_id);
+
+    EXPECT_EQ(_allocated_bytes.get(), object);
+}
+
+TEST_F(WorkerServiceTests, ExpireIdleWorkersShouldNotifyTheWorker)
+{
+    ExpireWorkerAfter(2min, true);
+
+    ASSERT_EQ(1u, expired_values.size());
+    EXPECT_EQ(123, expired_values[0]);
+}
+
+TEST_F(WorkerServiceTests, ExpireIdleWorkersShouldNotRemoveWorkersHeldByAContinuation)
+{
+    When(_pal.current_time).Do([this]() { return _now; });
+    active_service_mock = &_pal;
+
+    _service.register_type(&_worker_type, &create_worker_class);
+    _service.set_time_to_live(&_worker_type, 60s, false);
+    _service.get_worker(&_worker_type, _worker_id);
+    auto workers = std::get<autocrat::worker_service::worker_collection>(_service.release_locked());
+
+    _now += 2min;
+    _service.expire_idle_workers();
+    EXPECT_TRUE(_service.try_lock(workers).has_value());
+}
+
+TEST_F(WorkerServiceTests, ExpireIdleWorkersShouldRemoveIdleWorkers)
+{
+    ExpireWorkerAfter(2min, false);
+    void* object = _service.get_worker(&_worker_type, _worker_id);
+
+    EXPECT_TRUE(expired_values.empty());
+    EXPECT_EQ(worker_class->get(), object);
+}
+
+TEST_F(WorkerServiceTests, GetReadOnlyWorkerShouldNotLockTheWorker)
+{
+    _service.register_type(&_worker_type, &create_worker_class);
+    _service.get_worker(&_worker_type, _worker_id);
+    _service.end_work(0u);
+    _service.begin_work(0u);
+
+    void* object = _service.get_read_only_worker(&_worker_type, _worker_id);
+
+    EXPECT_EQ(123, reinterpret_cast<BaseClass*>(object)->BaseInteger);
+    AssertWorkerLocked(&_worker_type, false);
+}
+
+TEST_F(WorkerServiceTests, GetReadOnlyWorkerShouldPublishANewVersionWhenTheWorkerChanges)
+{
+    _service.register_type(&_worker_type, &create_worker_class);
+    _service.get_worker(&_worker_type, _worker_id);
+    _service.end_work(0u);
+    _service.begin_work(0u);
+
+    auto first = reinterpret_cast<BaseClass*>(
+        _service.get_read_only_worker(&_worker_type, _worker_id));
+    autocrat::worker_service::snapshot_collection held = _service.release_snapshots();
+    _service.end_work(0u);
+    _service.begin_work(0u);
+
+    auto writable = reinterpret_cast<BaseClass*>(
+        _service.get_worker(&_worker_type, _worker_id));
+    writable->BaseInteger = 456;
+    _service.end_work(0u);
+    _service.begin_work(0u);
+
+    auto second = reinterpret_cast<BaseClass*>(
+        _service.get_read_only_worker(&_worker_type, _worker_id));
+
+    EXPECT_EQ(123, first->BaseInteger);
+    EXPECT_EQ(456, second->BaseInteger);
+}
+
+TEST_F(WorkerServiceTests, GetReadOnlyWorkerShouldReturnThePublishedVersionWhilstTheWorkerIsLocked)
+{
+    _service.register_type(&_worker_type, &create_worker_class);
+    _service.get_worker(&_worker_type, _worker_id);
+    _service.end_work(0u);
+    _service.begin_work(0u);
+    _service.get_read_only_worker(&_worker_type, _worker_id);
+    _service.end_work(0u);
+    _service.begin_work(0u);
+
+    std::mutex mutex;
+    std::unique_lock<std::mutex> lock(mutex);
+    std::atomic_bool worker_locked = false;
+    std::thread lock_worker([&]()
+        {
+            _service.begin_work(1u);
+            _service.get_worker(&_worker_type, _worker_id);
+            worker_locked = true;
+
+            std::unique_lock<std::mutex> wait_for_release(mutex);
+            _service.end_work(1u);
+        });
+
+    while (!worker_locked)
+    {
+        std::this_thread::yield();
+    }
+
+    void* object = _service.get_read_only_worker(&_worker_type, _worker_id);
+    lock.unlock();
+    lock_worker.join();
+
+    ASSERT_NE(nullptr, object);
+    EXPECT_EQ(123, reinterpret_cast<BaseClass*>(object)->BaseInteger);
+}
+
 TEST_F(WorkerServiceTests, GetWorkerShouldReturnTheExistingWorker)
 {
     _service.register_type(&_worker_type, &create_worker_object);
@@ -96,6 +503,181 @@ TEST_F(WorkerServiceTests, GetWorkerShouldThrowIfTheConstructorIsNotRegistered)
     EXPECT_THROW(_service.get_worker(&_worker_type, _worker_id), std::invalid_argument);
 }
 
+TEST_F(WorkerServiceTests, LoadCheckpointShouldLoadTheSavedWorkers)
+{
+    fs::path path = fs::temp_directory_path() / "autocrat_checkpoint_test";
+    _service.register_type(&worker_class, &create_worker_class);
+    _service.get_worker(&worker_class, _worker_id);
+    _service.end_work(0u);
+    EXPECT_EQ(1u, _service.save_checkpoint(path));
+    _service.begin_work(0u);
+
+    {
+        autocrat::worker_service restarted(&_thread_pool);
+        restarted.pool_created(1u);
+        restarted.register_type(&worker_class, &create_worker_class);
+        EXPECT_EQ(1u, restarted.load_checkpoint(path));
+
+        restarted.begin_work(0u);
+        void* object = restarted.get_worker(&worker_class, _worker_id);
+        EXPECT_EQ(_allocated_bytes.get(), object);
+        EXPECT_EQ(123, reinterpret_cast<BaseClass*>(object)->BaseInteger);
+        restarted.end_work(0u);
+    }
+
+    fs::remove(path);
+}
+
+TEST_F(WorkerServiceTests, LoadCheckpointShouldThrowIfTheTypesHaveChanged)
+{
+    fs::path path = fs::temp_directory_path() / "autocrat_checkpoint_test";
+    _service.register_type(&worker_class, &create_worker_class);
+    _service.get_worker(&worker_class, _worker_id);
+    _service.end_work(0u);
+    _service.save_checkpoint(path);
+    _service.begin_work(0u);
+
+    {
+        autocrat::worker_service restarted(&_thread_pool);
+        restarted.register_type(&worker_class, &create_worker_class);
+        restarted.register_type(&worker_object, &create_worker_object);
+        EXPECT_THROW(restarted.load_checkpoint(path), std::runtime_error);
+    }
+
+    fs::remove(path);
+}
+
+TEST_F(WorkerServiceTests, PrefetchWorkersShouldRestoreTheWorkersBeforeTheContinuation)
+{
+    _service.enable_prefetch();
+    _service.register_type(&_worker_type, &create_worker_class);
+    _service.get_worker(&_worker_type, _worker_id);
+    auto workers = std::get<autocrat::worker_service::worker_collection>(_service.release_locked());
+
+    _service.prefetch_workers(workers);
+    _thread_pool.run_idle_work();
+    void* prefetched = _allocated_bytes.get();
+    auto objects = _service.try_lock(workers);
+
+    ASSERT_TRUE(objects.has_value());
+    EXPECT_NE(nullptr, prefetched);
+    EXPECT_EQ(prefetched, (*objects)[0]);
+    EXPECT_EQ(prefetched, _allocated_bytes.get());
+    EXPECT_EQ(123, reinterpret_cast<BaseClass*>(prefetched)->BaseInteger);
+}
+
+TEST_F(WorkerServiceTests, PrefetchWorkersShouldSkipWorkersTheContinuationHasLocked)
+{
+    _service.enable_prefetch();
+    _service.register_type(&_worker_type, &create_worker_class);
+    _service.get_worker(&_worker_type, _worker_id);
+    auto workers = std::get<autocrat::worker_service::worker_collection>(_service.release_locked());
+
+    _service.prefetch_workers(workers);
+    auto objects = _service.try_lock(workers);
+    void* restored = _allocated_bytes.get();
+    _thread_pool.run_idle_work();
+
+    ASSERT_TRUE(objects.has_value());
+    EXPECT_EQ(restored, (*objects)[0]);
+    EXPECT_EQ(restored, _allocated_bytes.get());
+}
+
+TEST_F(WorkerServiceTests, PreloadWorkersShouldCreateTheMissingWorkers)
+{
+    _service.register_type(&_worker_type, &create_worker_class);
+    _service.get_worker(&_worker_type, _worker_id);
+    _service.end_work(0u);
+
+    std::vector<std::string_view> ids = { "a", _worker_id, "b" };
+    std::size_t preloaded = _service.preload_workers(&_worker_type, ids);
+
+    _service.begin_work(0u);
+    void* object = _service.get_worker(&_worker_type, "b");
+
+    EXPECT_EQ(2u, preloaded);
+    EXPECT_EQ(_allocated_bytes.get(), object);
+    EXPECT_EQ(123, reinterpret_cast<BaseClass*>(object)->BaseInteger);
+}
+
+TEST_F(WorkerServiceTests, PreloadWorkersShouldRunTheBatchesInlineInsideAWorkItem)
+{
+    _service.register_type(&_worker_type, &create_worker_class);
+
+    // The fixture has started a work item, so the pool could be waiting on
+    // this thread
+    std::vector<std::string_view> ids = { "a", "b" };
+    std::size_t preloaded = _service.preload_workers(&_worker_type, ids);
+    void* object = _service.get_worker(&_worker_type, "b");
+
+    EXPECT_EQ(2u, preloaded);
+    EXPECT_EQ(0u, _thread_pool.enqueue_count);
+    EXPECT_EQ(_allocated_bytes.get(), object);
+}
+
+TEST_F(WorkerServiceTests, PreloadWorkersShouldReadTheCheckpointedWorkers)
+{
+    fs::path path = fs::temp_directory_path() / "autocrat_preload_test";
+    _service.register_type(&worker_class, &create_worker_class);
+    _service.get_worker(&worker_class, _worker_id);
+    _service.end_work(0u);
+    EXPECT_EQ(1u, _service.save_checkpoint(path));
+    _service.begin_work(0u);
+
+    {
+        autocrat::worker_service restarted(&_thread_pool);
+        restarted.pool_created(1u);
+        restarted.register_type(&worker_class, &create_worker_class);
+        restarted.load_checkpoint(path);
+
+        std::vector<std::string_view> ids = { _worker_id };
+        EXPECT_EQ(1u, restarted.preload_workers(&worker_class, ids));
+
+        restarted.begin_work(0u);
+        void* object = restarted.get_worker(&worker_class, _worker_id);
+        EXPECT_EQ(123, reinterpret_cast<BaseClass*>(object)->BaseInteger);
+        restarted.end_work(0u);
+    }
+
+    fs::remove(path);
+}
+
+TEST_F(WorkerServiceTests, PreloadWorkersShouldThrowIfTheConstructorIsNotRegistered)
+{
+    std::vector<std::string_view> ids = { _worker_id };
+
+    EXPECT_THROW(_service.preload_workers(&_worker_type, ids), std::invalid_argument);
+}
+
+TEST_F(WorkerServiceTests, QueueCheckpointShouldWriteTheLockedWorkersOnceReleased)
+{
+    fs::path path = fs::temp_directory_path() / "autocrat_checkpoint_test";
+    fs::remove(path);
+    _service.register_type(&worker_class, &create_worker_class);
+    _service.get_worker(&worker_class, _worker_id);
+
+    // The worker is locked by this thread, so the checkpoint can't write it
+    std::thread([&]() { _service.queue_checkpoint(path); }).join();
+    _service.end_work(0u);
+    EXPECT_FALSE(fs::exists(path));
+
+    // Releasing the worker allows a later pass to write it, after which the
+    // file is replaced
+    std::this_thread::sleep_for(20ms);
+    _service.check_and_dispatch();
+    _service.check_and_dispatch();
+    _service.check_and_dispatch();
+    _service.begin_work(0u);
+
+    {
+        autocrat::worker_service restarted(&_thread_pool);
+        restarted.register_type(&worker_class, &create_worker_class);
+        EXPECT_EQ(1u, restarted.load_checkpoint(path));
+    }
+
+    fs::remove(path);
+}
+
 TEST_F(WorkerServiceTests, ReleaseLockedShouldReturnAllLockedWorkers)
 {
     _service.register_type(&worker_class, &create_worker_class);
@@ -114,6 +696,129 @@ TEST_F(WorkerServiceTests, ReleaseLockedShouldReturnAllLockedWorkers)
     EXPECT_NE(objects.end(), std::find(objects.begin(), objects.end(), object_ptr));
 }
 
+TEST_F(WorkerServiceTests, ReleaseLockedShouldOrderTheWorkersByAddress)
+{
+    _service.register_type(&worker_class, &create_worker_class);
+    _service.register_type(&worker_object, &create_worker_object);
+    _service.get_worker(&worker_object, _worker_id);
+    _service.get_worker(&worker_class, _worker_id);
+
+    auto [objects, workers] = _service.release_locked();
+
+    EXPECT_TRUE(std::is_sorted(workers.begin(), workers.end()));
+}
+
+TEST_F(WorkerServiceTests, ResidentWorkersShouldBeUsedInPlace)
+{
+    _service.enable_resident_workers(100u);
+    _service.register_type(&_worker_type, &create_worker_class);
+    _service.get_worker(&_worker_type, _worker_id);
+
+    // The first save moves the worker into its own memory
+    _service.end_work(0u);
+    _service.begin_work(0u);
+    void* first = _service.get_worker(&_worker_type, _worker_id);
+
+    _service.end_work(0u);
+    _service.begin_work(0u);
+    void* second = _service.get_worker(&_worker_type, _worker_id);
+
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(123, reinterpret_cast<BaseClass*>(second)->BaseInteger);
+    EXPECT_EQ(nullptr, _allocated_bytes.get());
+}
+
+TEST_F(WorkerServiceTests, SaveCheckpointShouldKeepTheWorkersLoadedFromTheCheckpoint)
+{
+    fs::path first = fs::temp_directory_path() / "autocrat_checkpoint_first";
+    fs::path second = fs::temp_directory_path() / "autocrat_checkpoint_second";
+    _service.register_type(&worker_class, &create_worker_class);
+    _service.get_worker(&worker_class, _worker_id);
+    _service.end_work(0u);
+    _service.save_checkpoint(first);
+    _service.begin_work(0u);
+
+    {
+        autocrat::worker_service restarted(&_thread_pool);
+        restarted.pool_created(1u);
+        restarted.register_type(&worker_class, &create_worker_class);
+        restarted.load_checkpoint(first);
+        EXPECT_EQ(1u, restarted.save_checkpoint(second));
+
+        // The worker has been read from the first checkpoint, so it can
+        // still be used once that has been replaced
+        fs::remove(first);
+        restarted.begin_work(0u);
+        void* object = restarted.get_worker(&worker_class, _worker_id);
+        EXPECT_EQ(123, reinterpret_cast<BaseClass*>(object)->BaseInteger);
+        restarted.end_work(0u);
+    }
+
+    {
+        autocrat::worker_service restarted(&_thread_pool);
+        restarted.pool_created(1u);
+        restarted.register_type(&worker_class, &create_worker_class);
+        EXPECT_EQ(1u, restarted.load_checkpoint(second));
+    }
+
+    fs::remove(second);
+}
+
+TEST_F(WorkerServiceTests, SaveCheckpointShouldWaitForLockedWorkers)
+{
+    fs::path path = fs::temp_directory_path() / "autocrat_checkpoint_test";
+    _service.register_type(&worker_class, &create_worker_class);
+    _service.get_worker(&worker_class, _worker_id);
+
+    std::atomic_size_t saved = 0;
+    std::thread thread([&]() { saved = _service.save_checkpoint(path) + 1u; });
+    std::this_thread::sleep_for(10ms);
+    EXPECT_EQ(0u, saved.load());
+
+    // Releasing the worker allows it to be written
+    _service.end_work(0u);
+    thread.join();
+    _service.begin_work(0u);
+
+    EXPECT_EQ(2u, saved.load());
+    fs::remove(path);
+}
+
+TEST_F(WorkerServiceTests, SaveCheckpointShouldWriteCompressedWorkersThatAreSpilled)
+{
+    When(_pal.current_time).Do([this]() { return _now; });
+    active_service_mock = &_pal;
+
+    fs::path path = fs::temp_directory_path() / "autocrat_checkpoint_test";
+    fs::path directory =
+        fs::temp_directory_path() / "autocrat_worker_spill_tests";
+    _service.enable_compression(60s);
+    _service.enable_spilling(directory, 60s, 0u);
+    _service.register_type(&worker_class, &create_worker_class);
+    _service.get_worker(&worker_class, _worker_id);
+    _service.end_work(0u);
+
+    _now += 1min;
+    _service.compress_idle_workers();
+    _service.spill_idle_workers();
+    EXPECT_EQ(1u, _service.save_checkpoint(path));
+    _service.begin_work(0u);
+
+    {
+        autocrat::worker_service restarted(&_thread_pool);
+        restarted.pool_created(1u);
+        restarted.register_type(&worker_class, &create_worker_class);
+        EXPECT_EQ(1u, restarted.load_checkpoint(path));
+
+        restarted.begin_work(0u);
+        void* object = restarted.get_worker(&worker_class, _worker_id);
+        EXPECT_EQ(123, reinterpret_cast<BaseClass*>(object)->BaseInteger);
+        restarted.end_work(0u);
+    }
+
+    fs::remove(path);
+}
+
 TEST_F(WorkerServiceTests, ShouldSaveAndRestoreTheWorkerState)
 {
     _service.register_type(&_worker_type, &create_worker_class);
@@ -131,6 +836,16 @@ TEST_F(WorkerServiceTests, ShouldSaveAndRestoreTheWorkerState)
     EXPECT_EQ(123, base_class->BaseInteger);
 }
 
+TEST_F(WorkerServiceTests, SpillIdleWorkersShouldSpillIdleWorkers)
+{
+    ExpectSpilledWorkerIsRestored(0s, 0u);
+}
+
+TEST_F(WorkerServiceTests, SpillIdleWorkersShouldSpillWorkersOverTheBudget)
+{
+    ExpectSpilledWorkerIsRestored(24h, 1u);
+}
+
 TEST_F(WorkerServiceTests, TryLockShouldLockAndReturnTheManagedObjects)
 {
     _service.register_type(&_worker_type, &create_worker_object);
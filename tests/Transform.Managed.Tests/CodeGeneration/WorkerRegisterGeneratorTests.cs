@@ -1,9 +1,13 @@
 ﻿namespace Transform.Managed.Tests.CodeGeneration
 {
     using System.Collections.Generic;
+    using System.Linq;
+    using Autocrat.NativeAdapters;
     using Autocrat.Transform.Managed;
     using Autocrat.Transform.Managed.CodeGeneration;
+    using FluentAssertions;
     using Mono.Cecil;
+    using Mono.Cecil.Cil;
     using NSubstitute;
     using Xunit;
 
@@ -47,6 +51,39 @@
 
                 this.exportedMethods.ReceivedWithAnyArgs(3).RegisterMethod(null, null);
             }
+
+            [Fact]
+            public void ShouldRegisterTheExpiryOfTypesWithATimeToLive()
+            {
+                TypeDefinition testWorker = CodeHelper.CompileType(@"
+[Autocrat.Abstractions.WorkerTimeToLive(60)]
+class WorkerType { }");
+                this.workerTypes.Add(testWorker);
+
+                TypeDefinition workers = this.generator.EmitWorkerClass(testWorker.Module);
+
+                GetCalledMethods(workers).Should().Contain(nameof(WorkerFactory.RegisterExpiry));
+            }
+
+            [Fact]
+            public void ShouldNotRegisterTheExpiryOfOtherTypes()
+            {
+                TypeDefinition testWorker = CodeHelper.CompileType(@"class WorkerType { }");
+                this.workerTypes.Add(testWorker);
+
+                TypeDefinition workers = this.generator.EmitWorkerClass(testWorker.Module);
+
+                GetCalledMethods(workers).Should().NotContain(nameof(WorkerFactory.RegisterExpiry));
+            }
+
+            private static IEnumerable<string> GetCalledMethods(TypeDefinition workers)
+            {
+                return workers.Methods
+                    .Single(m => m.Name == WorkerRegisterGenerator.GeneratedMethodName)
+                    .Body.Instructions
+                    .Where(i => i.OpCode == OpCodes.Call)
+                    .Select(i => ((MethodReference)i.Operand).Name);
+            }
         }
     }
 }
@@ -39,6 +39,51 @@ public class TestClass
                 this.visitor.WorkerTypes.Select(x => x.FullName)
                     .Should().BeEquivalentTo("TestClass/Worker1", "TestClass/Worker2");
             }
+
+            [Fact]
+            public void ShouldExtractReadOnlyTypes()
+            {
+                TypeDefinition testClass = CodeHelper.CompileType(@"
+using System.Threading.Tasks;
+using Autocrat.Abstractions;
+
+public class TestClass
+{
+    public class Worker { }
+
+    public async Task ExampleMethod(IWorkerFactory factory)
+    {
+        await factory.GetWorkerReadOnlyAsync<Worker>(0);
+    }
+}");
+
+                CodeHelper.VisitMethods(this.visitor, testClass);
+
+                this.visitor.WorkerTypes.Select(x => x.FullName)
+                    .Should().ContainSingle().Which.Should().Be("TestClass/Worker");
+            }
+
+            [Fact]
+            public void ShouldExtractPreloadedTypes()
+            {
+                TypeDefinition testClass = CodeHelper.CompileType(@"
+using Autocrat.Abstractions;
+
+public class TestClass
+{
+    public class Worker { }
+
+    public void ExampleMethod(IWorkerFactory factory)
+    {
+        factory.PreloadWorkers<Worker>(new long[] { 1, 2 });
+    }
+}");
+
+                CodeHelper.VisitMethods(this.visitor, testClass);
+
+                this.visitor.WorkerTypes.Select(x => x.FullName)
+                    .Should().ContainSingle().Which.Should().Be("TestClass/Worker");
+            }
         }
     }
 }